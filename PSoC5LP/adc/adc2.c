@@ -0,0 +1,241 @@
+/*! @file
+  @brief
+  ADC convenience library for PSoC5LP. (ADC_SAR and ADC_DelSig)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Continuous sampling:
+  The ADC converts at the rate set in the component (free running),
+  and the DMA moves each result to the ring. The ring is divided into
+  ADC_DMA_NUM_TD chunks, one TD each, and the TDs are linked in a loop.
+  At the end of each TD, the nrq of the DMA raises the interrupt, and
+  adc_dma_isr() counts the samples written.
+  The chunk being written by the DMA is not readable, so the task can
+  be behind at most (ring size - chunk size) samples.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "adc2.h"
+
+/***** Constant values ******************************************************/
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! free the TDs.
+*/
+static void adc_free_td(ADC_HANDLE *ah)
+{
+  int i;
+
+  for( i = 0; i < ADC_DMA_NUM_TD; i++ ) {
+    if( ah->td[i] != CY_DMA_INVALID_TD ) CyDmaTdFree( ah->td[i] );
+    ah->td[i] = CY_DMA_INVALID_TD;
+  }
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+
+  @param  ah		pointer to ADC_HANDLE
+*/
+void adc_init_m(ADC_HANDLE *ah,
+		void *Start,
+		void *StartConvert,
+		void *StopConvert,
+		void *IsEndConversion,
+		void *GetResult16,
+		void *CountsTo_Volts,
+		void *result_reg)
+{
+  int i;
+
+  ah->result_reg = result_reg;
+  ah->flag_running = 0;
+  ah->dma_ch = 0xff;
+  for( i = 0; i < ADC_DMA_NUM_TD; i++ ) {
+    ah->td[i] = CY_DMA_INVALID_TD;
+  }
+  ah->buf = 0;
+  ah->buf_size = 0;
+  ah->chunk = 0;
+  ah->n_written = 0;
+  ah->n_read = 0;
+  ah->overflow = 0;
+  ah->filter = 0;
+
+  ah->Start = Start;
+  ah->StartConvert = StartConvert;
+  ah->StopConvert = StopConvert;
+  ah->IsEndConversion = IsEndConversion;
+  ah->GetResult16 = GetResult16;
+  ah->CountsTo_Volts = CountsTo_Volts;
+
+  ah->Start();
+}
+
+
+//================================================================
+/*! read a sample.
+
+  @param  ah		pointer to ADC_HANDLE
+  @return int		raw value.
+
+  In the continuous sampling, returns the latest result.
+*/
+int adc_read_raw(ADC_HANDLE *ah)
+{
+  if( ah->flag_running ) return ah->GetResult16();
+
+  ah->StartConvert();
+  ah->IsEndConversion( ADC_WAIT_FOR_RESULT );
+  int ret = ah->GetResult16();
+  ah->StopConvert();
+
+  return ret;
+}
+
+
+//================================================================
+/*! start the continuous sampling.
+
+  @param  ah		pointer to ADC_HANDLE
+  @param  DmaInitialize	DmaInitialize function of the DMA component.
+  @param  termout_en	__TD_TERMOUT_EN of the DMA component.
+  @param  buf		ring buffer.
+  @param  n		size of the ring in samples. power of 2.
+  @return int		0 is no error.
+*/
+int adc_start_dma_m(ADC_HANDLE *ah, void *DmaInitialize, int termout_en, int16_t *buf, int n)
+{
+  uint8 (*dma_initialize)(uint8, uint8, uint16, uint16) = DmaInitialize;
+  int i;
+
+  if( ah->flag_running ) return -1;
+  if( n < ADC_DMA_NUM_TD * 2 || n > ADC_DMA_MAX_SAMPLES ) return -1;
+  if( n & (n - 1) ) return -1;
+
+  // a burst is 2 bytes of the result register, a request each.
+  if( ah->dma_ch == 0xff ) {
+    ah->dma_ch = dma_initialize( 2, 1, HI16((uint32)ah->result_reg),
+				 HI16(CYDEV_SRAM_BASE) );
+  }
+
+  ah->buf = buf;
+  ah->buf_size = n;
+  ah->chunk = n / ADC_DMA_NUM_TD;
+  ah->n_written = 0;
+  ah->n_read = 0;
+  ah->overflow = 0;
+
+  for( i = 0; i < ADC_DMA_NUM_TD; i++ ) {
+    ah->td[i] = CyDmaTdAllocate();
+    if( ah->td[i] == CY_DMA_INVALID_TD ) goto ERROR_RETURN;
+  }
+  for( i = 0; i < ADC_DMA_NUM_TD; i++ ) {
+    CyDmaTdSetConfiguration( ah->td[i], ah->chunk * sizeof(int16_t),
+			     ah->td[(i + 1) % ADC_DMA_NUM_TD],
+			     TD_INC_DST_ADR | termout_en );
+    CyDmaTdSetAddress( ah->td[i], LO16((uint32)ah->result_reg),
+		       LO16((uint32)(buf + i * ah->chunk)) );
+  }
+  CyDmaChSetInitialTd( ah->dma_ch, ah->td[0] );
+  CyDmaChEnable( ah->dma_ch, 1 );
+
+  ah->flag_running = 1;
+  ah->StartConvert();
+  return 0;
+
+ ERROR_RETURN:
+  adc_free_td( ah );
+  return -1;
+}
+
+
+//================================================================
+/*! stop the continuous sampling.
+
+  @param  ah		pointer to ADC_HANDLE
+*/
+void adc_stop_dma(ADC_HANDLE *ah)
+{
+  if( !ah->flag_running ) return;
+
+  ah->StopConvert();
+  CyDmaChDisable( ah->dma_ch );
+  adc_free_td( ah );
+  ah->flag_running = 0;
+}
+
+
+//================================================================
+/*! interrupt handler. (nrq of the DMA)
+
+  @param  ah		pointer to ADC_HANDLE
+
+  Runs the filters on the chunk just written.
+*/
+void adc_dma_isr(ADC_HANDLE *ah)
+{
+  if( ah->filter ) {
+    int pos = ah->n_written & (ah->buf_size - 1);
+    adc_filter_run( ah->filter, ah->buf + pos, ah->chunk );
+  }
+  ah->n_written += ah->chunk;
+}
+
+
+//================================================================
+/*! read the samples from the ring.
+
+  @param  ah		pointer to ADC_HANDLE
+  @param  dst		buffer.
+  @param  n		number of samples.
+  @return int		n, or 0 if not enough samples.
+
+  If the task was too late, the oldest samples are skipped and
+  counted in the overflow.
+*/
+int adc_read_block(ADC_HANDLE *ah, int16_t *dst, int n)
+{
+  uint32_t avail = ah->n_written - ah->n_read;
+  uint32_t limit = ah->buf_size - ah->chunk;
+
+  if( avail > limit ) {
+    ah->overflow += avail - limit;
+    ah->n_read += avail - limit;
+    avail = limit;
+  }
+  if( n <= 0 || avail < (uint32_t)n ) return 0;
+
+  int pos = ah->n_read & (ah->buf_size - 1);
+  int len = ah->buf_size - pos;
+  if( len > n ) len = n;
+
+  memcpy( dst, ah->buf + pos, len * sizeof(int16_t) );
+  memcpy( dst + len, ah->buf, (n - len) * sizeof(int16_t) );
+  ah->n_read += n;
+
+  return n;
+}
@@ -0,0 +1,152 @@
+/*! @file
+  @brief
+  ADC convenience library for PSoC5LP. (ADC_SAR and ADC_DelSig)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_ADCWRAP2_H_
+#define PSOC5_ADCWRAP2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+#include "adc_filter.h"
+
+
+/***** Constant values ******************************************************/
+//! IsEndConversion() mode. same value in ADC_SAR and ADC_DelSig.
+#define ADC_WAIT_FOR_RESULT 1
+
+//! number of DMA transfer descriptors in the ring.
+#ifndef ADC_DMA_NUM_TD
+# define ADC_DMA_NUM_TD 4
+#endif
+
+//! maximum samples in the ring. (a TD transfers 4095 bytes at most)
+#define ADC_DMA_MAX_SAMPLES (ADC_DMA_NUM_TD * 1024)
+
+
+/***** Macros ***************************************************************/
+//! Initializer macro for ADC_SAR
+#define adc_init_sar(ah, NAME)			\
+  adc_init_m( ah,				\
+	      NAME ## _Start,			\
+	      NAME ## _StartConvert,		\
+	      NAME ## _StopConvert,		\
+	      NAME ## _IsEndConversion,		\
+	      NAME ## _GetResult16,		\
+	      NAME ## _CountsTo_Volts,		\
+	      (void *)NAME ## _SAR_WRK0_PTR)
+
+//! Initializer macro for ADC_DelSig
+#define adc_init_delsig(ah, NAME)		\
+  adc_init_m( ah,				\
+	      NAME ## _Start,			\
+	      NAME ## _StartConvert,		\
+	      NAME ## _StopConvert,		\
+	      NAME ## _IsEndConversion,		\
+	      NAME ## _GetResult16,		\
+	      NAME ## _CountsTo_Volts,		\
+	      (void *)NAME ## _DEC_SAMP_PTR)
+
+//! start the continuous sampling with the DMA component.
+#define adc_start_dma(ah, DMA, buf, n)		\
+  adc_start_dma_m( ah,				\
+		   DMA ## _DmaInitialize,	\
+		   DMA ## __TD_TERMOUT_EN,	\
+		   buf, n )
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! ADC handle.
+*/
+typedef struct ADC_HANDLE {
+  volatile uint8_t *result_reg;	// DMA source.
+
+  // continuous sampling.
+  uint8_t flag_running;
+  uint8_t dma_ch;		// 0xff if not initialized.
+  uint8_t td[ADC_DMA_NUM_TD];
+  int16_t *buf;			// ring of the samples.
+  uint16_t buf_size;		// in samples. power of 2.
+  uint16_t chunk;		// samples in a TD.
+  volatile uint32_t n_written;	// counted by adc_dma_isr().
+  uint32_t n_read;
+  uint32_t overflow;		// samples lost.
+  ADC_FILTER * volatile filter;	// run on each chunk in the ISR, or NULL.
+
+  // function table
+  void (*Start)(void);
+  void (*StartConvert)(void);
+  void (*StopConvert)(void);
+  uint8_t (*IsEndConversion)(uint8_t);
+  int16_t (*GetResult16)(void);
+  float (*CountsTo_Volts)(int16_t);
+
+} ADC_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void adc_init_m(ADC_HANDLE *ah,
+		void *Start,
+		void *StartConvert,
+		void *StopConvert,
+		void *IsEndConversion,
+		void *GetResult16,
+		void *CountsTo_Volts,
+		void *result_reg);
+int adc_read_raw(ADC_HANDLE *ah);
+int adc_start_dma_m(ADC_HANDLE *ah, void *DmaInitialize, int termout_en, int16_t *buf, int n);
+void adc_stop_dma(ADC_HANDLE *ah);
+void adc_dma_isr(ADC_HANDLE *ah);
+int adc_read_block(ADC_HANDLE *ah, int16_t *dst, int n);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! convert the raw value to volts.
+
+  @param  ah		pointer to ADC_HANDLE
+  @param  raw		raw value.
+  @return float		volts.
+*/
+static inline float adc_to_volts(ADC_HANDLE *ah, int raw)
+{
+  return ah->CountsTo_Volts( raw );
+}
+
+
+//================================================================
+/*! number of samples available in the ring.
+
+  @param  ah		pointer to ADC_HANDLE
+  @return int		samples. (limited by the ring)
+*/
+static inline int adc_available(ADC_HANDLE *ah)
+{
+  uint32_t n = ah->n_written - ah->n_read;
+  uint32_t limit = ah->buf_size - ah->chunk;
+
+  return n > limit ? limit : n;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,277 @@
+/*! @file
+  @brief
+  Reduction filters for the ADC samples.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The filters run incrementally on each block of samples,
+  in the DMA interrupt of the continuous sampling.
+  All in integer. Division is done once per output, not per sample.
+  This file doesn't depend on the PSoC, so it can be tested on a PC.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+
+/***** Local headers ********************************************************/
+#include "adc_filter.h"
+
+/***** Constant values ******************************************************/
+#define ADC_FILTER_QUEUE_MASK (ADC_FILTER_QUEUE_SIZE - 1)
+
+#if (ADC_FILTER_QUEUE_SIZE & ADC_FILTER_QUEUE_MASK) != 0 || ADC_FILTER_QUEUE_SIZE > 128
+#error "ADC_FILTER_QUEUE_SIZE must be power of 2, and 128 or less."
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! integer square root.
+*/
+static uint32_t adc_isqrt(uint64_t n)
+{
+  uint64_t bit = (uint64_t)1 << 62;
+  uint64_t ret = 0;
+
+  while( bit > n ) bit >>= 2;
+  while( bit ) {
+    if( n >= ret + bit ) {
+      n -= ret + bit;
+      ret = (ret >> 1) + bit;
+    } else {
+      ret >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)ret;
+}
+
+
+//================================================================
+/*! division rounded to nearest. (d > 0)
+*/
+static inline int64_t adc_div_round(int64_t n, int32_t d)
+{
+  return (n >= 0) ? (n + d / 2) / d : -((-n + d / 2) / d);
+}
+
+
+//================================================================
+/*! smoothing stage.
+*/
+static int32_t adc_filter_smooth(ADC_FILTER *f, int32_t x)
+{
+  switch( f->smooth ) {
+  case ADC_FILTER_SMOOTH_BOXCAR:
+    if( f->box_count == f->smooth_param ) {
+      f->box_sum -= f->box[f->box_pos];
+    } else {
+      f->box_count++;
+    }
+    f->box[f->box_pos] = x;
+    f->box_sum += x;
+    if( ++f->box_pos >= f->smooth_param ) f->box_pos = 0;
+    return adc_div_round( f->box_sum, f->box_count );
+
+  case ADC_FILTER_SMOOTH_EMA:
+    if( f->n_values == 0 ) {
+      f->ema = x * (1 << f->smooth_param);
+    } else {
+      f->ema += x - (f->ema >> f->smooth_param);
+    }
+    return f->ema >> f->smooth_param;
+
+  default:
+    return x;
+  }
+}
+
+
+//================================================================
+/*! a value to the window statistics and the threshold.
+*/
+static void adc_filter_value(ADC_FILTER *f, int32_t y)
+{
+  // threshold crossing.
+  if( f->flag_threshold ) {
+    if( y >= f->th_level + f->th_hysteresis ) {
+      if( f->th_state < 0 ) f->n_rise++;
+      f->th_state = 1;
+    } else if( y <= f->th_level - f->th_hysteresis ) {
+      if( f->th_state > 0 ) f->n_fall++;
+      f->th_state = -1;
+    }
+  }
+
+  f->value = y;
+  f->n_values++;
+  if( f->window == 0 ) return;
+
+  // window statistics.
+  if( f->win_count == 0 || y < f->win_min ) f->win_min = y;
+  if( f->win_count == 0 || y > f->win_max ) f->win_max = y;
+  f->win_sum += y;
+  f->win_sumsq += (int64_t)y * y;
+  if( ++f->win_count < f->window ) return;
+
+  uint8_t wr = f->wr;
+  if( (uint8_t)(wr - f->rd) >= ADC_FILTER_QUEUE_SIZE ) {
+    f->overflow++;
+  } else {
+    ADC_FILTER_RESULT *r = &f->queue[wr & ADC_FILTER_QUEUE_MASK];
+    r->mean = adc_div_round( f->win_sum, f->window );
+    r->min = f->win_min;
+    r->max = f->win_max;
+    r->rms = adc_isqrt( (uint64_t)f->win_sumsq / f->window );
+    r->n_rise = f->n_rise;
+    r->n_fall = f->n_fall;
+    f->wr = wr + 1;
+  }
+
+  f->win_count = 0;
+  f->win_sum = 0;
+  f->win_sumsq = 0;
+  f->n_rise = 0;
+  f->n_fall = 0;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize the filter chain.
+
+  @param  f		pointer to ADC_FILTER
+  @param  decimate	average of N samples. (1 to 4096)
+  @param  extra_bits	the result is scaled by 2^extra_bits. (0 to 4)
+  @param  window	values in a window of the statistics. 0 is none.
+  @return int		0 is no error.
+*/
+int adc_filter_init(ADC_FILTER *f, int decimate, int extra_bits, int window)
+{
+  if( decimate < 1 || decimate > 4096 ) return -1;
+  if( extra_bits < 0 || extra_bits > 4 ) return -1;
+  if( window < 0 || window > 0xffff ) return -1;
+
+  memset( f, 0, sizeof(ADC_FILTER) );
+  f->decimate = decimate;
+  f->extra_bits = extra_bits;
+  f->window = window;
+
+  return 0;
+}
+
+
+//================================================================
+/*! set the smoothing stage.
+
+  @param  f		pointer to ADC_FILTER
+  @param  smooth	ADC_FILTER_SMOOTH_*
+  @param  param		boxcar: length (1 to ADC_FILTER_MAX_BOXCAR)
+			EMA: alpha = 1/2^param (1 to 8)
+  @return int		0 is no error.
+*/
+int adc_filter_set_smooth(ADC_FILTER *f, int smooth, int param)
+{
+  switch( smooth ) {
+  case ADC_FILTER_SMOOTH_NONE:
+    break;
+  case ADC_FILTER_SMOOTH_BOXCAR:
+    if( param < 1 || param > ADC_FILTER_MAX_BOXCAR ) return -1;
+    break;
+  case ADC_FILTER_SMOOTH_EMA:
+    if( param < 1 || param > 8 ) return -1;
+    break;
+  default:
+    return -1;
+  }
+
+  f->smooth = smooth;
+  f->smooth_param = param;
+  f->box_pos = 0;
+  f->box_count = 0;
+  f->box_sum = 0;
+  if( smooth == ADC_FILTER_SMOOTH_EMA ) f->ema = f->value * (1 << param);
+
+  return 0;
+}
+
+
+//================================================================
+/*! set the threshold crossing detection.
+
+  @param  f		pointer to ADC_FILTER
+  @param  flag_enable	enable or disable.
+  @param  level		threshold level.
+  @param  hysteresis	the value must go beyond level +/- hysteresis.
+*/
+void adc_filter_set_threshold(ADC_FILTER *f, int flag_enable, int32_t level, int32_t hysteresis)
+{
+  f->flag_threshold = 0;
+  f->th_state = 0;
+  f->th_level = level;
+  f->th_hysteresis = hysteresis < 0 ? -hysteresis : hysteresis;
+  f->n_rise = 0;
+  f->n_fall = 0;
+  f->flag_threshold = flag_enable;
+}
+
+
+//================================================================
+/*! run the filters on the samples.
+
+  @param  f		pointer to ADC_FILTER
+  @param  samples	samples.
+  @param  n		number of samples.
+*/
+void adc_filter_run(ADC_FILTER *f, const int16_t *samples, int n)
+{
+  int i;
+
+  for( i = 0; i < n; i++ ) {
+    f->dec_acc += samples[i];
+    if( ++f->dec_count < f->decimate ) continue;
+
+    int32_t x = adc_div_round( (int64_t)f->dec_acc * (1 << f->extra_bits),
+			       f->decimate );
+    f->dec_acc = 0;
+    f->dec_count = 0;
+
+    adc_filter_value( f, adc_filter_smooth( f, x ) );
+  }
+}
+
+
+//================================================================
+/*! take a result from the queue.
+
+  @param  f		pointer to ADC_FILTER
+  @param  result	pointer to ADC_FILTER_RESULT to store.
+  @return int		1 if taken, 0 if empty.
+*/
+int adc_filter_take(ADC_FILTER *f, ADC_FILTER_RESULT *result)
+{
+  uint8_t rd = f->rd;
+
+  if( rd == f->wr ) return 0;
+  *result = f->queue[rd & ADC_FILTER_QUEUE_MASK];
+  f->rd = rd + 1;
+
+  return 1;
+}
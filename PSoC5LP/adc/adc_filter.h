@@ -0,0 +1,133 @@
+/*! @file
+  @brief
+  Reduction filters for the ADC samples.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_ADC_FILTER_H_
+#define PSOC5_ADC_FILTER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! maximum length of the boxcar average.
+#ifndef ADC_FILTER_MAX_BOXCAR
+# define ADC_FILTER_MAX_BOXCAR 32
+#endif
+
+//! number of results in the queue. must be power of 2.
+#ifndef ADC_FILTER_QUEUE_SIZE
+# define ADC_FILTER_QUEUE_SIZE 8
+#endif
+
+//! smoothing stage.
+#define ADC_FILTER_SMOOTH_NONE		0
+#define ADC_FILTER_SMOOTH_BOXCAR	1
+#define ADC_FILTER_SMOOTH_EMA		2
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! statistics of a window.
+*/
+typedef struct ADC_FILTER_RESULT {
+  int32_t mean;
+  int32_t min;
+  int32_t max;
+  int32_t rms;
+  uint16_t n_rise;		// threshold crossings in the window.
+  uint16_t n_fall;
+
+} ADC_FILTER_RESULT;
+
+
+//================================================================
+/*! filter chain.
+
+  sample -> decimation -> smoothing -> value -> window statistics
+                                             -> threshold crossing
+*/
+typedef struct ADC_FILTER {
+  // decimation. average of N samples, with extra bits.
+  uint16_t decimate;
+  uint8_t extra_bits;
+  uint16_t dec_count;
+  int32_t dec_acc;
+
+  // smoothing.
+  uint8_t smooth;		// ADC_FILTER_SMOOTH_*
+  uint8_t smooth_param;		// boxcar length, or EMA shift.
+  uint8_t box_pos;
+  uint8_t box_count;
+  int32_t box_sum;
+  int32_t box[ADC_FILTER_MAX_BOXCAR];
+  int32_t ema;			// scaled by 2^shift.
+
+  // window statistics.
+  uint16_t window;
+  uint16_t win_count;
+  int32_t win_min;
+  int32_t win_max;
+  int64_t win_sum;
+  int64_t win_sumsq;
+
+  // threshold crossing, with the hysteresis.
+  uint8_t flag_threshold;
+  int8_t th_state;		// 1: above, -1: below, 0: unknown.
+  int32_t th_level;
+  int32_t th_hysteresis;
+  uint16_t n_rise;
+  uint16_t n_fall;
+
+  // output.
+  volatile int32_t value;	// the latest value.
+  volatile uint32_t n_values;	// number of values.
+  ADC_FILTER_RESULT queue[ADC_FILTER_QUEUE_SIZE];
+  volatile uint8_t rd;		// written by the task only.
+  volatile uint8_t wr;		// written by the filter only.
+  volatile uint16_t overflow;	// dropped results.
+
+} ADC_FILTER;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int adc_filter_init(ADC_FILTER *f, int decimate, int extra_bits, int window);
+int adc_filter_set_smooth(ADC_FILTER *f, int smooth, int param);
+void adc_filter_set_threshold(ADC_FILTER *f, int flag_enable, int32_t level, int32_t hysteresis);
+void adc_filter_run(ADC_FILTER *f, const int16_t *samples, int n);
+int adc_filter_take(ADC_FILTER *f, ADC_FILTER_RESULT *result);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! number of results in the queue.
+
+  @param  f		pointer to ADC_FILTER
+  @return int		number of results.
+*/
+static inline int adc_filter_available(ADC_FILTER *f)
+{
+  return (uint8_t)(f->wr - f->rd);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
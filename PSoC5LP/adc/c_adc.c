@@ -0,0 +1,503 @@
+/*! @file
+  @brief
+  ADC class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Analog > ADC > SAR ADC" or
+        "Delta Sigma ADC" device.
+   2. Make sure the name is "ADC_1".
+   3. Set the resolution, the input range and the sample rate.
+      (SAR: Sample mode Free Running.  DelSig: Conversion mode Continuous)
+
+  For the continuous sampling.
+   4. Place "System > DMA" device, and change the name to "DMA_ADC".
+   5. Connect eoc of the ADC to drq of the DMA.
+   6. Place "System > Interrupt" device, and change the name to
+      "isr_ADC_DMA". Connect it to nrq of the DMA.
+
+
+  C program (main.c)
+
+    #include "c_adc.h"
+    mrbc_init_class_adc(0);
+
+
+  mruby program
+
+    adc = ADC.new()
+    v = adc.read()		# => volts (Float)
+    v = adc.rawread()		# => raw value (Integer)
+
+    # continuous sampling. (ring size in samples)
+    adc.start( 1024 )
+    s = adc.read_block( 256 )		# => String. (int16 little endian)
+    a = adc.read_block( 256, :array )	# => [Integer, ...]
+    adc.stop()
+
+    # filters on the continuous sampling.
+    adc.filter( 16, 100 )		# average of 16, statistics of 100.
+    adc.smooth( :ema, 3 )		# or :boxcar, :none
+    adc.threshold( 2048, 50 )
+    v = adc.value()			# => the latest value.
+    r = adc.results()	# => [[mean, min, max, rms, rises, falls], ...]
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "adc2.h"
+
+
+static ADC_HANDLE adch;
+static ADC_FILTER adc_filter;
+
+#if defined(isr_ADC_DMA__INTC_NUMBER)
+//================================================================
+/*! interrupt handler. (nrq of the DMA)
+*/
+static CY_ISR(adc_dma_isr_handler)
+{
+  adc_dma_isr( &adch );
+}
+#endif
+
+
+
+//================================================================
+/*! constructor
+
+  $adc = ADC.new()
+*/
+static void c_adc_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc >= 1 && !(mrbc_type(v[1]) == MRBC_TT_FIXNUM &&
+		     mrbc_fixnum(v[1]) == 1) ) {
+    console_printf("ADC: Illegal channel number specified.\n");
+    goto ERROR_RETURN;
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(ADC_HANDLE *));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  *((ADC_HANDLE **)ret.instance->data) = &adch;
+  SET_RETURN( ret );
+  return;
+
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! read a sample in volts
+
+  v = $adc.read()	# => Float
+
+  Not defined, if MRBC_USE_FLOAT is 0.
+*/
+#if MRBC_USE_FLOAT
+static void c_adc_read(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  SET_FLOAT_RETURN( adc_to_volts( ah, adc_read_raw( ah ) ) );
+}
+#endif
+
+
+//================================================================
+/*! read a sample
+
+  v = $adc.rawread()	# => Integer
+*/
+static void c_adc_rawread(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  SET_INT_RETURN( adc_read_raw( ah ) );
+}
+
+
+//================================================================
+/*! start the continuous sampling
+
+  $adc.start( n )	# n: ring size in samples. power of 2. (default 1024)
+
+  The ring is allocated from the mruby/c heap.
+*/
+static void c_adc_start(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+#if defined(DMA_ADC__DRQ_NUMBER) && defined(isr_ADC_DMA__INTC_NUMBER)
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  int n = 1024;
+
+  if( argc >= 1 ) {
+    if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    n = mrbc_fixnum(v[1]);
+  }
+  if( ah->flag_running ) goto ERROR_PARAM;
+  if( n < ADC_DMA_NUM_TD * 2 || n > ADC_DMA_MAX_SAMPLES ) goto ERROR_PARAM;
+
+  int16_t *buf = mrbc_raw_alloc( n * sizeof(int16_t) );
+  if( !buf ) goto ERROR_RETURN;		// ENOMEM
+
+  if( adc_start_dma( ah, DMA_ADC, buf, n ) != 0 ) {
+    mrbc_raw_free( buf );
+    goto ERROR_PARAM;
+  }
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("ADC: parameter error.\n");
+ ERROR_RETURN:
+  SET_FALSE_RETURN();
+
+#else
+  console_printf("ADC: DMA_ADC and isr_ADC_DMA are not placed.\n");
+  SET_FALSE_RETURN();
+#endif
+}
+
+
+//================================================================
+/*! stop the continuous sampling
+
+  $adc.stop()
+*/
+static void c_adc_stop(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+
+  if( ah->flag_running ) {
+    adc_stop_dma( ah );
+    mrbc_raw_free( ah->buf );
+    ah->buf = 0;
+  }
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! number of samples available
+
+  $adc.available()
+*/
+static void c_adc_available(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  SET_INT_RETURN( ah->flag_running ? adc_available( ah ) : 0 );
+}
+
+
+//================================================================
+/*! read the samples from the ring
+
+  s = $adc.read_block( n )		# => String. (int16 little endian)
+  a = $adc.read_block( n, :array )	# => [Integer, ...]
+
+  @return Nil		Not enough samples.
+*/
+static void c_adc_read_block(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  int flag_array = 0;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+    if( strcmp( symid_to_str(v[2].i), "array" ) != 0 ) goto ERROR_PARAM;
+    flag_array = 1;
+  }
+
+  int n = mrbc_fixnum(v[1]);
+  if( !ah->flag_running || n <= 0 || adc_available( ah ) < n ) goto RETURN_NIL;
+
+  int16_t *buf = mrbc_alloc( vm, n * sizeof(int16_t) + 1 );
+  if( !buf ) goto RETURN_NIL;		// ENOMEM
+  adc_read_block( ah, buf, n );
+
+  if( !flag_array ) {
+    // the buffer is passed to the String.
+    ((uint8_t *)buf)[n * sizeof(int16_t)] = 0;
+    mrbc_value ret = mrbc_string_new_alloc( vm, buf, n * sizeof(int16_t) );
+    SET_RETURN( ret );
+    return;
+  }
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) == MRBC_TT_ARRAY ) {
+    int i;
+    for( i = 0; i < n; i++ ) {
+      mrbc_value val = mrbc_fixnum_value( buf[i] );
+      mrbc_array_set( &ret, i, &val );
+    }
+  }
+  mrbc_free( vm, buf );
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("ADC: parameter error.\n");
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! number of samples lost
+
+  $adc.overflow()
+*/
+static void c_adc_overflow(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  SET_INT_RETURN( ah->overflow );
+}
+
+
+//================================================================
+/*! set the filters on the continuous sampling
+
+  $adc.filter( decimate, window = 0, extra_bits = 0 )
+  $adc.filter( nil )		# disable.
+
+  decimate:	average of N samples. (1 to 4096)
+  window:	values in a window of the statistics. 0 is none.
+  extra_bits:	the value is scaled by 2^extra_bits. (0 to 4)
+*/
+static void c_adc_filter(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  int param[3] = { 1, 0, 0 };
+  int i;
+
+  if( argc >= 1 && mrbc_type(v[1]) == MRBC_TT_NIL ) {
+    ah->filter = 0;
+    SET_TRUE_RETURN();
+    return;
+  }
+  if( argc < 1 || argc > 3 ) goto ERROR_PARAM;
+  for( i = 0; i < argc; i++ ) {
+    if( mrbc_type(v[i+1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    param[i] = mrbc_fixnum(v[i+1]);
+  }
+
+  // stop the filter while initializing.
+  ah->filter = 0;
+  if( adc_filter_init( &adc_filter, param[0], param[2], param[1] ) != 0 ) {
+    goto ERROR_PARAM;
+  }
+  ah->filter = &adc_filter;
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("ADC: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! set the smoothing stage of the filter
+
+  $adc.smooth( :boxcar, n )	# moving average of n values. (1 to 32)
+  $adc.smooth( :ema, shift )	# exponential, alpha = 1/2^shift. (1 to 8)
+  $adc.smooth( :none )
+*/
+static void c_adc_smooth(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  int smooth;
+  int param = 0;
+
+  if( !ah->filter ) goto ERROR_PARAM;
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+
+  const char *name = symid_to_str(v[1].i);
+  if( strcmp( name, "none" ) == 0 ) {
+    smooth = ADC_FILTER_SMOOTH_NONE;
+  } else if( strcmp( name, "boxcar" ) == 0 ) {
+    smooth = ADC_FILTER_SMOOTH_BOXCAR;
+  } else if( strcmp( name, "ema" ) == 0 ) {
+    smooth = ADC_FILTER_SMOOTH_EMA;
+  } else {
+    goto ERROR_PARAM;
+  }
+  if( smooth != ADC_FILTER_SMOOTH_NONE ) {
+    if( argc < 2 || mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    param = mrbc_fixnum(v[2]);
+  }
+
+  uint8 interrupts = CyEnterCriticalSection();
+  int ret = adc_filter_set_smooth( ah->filter, smooth, param );
+  CyExitCriticalSection( interrupts );
+  if( ret != 0 ) goto ERROR_PARAM;
+
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("ADC: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! set the threshold crossing detection of the filter
+
+  $adc.threshold( level, hysteresis = 0 )
+  $adc.threshold( nil )		# disable.
+
+  The crossings are counted in the window statistics.
+*/
+static void c_adc_threshold(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  int flag_enable = 1;
+  int level = 0;
+  int hysteresis = 0;
+
+  if( !ah->filter || argc < 1 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) == MRBC_TT_NIL ) {
+    flag_enable = 0;
+  } else {
+    if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    level = mrbc_fixnum(v[1]);
+    if( argc >= 2 ) {
+      if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+      hysteresis = mrbc_fixnum(v[2]);
+    }
+  }
+
+  uint8 interrupts = CyEnterCriticalSection();
+  adc_filter_set_threshold( ah->filter, flag_enable, level, hysteresis );
+  CyExitCriticalSection( interrupts );
+
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("ADC: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! the latest value of the filter
+
+  v = $adc.value()	# => Integer
+
+  @return Nil		No value yet.
+*/
+static void c_adc_value(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  ADC_FILTER *f = ah->filter;
+
+  if( !f || f->n_values == 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_INT_RETURN( f->value );
+}
+
+
+//================================================================
+/*! take the window statistics of the filter
+
+  a = $adc.results()	# => [[mean, min, max, rms, rises, falls], ...]
+
+  An empty Array if no window is completed.
+  The windows not taken in time are counted in $adc.filter_overflow().
+*/
+static void c_adc_results(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  ADC_FILTER *f = ah->filter;
+  int n = f ? adc_filter_available( f ) : 0;
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN;
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    ADC_FILTER_RESULT r;
+    if( !adc_filter_take( f, &r ) ) break;
+
+    mrbc_value a = mrbc_array_new( vm, 6 );
+    if( mrbc_type(a) != MRBC_TT_ARRAY ) break;
+    int32_t val[6] = { r.mean, r.min, r.max, r.rms, r.n_rise, r.n_fall };
+    int j;
+    for( j = 0; j < 6; j++ ) {
+      mrbc_value e = mrbc_fixnum_value( val[j] );
+      mrbc_array_set( &a, j, &e );
+    }
+    mrbc_array_set( &ret, i, &a );
+  }
+
+ RETURN:
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! number of the window statistics lost
+
+  $adc.filter_overflow()
+*/
+static void c_adc_filter_overflow(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  ADC_HANDLE *ah = *(ADC_HANDLE **)v->instance->data;
+  SET_INT_RETURN( ah->filter ? ah->filter->overflow : 0 );
+}
+
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_adc(struct VM *vm)
+{
+  // start physical device
+#if defined(ADC_1_SAR_WRK0_PTR)
+  adc_init_sar( &adch, ADC_1 );
+#else
+  adc_init_delsig( &adch, ADC_1 );
+#endif
+#if defined(isr_ADC_DMA__INTC_NUMBER)
+  isr_ADC_DMA_StartEx( adc_dma_isr_handler );
+#endif
+
+  // define class and methods.
+  mrbc_class *adc;
+  adc = mrbc_define_class(0, "ADC",		mrbc_class_object);
+  mrbc_define_method(0, adc, "new",		c_adc_new);
+#if MRBC_USE_FLOAT
+  mrbc_define_method(0, adc, "read",		c_adc_read);
+#endif
+  mrbc_define_method(0, adc, "rawread",		c_adc_rawread);
+  mrbc_define_method(0, adc, "raw_read",	c_adc_rawread);
+  mrbc_define_method(0, adc, "start",		c_adc_start);
+  mrbc_define_method(0, adc, "stop",		c_adc_stop);
+  mrbc_define_method(0, adc, "available",	c_adc_available);
+  mrbc_define_method(0, adc, "read_block",	c_adc_read_block);
+  mrbc_define_method(0, adc, "overflow",	c_adc_overflow);
+  mrbc_define_method(0, adc, "filter",		c_adc_filter);
+  mrbc_define_method(0, adc, "smooth",		c_adc_smooth);
+  mrbc_define_method(0, adc, "threshold",	c_adc_threshold);
+  mrbc_define_method(0, adc, "value",		c_adc_value);
+  mrbc_define_method(0, adc, "results",		c_adc_results);
+  mrbc_define_method(0, adc, "filter_overflow",	c_adc_filter_overflow);
+}
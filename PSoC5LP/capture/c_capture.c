@@ -0,0 +1,413 @@
+/*! @file
+  @brief
+  Capture class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Digital > Functions > Timer" device.
+   2. Make sure the name is "Timer_Capture".
+      Resolution 32-bit, Period 4294967295 (maximum),
+      Capture mode "Rising Edge" or "Either Edge",
+      Interrupt "On Capture".
+   3. Connect BUS_CLK (or a clock of CAPTURE_CLOCK_HZ) to clock of the Timer.
+   4. Place "Digital Input Pin" device, and change the name to "Pin_Capture".
+      Connect it to capture of the Timer.
+   5. Place "System > Interrupt" device, and change the name to
+      "isr_Capture". Connect it to interrupt of the Timer.
+
+  For the prescale, check "Enable Capture Counter" of the Timer,
+  and define CAPTURE_ENABLE_PRESCALE=1.
+
+
+  C program (main.c)
+
+    #include "c_capture.h"
+    mrbc_init_class_capture(0);
+
+    To detect no signal, call mrbc_capture_tick() every 1ms.
+    (e.g. in the same timer ISR as mrbc_tick)
+
+
+  mruby program
+
+    cap = Capture.new()		# gate time 100ms.
+    cap.gate_ms = 10
+    cap.start()
+    f = cap.frequency()		# => Hz (Float. Integer if MRBC_USE_FLOAT is 0)
+    t = cap.period_us()		# => micro seconds (Float)
+    w = cap.pulse_width()	# => micro seconds (Float)  "Either Edge" only
+    d = cap.duty()		# => 0 to 1024 (Integer)   "Either Edge" only
+    a = cap.timestamps()	# => [ticks, ...]
+    cap.stop()
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "capture2.h"
+
+
+#ifndef CAPTURE_ENABLE_PRESCALE
+# define CAPTURE_ENABLE_PRESCALE 0
+#endif
+
+//! timestamps are given to the program in 31 bits.
+#define CAPTURE_TIMESTAMP_MASK 0x7fffffff
+
+
+static CAPTURE_HANDLE caph;
+
+//================================================================
+/*! interrupt handler. (capture of the timer)
+*/
+static CY_ISR(capture_isr_handler)
+{
+  capture_isr( &caph );
+}
+
+
+//================================================================
+/*! return the measured value.
+
+  Rounded to Integer, if MRBC_USE_FLOAT is 0.
+*/
+static void capture_set_return(mrbc_value v[], double val)
+{
+#if MRBC_USE_FLOAT
+  SET_FLOAT_RETURN( val );
+#else
+  SET_INT_RETURN( (int32_t)(val + 0.5) );
+#endif
+}
+
+
+//================================================================
+/*! get the gate time argument.
+
+  @return	gate time in ms, or -1 if error.
+*/
+static int capture_get_gate_ms(CAPTURE_HANDLE *ch, const mrbc_value *v)
+{
+  if( mrbc_type(*v) != MRBC_TT_FIXNUM ) return -1;
+
+  // half of the timer range. (check before the conversion to us)
+  int ms = mrbc_fixnum(*v);
+  if( ms < 0 ) return -1;
+  if( (uint64_t)ms * ch->clock_hz / 1000 > ch->mask / 2 ) return -1;
+
+  return ms;
+}
+
+
+
+//================================================================
+/*! constructor
+
+  $cap = Capture.new( gate_ms = 100 )
+*/
+static void c_capture_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc >= 1 ) {
+    int ms = capture_get_gate_ms( &caph, &v[1] );
+    if( ms < 0 ) goto ERROR_PARAM;
+    capture_set_gate_us( &caph, ms * 1000 );
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(CAPTURE_HANDLE *));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  *((CAPTURE_HANDLE **)ret.instance->data) = &caph;
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("Capture: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! set the gate time
+
+  $cap.gate_ms = n	# 0 is every period.
+
+  Up to the half of the timer range. (89478ms with 32bit and 24MHz)
+*/
+static void c_capture_set_gate_ms(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+
+  int ms = (argc < 1) ? -1 : capture_get_gate_ms( ch, &v[1] );
+  if( ms < 0 ) {
+    console_printf("Capture: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+  capture_set_gate_us( ch, ms * 1000 );
+}
+
+
+//================================================================
+/*! set the prescale
+
+  $cap.prescale = n	# edges in a capture. (1 to 127) "Rising Edge" only.
+*/
+static void c_capture_set_prescale(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  int n = mrbc_fixnum(v[1]);
+
+#if CAPTURE_ENABLE_PRESCALE
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  if( capture_set_prescale( ch, n ) != 0 ) goto ERROR_PARAM;
+  Timer_Capture_SetCaptureCount( n );
+  return;
+#else
+  if( n == 1 ) return;
+#endif
+
+ ERROR_PARAM:
+  console_printf("Capture: parameter error.\n");
+}
+
+
+//================================================================
+/*! start the capture
+
+  $cap.start()
+*/
+static void c_capture_start(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+
+  capture_start( ch );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! stop the capture
+
+  $cap.stop()
+*/
+static void c_capture_stop(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+
+  capture_stop( ch );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! frequency
+
+  f = $cap.frequency()	# => Float (Hz)
+
+  0.0 if no signal.
+*/
+static void c_capture_frequency(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  CAPTURE_RESULT r;
+
+  if( !capture_get_result( ch, &r ) ) {
+    capture_set_return( v, 0 );
+    return;
+  }
+  capture_set_return( v, (double)r.n_periods * ch->clock_hz / r.span );
+}
+
+
+//================================================================
+/*! period
+
+  t = $cap.period_us()	# => Float (micro seconds)
+
+  @return Nil		No signal.
+*/
+static void c_capture_period_us(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  CAPTURE_RESULT r;
+
+  if( !capture_get_result( ch, &r ) ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  capture_set_return( v, (double)r.span * 1000000 / ch->clock_hz / r.n_periods );
+}
+
+
+//================================================================
+/*! pulse width (high time)
+
+  w = $cap.pulse_width()	# => Float (micro seconds)
+
+  @return Nil		No signal, or not "Either Edge" capture mode.
+*/
+static void c_capture_pulse_width(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  CAPTURE_RESULT r;
+
+  if( !capture_get_result( ch, &r ) || !ch->flag_both_edges ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  capture_set_return( v, (double)r.sum_high * 1000000 / ch->clock_hz / r.n_periods );
+}
+
+
+//================================================================
+/*! duty
+
+  d = $cap.duty()	# => Integer. 0 to 1024. (same as PWM#duty)
+
+  @return Nil		No signal, or not "Either Edge" capture mode.
+*/
+static void c_capture_duty(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  CAPTURE_RESULT r;
+
+  if( !capture_get_result( ch, &r ) || !ch->flag_both_edges ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_INT_RETURN( ((uint64_t)r.sum_high * 1024 + r.span / 2) / r.span );
+}
+
+
+//================================================================
+/*! take the timestamps of the edges
+
+  a = $cap.timestamps( max = nil )	# => [ticks, ...]
+  a = $cap.timestamps( max, :level )	# => [[ticks, level], ...]
+
+  ticks are 31 bits, so the interval is (b - a) & 0x7fffffff.
+  level is 1 for the rising edge, 0 for the falling edge.
+*/
+static void c_capture_timestamps(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  int n = CAPTURE_RING_SIZE;
+  int flag_level = 0;
+
+  if( argc >= 1 && mrbc_type(v[1]) != MRBC_TT_NIL ) {
+    if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    n = mrbc_fixnum(v[1]);
+    if( n < 0 ) goto ERROR_PARAM;
+    if( n > CAPTURE_RING_SIZE ) n = CAPTURE_RING_SIZE;
+  }
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+    if( strcmp( symid_to_str(v[2].i), "level" ) != 0 ) goto ERROR_PARAM;
+    flag_level = 1;
+  }
+
+  CAPTURE_EDGE edges[CAPTURE_RING_SIZE];
+  n = capture_read_edges( ch, edges, n );
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN;
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    mrbc_value t = mrbc_fixnum_value( edges[i].t & CAPTURE_TIMESTAMP_MASK );
+    if( !flag_level ) {
+      mrbc_array_set( &ret, i, &t );
+      continue;
+    }
+
+    mrbc_value a = mrbc_array_new( vm, 2 );
+    if( mrbc_type(a) != MRBC_TT_ARRAY ) break;
+    mrbc_value level = mrbc_fixnum_value( edges[i].level );
+    mrbc_array_set( &a, 0, &t );
+    mrbc_array_set( &a, 1, &level );
+    mrbc_array_set( &ret, i, &a );
+  }
+
+ RETURN:
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("Capture: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! number of edges lost (the ring was full)
+
+  $cap.overflow()
+*/
+static void c_capture_overflow(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  SET_INT_RETURN( ch->overflow );
+}
+
+
+//================================================================
+/*! clock of the timestamps
+
+  $cap.clock_hz()	# => Integer
+*/
+static void c_capture_clock_hz(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  CAPTURE_HANDLE *ch = *(CAPTURE_HANDLE **)v->instance->data;
+  SET_INT_RETURN( ch->clock_hz );
+}
+
+
+
+//================================================================
+/*! timer tick for the no signal detection.
+
+  Call this every 1ms from the periodic timer ISR. (e.g. with mrbc_tick)
+*/
+void mrbc_capture_tick(void)
+{
+  capture_tick( &caph );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_capture(struct VM *vm)
+{
+  capture_init( &caph, Timer_Capture, Pin_Capture );
+  isr_Capture_StartEx( capture_isr_handler );
+
+  // define class and methods.
+  mrbc_class *capture;
+  capture = mrbc_define_class(0, "Capture",	mrbc_class_object);
+  mrbc_define_method(0, capture, "new",		c_capture_new);
+  mrbc_define_method(0, capture, "gate_ms=",	c_capture_set_gate_ms);
+  mrbc_define_method(0, capture, "prescale=",	c_capture_set_prescale);
+  mrbc_define_method(0, capture, "start",	c_capture_start);
+  mrbc_define_method(0, capture, "stop",	c_capture_stop);
+  mrbc_define_method(0, capture, "frequency",	c_capture_frequency);
+  mrbc_define_method(0, capture, "period_us",	c_capture_period_us);
+  mrbc_define_method(0, capture, "pulse_width",	c_capture_pulse_width);
+  mrbc_define_method(0, capture, "duty",	c_capture_duty);
+  mrbc_define_method(0, capture, "timestamps",	c_capture_timestamps);
+  mrbc_define_method(0, capture, "overflow",	c_capture_overflow);
+  mrbc_define_method(0, capture, "clock_hz",	c_capture_clock_hz);
+}
@@ -0,0 +1,326 @@
+/*! @file
+  @brief
+  Input capture library for PSoC5LP. (Timer component)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The timer counts the clock, and latches the counter into the capture
+  FIFO at each edge of the input. The interrupt on capture drains the
+  FIFO (up to 4 edges), stores the edges to the ring, and accumulates
+  the measurement.
+
+  Measurement (reciprocal counting):
+  A gate starts at a rising edge, and ends at the first rising edge
+  after the gate time. The frequency is the number of periods divided by
+  the ticks between the two edges, so the error is one tick regardless
+  of the input frequency.
+  With "Either Edge" capture mode, the high time is summed in the gate.
+  The level of the edges alternates, so it is read from the pin only
+  once at start. (or after the FIFO gets full)
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "capture2.h"
+
+/***** Constant values ******************************************************/
+#define CAPTURE_RING_MASK (CAPTURE_RING_SIZE - 1)
+
+#if (CAPTURE_RING_SIZE & CAPTURE_RING_MASK) != 0
+#error "CAPTURE_RING_SIZE must be power of 2."
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! reset the measurement.
+*/
+static void capture_reset(CAPTURE_HANDLE *ch)
+{
+  ch->level = -1;
+  ch->flag_gate = 0;
+  memset( &ch->acc, 0, sizeof(ch->acc) );
+}
+
+
+//================================================================
+/*! an edge. (in the ISR)
+*/
+static void capture_edge(CAPTURE_HANDLE *ch, uint32_t t, int level)
+{
+  // to the ring.
+  uint16_t wr = ch->wr;
+  if( (uint16_t)(wr - ch->rd) >= CAPTURE_RING_SIZE ) {
+    ch->overflow++;
+  } else {
+    ch->ring[wr & CAPTURE_RING_MASK].t = t;
+    ch->ring[wr & CAPTURE_RING_MASK].level = level;
+    ch->wr = wr + 1;
+  }
+  ch->last_edge_tick = ch->tick;
+
+  // measurement.
+  if( !level ) {
+    if( ch->flag_gate ) ch->acc.sum_high += (t - ch->last_rise) & ch->mask;
+    return;
+  }
+
+  if( !ch->flag_gate ) {
+    ch->flag_gate = 1;
+    ch->gate_first = t;
+
+  } else {
+    ch->acc.n_periods += ch->prescale;
+    uint32_t span = (t - ch->gate_first) & ch->mask;
+    if( span >= ch->gate_ticks ) {
+      ch->acc.span = span;
+      ch->result = ch->acc;
+      ch->n_results++;
+      ch->gate_first = t;
+      memset( &ch->acc, 0, sizeof(ch->acc) );
+    }
+  }
+  ch->last_rise = t;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @param  resolution	bits of the timer.
+  @param  flag_both_edges capture mode is "Either Edge".
+  @param  clock_hz	clock of the timer.
+*/
+void capture_init_m(CAPTURE_HANDLE *ch,
+		    void *Start,
+		    void *Stop,
+		    void *ReadCapture,
+		    void *ReadStatusRegister,
+		    void *ClearFIFO,
+		    void *ReadPin,
+		    int status_fifo_not_empty,
+		    int status_fifo_full,
+		    int resolution,
+		    int flag_both_edges,
+		    uint32_t clock_hz)
+{
+  memset( ch, 0, sizeof(CAPTURE_HANDLE) );
+
+  ch->clock_hz = clock_hz;
+  ch->mask = (resolution >= 32) ? 0xffffffff : ((uint32_t)1 << resolution) - 1;
+  ch->flag_both_edges = flag_both_edges;
+  ch->prescale = 1;
+  capture_set_gate_us( ch, 100000 );
+  capture_reset( ch );
+
+  ch->Start = Start;
+  ch->Stop = Stop;
+  ch->ReadCapture = ReadCapture;
+  ch->ReadStatusRegister = ReadStatusRegister;
+  ch->ClearFIFO = ClearFIFO;
+  ch->ReadPin = ReadPin;
+  ch->status_fifo_not_empty = status_fifo_not_empty;
+  ch->status_fifo_full = status_fifo_full;
+}
+
+
+//================================================================
+/*! start the capture.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+*/
+void capture_start(CAPTURE_HANDLE *ch)
+{
+  if( ch->flag_running ) return;
+
+  capture_reset( ch );
+  ch->wr = ch->rd = 0;
+  ch->overflow = 0;
+  ch->n_results = 0;
+
+  ch->Start();
+  ch->ClearFIFO();
+  ch->flag_running = 1;
+}
+
+
+//================================================================
+/*! stop the capture.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+*/
+void capture_stop(CAPTURE_HANDLE *ch)
+{
+  if( !ch->flag_running ) return;
+
+  ch->Stop();
+  ch->flag_running = 0;
+}
+
+
+//================================================================
+/*! set the gate time.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @param  us		gate time in micro seconds. 0 is every period.
+*/
+void capture_set_gate_us(CAPTURE_HANDLE *ch, uint32_t us)
+{
+  uint64_t ticks = (uint64_t)ch->clock_hz * us / 1000000;
+
+  if( ticks > ch->mask / 2 ) ticks = ch->mask / 2;
+  ch->gate_ticks = ticks;
+}
+
+
+//================================================================
+/*! set the prescale.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @param  n		edges in a capture. (1 to 127)
+  @return int		0 is no error.
+
+  The capture counter of the timer must be set to the same value.
+  Only for the "Rising Edge" capture mode.
+*/
+int capture_set_prescale(CAPTURE_HANDLE *ch, int n)
+{
+  if( n < 1 || n > 127 ) return -1;
+  if( ch->flag_both_edges && n != 1 ) return -1;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  ch->prescale = n;
+  capture_reset( ch );
+  ch->n_results = 0;
+  CyExitCriticalSection( interrupts );
+
+  return 0;
+}
+
+
+//================================================================
+/*! interrupt handler. (capture of the timer)
+
+  @param  ch		pointer to CAPTURE_HANDLE
+*/
+void capture_isr(CAPTURE_HANDLE *ch)
+{
+  uint8_t status = ch->ReadStatusRegister();
+
+  // edges may be lost, so the level is unknown.
+  if( ch->flag_both_edges && (status & ch->status_fifo_full) ) {
+    capture_reset( ch );
+  }
+
+  while( status & ch->status_fifo_not_empty ) {
+    uint32_t t = ch->mask - (ch->ReadCapture() & ch->mask);
+    int level = 1;
+
+    if( ch->flag_both_edges ) {
+      if( ch->level < 0 ) {
+	// the pin shows the level after this edge, unless the next one came.
+	level = ch->ReadPin() ? 1 : 0;
+	status = ch->ReadStatusRegister();
+	if( status & ch->status_fifo_not_empty ) continue;
+	ch->level = level;
+      }
+      level = ch->level;
+      ch->level = !level;
+    }
+
+    capture_edge( ch, t, level );
+    status = ch->ReadStatusRegister();
+  }
+}
+
+
+//================================================================
+/*! timer tick for the no signal detection.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @note
+    Call this every 1ms from the timer ISR.
+*/
+void capture_tick(CAPTURE_HANDLE *ch)
+{
+  ch->flag_tick = 1;
+  ch->tick++;
+}
+
+
+//================================================================
+/*! get the latest result of the gate.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @param  result	pointer to CAPTURE_RESULT to store.
+  @return int		1 if valid. 0 if no result, or no signal.
+
+  No signal means no edge in twice the gate time (or the period).
+  It is detected by capture_tick(), because ReadCounter of the timer
+  is a software capture through the FIFO, which the ISR also reads.
+  Without the tick, the last result stays valid.
+*/
+int capture_get_result(CAPTURE_HANDLE *ch, CAPTURE_RESULT *result)
+{
+  if( !ch->flag_running ) return 0;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  uint32_t n_results = ch->n_results;
+  uint32_t elapsed = ch->tick - ch->last_edge_tick;
+  *result = ch->result;
+  CyExitCriticalSection( interrupts );
+
+  if( n_results == 0 ) return 0;
+
+  if( ch->flag_tick ) {
+    uint32_t span = ch->gate_ticks > result->span ? ch->gate_ticks : result->span;
+    uint32_t timeout_ms = (uint64_t)span * 1000 / ch->clock_hz + 1;
+    if( elapsed > timeout_ms * 2 ) return 0;
+  }
+
+  return 1;
+}
+
+
+//================================================================
+/*! read the edges from the ring.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @param  dst		buffer.
+  @param  n		maximum number of edges.
+  @return int		number of edges read.
+*/
+int capture_read_edges(CAPTURE_HANDLE *ch, CAPTURE_EDGE *dst, int n)
+{
+  uint16_t rd = ch->rd;
+  int i;
+
+  for( i = 0; i < n && rd != ch->wr; i++ ) {
+    dst[i] = ch->ring[rd++ & CAPTURE_RING_MASK];
+  }
+  ch->rd = rd;
+
+  return i;
+}
@@ -0,0 +1,161 @@
+/*! @file
+  @brief
+  Input capture library for PSoC5LP. (Timer component)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_CAPTURE2_H_
+#define PSOC5_CAPTURE2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! number of edges in the ring. must be power of 2.
+#ifndef CAPTURE_RING_SIZE
+# define CAPTURE_RING_SIZE 32
+#endif
+
+//! clock of the timer component.
+#ifndef CAPTURE_CLOCK_HZ
+# define CAPTURE_CLOCK_HZ BCLK__BUS_CLK__HZ
+#endif
+
+
+/***** Macros ***************************************************************/
+//! Initializer macro
+#define capture_init(ch, NAME, PIN)			\
+  capture_init_m( ch,					\
+		  NAME ## _Start,			\
+		  NAME ## _Stop,			\
+		  NAME ## _ReadCapture,			\
+		  NAME ## _ReadStatusRegister,		\
+		  NAME ## _ClearFIFO,			\
+		  PIN ## _Read,				\
+		  NAME ## _STATUS_FIFONEMP,		\
+		  NAME ## _STATUS_FIFOFULL,		\
+		  NAME ## _Resolution,			\
+		  NAME ## _CaptureMode == NAME ## __B_TIMER__CM_EITHEREDGE, \
+		  CAPTURE_CLOCK_HZ )
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! a captured edge.
+*/
+typedef struct CAPTURE_EDGE {
+  uint32_t t;			// ticks, counting up.
+  uint8_t level;		// 1: rising, 0: falling.
+
+} CAPTURE_EDGE;
+
+
+//================================================================
+/*! a result of the gate.
+
+  The periods between the first and the last rising edge.
+*/
+typedef struct CAPTURE_RESULT {
+  uint32_t n_periods;
+  uint32_t span;		// ticks.
+  uint32_t sum_high;		// ticks. 0 if unknown.
+
+} CAPTURE_RESULT;
+
+
+//================================================================
+/*! capture handle.
+*/
+typedef struct CAPTURE_HANDLE {
+  uint32_t clock_hz;
+  uint32_t mask;		// of the ticks. 2^resolution - 1
+  uint8_t flag_both_edges;	// capture mode is "Either Edge".
+  uint8_t flag_running;
+  uint8_t prescale;		// edges in a capture. (rising only)
+  int8_t level;			// of the next edge. -1 is unknown.
+
+  // ring of the edges. the ISR writes, and the task reads.
+  CAPTURE_EDGE ring[CAPTURE_RING_SIZE];
+  volatile uint16_t wr;
+  volatile uint16_t rd;
+  volatile uint32_t overflow;	// edges lost.
+
+  // measurement in the gate.
+  uint32_t gate_ticks;
+  uint8_t flag_gate;		// a rising edge is seen.
+  uint32_t gate_first;		// the first rising edge.
+  uint32_t last_rise;
+  CAPTURE_RESULT acc;
+  volatile uint32_t tick;	// counted by capture_tick(). (ms)
+  volatile uint32_t last_edge_tick; // for the timeout.
+  volatile uint8_t flag_tick;	// capture_tick() is called.
+  volatile uint32_t n_results;
+  CAPTURE_RESULT result;	// the latest.
+
+  // function table
+  void (*Start)(void);
+  void (*Stop)(void);
+  uint32_t (*ReadCapture)(void);
+  uint8_t (*ReadStatusRegister)(void);
+  void (*ClearFIFO)(void);
+  uint8_t (*ReadPin)(void);
+  uint8_t status_fifo_not_empty;
+  uint8_t status_fifo_full;
+
+} CAPTURE_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void capture_init_m(CAPTURE_HANDLE *ch,
+		    void *Start,
+		    void *Stop,
+		    void *ReadCapture,
+		    void *ReadStatusRegister,
+		    void *ClearFIFO,
+		    void *ReadPin,
+		    int status_fifo_not_empty,
+		    int status_fifo_full,
+		    int resolution,
+		    int flag_both_edges,
+		    uint32_t clock_hz);
+void capture_start(CAPTURE_HANDLE *ch);
+void capture_stop(CAPTURE_HANDLE *ch);
+void capture_set_gate_us(CAPTURE_HANDLE *ch, uint32_t us);
+int capture_set_prescale(CAPTURE_HANDLE *ch, int n);
+void capture_isr(CAPTURE_HANDLE *ch);
+void capture_tick(CAPTURE_HANDLE *ch);
+int capture_get_result(CAPTURE_HANDLE *ch, CAPTURE_RESULT *result);
+int capture_read_edges(CAPTURE_HANDLE *ch, CAPTURE_EDGE *dst, int n);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! number of edges in the ring.
+
+  @param  ch		pointer to CAPTURE_HANDLE
+  @return int		number of edges.
+*/
+static inline int capture_available(CAPTURE_HANDLE *ch)
+{
+  return (uint16_t)(ch->wr - ch->rd);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
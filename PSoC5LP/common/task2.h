@@ -0,0 +1,81 @@
+/*! @file
+  @brief
+  Task helpers for the device classes. (suspend and resume)
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  A method suspends the calling task, and the ISR (or another task)
+  resumes it. The task sleeps after the method returns.
+  </pre>
+*/
+
+#ifndef MRBC_PSOC5LP_TASK2_H_
+#define MRBC_PSOC5LP_TASK2_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+
+/***** Local headers ********************************************************/
+#include "mrubyc.h"
+
+
+/***** Macros ***************************************************************/
+//! the task of the VM. (mruby/c doesn't export it)
+#if !defined(VM2TCB)
+# define VM2TCB(p) ((mrbc_tcb *)((uint8_t *)p - offsetof(mrbc_tcb, vm)))
+#endif
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! resume the waiting task, if any.
+
+  @param  waiter	pointer to the waiting task. cleared.
+*/
+static inline void task_wakeup(mrbc_tcb * volatile *waiter)
+{
+  if( *waiter ) {
+    mrbc_resume_task( *waiter );
+    *waiter = 0;
+  }
+}
+
+
+//================================================================
+/*! has the task ended?
+
+  @param  tcb		pointer to the task.
+  @return int		true if the task is dormant. (ended or not started)
+*/
+static inline int task_is_dormant(const mrbc_tcb *tcb)
+{
+  return tcb->state == TASKSTATE_DORMANT;
+}
+
+
+//================================================================
+/*! can the task run?
+
+  @param  tcb		pointer to the task.
+  @return int		true if the task is ready or running.
+			(not sleeping, suspended or ended)
+*/
+static inline int task_is_runnable(const mrbc_tcb *tcb)
+{
+  return tcb->state == TASKSTATE_READY || tcb->state == TASKSTATE_RUNNING;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
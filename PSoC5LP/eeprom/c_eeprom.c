@@ -12,8 +12,11 @@
    1. Launch PSoC Creator.
    2. Place 'EEPROM' device.
    3. Make sure name is 'EEPROM_1'.
-   4. Copy c_eeprom.h and c_eeprom.c files to project folder.
-   5. Add this (c_eeprom.c) file to PSoC Creator.
+   4. Copy c_eeprom.h, c_eeprom.c, eeprom2.h, eeprom2.c, eeprom_kv.h,
+      eeprom_kv.c, eeprom_log.h, eeprom_log.c, eeprom_image.h and
+      eeprom_image.c files to project folder.
+   5. Add c_eeprom.c, eeprom2.c, eeprom_kv.c, eeprom_log.c and
+      eeprom_image.c files to PSoC Creator.
    6. Add below to main.c.
       #include "c_eeprom.h"
       mrbc_init_class_eeprom(0);	// needs to be after mrbc_init()
@@ -26,6 +29,42 @@
     # read from device
     s = EEPROM.read( address, byte_length )
 
+    # write-back mode. the rows are written by flush.
+    EEPROM.write_back = true
+    EEPROM.write( address, "DATA" )
+    EEPROM.flush
+
+    # asynchronous write. programmed in background.
+    # (needs mrbc_eeprom_tick() in the 1ms timer ISR,
+    #  and mrbc_eeprom_idle() in the task context)
+    EEPROM.write_async( address, "DATA" )
+    EEPROM.pending	# => number of rows in the queue.
+    EEPROM.sync		# wait for the queue.
+
+    # read-only view of the mapped EEPROM. no copy.
+    tbl = EEPROM.view( address, length )
+    tbl[ offset ]	# => byte
+    tbl.u16( 4 )	# => little endian uint16 at offset 4.
+
+    # key-value store. (region address, size)
+    kv = EEPROM::KV.new( 0x400, 1024 )
+    kv.set( "mode", "\x01" )
+    s = kv.get( "mode" )
+    kv.delete( "mode" )
+    kv.flush
+
+    # ring log of fixed size records. (region address, size, record size)
+    log = EEPROM::Log.new( 0x200, 256, 8 )
+    seq = log.append( "\x01\x02" )
+    log.since( seq )	# => [[seq, String], ...]
+    log.flush
+
+    # bytecode image. (address, size, version) then reset.
+    img = EEPROM::Image.new( 0x000, mrb.size, 2 )
+    img.write( mrb )
+    img.commit		# => true if success.
+    EEPROM::Image.info( 0x000 )	# => [version, size], or nil.
+
   (note)
     Only string read/write available in this version.
     Address range is 0 to 2047.
@@ -40,6 +79,50 @@
 #include <string.h>
 
 #include "mrubyc.h"
+#include "eeprom2.h"
+#include "eeprom_kv.h"
+#include "eeprom_log.h"
+#include "eeprom_image.h"
+
+
+static EEPROM_HANDLE eeh;
+static uint8_t eeprom_flag_write_back;
+static mrbc_class *eeprom_view_class;
+static mrbc_class *eeprom_kv_class;
+static mrbc_class *eeprom_log_class;
+static mrbc_class *eeprom_image_class;
+
+//! attribute of EEPROM::View
+struct EEPROM_VIEW_attr {
+  uint16_t address;
+  uint16_t length;
+};
+
+
+//================================================================
+/*! read bytes for the view.
+
+  @param  attr		pointer to the view.
+  @param  offset	offset in the view.
+  @param  buf		pointer to buffer.
+  @param  n		number of bytes.
+  @return		pointer to the bytes, or NULL if out of range.
+  @note
+    Returns the mapped address directly, unless the cache or
+    the queue has data not yet written.
+*/
+static const uint8_t *eeprom_view_bytes(const struct EEPROM_VIEW_attr *attr,
+					int offset, uint8_t *buf, int n)
+{
+  if( offset < 0 || n > attr->length - offset ) return NULL;
+
+  int address = attr->address + offset;
+  if( eeprom_is_dirty( &eeh ) || eeprom_pending( &eeh ) ) {
+    eeprom_read( &eeh, address, buf, n );
+    return buf;
+  }
+  return (const uint8_t *)CYDEV_EE_BASE + address;
+}
 
 
 //================================================================
@@ -83,11 +166,14 @@ static void c_eeprom_read(struct VM *vm, mrb_value v[], int argc)
 
   int address = mrbc_fixnum(v[1]);
   int length = mrbc_fixnum(v[2]);
+  if( address < 0 || length < 0 || address + length > CYDEV_EE_SIZE ) {
+    goto ERROR_PARAM;
+  }
 
   uint8_t *buf = mrbc_alloc(vm, length + 1);
   if( !buf ) return;		// ENOMEM, raise?
 
-  memcpy( buf, (uint8_t *)CYDEV_EE_BASE + address, length );
+  eeprom_read( &eeh, address, buf, length );
   *(buf + length) = '\0';
 
   mrbc_value ret = mrbc_string_new_alloc(vm, buf, length);
@@ -105,6 +191,10 @@ static void c_eeprom_read(struct VM *vm, mrb_value v[], int argc)
 
   (mruby usage)
   eeprom.write( address, data )
+
+  The data is merged into the row cache, and each touched row
+  is written once. Unchanged rows are not written.
+  In write-back mode, the rows are written by flush.
 */
 static void c_eeprom_write(struct VM *vm, mrb_value v[], int argc)
 {
@@ -113,65 +203,1055 @@ static void c_eeprom_write(struct VM *vm, mrb_value v[], int argc)
   if( mrbc_type(v[2]) != MRBC_TT_STRING ) goto ERROR_PARAM;
 
   int address = mrbc_fixnum(v[1]);
-  int remain = mrbc_string_size(&v[2]);
-  const uint8_t *p = (uint8_t*)mrbc_string_cstr(&v[2]);
+  int size = mrbc_string_size(&v[2]);
+  if( address < 0 || address + size > CYDEV_EE_SIZE ) goto ERROR_PARAM;
+
+  if( eeprom_write( &eeh, address, mrbc_string_cstr(&v[2]), size ) < 0 ) {
+    goto ERROR;
+  }
+  if( !eeprom_flag_write_back ) {
+    if( eeprom_flush( &eeh ) != 0 ) goto ERROR;
+  }
+
+  SET_INT_RETURN(size);
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM: parameter error.\n");
+  SET_INT_RETURN(0);
+  return;
+
+ ERROR:
+  console_printf("EEPROM: Write error.\n");
+  SET_INT_RETURN(0);
+}
 
-  EEPROM_1_UpdateTemperature();
 
-  // Head surplus
-  int len = CYDEV_EEPROM_ROW_SIZE - (address % CYDEV_EEPROM_ROW_SIZE);
-  if( len > remain ) len = remain;
+//================================================================
+/*! EEPROM flush
+
+  (mruby usage)
+  eeprom.flush	# => true if success.
 
-  if( len != CYDEV_EEPROM_ROW_SIZE ) {
-    remain -= len;
-    while( --len >= 0 ) {
-      if( EEPROM_1_WriteByte( *p++, address++ ) != CYRET_SUCCESS ) goto ERROR;
-    }
+  Write the changed rows in the cache to the device.
+*/
+static void c_eeprom_flush(struct VM *vm, mrb_value v[], int argc)
+{
+  if( eeprom_flush( &eeh ) != 0 ) {
+    console_printf("EEPROM: Write error.\n");
+    SET_FALSE_RETURN();
+    return;
   }
+  SET_TRUE_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM set write-back mode
+
+  (mruby usage)
+  eeprom.write_back = true
+
+  true:  write keeps the data in the cache until flush. (or row eviction)
+  false: write flushes at the end of each call. (default)
+*/
+static void c_eeprom_set_write_back(struct VM *vm, mrb_value v[], int argc)
+{
+  eeprom_flag_write_back = (mrbc_type(v[1]) != MRBC_TT_FALSE &&
+			    mrbc_type(v[1]) != MRBC_TT_NIL);
+
+  // leaving write-back mode. write the pending rows.
+  if( !eeprom_flag_write_back ) eeprom_flush( &eeh );
+}
+
+
+//================================================================
+/*! EEPROM write (asynchronous)
+
+  (mruby usage)
+  eeprom.write_async( address, data )	# => written bytes
+
+  The rows are queued and programmed in background.
+  Returns 0 if the queue is full. (nothing is queued)
+*/
+static void c_eeprom_write_async(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_STRING ) goto ERROR_PARAM;
+
+  int address = mrbc_fixnum(v[1]);
+  int size = mrbc_string_size(&v[2]);
+  if( address < 0 || address + size > CYDEV_EE_SIZE ) goto ERROR_PARAM;
+
+  int ret = eeprom_write_async( &eeh, address, mrbc_string_cstr(&v[2]), size );
+  SET_INT_RETURN( ret < 0 ? 0 : ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM: parameter error.\n");
+  SET_INT_RETURN(0);
+}
+
+
+//================================================================
+/*! EEPROM number of rows in the write queue
+
+  (mruby usage)
+  eeprom.pending	# => Integer
+*/
+static void c_eeprom_pending(struct VM *vm, mrb_value v[], int argc)
+{
+  eeprom_poll( &eeh );
+  SET_INT_RETURN( eeprom_pending( &eeh ) );
+}
 
-  // Just ROW size
-  int row_num = address / CYDEV_EEPROM_ROW_SIZE;
-  while( remain >= CYDEV_EEPROM_ROW_SIZE ) {
-    if( EEPROM_1_Write( p, row_num++ ) != CYRET_SUCCESS ) goto ERROR;
 
-    remain -= CYDEV_EEPROM_ROW_SIZE;
-    p += CYDEV_EEPROM_ROW_SIZE;
+//================================================================
+/*! EEPROM wait for the write queue
+
+  (mruby usage)
+  eeprom.sync	# => true if no error.
+
+  Also writes the rows in the cache.
+*/
+static void c_eeprom_sync(struct VM *vm, mrb_value v[], int argc)
+{
+  int ret = eeprom_sync( &eeh );
+  ret |= eeprom_flush( &eeh );
+
+  if( ret != 0 ) {
+    console_printf("EEPROM: Write error.\n");
+    SET_FALSE_RETURN();
+    return;
   }
+  SET_TRUE_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM has pending rows?
+
+  (mruby usage)
+  eeprom.dirty?
+*/
+static void c_eeprom_dirty(struct VM *vm, mrb_value v[], int argc)
+{
+  SET_BOOL_RETURN( eeprom_is_dirty( &eeh ) );
+}
 
-  // Tail surplus
-  address = row_num * CYDEV_EEPROM_ROW_SIZE;
-  for(; remain > 0; remain-- ) {
-    if( EEPROM_1_WriteByte( *p++, address++ ) != CYRET_SUCCESS ) goto ERROR;
+
+
+//================================================================
+/*! EEPROM get read-only view
+
+  (mruby usage)
+  tbl = eeprom.view( address, length )
+
+  The view references the memory-mapped EEPROM. No heap for the data.
+*/
+static void c_eeprom_view(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int address = mrbc_fixnum(v[1]);
+  int length = mrbc_fixnum(v[2]);
+  if( address < 0 || length < 0 || address + length > CYDEV_EE_SIZE ) {
+    goto ERROR_PARAM;
   }
 
-  SET_INT_RETURN(mrbc_string_size(&v[2]));
+  mrbc_value ret = mrbc_instance_new(vm, eeprom_view_class,
+				     sizeof(struct EEPROM_VIEW_attr));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)ret.instance->data;
+  attr->address = address;
+  attr->length = length;
+  SET_RETURN( ret );
   return;
 
  ERROR_PARAM:
   console_printf("EEPROM: parameter error.\n");
-  SET_INT_RETURN(0);
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::View get size
+
+  (mruby usage)
+  tbl.size
+*/
+static void c_eeprom_view_size(struct VM *vm, mrb_value v[], int argc)
+{
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
+  SET_INT_RETURN( attr->length );
+}
+
+
+//================================================================
+/*! EEPROM::View get address
+
+  (mruby usage)
+  tbl.address
+*/
+static void c_eeprom_view_address(struct VM *vm, mrb_value v[], int argc)
+{
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
+  SET_INT_RETURN( attr->address );
+}
+
+
+//================================================================
+/*! EEPROM::View typed accessors. (little endian)
+
+  (mruby usage)
+  tbl.u8( offset )	# => 0..255
+  tbl.getbyte( offset )	# same as u8
+  tbl.u16( offset )	# => 0..65535
+  tbl.i16( offset )	# => -32768..32767
+  tbl.u32( offset )	# => 0..4294967295 (Float above 0x7fffffff)
+			(as negative Integer, if MRBC_USE_FLOAT is 0)
+
+  Returns nil if out of range.
+*/
+static void c_eeprom_view_get(struct VM *vm, mrb_value v[], int argc, int n, int flag_signed)
+{
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
+  uint8_t buf[4];
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  const uint8_t *p = eeprom_view_bytes( attr, mrbc_fixnum(v[1]), buf, n );
+  if( !p ) goto ERROR_RETURN;
+
+  uint32_t val = 0;
+  int i;
+  for( i = n - 1; i >= 0; i-- ) {
+    val = (val << 8) | p[i];
+  }
+
+  if( flag_signed && n == 2 ) {
+    SET_INT_RETURN( (int16_t)val );
+#if MRBC_USE_FLOAT
+  } else if( val > INT32_MAX ) {
+    SET_FLOAT_RETURN( val );		// out of Fixnum range.
+#endif
+  } else {
+    SET_INT_RETURN( (int32_t)val );	// same bits, if no Float.
+  }
   return;
 
- ERROR:
-  console_printf("EEPROM: Write error.\n");
-  SET_INT_RETURN(0);
+ ERROR_PARAM:
+  console_printf("EEPROM::View: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+static void c_eeprom_view_u8(struct VM *vm, mrb_value v[], int argc)
+{
+  c_eeprom_view_get( vm, v, argc, 1, 0 );
+}
+
+static void c_eeprom_view_u16(struct VM *vm, mrb_value v[], int argc)
+{
+  c_eeprom_view_get( vm, v, argc, 2, 0 );
+}
+
+static void c_eeprom_view_i16(struct VM *vm, mrb_value v[], int argc)
+{
+  c_eeprom_view_get( vm, v, argc, 2, 1 );
+}
+
+static void c_eeprom_view_u32(struct VM *vm, mrb_value v[], int argc)
+{
+  c_eeprom_view_get( vm, v, argc, 4, 0 );
 }
 
 
+//================================================================
+/*! EEPROM::View copy to String
+
+  (mruby usage)
+  s = tbl.to_s
+*/
+static void c_eeprom_view_to_s(struct VM *vm, mrb_value v[], int argc)
+{
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
+
+  mrbc_value ret = mrbc_string_new( vm, 0, attr->length );
+  if( mrbc_type(ret) != MRBC_TT_STRING ) {
+    SET_NIL_RETURN();		// ENOMEM
+    return;
+  }
+  eeprom_read( &eeh, attr->address, mrbc_string_cstr(&ret), attr->length );
+  SET_RETURN( ret );
+}
+
 
 //================================================================
-/*! initialize
+/*! EEPROM::View get a byte, or copy a part to String
+
+  (mruby usage)
+  tbl[ offset ]			# => 0..255. same as u8
+  s = tbl[ offset, length ]	# => String
+
+  Returns nil if out of range.
 */
-void mrbc_init_class_eeprom(struct VM *vm)
+static void c_eeprom_view_aref(struct VM *vm, mrb_value v[], int argc)
 {
-  EEPROM_1_Start();	// start physical device
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
 
-  mrb_class *eeprom;
-  eeprom = mrbc_define_class(vm, "EEPROM",	mrbc_class_object);
+  if( argc == 1 ) {
+    c_eeprom_view_get( vm, v, argc, 1, 0 );
+    return;
+  }
 
-  mrbc_define_method(vm, eeprom, "size",	c_eeprom_size);
-  mrbc_define_method(vm, eeprom, "row_size",	c_eeprom_row_size);
-  mrbc_define_method(vm, eeprom, "page_size",	c_eeprom_page_size);
-  mrbc_define_method(vm, eeprom, "read",	c_eeprom_read);
-  mrbc_define_method(vm, eeprom, "write",	c_eeprom_write);
+  if( argc != 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int offset = mrbc_fixnum(v[1]);
+  int length = mrbc_fixnum(v[2]);
+  if( offset < 0 || length < 0 || length > attr->length - offset ) {
+    goto ERROR_RETURN;
+  }
+
+  mrbc_value ret = mrbc_string_new( vm, 0, length );
+  if( mrbc_type(ret) != MRBC_TT_STRING ) goto ERROR_RETURN;	// ENOMEM
+  eeprom_read( &eeh, attr->address + offset, mrbc_string_cstr(&ret), length );
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::View: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::View compare the contents
+
+  (mruby usage)
+  tbl == other		# other is EEPROM::View or String
+
+  Compares a row at a time. No copy of the whole view.
+*/
+static void c_eeprom_view_eq(struct VM *vm, mrb_value v[], int argc)
+{
+  struct EEPROM_VIEW_attr *attr = (struct EEPROM_VIEW_attr *)v->instance->data;
+  struct EEPROM_VIEW_attr *other = NULL;
+  const uint8_t *str = NULL;
+  int length;
+  int flag_eq = 0;
+
+  if( mrbc_type(v[1]) == MRBC_TT_STRING ) {
+    str = (const uint8_t *)mrbc_string_cstr(&v[1]);
+    length = mrbc_string_size(&v[1]);
+  } else if( mrbc_type(v[1]) == MRBC_TT_OBJECT &&
+	     v[1].instance->cls == eeprom_view_class ) {
+    other = (struct EEPROM_VIEW_attr *)v[1].instance->data;
+    length = other->length;
+  } else {
+    goto DONE;
+  }
+  if( length != attr->length ) goto DONE;
+
+  int offset;
+  for( offset = 0; offset < length; offset += EEPROM_ROW_SIZE ) {
+    uint8_t buf1[EEPROM_ROW_SIZE], buf2[EEPROM_ROW_SIZE];
+    int n = length - offset;
+    if( n > EEPROM_ROW_SIZE ) n = EEPROM_ROW_SIZE;
+
+    const uint8_t *p1 = eeprom_view_bytes( attr, offset, buf1, n );
+    const uint8_t *p2 = str ? str + offset :
+      eeprom_view_bytes( other, offset, buf2, n );
+    if( memcmp( p1, p2, n ) != 0 ) goto DONE;
+  }
+  flag_eq = 1;
+
+ DONE:
+  SET_BOOL_RETURN( flag_eq );
+}
+
+
+
+//================================================================
+/*! get the key of EEPROM::KV from String or Symbol.
+
+  @return	pointer to the key, or NULL if error.
+*/
+static const char *eeprom_kv_key(mrbc_value *v, int *klen)
+{
+  const char *key;
+
+  switch( mrbc_type(*v) ) {
+  case MRBC_TT_STRING:
+    key = mrbc_string_cstr(v);
+    *klen = mrbc_string_size(v);
+    break;
+
+  case MRBC_TT_SYMBOL:
+    key = symid_to_str( v->i );
+    *klen = strlen(key);
+    break;
+
+  default:
+    return NULL;
+  }
+
+  if( *klen <= 0 || *klen > EEPROM_KV_MAX_KEY_LEN ) return NULL;
+  return key;
+}
+
+
+//================================================================
+/*! EEPROM::KV constructor
+
+  (mruby usage)
+  kv = EEPROM::KV.new( address, size )
+
+  address: row aligned. (multiple of 16)
+  size:    multiple of 32, min 64. half of it is used for the compaction.
+
+  Scans the region and builds the index. Formats if no valid data.
+*/
+static void c_eeprom_kv_new(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(EEPROM_KV));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  EEPROM_KV *kv = (EEPROM_KV *)ret.instance->data;
+  if( eeprom_kv_open( kv, &eeh, mrbc_fixnum(v[1]), mrbc_fixnum(v[2])) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::KV: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::KV get
+
+  (mruby usage)
+  s = kv.get( key )	# => String or nil
+  s = kv[ key ]
+
+  key: String or Symbol
+*/
+static void c_eeprom_kv_get(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  uint8_t buf[EEPROM_KV_MAX_VALUE_LEN];
+  int klen;
+
+  const char *key = eeprom_kv_key( &v[1], &klen );
+  if( !key ) goto ERROR_PARAM;
+
+  int vlen = eeprom_kv_get( kv, key, klen, buf, sizeof(buf) );
+  if( vlen < 0 ) goto RETURN_NIL;
+
+  mrbc_value ret = mrbc_string_new( vm, buf, vlen );
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::KV: parameter error.\n");
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::KV set
+
+  (mruby usage)
+  kv.set( key, value )	# => true if success.
+  kv[ key ] = value
+
+  key:   String or Symbol. (1..255 bytes)
+  value: String. (0..254 bytes)
+
+  The record is appended to the log, and written with the row.
+  Call flush to write it now.
+*/
+static void c_eeprom_kv_set(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  int klen;
+
+  const char *key = eeprom_kv_key( &v[1], &klen );
+  if( !key ) goto ERROR_PARAM;
+  if( argc < 2 || mrbc_type(v[2]) != MRBC_TT_STRING ) goto ERROR_PARAM;
+
+  if( eeprom_kv_set( kv, key, klen, mrbc_string_cstr(&v[2]),
+		     mrbc_string_size(&v[2]) ) != 0 ) {
+    console_printf("EEPROM::KV: no space.\n");
+    SET_FALSE_RETURN();
+    return;
+  }
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::KV: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::KV delete
+
+  (mruby usage)
+  kv.delete( key )	# => true if deleted.
+*/
+static void c_eeprom_kv_delete(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  int klen;
+
+  const char *key = eeprom_kv_key( &v[1], &klen );
+  if( !key ) {
+    console_printf("EEPROM::KV: parameter error.\n");
+    SET_FALSE_RETURN();
+    return;
+  }
+
+  SET_BOOL_RETURN( eeprom_kv_delete( kv, key, klen ) == 0 );
+}
+
+
+//================================================================
+/*! EEPROM::KV get keys
+
+  (mruby usage)
+  a = kv.keys		# => [String, ...]
+*/
+static void c_eeprom_kv_keys(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  uint8_t buf[EEPROM_KV_MAX_KEY_LEN];
+  int n = kv->n_keys;
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN_NIL;	// ENOMEM
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    int klen = eeprom_kv_key_at( kv, i, buf, sizeof(buf) );
+    mrbc_value key = mrbc_string_new( vm, buf, klen );
+    mrbc_array_set( &ret, i, &key );
+  }
+  SET_RETURN( ret );
+  return;
+
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::KV number of keys
+
+  (mruby usage)
+  kv.size
+*/
+static void c_eeprom_kv_size(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  SET_INT_RETURN( kv->n_keys );
+}
+
+
+//================================================================
+/*! EEPROM::KV free bytes in the log
+
+  (mruby usage)
+  kv.free
+*/
+static void c_eeprom_kv_free(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  SET_INT_RETURN( eeprom_kv_free( kv ) );
+}
+
+
+//================================================================
+/*! EEPROM::KV compaction
+
+  (mruby usage)
+  kv.compact		# => true if success.
+
+  Done automatically when the log is full.
+*/
+static void c_eeprom_kv_compact(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_KV *kv = (EEPROM_KV *)v->instance->data;
+  SET_BOOL_RETURN( eeprom_kv_compact( kv ) == 0 );
+}
+
+
+//================================================================
+/*! EEPROM::Log constructor
+
+  (mruby usage)
+  log = EEPROM::Log.new( address, size, rec_size )
+
+  address:  row aligned. (multiple of 16)
+  size:     multiple of 16, min 32.
+  rec_size: 1 to 11. records are packed in a row. (11 / rec_size)
+
+  Finds the head of the log by binary search.
+*/
+static void c_eeprom_log_new(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 3 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[3]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(EEPROM_LOG));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  EEPROM_LOG *lg = (EEPROM_LOG *)ret.instance->data;
+  if( eeprom_log_open( lg, &eeh, mrbc_fixnum(v[1]), mrbc_fixnum(v[2]),
+		       mrbc_fixnum(v[3])) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Log: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Log append a record
+
+  (mruby usage)
+  seq = log.append( "DATA" )	# => sequence number, or nil if error.
+
+  The data is padded with 0 to the record size.
+  Committed to the device when the row is full, or by flush_every.
+  If the commit fails, the record stays in RAM and is retried.
+*/
+static void c_eeprom_log_append(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+
+  if( argc < 1 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_STRING ) goto ERROR_PARAM;
+  if( mrbc_string_size(&v[1]) > lg->rec_size ) goto ERROR_PARAM;
+
+  int32_t seq = eeprom_log_append( lg, mrbc_string_cstr(&v[1]),
+				   mrbc_string_size(&v[1]) );
+  if( seq < 0 ) {
+    console_printf("EEPROM::Log: write error.\n");
+    goto RETURN_NIL;
+  }
+  SET_INT_RETURN( seq );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Log: parameter error.\n");
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Log get records since the sequence number
+
+  (mruby usage)
+  a = log.since( seq )		# => [[seq, String], ...]
+  a = log.since( seq, max )	# max: maximum number of records.
+
+  Records older than the log, and records in a broken row are skipped.
+  This is used in place of each_since( seq ) {|seq, s| }, because
+  mrbc_send() of mruby/c calls only C functions and can't yield
+  to a block. each_since can be written in Ruby. (see readme.md)
+*/
+static void c_eeprom_log_since(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+  uint8_t buf[EEPROM_LOG_ROW_PAYLOAD];
+
+  if( argc < 1 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int32_t seq = mrbc_fixnum(v[1]);
+  int32_t first = eeprom_log_first_seq( lg );
+  int32_t next = eeprom_log_next_seq( lg );
+  if( seq < first ) seq = first;
+  if( seq > next ) seq = next;
+
+  int n = next - seq;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    if( n > mrbc_fixnum(v[2]) ) n = mrbc_fixnum(v[2]);
+    if( n < 0 ) n = 0;
+  }
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN_NIL;	// ENOMEM
+
+  int i, j = 0;
+  for( i = 0; i < n; i++ ) {
+    int size = eeprom_log_read( lg, seq + i, buf );
+    if( size < 0 ) continue;		// broken row.
+
+    mrbc_value rec = mrbc_array_new( vm, 2 );
+    mrbc_value s = mrbc_fixnum_value( seq + i );
+    mrbc_array_set( &rec, 0, &s );
+    s = mrbc_string_new( vm, buf, size );
+    mrbc_array_set( &rec, 1, &s );
+    mrbc_array_set( &ret, j++, &rec );
+  }
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Log: parameter error.\n");
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Log set the flush policy
+
+  (mruby usage)
+  log.flush_every = n	# commit every n records. (1 to records per row)
+
+  Default is records per row. (commit full rows only)
+*/
+static void c_eeprom_log_set_flush_every(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  int n = mrbc_fixnum(v[1]);
+  if( n < 1 || n > lg->rec_per_row ) goto ERROR_PARAM;
+
+  lg->flush_every = n;
+  SET_INT_RETURN( n );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Log: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Log commit the records in RAM
+
+  (mruby usage)
+  log.flush		# => true if success.
+*/
+static void c_eeprom_log_flush(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+  SET_BOOL_RETURN( eeprom_log_commit( lg ) == 0 );
+}
+
+
+//================================================================
+/*! EEPROM::Log sequence number of the oldest record
+
+  (mruby usage)
+  log.first_seq
+*/
+static void c_eeprom_log_first_seq(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+  SET_INT_RETURN( eeprom_log_first_seq( lg ) );
+}
+
+
+//================================================================
+/*! EEPROM::Log sequence number of the next record
+
+  (mruby usage)
+  log.next_seq
+*/
+static void c_eeprom_log_next_seq(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_LOG *lg = (EEPROM_LOG *)v->instance->data;
+  SET_INT_RETURN( eeprom_log_next_seq( lg ) );
+}
+
+
+//================================================================
+/*! EEPROM::Image constructor (begin to write the image)
+
+  (mruby usage)
+  img = EEPROM::Image.new( address, size, version )
+
+  address: row aligned. (multiple of 16)
+  size:    size of the bytecode.
+  version: 0 to 65535. (user defined)
+
+  The old image at the address is invalidated.
+*/
+static void c_eeprom_image_new(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 3 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[3]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_fixnum(v[3]) < 0 || mrbc_fixnum(v[3]) > 0xffff ) goto ERROR_PARAM;
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(EEPROM_IMAGE_WRITER));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  EEPROM_IMAGE_WRITER *w = (EEPROM_IMAGE_WRITER *)ret.instance->data;
+  if( eeprom_image_begin( w, &eeh, mrbc_fixnum(v[1]), mrbc_fixnum(v[2]),
+			  mrbc_fixnum(v[3])) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Image: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Image write a part of the bytecode
+
+  (mruby usage)
+  img.write( "DATA" )	# => true if success.
+
+  The rows are programmed when filled.
+*/
+static void c_eeprom_image_write(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_IMAGE_WRITER *w = (EEPROM_IMAGE_WRITER *)v->instance->data;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_STRING ) {
+    console_printf("EEPROM::Image: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  SET_BOOL_RETURN( eeprom_image_write( w, mrbc_string_cstr(&v[1]),
+				       mrbc_string_size(&v[1]) ) == 0 );
+}
+
+
+//================================================================
+/*! EEPROM::Image finish the image
+
+  (mruby usage)
+  img.commit		# => true if success.
+
+  Verifies the bytecode, and writes the header.
+*/
+static void c_eeprom_image_commit(struct VM *vm, mrb_value v[], int argc)
+{
+  EEPROM_IMAGE_WRITER *w = (EEPROM_IMAGE_WRITER *)v->instance->data;
+  SET_BOOL_RETURN( eeprom_image_end( w ) == 0 );
+}
+
+
+//================================================================
+/*! EEPROM::Image get the version and the size of the image
+
+  (mruby usage)
+  EEPROM::Image.info( address )	# => [version, size], or nil.
+*/
+static void c_eeprom_image_info(struct VM *vm, mrb_value v[], int argc)
+{
+  uint16_t version;
+  int size;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( !eeprom_image_find( mrbc_fixnum(v[1]), &version, &size ) ) {
+    goto RETURN_NIL;
+  }
+
+  mrbc_value ret = mrbc_array_new( vm, 2 );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN_NIL;	// ENOMEM
+  mrbc_value val = mrbc_fixnum_value( version );
+  mrbc_array_set( &ret, 0, &val );
+  val = mrbc_fixnum_value( size );
+  mrbc_array_set( &ret, 1, &val );
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("EEPROM::Image: parameter error.\n");
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! EEPROM::Image verify the bytecode of the image
+
+  (mruby usage)
+  EEPROM::Image.verify( address )	# => true if valid.
+*/
+static void c_eeprom_image_verify(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) {
+    console_printf("EEPROM::Image: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  int address = mrbc_fixnum(v[1]);
+  SET_BOOL_RETURN( eeprom_image_find( address, NULL, NULL ) &&
+		   eeprom_image_verify( (const uint8_t *)CYDEV_EE_BASE + address ) == 0 );
+}
+
+
+
+
+
+//================================================================
+/*! get the bytecode of the image in the EEPROM.
+
+  @param  address	address of the image.
+  @return		pointer to the bytecode in the mapped EEPROM, or NULL.
+
+  Checks the header only. Pass it to mrbc_create_task() without a copy.
+  Can be called before mrbc_init_class_eeprom().
+*/
+const void *mrbc_eeprom_image(int address)
+{
+  return eeprom_image_find( address, NULL, NULL );
+}
+
+
+//================================================================
+/*! timer tick of the asynchronous write.
+
+  Call this every 1ms from the periodic timer ISR. (e.g. with mrbc_tick)
+  It only requests the next step to mrbc_eeprom_idle().
+*/
+void mrbc_eeprom_tick(void)
+{
+  eeprom_tick( &eeh );
+}
+
+
+//================================================================
+/*! drive the asynchronous write in the task context.
+
+  Call this when the scheduler is idle. (e.g. hal_idle_cpu() of mruby/c)
+  The temperature update and StartWrite of the SPC are done here,
+  not in the timer ISR.
+*/
+void mrbc_eeprom_idle(void)
+{
+  eeprom_idle( &eeh );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_eeprom(struct VM *vm)
+{
+  eeprom_init( &eeh, EEPROM_1 );	// start physical device
+
+  mrb_class *eeprom;
+  eeprom = mrbc_define_class(vm, "EEPROM",	mrbc_class_object);
+
+  mrbc_define_method(vm, eeprom, "size",	c_eeprom_size);
+  mrbc_define_method(vm, eeprom, "row_size",	c_eeprom_row_size);
+  mrbc_define_method(vm, eeprom, "page_size",	c_eeprom_page_size);
+  mrbc_define_method(vm, eeprom, "read",	c_eeprom_read);
+  mrbc_define_method(vm, eeprom, "write",	c_eeprom_write);
+  mrbc_define_method(vm, eeprom, "flush",	c_eeprom_flush);
+  mrbc_define_method(vm, eeprom, "write_back=",	c_eeprom_set_write_back);
+  mrbc_define_method(vm, eeprom, "dirty?",	c_eeprom_dirty);
+  mrbc_define_method(vm, eeprom, "write_async",	c_eeprom_write_async);
+  mrbc_define_method(vm, eeprom, "pending",	c_eeprom_pending);
+  mrbc_define_method(vm, eeprom, "sync",	c_eeprom_sync);
+  mrbc_define_method(vm, eeprom, "view",	c_eeprom_view);
+
+  // EEPROM::View
+  eeprom_view_class = mrbc_define_class(vm, "EEPROM_View", mrbc_class_object);
+  mrbc_value val = {.tt = MRBC_TT_CLASS, .cls = eeprom_view_class};
+  mrbc_set_class_const( eeprom, str_to_symid("View"), &val );
+
+  mrbc_define_method(vm, eeprom_view_class, "size",	c_eeprom_view_size);
+  mrbc_define_method(vm, eeprom_view_class, "address",	c_eeprom_view_address);
+  mrbc_define_method(vm, eeprom_view_class, "u8",	c_eeprom_view_u8);
+  mrbc_define_method(vm, eeprom_view_class, "getbyte",	c_eeprom_view_u8);
+  mrbc_define_method(vm, eeprom_view_class, "u16",	c_eeprom_view_u16);
+  mrbc_define_method(vm, eeprom_view_class, "i16",	c_eeprom_view_i16);
+  mrbc_define_method(vm, eeprom_view_class, "u32",	c_eeprom_view_u32);
+  mrbc_define_method(vm, eeprom_view_class, "to_s",	c_eeprom_view_to_s);
+  mrbc_define_method(vm, eeprom_view_class, "[]",	c_eeprom_view_aref);
+  mrbc_define_method(vm, eeprom_view_class, "==",	c_eeprom_view_eq);
+
+  // EEPROM::KV
+  eeprom_kv_class = mrbc_define_class(vm, "EEPROM_KV", mrbc_class_object);
+  val.cls = eeprom_kv_class;
+  mrbc_set_class_const( eeprom, str_to_symid("KV"), &val );
+
+  mrbc_define_method(vm, eeprom_kv_class, "new",	c_eeprom_kv_new);
+  mrbc_define_method(vm, eeprom_kv_class, "get",	c_eeprom_kv_get);
+  mrbc_define_method(vm, eeprom_kv_class, "[]",		c_eeprom_kv_get);
+  mrbc_define_method(vm, eeprom_kv_class, "set",	c_eeprom_kv_set);
+  mrbc_define_method(vm, eeprom_kv_class, "[]=",	c_eeprom_kv_set);
+  mrbc_define_method(vm, eeprom_kv_class, "delete",	c_eeprom_kv_delete);
+  mrbc_define_method(vm, eeprom_kv_class, "keys",	c_eeprom_kv_keys);
+  mrbc_define_method(vm, eeprom_kv_class, "size",	c_eeprom_kv_size);
+  mrbc_define_method(vm, eeprom_kv_class, "free",	c_eeprom_kv_free);
+  mrbc_define_method(vm, eeprom_kv_class, "compact",	c_eeprom_kv_compact);
+  mrbc_define_method(vm, eeprom_kv_class, "flush",	c_eeprom_flush);
+
+  // EEPROM::Log
+  eeprom_log_class = mrbc_define_class(vm, "EEPROM_Log", mrbc_class_object);
+  val.cls = eeprom_log_class;
+  mrbc_set_class_const( eeprom, str_to_symid("Log"), &val );
+
+  mrbc_define_method(vm, eeprom_log_class, "new",	c_eeprom_log_new);
+  mrbc_define_method(vm, eeprom_log_class, "append",	c_eeprom_log_append);
+  mrbc_define_method(vm, eeprom_log_class, "since",	c_eeprom_log_since);
+  mrbc_define_method(vm, eeprom_log_class, "flush_every=", c_eeprom_log_set_flush_every);
+  mrbc_define_method(vm, eeprom_log_class, "flush",	c_eeprom_log_flush);
+  mrbc_define_method(vm, eeprom_log_class, "first_seq",	c_eeprom_log_first_seq);
+  mrbc_define_method(vm, eeprom_log_class, "next_seq",	c_eeprom_log_next_seq);
+
+  // EEPROM::Image
+  eeprom_image_class = mrbc_define_class(vm, "EEPROM_Image", mrbc_class_object);
+  val.cls = eeprom_image_class;
+  mrbc_set_class_const( eeprom, str_to_symid("Image"), &val );
+
+  mrbc_define_method(vm, eeprom_image_class, "new",	c_eeprom_image_new);
+  mrbc_define_method(vm, eeprom_image_class, "write",	c_eeprom_image_write);
+  mrbc_define_method(vm, eeprom_image_class, "commit",	c_eeprom_image_commit);
+  mrbc_define_method(vm, eeprom_image_class, "info",	c_eeprom_image_info);
+  mrbc_define_method(vm, eeprom_image_class, "verify",	c_eeprom_image_verify);
 }
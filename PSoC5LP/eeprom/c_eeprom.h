@@ -20,6 +20,9 @@ extern "C" {
 
 struct VM;
 void mrbc_init_class_eeprom(struct VM *vm);
+void mrbc_eeprom_tick(void);
+void mrbc_eeprom_idle(void);
+const void *mrbc_eeprom_image(int address);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,558 @@
+/*! @file
+  @brief
+  EEPROM convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Each EEPROM row write is an erase/program cycle of several ms,
+  even for a single byte. This library merges the writes into
+  the row cache, and writes each touched row only once.
+
+  The asynchronous write queue programs the rows in background by
+  StartWrite/Query, driven by eeprom_poll() in the task context.
+  eeprom_tick() in the timer ISR only requests it. (eeprom_idle())
+  The queue is changed only in the task context, so it needs no
+  critical section. The row being programmed stays at the head until
+  it is done, and hides the device row while the SPC writes it.
+  The latest contents of a row are, in order of priority,
+  the dirty cached row, the newest queued row, and the device.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "eeprom2.h"
+
+/***** Constant values ******************************************************/
+#if EEPROM_ROW_SIZE != CYDEV_EEPROM_ROW_SIZE
+#error "EEPROM_ROW_SIZE != CYDEV_EEPROM_ROW_SIZE"
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! pointer to the row in the device.
+*/
+static inline const uint8_t *eeprom_device_row(int row)
+{
+  return (const uint8_t *)CYDEV_EE_BASE + row * EEPROM_ROW_SIZE;
+}
+
+
+//================================================================
+/*! pointer to the n-th row in the queue. (0 is the head)
+*/
+static inline EEPROM_QUEUE_ROW *eeprom_queue_at(EEPROM_HANDLE *eh, int n)
+{
+  n += eh->q_head;
+  if( n >= EEPROM_QUEUE_SIZE ) n -= EEPROM_QUEUE_SIZE;
+  return &eh->queue[n];
+}
+
+
+//================================================================
+/*! remove the head of the queue.
+*/
+static void eeprom_queue_pop(EEPROM_HANDLE *eh)
+{
+  if( ++eh->q_head >= EEPROM_QUEUE_SIZE ) eh->q_head = 0;
+  eh->q_count--;
+  eh->flag_in_progress = 0;
+}
+
+
+//================================================================
+/*! find the newest queued row.
+
+  @return	index in the queue, or -1 if not found.
+*/
+static int eeprom_queue_find(EEPROM_HANDLE *eh, int row)
+{
+  int i;
+  for( i = eh->q_count - 1; i >= 0; i-- ) {
+    if( eeprom_queue_at( eh, i )->row == row ) return i;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*! update the temperature for the write, if it is not valid.
+
+  @return int	0 if success.
+  @note
+    With eeprom_tick(), the temperature is valid for EEPROM_TEMP_VALID_MS.
+    Without it, it is updated once in an operation.
+*/
+static int eeprom_update_temperature(EEPROM_HANDLE *eh)
+{
+  if( eh->flag_tick ) {
+    if( eh->flag_temp_updated && eh->temp_age < EEPROM_TEMP_VALID_MS ) return 0;
+  } else {
+    if( eh->flag_temp_updated ) return 0;
+  }
+
+  if( eh->UpdateTemperature() != CYRET_SUCCESS ) return -1;
+  eh->flag_temp_updated = 1;
+  eh->temp_age = 0;
+  return 0;
+}
+
+
+//================================================================
+/*! write a cached row to the device, if it was changed.
+
+  @return int	0 if success.
+*/
+static int eeprom_write_back(EEPROM_HANDLE *eh, EEPROM_CACHE_ROW *cr)
+{
+  if( !cr->flag_dirty ) return 0;
+
+  // the cached row is newer than the queued rows,
+  // and the SPC can't write while the queue is in progress.
+  if( eh->q_count ) eeprom_sync( eh );
+
+  if( memcmp( eeprom_device_row(cr->row), cr->data, EEPROM_ROW_SIZE ) == 0 ) {
+    eh->n_row_skips++;
+    cr->flag_dirty = 0;
+    return 0;
+  }
+
+  if( eeprom_update_temperature( eh ) != 0 ) return -1;
+  if( eh->Write( cr->data, cr->row ) != CYRET_SUCCESS ) return -1;
+  eh->n_row_writes++;
+  cr->flag_dirty = 0;
+  return 0;
+}
+
+
+//================================================================
+/*! find the row in the cache.
+
+  @return	pointer to the cached row, or NULL.
+*/
+static EEPROM_CACHE_ROW *eeprom_find_row(EEPROM_HANDLE *eh, int row)
+{
+  int i;
+  for( i = 0; i < EEPROM_NUM_CACHE_ROWS; i++ ) {
+    if( eh->cache[i].row == row ) return &eh->cache[i];
+  }
+  return NULL;
+}
+
+
+//================================================================
+/*! load the row into the cache. evict the LRU row if full.
+
+  @return	pointer to the cached row, or NULL if error.
+*/
+static EEPROM_CACHE_ROW *eeprom_load_row(EEPROM_HANDLE *eh, int row)
+{
+  EEPROM_CACHE_ROW *cr = eeprom_find_row( eh, row );
+  if( cr ) goto DONE;
+
+  // empty or the least recently used row.
+  int i;
+  cr = &eh->cache[0];
+  for( i = 0; i < EEPROM_NUM_CACHE_ROWS; i++ ) {
+    if( eh->cache[i].row < 0 ) {
+      cr = &eh->cache[i];
+      break;
+    }
+    if( (uint16_t)(eh->clock - eh->cache[i].age) >
+	(uint16_t)(eh->clock - cr->age) ) cr = &eh->cache[i];
+  }
+  if( eeprom_write_back( eh, cr ) != 0 ) return NULL;
+
+  // the latest contents. (queued or device)
+  cr->row = row;
+  i = eeprom_queue_find( eh, row );
+  memcpy( cr->data, (i < 0) ? eeprom_device_row(row) :
+	  eeprom_queue_at( eh, i )->data, EEPROM_ROW_SIZE );
+
+ DONE:
+  cr->age = ++eh->clock;
+  return cr;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+  @internal
+  @param  eh		pointer to EEPROM_HANDLE
+  @note
+    Don't use this directry. Use eeprom_init macro.
+*/
+void eeprom_init_m(EEPROM_HANDLE *eh,
+		   void *Start,
+		   void *UpdateTemperature,
+		   void *Write,
+		   void *StartWrite,
+		   void *Query)
+{
+  int i;
+
+  for( i = 0; i < EEPROM_NUM_CACHE_ROWS; i++ ) {
+    eh->cache[i].row = -1;
+    eh->cache[i].flag_dirty = 0;
+    eh->cache[i].age = 0;
+  }
+  eh->clock = 0;
+  eh->q_head = 0;
+  eh->q_count = 0;
+  eh->flag_in_progress = 0;
+  eh->flag_polling = 0;
+  eh->flag_temp_updated = 0;
+  eh->flag_tick = 0;
+  eh->flag_poll_request = 0;
+  eh->temp_age = 0;
+  eh->n_row_writes = 0;
+  eh->n_row_skips = 0;
+  eh->n_errors = 0;
+
+  eh->Start = Start;
+  eh->UpdateTemperature = UpdateTemperature;
+  eh->Write = Write;
+  eh->StartWrite = StartWrite;
+  eh->Query = Query;
+
+  eh->Start();
+}
+
+
+//================================================================
+/*! read data. includes data in the queue and the cache.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address. (0 to CYDEV_EE_SIZE-1)
+  @param  buffer	pointer to buffer.
+  @param  size		size of buffer.
+  @return int		number of read bytes, or -1 if parameter error.
+*/
+int eeprom_read(EEPROM_HANDLE *eh, int address, void *buffer, int size)
+{
+  uint8_t *p = buffer;
+  int i;
+
+  if( address < 0 || size < 0 || address + size > CYDEV_EE_SIZE ) return -1;
+
+  // the queue is popped only by eeprom_poll() in the task context,
+  // so it doesn't change while reading.
+  memcpy( p, (const uint8_t *)CYDEV_EE_BASE + address, size );
+
+  // overlay the queued rows (older first), and the cached rows.
+  for( i = 0; i < eh->q_count + EEPROM_NUM_CACHE_ROWS; i++ ) {
+    const uint8_t *data;
+    int top;
+
+    if( i < eh->q_count ) {
+      EEPROM_QUEUE_ROW *qr = eeprom_queue_at( eh, i );
+      data = qr->data;
+      top = qr->row * EEPROM_ROW_SIZE;
+    } else {
+      EEPROM_CACHE_ROW *cr = &eh->cache[i - eh->q_count];
+      if( !cr->flag_dirty ) continue;
+      data = cr->data;
+      top = cr->row * EEPROM_ROW_SIZE;
+    }
+
+    int s = (address > top) ? address : top;
+    int e = (address + size < top + EEPROM_ROW_SIZE) ?
+      address + size : top + EEPROM_ROW_SIZE;
+    if( s < e ) memcpy( p + (s - address), data + (s - top), e - s );
+  }
+
+  return size;
+}
+
+
+//================================================================
+/*! write data to the cache.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address. (0 to CYDEV_EE_SIZE-1)
+  @param  data		pointer to data.
+  @param  size		size of data.
+  @return int		number of written bytes, or -1 if error.
+  @note
+    The data is written to the device when the row is evicted,
+    or by eeprom_flush().
+*/
+int eeprom_write(EEPROM_HANDLE *eh, int address, const void *data, int size)
+{
+  const uint8_t *p = data;
+  int remain = size;
+
+  if( address < 0 || size < 0 || address + size > CYDEV_EE_SIZE ) return -1;
+  eh->flag_temp_updated &= eh->flag_tick;
+
+  while( remain > 0 ) {
+    EEPROM_CACHE_ROW *cr = eeprom_load_row( eh, address / EEPROM_ROW_SIZE );
+    if( !cr ) return -1;
+
+    int ofs = address % EEPROM_ROW_SIZE;
+    int len = EEPROM_ROW_SIZE - ofs;
+    if( len > remain ) len = remain;
+
+    if( memcmp( cr->data + ofs, p, len ) != 0 ) {
+      memcpy( cr->data + ofs, p, len );
+      cr->flag_dirty = 1;
+    }
+
+    address += len;
+    p += len;
+    remain -= len;
+  }
+
+  return size;
+}
+
+
+//================================================================
+/*! write all changed rows in the cache to the device.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @return int		0 if success.
+*/
+int eeprom_flush(EEPROM_HANDLE *eh)
+{
+  int ret = 0;
+  int i;
+
+  eh->flag_temp_updated &= eh->flag_tick;
+  for( i = 0; i < EEPROM_NUM_CACHE_ROWS; i++ ) {
+    if( eeprom_write_back( eh, &eh->cache[i] ) != 0 ) ret = -1;
+  }
+
+  return ret;
+}
+
+
+//================================================================
+/*! write a row to the device now. (bypass the cache)
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  row		row number.
+  @param  data		pointer to data. (EEPROM_ROW_SIZE bytes)
+  @return int		0 if success.
+*/
+int eeprom_write_row(EEPROM_HANDLE *eh, int row, const void *data)
+{
+  if( row < 0 || row >= CYDEV_EE_SIZE / EEPROM_ROW_SIZE ) return -1;
+  if( eh->q_count ) eeprom_sync( eh );
+
+  // the cached row follows.
+  EEPROM_CACHE_ROW *cr = eeprom_find_row( eh, row );
+  if( cr ) {
+    memcpy( cr->data, data, EEPROM_ROW_SIZE );
+    cr->flag_dirty = 0;
+  }
+
+  if( memcmp( eeprom_device_row(row), data, EEPROM_ROW_SIZE ) == 0 ) {
+    eh->n_row_skips++;
+    return 0;
+  }
+
+  eh->flag_temp_updated &= eh->flag_tick;
+  if( eeprom_update_temperature( eh ) != 0 ) return -1;
+  if( eh->Write( data, row ) != CYRET_SUCCESS ) return -1;
+  eh->n_row_writes++;
+  return 0;
+}
+
+
+//================================================================
+/*! write data to the asynchronous write queue.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address. (0 to CYDEV_EE_SIZE-1)
+  @param  data		pointer to data.
+  @param  size		size of data.
+  @return int		number of queued bytes, or -1 if error or queue full.
+  @note
+    Nothing is queued if the queue doesn't have enough space.
+*/
+int eeprom_write_async(EEPROM_HANDLE *eh, int address, const void *data, int size)
+{
+  const uint8_t *p = data;
+  int remain = size;
+  int row;
+
+  if( address < 0 || size < 0 || address + size > CYDEV_EE_SIZE ) return -1;
+  if( size == 0 ) return 0;
+
+  // check the space. (the head in progress can't be merged)
+  int first = address / EEPROM_ROW_SIZE;
+  int last = (address + size - 1) / EEPROM_ROW_SIZE;
+  int n_new = 0;
+  for( row = first; row <= last; row++ ) {
+    if( eeprom_queue_find( eh, row ) <= 0 ) n_new++;
+  }
+  if( eh->q_count + n_new > EEPROM_QUEUE_SIZE ) return -1;
+  eh->flag_temp_updated &= eh->flag_tick;
+
+  for( row = first; row <= last; row++ ) {
+    int ofs = address % EEPROM_ROW_SIZE;
+    int len = EEPROM_ROW_SIZE - ofs;
+    if( len > remain ) len = remain;
+
+    EEPROM_CACHE_ROW *cr = eeprom_find_row( eh, row );
+    int i = eeprom_queue_find( eh, row );
+    EEPROM_QUEUE_ROW *qr;
+
+    if( i < 0 || (i == 0 && eh->flag_in_progress) ) {
+      // new row. based on the latest contents.
+      qr = eeprom_queue_at( eh, eh->q_count );
+      qr->row = row;
+      memcpy( qr->data, cr ? cr->data : (i < 0) ? eeprom_device_row(row) :
+	      eeprom_queue_at( eh, 0 )->data, EEPROM_ROW_SIZE );
+      eh->q_count++;
+    } else {
+      // merge into the queued row.
+      qr = eeprom_queue_at( eh, i );
+      if( cr ) memcpy( qr->data, cr->data, EEPROM_ROW_SIZE );
+    }
+    memcpy( qr->data + ofs, p, len );
+
+    // the cached row follows the queued row.
+    if( cr ) {
+      memcpy( cr->data, qr->data, EEPROM_ROW_SIZE );
+      cr->flag_dirty = 0;
+    }
+
+    address += len;
+    p += len;
+    remain -= len;
+  }
+
+  eeprom_poll( eh );
+  return size;
+}
+
+
+//================================================================
+/*! drive the asynchronous write queue.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @note
+    Call this in the task context, not in the ISR.
+    The temperature update of the SPC blocks for a few ms.
+*/
+void eeprom_poll(EEPROM_HANDLE *eh)
+{
+  if( eh->flag_polling ) return;
+  eh->flag_polling = 1;
+
+  // the head is being programmed?
+  if( eh->flag_in_progress ) {
+    uint32_t status = eh->Query();
+    if( status == CYRET_STARTED ) goto DONE;
+
+    if( status == CYRET_SUCCESS ) {
+      eh->n_row_writes++;
+    } else {
+      eh->n_errors++;
+    }
+    eeprom_queue_pop( eh );
+  }
+
+  // start the next row.
+  while( eh->q_count > 0 ) {
+    EEPROM_QUEUE_ROW *qr = eeprom_queue_at( eh, 0 );
+
+    if( memcmp( eeprom_device_row(qr->row), qr->data, EEPROM_ROW_SIZE ) == 0 ) {
+      eh->n_row_skips++;
+      eeprom_queue_pop( eh );
+      continue;
+    }
+    eh->flag_in_progress = 1;		// no more merging.
+
+    if( eeprom_update_temperature( eh ) != 0 ) goto ERROR;
+
+    uint32_t status = eh->StartWrite( qr->data, qr->row );
+    if( status == CYRET_SUCCESS ) break;
+    if( status == CYRET_LOCKED ) {	// SPC is busy. try later.
+      eh->flag_in_progress = 0;
+      break;
+    }
+
+  ERROR:
+    eh->n_errors++;
+    eeprom_queue_pop( eh );
+  }
+
+ DONE:
+  eh->flag_polling = 0;
+}
+
+
+//================================================================
+/*! timer tick. count the temperature age, and request the poll.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @note
+    Call this every 1ms from the timer ISR.
+    It doesn't use the SPC. eeprom_idle() drives the queue.
+*/
+void eeprom_tick(EEPROM_HANDLE *eh)
+{
+  eh->flag_tick = 1;
+  if( eh->temp_age != 0xffff ) eh->temp_age++;
+
+  if( eh->q_count ) eh->flag_poll_request = 1;
+}
+
+
+//================================================================
+/*! drive the queue, if eeprom_tick() requested it.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @note
+    Call this from the task context. (e.g. the idle hook of the scheduler)
+*/
+void eeprom_idle(EEPROM_HANDLE *eh)
+{
+  if( !eh->flag_poll_request ) return;
+
+  eh->flag_poll_request = 0;
+  eeprom_poll( eh );
+}
+
+
+//================================================================
+/*! wait until the asynchronous write queue is empty.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @return int		0 if no error occurred while waiting.
+*/
+int eeprom_sync(EEPROM_HANDLE *eh)
+{
+  uint16_t n_errors = eh->n_errors;
+
+  while( eh->q_count > 0 ) {
+    eeprom_poll( eh );
+    CyDelayUs( 100 );
+  }
+
+  return (eh->n_errors == n_errors) ? 0 : -1;
+}
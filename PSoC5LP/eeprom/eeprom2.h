@@ -0,0 +1,168 @@
+/*! @file
+  @brief
+  EEPROM convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_EEPROMWRAP2_H_
+#define PSOC5_EEPROMWRAP2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! row size. must be same as CYDEV_EEPROM_ROW_SIZE.
+#ifndef EEPROM_ROW_SIZE
+# define EEPROM_ROW_SIZE 16
+#endif
+
+//! number of rows in the write-back cache.
+#ifndef EEPROM_NUM_CACHE_ROWS
+# define EEPROM_NUM_CACHE_ROWS 2
+#endif
+
+//! number of rows in the asynchronous write queue.
+#ifndef EEPROM_QUEUE_SIZE
+# define EEPROM_QUEUE_SIZE 8
+#endif
+
+//! validity window of the temperature for the write. (ms)
+#ifndef EEPROM_TEMP_VALID_MS
+# define EEPROM_TEMP_VALID_MS 1000
+#endif
+
+
+/***** Macros ***************************************************************/
+//! Initializer macro
+#define eeprom_init(eh, NAME)			\
+  eeprom_init_m( eh,				\
+		 NAME ## _Start,		\
+		 NAME ## _UpdateTemperature,	\
+		 NAME ## _Write,		\
+		 NAME ## _StartWrite,		\
+		 NAME ## _Query)
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! a row in the write-back cache.
+*/
+typedef struct EEPROM_CACHE_ROW {
+  int16_t row;			// row number, or -1 if empty.
+  uint8_t flag_dirty;		// not yet written to the device.
+  uint16_t age;			// for LRU.
+  uint8_t data[EEPROM_ROW_SIZE];
+
+} EEPROM_CACHE_ROW;
+
+
+//================================================================
+/*! a row in the asynchronous write queue.
+*/
+typedef struct EEPROM_QUEUE_ROW {
+  int16_t row;			// row number.
+  uint8_t data[EEPROM_ROW_SIZE];
+
+} EEPROM_QUEUE_ROW;
+
+
+//================================================================
+/*! EEPROM handle.
+*/
+typedef struct EEPROM_HANDLE {
+  EEPROM_CACHE_ROW cache[EEPROM_NUM_CACHE_ROWS];
+  uint16_t clock;		// LRU clock.
+
+  // asynchronous write queue. the head is programmed in background.
+  EEPROM_QUEUE_ROW queue[EEPROM_QUEUE_SIZE];
+  volatile uint8_t q_head;
+  volatile uint8_t q_count;
+  volatile uint8_t flag_in_progress;	// the head is being programmed.
+  volatile uint8_t flag_polling;	// lock of eeprom_poll().
+
+  // temperature.
+  uint8_t flag_temp_updated;	// temperature updated in this operation.
+  volatile uint8_t flag_tick;	// eeprom_tick() is called.
+  volatile uint8_t flag_poll_request;	// eeprom_tick() requests the poll.
+  volatile uint16_t temp_age;	// ms since the last temperature update.
+
+  // statistics.
+  volatile uint16_t n_row_writes;	// rows written to the device.
+  volatile uint16_t n_row_skips;	// rows skipped, because unchanged.
+  volatile uint16_t n_errors;		// failed asynchronous writes.
+
+  // function table
+  void (*Start)(void);
+  uint32_t (*UpdateTemperature)(void);
+  uint32_t (*Write)(const uint8_t *, uint8_t);
+  uint32_t (*StartWrite)(const uint8_t *, uint8_t);
+  uint32_t (*Query)(void);
+
+} EEPROM_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void eeprom_init_m(EEPROM_HANDLE *eh,
+		   void *Start,
+		   void *UpdateTemperature,
+		   void *Write,
+		   void *StartWrite,
+		   void *Query);
+int eeprom_read(EEPROM_HANDLE *eh, int address, void *buffer, int size);
+int eeprom_write(EEPROM_HANDLE *eh, int address, const void *data, int size);
+int eeprom_flush(EEPROM_HANDLE *eh);
+int eeprom_write_row(EEPROM_HANDLE *eh, int row, const void *data);
+int eeprom_write_async(EEPROM_HANDLE *eh, int address, const void *data, int size);
+void eeprom_poll(EEPROM_HANDLE *eh);
+void eeprom_tick(EEPROM_HANDLE *eh);
+void eeprom_idle(EEPROM_HANDLE *eh);
+int eeprom_sync(EEPROM_HANDLE *eh);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! Is there data not yet written to the device?
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @return int	true or false
+*/
+static inline int eeprom_is_dirty(const EEPROM_HANDLE *eh)
+{
+  int i;
+  for( i = 0; i < EEPROM_NUM_CACHE_ROWS; i++ ) {
+    if( eh->cache[i].flag_dirty ) return 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! number of rows in the asynchronous write queue.
+
+  @param  eh		pointer to EEPROM_HANDLE
+  @return int	number of rows.
+*/
+static inline int eeprom_pending(const EEPROM_HANDLE *eh)
+{
+  return eh->q_count;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,235 @@
+/*! @file
+  @brief
+  mruby/c bytecode image on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The EEPROM is mapped to CYDEV_EE_BASE, so the VM can load the
+  bytecode in place, without a copy to RAM.
+
+  image:  header (1 row) | bytecode ... | padding to the row
+  header: 'm' 'r' 'b' 'I' version size crc reserved hdr_crc
+          all little endian 16bit. crc is CRC-16/CCITT.
+          The header is written after the bytecode, so a valid header
+          means a complete image. Loading checks the header only.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "eeprom_image.h"
+
+/***** Constant values ******************************************************/
+static const uint8_t IMAGE_MAGIC[4] = {'m', 'r', 'b', 'I'};
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! CRC-16/CCITT
+*/
+static uint16_t image_crc16(uint16_t crc, const uint8_t *p, int n)
+{
+  while( --n >= 0 ) {
+    crc ^= (uint16_t)*p++ << 8;
+    int i;
+    for( i = 0; i < 8; i++ ) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+//================================================================
+/*! write the buffered row of the bytecode.
+*/
+static int image_write_row(EEPROM_IMAGE_WRITER *w)
+{
+  int row = (w->address + EEPROM_IMAGE_HEADER_SIZE + w->pos - 1) / EEPROM_ROW_SIZE;
+  int ret = eeprom_write_row( w->eh, row, w->row );
+
+  memset( w->row, 0, EEPROM_ROW_SIZE );
+  return ret;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! check the image header.
+
+  @param  image		pointer to the image. (mapped EEPROM or flash)
+  @param  version	returns the version, or NULL.
+  @param  size		returns the size of the bytecode, or NULL.
+  @return		pointer to the bytecode, or NULL if not valid.
+*/
+const uint8_t *eeprom_image_check(const void *image, uint16_t *version, int *size)
+{
+  EEPROM_IMAGE_HEADER hdr;
+
+  memcpy( &hdr, image, sizeof(hdr) );
+  if( memcmp( hdr.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC) ) != 0 ) return NULL;
+  if( image_crc16( 0xffff, (const uint8_t *)&hdr,
+		   offsetof(EEPROM_IMAGE_HEADER, hdr_crc) ) != hdr.hdr_crc ) {
+    return NULL;
+  }
+
+  if( version ) *version = hdr.version;
+  if( size ) *size = hdr.size;
+  return (const uint8_t *)image + EEPROM_IMAGE_HEADER_SIZE;
+}
+
+
+//================================================================
+/*! find the image in the EEPROM.
+
+  @param  address	address of the image.
+  @param  version	returns the version, or NULL.
+  @param  size		returns the size of the bytecode, or NULL.
+  @return		pointer to the bytecode in the mapped EEPROM, or NULL.
+*/
+const uint8_t *eeprom_image_find(int address, uint16_t *version, int *size)
+{
+  if( address < 0 || address % EEPROM_ROW_SIZE != 0 ||
+      address + EEPROM_IMAGE_HEADER_SIZE > CYDEV_EE_SIZE ) return NULL;
+
+  int sz;
+  const uint8_t *code = eeprom_image_check(
+	(const uint8_t *)CYDEV_EE_BASE + address, version, &sz );
+  if( !code ) return NULL;
+  if( address + EEPROM_IMAGE_HEADER_SIZE + sz > CYDEV_EE_SIZE ) return NULL;
+
+  if( size ) *size = sz;
+  return code;
+}
+
+
+//================================================================
+/*! verify the CRC of the bytecode.
+
+  @param  image		pointer to the image.
+  @return int		0 is valid.
+*/
+int eeprom_image_verify(const void *image)
+{
+  int size;
+  const uint8_t *code = eeprom_image_check( image, NULL, &size );
+  if( !code ) return -1;
+
+  const EEPROM_IMAGE_HEADER *hdr = image;
+  return image_crc16( 0xffff, code, size ) == hdr->crc ? 0 : -1;
+}
+
+
+//================================================================
+/*! begin to write the image.
+
+  @param  w		pointer to EEPROM_IMAGE_WRITER
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address of the image. (row aligned)
+  @param  size		size of the bytecode.
+  @param  version	version of the program.
+  @return int		0 is no error.
+
+  The old image is invalidated first.
+*/
+int eeprom_image_begin(EEPROM_IMAGE_WRITER *w, EEPROM_HANDLE *eh, int address, int size, int version)
+{
+  if( address < 0 || address % EEPROM_ROW_SIZE != 0 || size <= 0 ||
+      address + EEPROM_IMAGE_HEADER_SIZE + size > CYDEV_EE_SIZE ) return -1;
+
+  w->eh = eh;
+  w->address = address;
+  w->size = size;
+  w->version = version;
+  w->pos = 0;
+  w->crc = 0xffff;
+  memset( w->row, 0, EEPROM_ROW_SIZE );
+
+  return eeprom_write_row( eh, address / EEPROM_ROW_SIZE, w->row );
+}
+
+
+//================================================================
+/*! write a part of the bytecode.
+
+  @param  w		pointer to EEPROM_IMAGE_WRITER
+  @param  data		pointer to the data.
+  @param  size		size of the data.
+  @return int		0 is no error.
+
+  Each row is programmed when it is filled.
+*/
+int eeprom_image_write(EEPROM_IMAGE_WRITER *w, const void *data, int size)
+{
+  const uint8_t *p = data;
+
+  if( size < 0 || w->pos + size > w->size ) return -1;
+  w->crc = image_crc16( w->crc, p, size );
+
+  while( size > 0 ) {
+    int ofs = w->pos % EEPROM_ROW_SIZE;
+    int len = EEPROM_ROW_SIZE - ofs;
+    if( len > size ) len = size;
+
+    memcpy( w->row + ofs, p, len );
+    w->pos += len;
+    p += len;
+    size -= len;
+
+    if( w->pos % EEPROM_ROW_SIZE == 0 ) {
+      if( image_write_row( w ) != 0 ) return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! finish the image.
+
+  @param  w		pointer to EEPROM_IMAGE_WRITER
+  @return int		0 is no error.
+
+  Verifies the programmed bytecode, and writes the header.
+*/
+int eeprom_image_end(EEPROM_IMAGE_WRITER *w)
+{
+  if( w->pos != w->size ) return -1;
+  if( w->pos % EEPROM_ROW_SIZE != 0 && image_write_row( w ) != 0 ) return -1;
+
+  const uint8_t *code = (const uint8_t *)CYDEV_EE_BASE +
+    w->address + EEPROM_IMAGE_HEADER_SIZE;
+  if( image_crc16( 0xffff, code, w->size ) != w->crc ) return -1;
+
+  EEPROM_IMAGE_HEADER hdr;
+  memset( &hdr, 0, sizeof(hdr) );
+  memcpy( hdr.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC) );
+  hdr.version = w->version;
+  hdr.size = w->size;
+  hdr.crc = w->crc;
+  hdr.hdr_crc = image_crc16( 0xffff, (const uint8_t *)&hdr,
+			     offsetof(EEPROM_IMAGE_HEADER, hdr_crc) );
+
+  return eeprom_write_row( w->eh, w->address / EEPROM_ROW_SIZE, &hdr );
+}
@@ -0,0 +1,81 @@
+/*! @file
+  @brief
+  mruby/c bytecode image on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_EEPROM_IMAGE_H_
+#define PSOC5_EEPROM_IMAGE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+#include "eeprom2.h"
+
+
+/***** Constant values ******************************************************/
+//! size of the image header. (one row)
+#define EEPROM_IMAGE_HEADER_SIZE EEPROM_ROW_SIZE
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! image header. the bytecode follows.
+*/
+typedef struct EEPROM_IMAGE_HEADER {
+  uint8_t magic[4];		// "mrbI"
+  uint16_t version;		// version of the program. (user defined)
+  uint16_t size;		// size of the bytecode.
+  uint16_t crc;			// CRC-16 of the bytecode.
+  uint8_t reserved[4];
+  uint16_t hdr_crc;		// CRC-16 of the header before this.
+
+} EEPROM_IMAGE_HEADER;
+
+
+//================================================================
+/*! image writer.
+*/
+typedef struct EEPROM_IMAGE_WRITER {
+  EEPROM_HANDLE *eh;
+  uint16_t address;		// address of the image. (header)
+  uint16_t size;		// size of the bytecode.
+  uint16_t version;
+  uint16_t pos;			// bytes written.
+  uint16_t crc;
+  uint8_t row[EEPROM_ROW_SIZE];
+
+} EEPROM_IMAGE_WRITER;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+const uint8_t *eeprom_image_check(const void *image, uint16_t *version, int *size);
+const uint8_t *eeprom_image_find(int address, uint16_t *version, int *size);
+int eeprom_image_verify(const void *image);
+int eeprom_image_begin(EEPROM_IMAGE_WRITER *w, EEPROM_HANDLE *eh, int address, int size, int version);
+int eeprom_image_write(EEPROM_IMAGE_WRITER *w, const void *data, int size);
+int eeprom_image_end(EEPROM_IMAGE_WRITER *w);
+
+
+/***** Inline functions *****************************************************/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,571 @@
+/*! @file
+  @brief
+  Log-structured key-value store on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The region is divided into two banks. The active bank is a log of
+  records, and the other bank is used for the compaction.
+  Updates are appended, so the writes are spread over the rows
+  and several small updates share a row program in the row cache.
+
+  bank:   'K' 'V' gen_L gen_H | record | record | ... | 0x00
+  record: klen vlen key... value... crc_L crc_H
+          vlen = 0xff is a tombstone. (deleted, no value)
+          crc is CRC-16/CCITT over gen, klen, vlen, key and value.
+          The records of the old generation fail the CRC.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "eeprom_kv.h"
+
+/***** Constant values ******************************************************/
+#define KV_HEADER_SIZE	4
+#define KV_TOMBSTONE	0xff
+#define KV_INDEX_MASK	(EEPROM_KV_INDEX_SIZE - 1)
+
+#if (EEPROM_KV_INDEX_SIZE & KV_INDEX_MASK) != 0
+#error "EEPROM_KV_INDEX_SIZE must be power of 2."
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! CRC-16/CCITT
+*/
+static uint16_t kv_crc16(uint16_t crc, const uint8_t *p, int n)
+{
+  while( --n >= 0 ) {
+    crc ^= (uint16_t)*p++ << 8;
+    int i;
+    for( i = 0; i < 8; i++ ) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+//================================================================
+/*! hash of the key. (FNV-1a, folded to 16bit)
+*/
+static uint16_t kv_hash(const uint8_t *key, int klen)
+{
+  uint32_t h = 2166136261UL;
+
+  while( --klen >= 0 ) {
+    h ^= *key++;
+    h *= 16777619UL;
+  }
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+
+//================================================================
+/*! address of the bank.
+*/
+static inline int kv_bank_address(const EEPROM_KV *kv, int bank)
+{
+  return kv->address + bank * kv->bank_size;
+}
+
+
+//================================================================
+/*! read bytes in the active bank.
+*/
+static inline void kv_read(EEPROM_KV *kv, int pos, void *buf, int n)
+{
+  eeprom_read( kv->eh, kv_bank_address(kv, kv->bank) + pos, buf, n );
+}
+
+
+//================================================================
+/*! size of the record.
+*/
+static inline int kv_record_size(int klen, int vlen)
+{
+  return 2 + klen + (vlen == KV_TOMBSTONE ? 0 : vlen) + 2;
+}
+
+
+//================================================================
+/*! size of the record at pos in the active bank.
+*/
+static int kv_record_size_at(EEPROM_KV *kv, int pos)
+{
+  uint8_t hdr[2];
+  kv_read( kv, pos, hdr, 2 );
+  return kv_record_size( hdr[0], hdr[1] );
+}
+
+
+//================================================================
+/*! find the slot of the key.
+
+  @return int	index of the slot. if not found, the slot is empty.
+*/
+static int kv_find(EEPROM_KV *kv, const uint8_t *key, int klen, uint16_t hash)
+{
+  int i = hash & KV_INDEX_MASK;
+
+  while( kv->index[i].pos ) {
+    if( kv->index[i].hash == hash ) {
+      uint8_t buf[16];
+      uint8_t hdr[2];
+      int pos = kv->index[i].pos;
+      int ofs;
+
+      kv_read( kv, pos, hdr, 2 );
+      if( hdr[0] != klen ) goto NEXT;
+      for( ofs = 0; ofs < klen; ofs += sizeof(buf) ) {
+	int n = klen - ofs;
+	if( n > sizeof(buf) ) n = sizeof(buf);
+	kv_read( kv, pos + 2 + ofs, buf, n );
+	if( memcmp( buf, key + ofs, n ) != 0 ) goto NEXT;
+      }
+      return i;
+    }
+  NEXT:
+    i = (i + 1) & KV_INDEX_MASK;
+  }
+
+  return i;
+}
+
+
+//================================================================
+/*! remove the slot from the index. (backward shift)
+*/
+static void kv_index_remove(EEPROM_KV *kv, int i)
+{
+  int j = i;
+
+  while( 1 ) {
+    j = (j + 1) & KV_INDEX_MASK;
+    if( !kv->index[j].pos ) break;
+
+    // stays if the home slot is cyclically in (i, j].
+    int k = kv->index[j].hash & KV_INDEX_MASK;
+    if( (i <= j) ? (i < k && k <= j) : (i < k || k <= j) ) continue;
+
+    kv->index[i] = kv->index[j];
+    i = j;
+  }
+  kv->index[i].pos = 0;
+  kv->n_keys--;
+}
+
+
+//================================================================
+/*! write a record and the end mark.
+
+  @return int	0 if success.
+*/
+static int kv_write_record(EEPROM_KV *kv, int bank, uint16_t gen, int pos,
+			   const uint8_t *key, int klen,
+			   const uint8_t *value, int vlen)
+{
+  int size = kv_record_size( klen, vlen );
+  int address = kv_bank_address(kv, bank) + pos;
+  uint8_t g[2] = { gen, gen >> 8 };
+  uint8_t hdr[2] = { klen, vlen };
+  if( vlen == KV_TOMBSTONE ) vlen = 0;
+
+  uint16_t crc = kv_crc16( 0xffff, g, 2 );
+  crc = kv_crc16( crc, hdr, 2 );
+  crc = kv_crc16( crc, key, klen );
+  crc = kv_crc16( crc, value, vlen );
+  uint8_t tail[3] = { crc, crc >> 8, 0 };	// and the end mark.
+
+  if( eeprom_write( kv->eh, address, hdr, 2 ) < 0 ) return -1;
+  if( eeprom_write( kv->eh, address + 2, key, klen ) < 0 ) return -1;
+  if( eeprom_write( kv->eh, address + 2 + klen, value, vlen ) < 0 ) return -1;
+  if( eeprom_write( kv->eh, address + 2 + klen + vlen, tail,
+		    (pos + size < kv->bank_size) ? 3 : 2 ) < 0 ) return -1;
+
+  return 0;
+}
+
+
+//================================================================
+/*! append a record to the active bank.
+
+  @return int	position of the record, or -1 if no space or error.
+  @note
+    If a write fails, the tail stays. The next record overwrites
+    the partial one, and the scan stops at it by the CRC.
+*/
+static int kv_append(EEPROM_KV *kv, const uint8_t *key, int klen,
+		     const uint8_t *value, int vlen)
+{
+  int size = kv_record_size( klen, vlen );
+  int pos = kv->tail;
+  if( pos + size > kv->bank_size ) return -1;
+
+  if( kv_write_record( kv, kv->bank, kv->gen, pos,
+		       key, klen, value, vlen ) != 0 ) return -1;
+
+  kv->tail = pos + size;
+  return pos;
+}
+
+
+//================================================================
+/*! scan the active bank, and build the index.
+*/
+static void kv_scan(EEPROM_KV *kv)
+{
+  uint8_t gen[2] = { kv->gen, kv->gen >> 8 };
+  uint8_t key[EEPROM_KV_MAX_KEY_LEN];
+  int pos = KV_HEADER_SIZE;
+
+  memset( kv->index, 0, sizeof(kv->index) );
+  kv->n_keys = 0;
+  kv->live_bytes = 0;
+
+  while( pos + 2 <= kv->bank_size ) {
+    uint8_t hdr[2];
+    kv_read( kv, pos, hdr, 2 );
+    int klen = hdr[0];
+    if( klen == 0 ) break;		// end mark.
+
+    int size = kv_record_size( klen, hdr[1] );
+    if( pos + size > kv->bank_size ) break;
+
+    // check the CRC.
+    uint16_t crc = kv_crc16( 0xffff, gen, 2 );
+    crc = kv_crc16( crc, hdr, 2 );
+    int ofs;
+    for( ofs = 2; ofs < size - 2; ) {
+      uint8_t buf[16];
+      int n = size - 2 - ofs;
+      if( n > sizeof(buf) ) n = sizeof(buf);
+      kv_read( kv, pos + ofs, buf, n );
+      crc = kv_crc16( crc, buf, n );
+      ofs += n;
+    }
+    uint8_t c[2];
+    kv_read( kv, pos + size - 2, c, 2 );
+    if( c[0] != (uint8_t)crc || c[1] != (uint8_t)(crc >> 8) ) break;
+
+    // update the index.
+    kv_read( kv, pos + 2, key, klen );
+    uint16_t hash = kv_hash( key, klen );
+    int i = kv_find( kv, key, klen, hash );
+
+    if( kv->index[i].pos ) {
+      kv->live_bytes -= kv_record_size_at( kv, kv->index[i].pos );
+      if( hdr[1] == KV_TOMBSTONE ) {
+	kv_index_remove( kv, i );
+      } else {
+	kv->index[i].pos = pos;
+	kv->live_bytes += size;
+      }
+    } else if( hdr[1] != KV_TOMBSTONE ) {
+      if( kv->n_keys >= EEPROM_KV_MAX_KEYS ) break;
+      kv->index[i].pos = pos;
+      kv->index[i].hash = hash;
+      kv->n_keys++;
+      kv->live_bytes += size;
+    }
+
+    pos += size;
+  }
+
+  kv->tail = pos;
+}
+
+
+//================================================================
+/*! compaction. copy the live records to the other bank.
+
+  @param  kv	pointer to EEPROM_KV
+  @param  key	the record to put instead of the old one, or NULL.
+  @return int	0 if success.
+  @note
+    The new record is written to the new bank with the others,
+    so the key has the old or the new value on a power loss.
+    The caller updates n_keys and live_bytes for the new record.
+*/
+static int kv_compact(EEPROM_KV *kv, const uint8_t *key, int klen,
+		      const uint8_t *value, int vlen)
+{
+  int dst_bank = kv->bank ^ 1;
+  int dst = kv_bank_address( kv, dst_bank );
+  uint16_t new_gen = kv->gen + 1;
+  uint8_t gen[2] = { new_gen, new_gen >> 8 };
+  int pos = KV_HEADER_SIZE;
+  int skip = key ? kv_find( kv, key, klen, kv_hash( key, klen ) ) : -1;
+  int i;
+
+  if( eeprom_flush( kv->eh ) != 0 ) goto ERROR;
+
+  for( i = 0; i < EEPROM_KV_INDEX_SIZE; i++ ) {
+    if( !kv->index[i].pos || i == skip ) continue;
+
+    int src = kv_bank_address( kv, kv->bank ) + kv->index[i].pos;
+    uint8_t buf[16];
+    eeprom_read( kv->eh, src, buf, 2 );
+    int size = kv_record_size( buf[0], buf[1] );
+
+    // copy, and recalculate the CRC for the new generation.
+    uint16_t crc = kv_crc16( 0xffff, gen, 2 );
+    int ofs;
+    for( ofs = 0; ofs < size - 2; ) {
+      int n = size - 2 - ofs;
+      if( n > sizeof(buf) ) n = sizeof(buf);
+      eeprom_read( kv->eh, src + ofs, buf, n );
+      if( eeprom_write( kv->eh, dst + pos + ofs, buf, n ) < 0 ) goto ERROR;
+      crc = kv_crc16( crc, buf, n );
+      ofs += n;
+    }
+    buf[0] = crc;
+    buf[1] = crc >> 8;
+    if( eeprom_write( kv->eh, dst + pos + size - 2, buf, 2 ) < 0 ) goto ERROR;
+
+    kv->index[i].pos = pos;
+    pos += size;
+  }
+
+  if( key ) {
+    if( kv_write_record( kv, dst_bank, new_gen, pos,
+			 key, klen, value, vlen ) != 0 ) goto ERROR;
+    kv->index[skip].pos = pos;
+    pos += kv_record_size( klen, vlen );
+  }
+
+  // end mark and the header.
+  uint8_t hdr[KV_HEADER_SIZE] = { 'K', 'V', new_gen, new_gen >> 8 };
+  if( pos < kv->bank_size ) {
+    if( eeprom_write( kv->eh, dst + pos, "", 1 ) < 0 ) goto ERROR;
+  }
+  if( eeprom_flush( kv->eh ) != 0 ) goto ERROR;
+  if( eeprom_write( kv->eh, dst, hdr, KV_HEADER_SIZE ) < 0 ) goto ERROR;
+  if( eeprom_flush( kv->eh ) != 0 ) goto ERROR;
+
+  kv->bank = dst_bank;
+  kv->gen = new_gen;
+  kv->tail = pos;
+  return 0;
+
+  // rebuild the index from the old bank.
+ ERROR:
+  kv_scan( kv );
+  return -1;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! open the key-value store. (scan and build the index)
+
+  @param  kv		pointer to EEPROM_KV
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address of the region. (row aligned)
+  @param  size		size of the region. (multiple of 2 rows, min 4 rows)
+  @return int		0 if success.
+  @note
+    Formats the region, if there is no valid bank.
+*/
+int eeprom_kv_open(EEPROM_KV *kv, EEPROM_HANDLE *eh, int address, int size)
+{
+  if( address < 0 || address % EEPROM_ROW_SIZE != 0 ) return -1;
+  if( size < EEPROM_ROW_SIZE * 4 || size % (EEPROM_ROW_SIZE * 2) != 0 ) return -1;
+  if( address + size > CYDEV_EE_SIZE ) return -1;
+
+  kv->eh = eh;
+  kv->address = address;
+  kv->bank_size = size / 2;
+
+  // select the active bank.
+  int valid[2];
+  uint16_t gen[2];
+  int i;
+  for( i = 0; i < 2; i++ ) {
+    uint8_t hdr[KV_HEADER_SIZE];
+    eeprom_read( eh, kv_bank_address(kv, i), hdr, KV_HEADER_SIZE );
+    valid[i] = (hdr[0] == 'K' && hdr[1] == 'V');
+    gen[i] = hdr[2] | hdr[3] << 8;
+  }
+
+  if( valid[0] && valid[1] ) {
+    kv->bank = ((int16_t)(gen[1] - gen[0]) > 0) ? 1 : 0;
+  } else if( valid[0] || valid[1] ) {
+    kv->bank = valid[1];
+  } else {
+    // format.
+    uint8_t hdr[KV_HEADER_SIZE + 1] = { 'K', 'V', 1, 0, 0 };
+    if( eeprom_write( eh, address, hdr, sizeof(hdr) ) < 0 ) return -1;
+    if( eeprom_flush( eh ) != 0 ) return -1;
+    kv->bank = 0;
+    gen[0] = 1;
+  }
+  kv->gen = gen[kv->bank];
+
+  kv_scan( kv );
+  return 0;
+}
+
+
+//================================================================
+/*! get the value.
+
+  @param  kv		pointer to EEPROM_KV
+  @param  key		pointer to the key.
+  @param  klen		length of the key.
+  @param  buf		pointer to buffer for the value.
+  @param  bufsize	size of buffer.
+  @return int		length of the value, or -1 if not found.
+*/
+int eeprom_kv_get(EEPROM_KV *kv, const void *key, int klen, void *buf, int bufsize)
+{
+  if( klen <= 0 || klen > EEPROM_KV_MAX_KEY_LEN ) return -1;
+
+  int i = kv_find( kv, key, klen, kv_hash( key, klen ) );
+  int pos = kv->index[i].pos;
+  if( !pos ) return -1;
+
+  uint8_t hdr[2];
+  kv_read( kv, pos, hdr, 2 );
+  int vlen = hdr[1];
+  kv_read( kv, pos + 2 + klen, buf, (vlen < bufsize) ? vlen : bufsize );
+
+  return vlen;
+}
+
+
+//================================================================
+/*! set the value.
+
+  @param  kv		pointer to EEPROM_KV
+  @param  key		pointer to the key.
+  @param  klen		length of the key. (1..255)
+  @param  value		pointer to the value.
+  @param  vlen		length of the value. (0..254)
+  @return int		0 if success, or -1 if error or no space.
+  @note
+    The record stays in the row cache until it is written back.
+*/
+int eeprom_kv_set(EEPROM_KV *kv, const void *key, int klen, const void *value, int vlen)
+{
+  if( klen <= 0 || klen > EEPROM_KV_MAX_KEY_LEN ) return -1;
+  if( vlen < 0 || vlen > EEPROM_KV_MAX_VALUE_LEN ) return -1;
+
+  uint16_t hash = kv_hash( key, klen );
+  int i = kv_find( kv, key, klen, hash );
+  int size = kv_record_size( klen, vlen );
+  int old_size = kv->index[i].pos ? kv_record_size_at( kv, kv->index[i].pos ) : 0;
+
+  if( !old_size && kv->n_keys >= EEPROM_KV_MAX_KEYS ) return -1;
+
+  if( kv->tail + size > kv->bank_size ) {
+    // compaction, with the new record instead of the old one.
+    // the old record stays valid until the new bank is active.
+    if( KV_HEADER_SIZE + kv->live_bytes - old_size + size > kv->bank_size ) {
+      return -1;
+    }
+    if( kv_compact( kv, key, klen, value, vlen ) != 0 ) return -1;
+
+  } else {
+    int pos = kv_append( kv, key, klen, value, vlen );
+    if( pos < 0 ) return -1;
+    kv->index[i].pos = pos;
+  }
+
+  if( !old_size ) {
+    kv->index[i].hash = hash;
+    kv->n_keys++;
+  }
+  kv->live_bytes += size - old_size;
+
+  return 0;
+}
+
+
+//================================================================
+/*! delete the key.
+
+  @param  kv		pointer to EEPROM_KV
+  @param  key		pointer to the key.
+  @param  klen		length of the key.
+  @return int		0 if success, or -1 if not found or error.
+*/
+int eeprom_kv_delete(EEPROM_KV *kv, const void *key, int klen)
+{
+  if( klen <= 0 || klen > EEPROM_KV_MAX_KEY_LEN ) return -1;
+
+  int i = kv_find( kv, key, klen, kv_hash( key, klen ) );
+  if( !kv->index[i].pos ) return -1;
+
+  kv->live_bytes -= kv_record_size_at( kv, kv->index[i].pos );
+  kv_index_remove( kv, i );
+
+  // tombstone. or the compaction drops the record.
+  if( kv_append( kv, key, klen, 0, KV_TOMBSTONE ) < 0 ) {
+    return eeprom_kv_compact( kv );
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! compaction. copy the live records to the other bank.
+
+  @param  kv		pointer to EEPROM_KV
+  @return int		0 if success.
+  @note
+    The header is written at last, so the old bank stays active
+    until the copy is complete.
+*/
+int eeprom_kv_compact(EEPROM_KV *kv)
+{
+  return kv_compact( kv, 0, 0, 0, 0 );
+}
+
+
+//================================================================
+/*! get the n-th key. (in the order of the index)
+
+  @param  kv		pointer to EEPROM_KV
+  @param  n		0 to n_keys-1.
+  @param  buf		pointer to buffer for the key.
+  @param  bufsize	size of buffer.
+  @return int		length of the key, or -1 if out of range.
+*/
+int eeprom_kv_key_at(EEPROM_KV *kv, int n, void *buf, int bufsize)
+{
+  int i;
+
+  for( i = 0; i < EEPROM_KV_INDEX_SIZE; i++ ) {
+    if( !kv->index[i].pos ) continue;
+    if( n-- != 0 ) continue;
+
+    uint8_t klen;
+    kv_read( kv, kv->index[i].pos, &klen, 1 );
+    kv_read( kv, kv->index[i].pos + 2, buf, (klen < bufsize) ? klen : bufsize );
+    return klen;
+  }
+
+  return -1;
+}
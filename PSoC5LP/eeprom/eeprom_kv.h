@@ -0,0 +1,99 @@
+/*! @file
+  @brief
+  Log-structured key-value store on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_EEPROM_KV_H_
+#define PSOC5_EEPROM_KV_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+#include "eeprom2.h"
+
+
+/***** Constant values ******************************************************/
+//! number of slots in the hash index. must be power of 2.
+#ifndef EEPROM_KV_INDEX_SIZE
+# define EEPROM_KV_INDEX_SIZE 64
+#endif
+
+//! maximum number of keys. (load factor 3/4)
+#define EEPROM_KV_MAX_KEYS (EEPROM_KV_INDEX_SIZE * 3 / 4)
+
+//! maximum length of the key and the value.
+#define EEPROM_KV_MAX_KEY_LEN 255
+#define EEPROM_KV_MAX_VALUE_LEN 254
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! a slot of the hash index.
+*/
+typedef struct EEPROM_KV_SLOT {
+  uint16_t pos;			// position of the record in the bank. 0 is empty.
+  uint16_t hash;
+
+} EEPROM_KV_SLOT;
+
+
+//================================================================
+/*! key-value store handle.
+*/
+typedef struct EEPROM_KV {
+  EEPROM_HANDLE *eh;
+  uint16_t address;		// address of the region. (bank 0)
+  uint16_t bank_size;		// size of a bank. (half of the region)
+  uint8_t bank;			// active bank.
+  uint16_t gen;			// generation of the active bank.
+  uint16_t tail;		// end of the log in the active bank.
+  uint16_t n_keys;
+  uint16_t live_bytes;		// size of the live records.
+
+  EEPROM_KV_SLOT index[EEPROM_KV_INDEX_SIZE];
+
+} EEPROM_KV;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int eeprom_kv_open(EEPROM_KV *kv, EEPROM_HANDLE *eh, int address, int size);
+int eeprom_kv_get(EEPROM_KV *kv, const void *key, int klen, void *buf, int bufsize);
+int eeprom_kv_set(EEPROM_KV *kv, const void *key, int klen, const void *value, int vlen);
+int eeprom_kv_delete(EEPROM_KV *kv, const void *key, int klen);
+int eeprom_kv_compact(EEPROM_KV *kv);
+int eeprom_kv_key_at(EEPROM_KV *kv, int n, void *buf, int bufsize);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! free bytes in the active bank.
+
+  @param  kv		pointer to EEPROM_KV
+  @return int		bytes.
+*/
+static inline int eeprom_kv_free(const EEPROM_KV *kv)
+{
+  return kv->bank_size - kv->tail - 1;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
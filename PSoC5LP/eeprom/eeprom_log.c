@@ -0,0 +1,318 @@
+/*! @file
+  @brief
+  Circular record log on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The region is a ring of rows. Each row holds fixed size records
+  and has a sequence number, so the head is found by binary search.
+  Records are batched in RAM and written in row units.
+
+  row:    seq_L seq_M seq_H n | record | record | ... | crc
+          seq is the 24bit sequence number of the row.
+          n is the number of records in the row. (1..rec_per_row)
+          crc is CRC-8 (poly 0x07, init 0xff) over the first 15 bytes.
+  record: sequence number is seq * rec_per_row + index in the row.
+          It wraps around at 2^24 rows.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "eeprom_log.h"
+
+/***** Constant values ******************************************************/
+#define LOG_SEQ_MASK	0xffffffUL
+#define LOG_CRC_POS	(EEPROM_ROW_SIZE - 1)
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! CRC-8
+*/
+static uint8_t log_crc8(const uint8_t *p, int n)
+{
+  uint8_t crc = 0xff;
+
+  while( --n >= 0 ) {
+    crc ^= *p++;
+    int i;
+    for( i = 0; i < 8; i++ ) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+//================================================================
+/*! read the row in the region and check it.
+
+  @return	sequence number of the row, or -1 if not valid.
+*/
+static int32_t log_read_row(EEPROM_LOG *lg, int idx, uint8_t *buf)
+{
+  eeprom_read( lg->eh, (lg->first_row + idx) * EEPROM_ROW_SIZE,
+	       buf, EEPROM_ROW_SIZE );
+
+  if( buf[3] == 0 || buf[3] > lg->rec_per_row ) return -1;
+  if( log_crc8( buf, LOG_CRC_POS ) != buf[LOG_CRC_POS] ) return -1;
+
+  return buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16;
+}
+
+
+//================================================================
+/*! sequence number of the row, or -1 if not valid.
+*/
+static inline int32_t log_row_seq(EEPROM_LOG *lg, int idx)
+{
+  uint8_t buf[EEPROM_ROW_SIZE];
+  return log_read_row( lg, idx, buf );
+}
+
+
+//================================================================
+/*! find the last written row.
+
+  @return	index of the row, or -1 if the log is empty.
+*/
+static int log_find_last(EEPROM_LOG *lg)
+{
+  int32_t seq0 = log_row_seq( lg, 0 );
+
+  if( seq0 >= 0 ) {
+    // rows 0..h have the sequence numbers seq0..seq0+h.
+    int lo = 0, hi = lg->n_rows;
+    while( hi - lo > 1 ) {
+      int mid = (lo + hi) / 2;
+      int32_t seq = log_row_seq( lg, mid );
+      if( seq >= 0 && ((seq - seq0) & LOG_SEQ_MASK) == (uint32_t)mid ) {
+	lo = mid;
+      } else {
+	hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // the row 0 is broken, or the log is empty. scan all.
+  int last = -1;
+  int32_t last_seq = 0;
+  int i;
+  for( i = 1; i < lg->n_rows; i++ ) {
+    int32_t seq = log_row_seq( lg, i );
+    if( seq < 0 ) continue;
+    if( last < 0 || ((seq - last_seq) & LOG_SEQ_MASK) < LOG_SEQ_MASK / 2 ) {
+      last = i;
+      last_seq = seq;
+    }
+  }
+  return last;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! open the log.
+
+  @param  lg		pointer to EEPROM_LOG
+  @param  eh		pointer to EEPROM_HANDLE
+  @param  address	address of the region. (row aligned)
+  @param  size		size of the region. (multiple of the row size)
+  @param  rec_size	size of a record.
+  @return int		0 is no error.
+*/
+int eeprom_log_open(EEPROM_LOG *lg, EEPROM_HANDLE *eh, int address, int size, int rec_size)
+{
+  if( address < 0 || address % EEPROM_ROW_SIZE != 0 ||
+      size < EEPROM_ROW_SIZE * 2 || size % EEPROM_ROW_SIZE != 0 ||
+      address + size > CYDEV_EE_SIZE ) return -1;
+  if( rec_size < 1 || rec_size > EEPROM_LOG_ROW_PAYLOAD ) return -1;
+
+  lg->eh = eh;
+  lg->first_row = address / EEPROM_ROW_SIZE;
+  lg->n_rows = size / EEPROM_ROW_SIZE;
+  lg->rec_size = rec_size;
+  lg->rec_per_row = EEPROM_LOG_ROW_PAYLOAD / rec_size;
+  lg->flush_every = lg->rec_per_row;
+  lg->n_unflushed = 0;
+  memset( lg->row, 0, EEPROM_ROW_SIZE );
+
+  int last = log_find_last( lg );
+  if( last < 0 ) {
+    lg->head = 0;
+    lg->seq = 0;
+    lg->n_recs = 0;
+    lg->n_rows_used = 1;
+    return 0;
+  }
+
+  // continue the last row if it is not full.
+  int32_t seq = log_read_row( lg, last, lg->row );
+  if( lg->row[3] < lg->rec_per_row ) {
+    lg->head = last;
+    lg->seq = seq;
+    lg->n_recs = lg->row[3];
+  } else {
+    lg->head = (last + 1) % lg->n_rows;
+    lg->seq = (seq + 1) & LOG_SEQ_MASK;
+    lg->n_recs = 0;
+    memset( lg->row, 0, EEPROM_ROW_SIZE );
+  }
+
+  // wrapped around?
+  int32_t oldest = log_row_seq( lg, (lg->head + 1) % lg->n_rows );
+  if( oldest >= 0 &&
+      (uint32_t)oldest == ((lg->seq - (lg->n_rows - 1)) & LOG_SEQ_MASK) ) {
+    lg->n_rows_used = lg->n_rows;
+  } else {
+    lg->n_rows_used = lg->head + 1;
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! append a record.
+
+  @param  lg		pointer to EEPROM_LOG
+  @param  data		pointer to the record.
+  @param  size		size of the data. (padded with 0 to the record size)
+  @return int32_t	sequence number of the record, or -1 if error.
+  @note
+    The record is queued in RAM, even if the commit fails.
+    The commit is retried by the next append or eeprom_log_commit().
+*/
+int32_t eeprom_log_append(EEPROM_LOG *lg, const void *data, int size)
+{
+  if( size < 0 || size > lg->rec_size ) return -1;
+
+  // the last commit of the full row was failed.
+  if( lg->n_recs >= lg->rec_per_row && eeprom_log_commit( lg ) != 0 ) {
+    return -1;
+  }
+
+  int32_t rec_seq = eeprom_log_next_seq( lg );
+  uint8_t *p = lg->row + EEPROM_LOG_ROW_HEADER + lg->n_recs * lg->rec_size;
+  memcpy( p, data, size );
+  memset( p + size, 0, lg->rec_size - size );
+  lg->n_recs++;
+  lg->n_unflushed++;
+
+  if( lg->n_recs >= lg->rec_per_row || lg->n_unflushed >= lg->flush_every ) {
+    // if failed, the record stays in RAM and is committed with the next.
+    eeprom_log_commit( lg );
+  }
+
+  return rec_seq;
+}
+
+
+//================================================================
+/*! commit the records in RAM to the device.
+
+  @param  lg		pointer to EEPROM_LOG
+  @return int		0 is no error.
+*/
+int eeprom_log_commit(EEPROM_LOG *lg)
+{
+  EEPROM_HANDLE *eh = lg->eh;
+  int row = lg->first_row + lg->head;
+  int ret = -1;
+
+  if( lg->n_unflushed == 0 ) return 0;
+
+  lg->row[0] = lg->seq;
+  lg->row[1] = lg->seq >> 8;
+  lg->row[2] = lg->seq >> 16;
+  lg->row[3] = lg->n_recs;
+  lg->row[LOG_CRC_POS] = log_crc8( lg->row, LOG_CRC_POS );
+
+  // program in background, if eeprom_tick() and eeprom_idle() run.
+  if( eh->flag_tick && eeprom_pending( eh ) < EEPROM_QUEUE_SIZE ) {
+    ret = eeprom_write_async( eh, row * EEPROM_ROW_SIZE,
+			      lg->row, EEPROM_ROW_SIZE );
+  }
+  if( ret < 0 && eeprom_write_row( eh, row, lg->row ) != 0 ) return -1;
+  lg->n_unflushed = 0;
+
+  // advance to the next row.
+  if( lg->n_recs >= lg->rec_per_row ) {
+    lg->head = (lg->head + 1) % lg->n_rows;
+    lg->seq = (lg->seq + 1) & LOG_SEQ_MASK;
+    lg->n_recs = 0;
+    if( lg->n_rows_used < lg->n_rows ) lg->n_rows_used++;
+    memset( lg->row, 0, EEPROM_ROW_SIZE );
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*! read a record.
+
+  @param  lg		pointer to EEPROM_LOG
+  @param  rec_seq	sequence number of the record.
+  @param  buf		buffer. (record size)
+  @return int		size of the record, or -1 if not in the log.
+*/
+int eeprom_log_read(EEPROM_LOG *lg, int32_t rec_seq, void *buf)
+{
+  if( rec_seq < eeprom_log_first_seq( lg ) ||
+      rec_seq >= eeprom_log_next_seq( lg ) ) return -1;
+
+  uint32_t seq = rec_seq / lg->rec_per_row;
+  int n = rec_seq % lg->rec_per_row;
+  const uint8_t *p;
+  uint8_t row[EEPROM_ROW_SIZE];
+
+  if( seq == lg->seq ) {
+    p = lg->row;
+  } else {
+    int back = (lg->seq - seq) & LOG_SEQ_MASK;
+    int idx = (lg->head + lg->n_rows - back) % lg->n_rows;
+    if( (uint32_t)log_read_row( lg, idx, row ) != seq ) return -1;
+    if( n >= row[3] ) return -1;
+    p = row;
+  }
+
+  memcpy( buf, p + EEPROM_LOG_ROW_HEADER + n * lg->rec_size, lg->rec_size );
+  return lg->rec_size;
+}
+
+
+//================================================================
+/*! sequence number of the oldest record.
+
+  @param  lg		pointer to EEPROM_LOG
+  @return int32_t	sequence number.
+*/
+int32_t eeprom_log_first_seq(const EEPROM_LOG *lg)
+{
+  uint32_t seq = (lg->seq - (lg->n_rows_used - 1)) & LOG_SEQ_MASK;
+  if( seq > lg->seq ) return 0;		// wrapped around the 24bit.
+
+  return (int32_t)seq * lg->rec_per_row;
+}
@@ -0,0 +1,86 @@
+/*! @file
+  @brief
+  Circular record log on the EEPROM for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_EEPROM_LOG_H_
+#define PSOC5_EEPROM_LOG_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+#include "eeprom2.h"
+
+
+/***** Constant values ******************************************************/
+//! size of the row header. (seq 3 bytes, number of records 1 byte)
+#define EEPROM_LOG_ROW_HEADER 4
+
+//! payload size in a row. (the last byte is CRC-8)
+#define EEPROM_LOG_ROW_PAYLOAD (EEPROM_ROW_SIZE - EEPROM_LOG_ROW_HEADER - 1)
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! log handle.
+*/
+typedef struct EEPROM_LOG {
+  EEPROM_HANDLE *eh;
+  uint16_t first_row;		// row number of the region.
+  uint16_t n_rows;		// number of rows in the region.
+  uint8_t rec_size;		// size of a record.
+  uint8_t rec_per_row;		// records in a row.
+  uint8_t flush_every;		// commit after this number of appends.
+
+  // current row. (the head, in RAM)
+  uint16_t head;		// index in the region.
+  uint32_t seq;			// sequence number of the row. (24bit)
+  uint8_t n_recs;		// records in the row.
+  uint8_t n_unflushed;		// records not yet committed.
+  uint16_t n_rows_used;		// rows in the log, including the head.
+  uint8_t row[EEPROM_ROW_SIZE];
+
+} EEPROM_LOG;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int eeprom_log_open(EEPROM_LOG *lg, EEPROM_HANDLE *eh, int address, int size, int rec_size);
+int32_t eeprom_log_append(EEPROM_LOG *lg, const void *data, int size);
+int eeprom_log_commit(EEPROM_LOG *lg);
+int eeprom_log_read(EEPROM_LOG *lg, int32_t rec_seq, void *buf);
+int32_t eeprom_log_first_seq(const EEPROM_LOG *lg);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! sequence number of the next record.
+
+  @param  lg		pointer to EEPROM_LOG
+  @return int32_t	sequence number.
+*/
+static inline int32_t eeprom_log_next_seq(const EEPROM_LOG *lg)
+{
+  return (int32_t)lg->seq * lg->rec_per_row + lg->n_recs;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,499 @@
+/*! @file
+  @brief
+  GPIO class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+   1. Copy c_gpio.h, c_gpio.c, gpio2.h and gpio2.c files,
+      and task2.h in the common directory to project folder.
+   2. Add c_gpio.c and gpio2.c files to PSoC Creator.
+   3. Add below to main.c.
+      #include "c_gpio.h"
+      mrbc_init_class_gpio(0);	// needs to be after mrbc_init()
+
+  (for the pin change events)
+   4. Place the input pins, and set "Interrupt" to any edge in the
+      configure dialog, so the irq terminal appears.
+   5. Place "System > Interrupt" device, and connect the irq terminals.
+      (Type: RISING_EDGE)
+   6. Change the name to "isr_GPIO".
+   7. Call mrbc_gpio_tick() every 1ms for the timestamp.
+      (e.g. in the same timer ISR as mrbc_tick)
+
+
+  (on Ruby)
+    # a pin. (port, pin)
+    led = GPIO.new( 2, 1 )		# P2[1]
+    led.setmode( GPIO::OUT )
+    led.write( 1 )
+    sw = GPIO.new( 2, 2, GPIO::PULL_UP )
+    v = sw.read()			# => 0 or 1
+
+    # bits of a port. (port, mask)
+    bus = GPIO::Port.new( 0 )		# P0[7:0]
+    bus.setmode( GPIO::OUT )
+    bus.write( 0x55 )			# all bits in use.
+    bus.write( 0x0f, 0x05 )		# (mask, value)
+    v = bus.read()
+
+    # pin change events. (edge, debounce ms)
+    sw.irq( GPIO::FALLING, 20 )
+    GPIO.wait_event			# sleep until an event.
+    GPIO.events			# => [[port, pin, edge, timestamp], ...]
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <project.h>	// auto generated by PSoC Creator.
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mrubyc.h"
+#include "gpio2.h"
+#include "task2.h"
+
+
+static GPIO_EVENTS gpio_ev;
+static mrbc_tcb *volatile gpio_waiting_tcb;	// task waiting for an event.
+
+
+//================================================================
+/*! event callback. (called in the ISR)
+*/
+static void gpio_event_callback(GPIO_EVENTS *ev)
+{
+  task_wakeup( &gpio_waiting_tcb );
+}
+
+
+#if defined(isr_GPIO__INTC_NUMBER)
+//================================================================
+/*! interrupt handler of the pins.
+*/
+static CY_ISR(gpio_isr)
+{
+  gpio_irq_isr( &gpio_ev );
+}
+#endif
+
+
+//================================================================
+/*! get the drive mode from the argument.
+
+  @return	PIN_DM_*, or -1 if error.
+*/
+static int gpio_mode_arg(mrbc_value *v)
+{
+  if( mrbc_type(*v) != MRBC_TT_FIXNUM ) return -1;
+
+  int mode = mrbc_fixnum(*v);
+  if( mode & ~CY_PINS_PC_DRIVE_MODE_MASK ) return -1;
+
+  return mode;
+}
+
+
+
+//================================================================
+/*! constructor
+
+  (mruby usage)
+  gpio = GPIO.new( port, pin )
+  gpio = GPIO.new( port, pin, mode )	# mode: GPIO::IN, OUT, ...
+
+  The drive mode is not changed unless mode is given.
+*/
+static void c_gpio_new(struct VM *vm, mrb_value v[], int argc)
+{
+  int mode = -1;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( argc >= 3 && (mode = gpio_mode_arg( &v[3] )) < 0 ) goto ERROR_PARAM;
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(GPIO_PIN));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  GPIO_PIN *gp = (GPIO_PIN *)ret.instance->data;
+  if( gpio_pin_init( gp, mrbc_fixnum(v[1]), mrbc_fixnum(v[2]) ) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+  if( mode >= 0 ) gpio_pin_set_mode( gp, mode );
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("GPIO: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! set the drive mode
+
+  (mruby usage)
+  gpio.setmode( GPIO::OUT )
+*/
+static void c_gpio_setmode(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PIN *gp = (GPIO_PIN *)v->instance->data;
+  int mode;
+
+  if( argc < 1 || (mode = gpio_mode_arg( &v[1] )) < 0 ) {
+    console_printf("GPIO: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  gpio_pin_set_mode( gp, mode );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! write
+
+  (mruby usage)
+  gpio.write( 1 )	# 0 or 1
+*/
+static void c_gpio_write(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PIN *gp = (GPIO_PIN *)v->instance->data;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) {
+    console_printf("GPIO: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  gpio_pin_write( gp, mrbc_fixnum(v[1]) );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! read
+
+  (mruby usage)
+  v = gpio.read()	# => 0 or 1
+*/
+static void c_gpio_read(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PIN *gp = (GPIO_PIN *)v->instance->data;
+  SET_INT_RETURN( gpio_pin_read( gp ) );
+}
+
+
+//================================================================
+/*! enable or disable the pin change event
+
+  (mruby usage)
+  gpio.irq( GPIO::RISING )		# GPIO::RISING, FALLING or BOTH
+  gpio.irq( GPIO::BOTH, 20 )		# ignore edges in 20ms after an event.
+  gpio.irq( GPIO::EDGE_NONE )		# disable.
+
+  The events are queued in the ISR with the timestamp.
+*/
+static void c_gpio_irq(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PIN *gp = (GPIO_PIN *)v->instance->data;
+  int debounce = 0;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    debounce = mrbc_fixnum(v[2]);
+  }
+
+  if( gpio_irq_enable( &gpio_ev, gp->port, gp->pin,
+		       mrbc_fixnum(v[1]), debounce ) != 0 ) goto ERROR_PARAM;
+  SET_NIL_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("GPIO: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! take the pin change events
+
+  (mruby usage)
+  a = GPIO.events	# => [[port, pin, edge, timestamp], ...]
+
+  edge is GPIO::RISING or FALLING. timestamp is in ms.
+*/
+static void c_gpio_events(struct VM *vm, mrb_value v[], int argc)
+{
+  int n = gpio_event_available( &gpio_ev );
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN_NIL;	// ENOMEM
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    GPIO_EVENT e;
+    if( !gpio_event_take( &gpio_ev, &e ) ) break;
+
+    mrbc_value ev = mrbc_array_new( vm, 4 );
+    mrbc_value val = mrbc_fixnum_value( e.port );
+    mrbc_array_set( &ev, 0, &val );
+    val = mrbc_fixnum_value( e.pin );
+    mrbc_array_set( &ev, 1, &val );
+    val = mrbc_fixnum_value( e.edge );
+    mrbc_array_set( &ev, 2, &val );
+    val = mrbc_fixnum_value( e.timestamp );
+    mrbc_array_set( &ev, 3, &val );
+    mrbc_array_set( &ret, i, &ev );
+  }
+  SET_RETURN( ret );
+  return;
+
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! sleep until a pin change event
+
+  (mruby usage)
+  GPIO.wait_event
+  a = GPIO.events
+
+  Other tasks run while waiting. Only one task can wait.
+*/
+static void c_gpio_wait_event(struct VM *vm, mrb_value v[], int argc)
+{
+  mrbc_tcb *tcb = VM2TCB(vm);
+
+  SET_NIL_RETURN();
+  if( gpio_event_available( &gpio_ev ) ) return;
+
+  // the task sleeps after the method returns.
+  mrbc_suspend_task( tcb );
+
+  uint8 interrupts = CyEnterCriticalSection();
+  if( gpio_event_available( &gpio_ev ) ) {
+    mrbc_resume_task( tcb );
+  } else {
+    gpio_waiting_tcb = tcb;
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! number of events dropped by the queue full
+
+  (mruby usage)
+  GPIO.event_overflow
+*/
+static void c_gpio_event_overflow(struct VM *vm, mrb_value v[], int argc)
+{
+  SET_INT_RETURN( gpio_ev.overflow );
+}
+
+
+
+
+//================================================================
+/*! GPIO::Port constructor
+
+  (mruby usage)
+  port = GPIO::Port.new( port )		# all bits.
+  port = GPIO::Port.new( port, mask )	# bits in use.
+*/
+static void c_gpio_port_new(struct VM *vm, mrb_value v[], int argc)
+{
+  int mask = 0xff;
+
+  if( argc < 1 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    mask = mrbc_fixnum(v[2]);
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(GPIO_PORT));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  GPIO_PORT *pt = (GPIO_PORT *)ret.instance->data;
+  if( gpio_port_init( pt, mrbc_fixnum(v[1]), mask ) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("GPIO::Port: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! GPIO::Port set the drive mode
+
+  (mruby usage)
+  port.setmode( GPIO::OUT )		# all bits in use.
+  port.setmode( GPIO::OUT, mask )
+*/
+static void c_gpio_port_setmode(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PORT *pt = (GPIO_PORT *)v->instance->data;
+  int mode;
+  int mask = 0xff;
+
+  if( argc < 1 || (mode = gpio_mode_arg( &v[1] )) < 0 ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    mask = mrbc_fixnum(v[2]);
+  }
+
+  gpio_port_set_mode( pt, mask, mode );
+  SET_NIL_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("GPIO::Port: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! GPIO::Port write
+
+  (mruby usage)
+  port.write( value )		# all bits in use.
+  port.write( mask, value )	# only the bits in mask.
+
+  The bits are changed at once by a store to the port data register.
+*/
+static void c_gpio_port_write(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PORT *pt = (GPIO_PORT *)v->instance->data;
+
+  if( argc == 1 && mrbc_type(v[1]) == MRBC_TT_FIXNUM ) {
+    gpio_port_write( pt, 0xff, mrbc_fixnum(v[1]) );
+
+  } else if( argc >= 2 && mrbc_type(v[1]) == MRBC_TT_FIXNUM &&
+	     mrbc_type(v[2]) == MRBC_TT_FIXNUM ) {
+    gpio_port_write( pt, mrbc_fixnum(v[1]), mrbc_fixnum(v[2]) );
+
+  } else {
+    console_printf("GPIO::Port: parameter error.\n");
+  }
+
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! GPIO::Port read the pin state
+
+  (mruby usage)
+  v = port.read()	# => bits in use.
+*/
+static void c_gpio_port_read(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PORT *pt = (GPIO_PORT *)v->instance->data;
+  SET_INT_RETURN( gpio_port_read( pt ) );
+}
+
+
+//================================================================
+/*! GPIO::Port read the output data
+
+  (mruby usage)
+  v = port.output()	# => last written bits.
+*/
+static void c_gpio_port_output(struct VM *vm, mrb_value v[], int argc)
+{
+  GPIO_PORT *pt = (GPIO_PORT *)v->instance->data;
+  SET_INT_RETURN( gpio_port_output( pt ) );
+}
+
+
+
+//================================================================
+/*! timer tick for the timestamp of the events.
+
+  Call this every 1ms from the periodic timer ISR. (e.g. with mrbc_tick)
+*/
+void mrbc_gpio_tick(void)
+{
+  gpio_events_tick( &gpio_ev );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_gpio(struct VM *vm)
+{
+  gpio_ev.callback = gpio_event_callback;
+  gpio_irq_init( &gpio_ev );
+#if defined(isr_GPIO__INTC_NUMBER)
+  isr_GPIO_ClearPending();
+  isr_GPIO_StartEx( gpio_isr );
+#endif
+
+  mrb_class *gpio;
+  gpio = mrbc_define_class(vm, "GPIO",		mrbc_class_object);
+
+  mrbc_define_method(vm, gpio, "new",		c_gpio_new);
+  mrbc_define_method(vm, gpio, "setmode",	c_gpio_setmode);
+  mrbc_define_method(vm, gpio, "write",		c_gpio_write);
+  mrbc_define_method(vm, gpio, "read",		c_gpio_read);
+  mrbc_define_method(vm, gpio, "irq",		c_gpio_irq);
+  mrbc_define_method(vm, gpio, "events",	c_gpio_events);
+  mrbc_define_method(vm, gpio, "wait_event",	c_gpio_wait_event);
+  mrbc_define_method(vm, gpio, "event_overflow", c_gpio_event_overflow);
+
+  // drive mode and edge constants.
+  static const struct {
+    const char *name;
+    int value;
+  } gpio_mode_const[] = {
+    { "IN",		PIN_DM_DIG_HIZ },
+    { "OUT",		PIN_DM_STRONG },
+    { "PULL_UP",	PIN_DM_RES_UP },
+    { "PULL_DOWN",	PIN_DM_RES_DWN },
+    { "OPEN_DRAIN",	PIN_DM_OD_LO },
+    { "ANALOG",		PIN_DM_ALG_HIZ },
+    { "EDGE_NONE",	GPIO_EDGE_NONE },
+    { "RISING",		GPIO_EDGE_RISING },
+    { "FALLING",	GPIO_EDGE_FALLING },
+    { "BOTH",		GPIO_EDGE_BOTH },
+  };
+  int i;
+  for( i = 0; i < sizeof(gpio_mode_const) / sizeof(gpio_mode_const[0]); i++ ) {
+    mrbc_value val = mrbc_fixnum_value( gpio_mode_const[i].value );
+    mrbc_set_class_const( gpio, str_to_symid(gpio_mode_const[i].name), &val );
+  }
+
+  // GPIO::Port
+  mrb_class *port;
+  port = mrbc_define_class(vm, "GPIO_Port",	mrbc_class_object);
+  mrbc_value val = {.tt = MRBC_TT_CLASS, .cls = port};
+  mrbc_set_class_const( gpio, str_to_symid("Port"), &val );
+
+  mrbc_define_method(vm, port, "new",		c_gpio_port_new);
+  mrbc_define_method(vm, port, "setmode",	c_gpio_port_setmode);
+  mrbc_define_method(vm, port, "write",		c_gpio_port_write);
+  mrbc_define_method(vm, port, "read",		c_gpio_port_read);
+  mrbc_define_method(vm, port, "output",	c_gpio_port_output);
+}
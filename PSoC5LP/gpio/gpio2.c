@@ -0,0 +1,331 @@
+/*! @file
+  @brief
+  GPIO convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The pins are accessed directly by the registers, so they need not be
+  placed in PSoC Creator. The pins placed with a hardware connection
+  (bypass) or used by the other components can't be controlled.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "gpio2.h"
+
+/***** Constant values ******************************************************/
+#define GPIO_EVENT_QUEUE_MASK (GPIO_EVENT_QUEUE_SIZE - 1)
+
+#if (GPIO_EVENT_QUEUE_SIZE & GPIO_EVENT_QUEUE_MASK) != 0 || GPIO_EVENT_QUEUE_SIZE > 128
+#error "GPIO_EVENT_QUEUE_SIZE must be power of 2, and 128 or less."
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! valid port number?
+
+  PSoC5LP has port 0 to 6, 12 (SIO) and 15.
+*/
+static int gpio_valid_port(int port)
+{
+  return (port >= 0 && port <= 6) || port == 12 || port == 15;
+}
+
+
+//================================================================
+/*! PICU interrupt type register of the pin.
+*/
+static inline volatile uint8_t *gpio_picu_inttype(int port, int pin)
+{
+  return (volatile uint8_t *)(CYREG_PICU0_INTTYPE0 +
+			      port * GPIO_PICU_INTTYPE_STRIDE + pin);
+}
+
+
+//================================================================
+/*! PICU interrupt status register of the port. (cleared by read)
+*/
+static inline volatile uint8_t *gpio_picu_intstat(int port)
+{
+  return (volatile uint8_t *)(CYREG_PICU0_INTSTAT +
+			      port * GPIO_PICU_INTSTAT_STRIDE);
+}
+
+
+//================================================================
+/*! ports with any pin of the interrupt type set.
+
+  @return	bit n is port n.
+*/
+static uint16_t gpio_irq_port_mask(void)
+{
+  uint16_t mask = 0;
+  int port, pin;
+
+  for( port = 0; port < 16; port++ ) {
+    if( !gpio_valid_port(port) ) continue;
+    for( pin = 0; pin < 8; pin++ ) {
+      if( *gpio_picu_inttype( port, pin ) != GPIO_EDGE_NONE ) {
+	mask |= (1 << port);
+	break;
+      }
+    }
+  }
+
+  return mask;
+}
+
+
+//================================================================
+/*! read and clear the status of the ports, and queue the events.
+
+  @param  ev		pointer to GPIO_EVENTS
+  @param  port_mask	ports to read. bit n is port n.
+  @return int		number of the queued events.
+  @note
+    The status is cleared by read, and the irq is asserted until then.
+    So all ports in port_mask are read, even without registered pins.
+*/
+static int gpio_irq_scan(GPIO_EVENTS *ev, uint16_t port_mask)
+{
+  uint8_t stat[16];
+  int n_events = 0;
+  int i;
+
+  for( i = 0; i < 16; i++ ) {
+    stat[i] = (port_mask & (1 << i)) ? *gpio_picu_intstat( i ) : 0;
+  }
+
+  uint32_t now = GPIO_EVENT_TIMESTAMP(ev);
+
+  for( i = 0; i < ev->n_pins; i++ ) {
+    GPIO_IRQ_PIN *ip = &ev->pins[i];
+
+    if( !(stat[ip->port] & (1 << ip->pin)) ) continue;
+
+    // debounce.
+    if( now - ip->last < ip->debounce ) continue;
+    ip->last = now;
+
+    uint8_t wr = ev->wr;
+    if( (uint8_t)(wr - ev->rd) >= GPIO_EVENT_QUEUE_SIZE ) {
+      ev->overflow++;
+      continue;
+    }
+
+    GPIO_EVENT *e = &ev->queue[wr & GPIO_EVENT_QUEUE_MASK];
+    e->timestamp = now;
+    e->port = ip->port;
+    e->pin = ip->pin;
+    if( ip->edge == GPIO_EDGE_BOTH ) {
+      volatile uint8_t *ps = (volatile uint8_t *)(CYREG_PRT0_PS +
+						 ip->port * GPIO_PRT_STRIDE);
+      e->edge = (*ps & (1 << ip->pin)) ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+    } else {
+      e->edge = ip->edge;
+    }
+    ev->wr = wr + 1;
+    n_events++;
+  }
+
+  return n_events;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize the pin handle.
+
+  @param  gp		pointer to GPIO_PIN
+  @param  port		port number.
+  @param  pin		pin number. (0..7)
+  @return int		0 is no error.
+*/
+int gpio_pin_init(GPIO_PIN *gp, int port, int pin)
+{
+  if( !gpio_valid_port(port) || pin < 0 || pin > 7 ) return -1;
+
+  gp->pc = (volatile uint8_t *)(CYREG_PRT0_PC0 + port * GPIO_PC_STRIDE + pin);
+  gp->port = port;
+  gp->pin = pin;
+
+  return 0;
+}
+
+
+//================================================================
+/*! initialize the port handle.
+
+  @param  pt		pointer to GPIO_PORT
+  @param  port		port number.
+  @param  mask		bits in use.
+  @return int		0 is no error.
+*/
+int gpio_port_init(GPIO_PORT *pt, int port, int mask)
+{
+  if( !gpio_valid_port(port) || mask <= 0 || mask > 0xff ) return -1;
+
+  pt->dr = (volatile uint8_t *)(CYREG_PRT0_DR + port * GPIO_PRT_STRIDE);
+  pt->port = port;
+  pt->mask = mask;
+
+  return 0;
+}
+
+
+//================================================================
+/*! set the drive mode of the bits.
+
+  @param  pt		pointer to GPIO_PORT
+  @param  mask		bits to set. (limited to the bits in use)
+  @param  mode		PIN_DM_*
+
+  The drive mode is 3 bit planes (DM0..DM2) in the port registers.
+*/
+void gpio_port_set_mode(GPIO_PORT *pt, int mask, int mode)
+{
+  int dm = (mode & CY_PINS_PC_DRIVE_MODE_MASK) >> CY_PINS_PC_DRIVE_MODE_SHIFT;
+  static const uint8_t dm_reg[3] = { GPIO_PRT_DM0, GPIO_PRT_DM1, GPIO_PRT_DM2 };
+  int i;
+
+  mask &= pt->mask;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  for( i = 0; i < 3; i++ ) {
+    if( dm & (1 << i) ) {
+      pt->dr[dm_reg[i]] |= mask;
+    } else {
+      pt->dr[dm_reg[i]] &= ~mask;
+    }
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! initialize the pin interrupts. clear the stale status.
+
+  @param  ev		pointer to GPIO_EVENTS
+
+  Call this before the ISR is started.
+*/
+void gpio_irq_init(GPIO_EVENTS *ev)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+  ev->port_mask = gpio_irq_port_mask();
+  gpio_irq_scan( ev, ev->port_mask );
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! enable or disable the interrupt of the pin.
+
+  @param  ev		pointer to GPIO_EVENTS
+  @param  port		port number.
+  @param  pin		pin number.
+  @param  edge		GPIO_EDGE_*. GPIO_EDGE_NONE disables.
+  @param  debounce	ignore the edges in this period after an event.
+  @return int		0 is no error.
+*/
+int gpio_irq_enable(GPIO_EVENTS *ev, int port, int pin, int edge, int debounce)
+{
+  int i;
+
+  if( !gpio_valid_port(port) || pin < 0 || pin > 7 ) return -1;
+  if( edge < GPIO_EDGE_NONE || edge > GPIO_EDGE_BOTH ) return -1;
+  if( debounce < 0 || debounce > 0xffff ) return -1;
+
+  int ret = 0;
+  uint8 interrupts = CyEnterCriticalSection();
+  for( i = 0; i < ev->n_pins; i++ ) {
+    if( ev->pins[i].port == port && ev->pins[i].pin == pin ) break;
+  }
+
+  // take the pending status of the port before the change,
+  // so a stale status doesn't make an event or keep the irq asserted.
+  if( edge == GPIO_EDGE_NONE ) *gpio_picu_inttype( port, pin ) = GPIO_EDGE_NONE;
+  int n_events = gpio_irq_scan( ev, ev->port_mask | (1 << port) );
+
+  if( edge == GPIO_EDGE_NONE ) {
+    if( i < ev->n_pins ) ev->pins[i] = ev->pins[--ev->n_pins];
+    goto DONE;
+  }
+
+  if( i == ev->n_pins ) {
+    if( ev->n_pins >= GPIO_MAX_IRQ_PINS ) {
+      ret = -1;
+      goto DONE;
+    }
+    ev->n_pins++;
+  }
+
+  GPIO_IRQ_PIN *ip = &ev->pins[i];
+  ip->port = port;
+  ip->pin = pin;
+  ip->edge = edge;
+  ip->debounce = debounce;
+  ip->last = GPIO_EVENT_TIMESTAMP(ev) - debounce;
+  *gpio_picu_inttype( port, pin ) = edge;
+
+ DONE:
+  ev->port_mask = gpio_irq_port_mask();
+  CyExitCriticalSection( interrupts );
+
+  if( n_events && ev->callback ) ev->callback( ev );
+  return ret;
+}
+
+
+//================================================================
+/*! interrupt handler of the pins.
+
+  @param  ev		pointer to GPIO_EVENTS
+
+  Call this from the ISR connected to the irq of the pins.
+*/
+void gpio_irq_isr(GPIO_EVENTS *ev)
+{
+  int n_events = gpio_irq_scan( ev, ev->port_mask );
+
+  if( n_events && ev->callback ) ev->callback( ev );
+}
+
+
+//================================================================
+/*! take an event from the queue.
+
+  @param  ev		pointer to GPIO_EVENTS
+  @param  event		pointer to GPIO_EVENT to store.
+  @return int		1 if taken, 0 if empty.
+*/
+int gpio_event_take(GPIO_EVENTS *ev, GPIO_EVENT *event)
+{
+  uint8_t rd = ev->rd;
+
+  if( rd == ev->wr ) return 0;
+  *event = ev->queue[rd & GPIO_EVENT_QUEUE_MASK];
+  ev->rd = rd + 1;
+
+  return 1;
+}
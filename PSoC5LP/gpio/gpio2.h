@@ -0,0 +1,259 @@
+/*! @file
+  @brief
+  GPIO convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_GPIOWRAP2_H_
+#define PSOC5_GPIOWRAP2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <project.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! offsets of the port registers from PRTn_DR.
+#define GPIO_PRT_PS	(CYREG_PRT0_PS - CYREG_PRT0_DR)
+#define GPIO_PRT_DM0	(CYREG_PRT0_DM0 - CYREG_PRT0_DR)
+#define GPIO_PRT_DM1	(CYREG_PRT0_DM1 - CYREG_PRT0_DR)
+#define GPIO_PRT_DM2	(CYREG_PRT0_DM2 - CYREG_PRT0_DR)
+
+//! distance of the ports.
+#define GPIO_PRT_STRIDE	(CYREG_PRT1_DR - CYREG_PRT0_DR)
+#define GPIO_PC_STRIDE	(CYREG_PRT1_PC0 - CYREG_PRT0_PC0)
+
+//! distance of the port interrupt control unit (PICU) registers.
+#define GPIO_PICU_INTTYPE_STRIDE (CYREG_PICU1_INTTYPE0 - CYREG_PICU0_INTTYPE0)
+#define GPIO_PICU_INTSTAT_STRIDE (CYREG_PICU1_INTSTAT - CYREG_PICU0_INTSTAT)
+
+//! edge. same as the value of PICU INTTYPE register.
+#define GPIO_EDGE_NONE		0
+#define GPIO_EDGE_RISING	1
+#define GPIO_EDGE_FALLING	2
+#define GPIO_EDGE_BOTH		3
+
+//! number of pins with the interrupt.
+#ifndef GPIO_MAX_IRQ_PINS
+# define GPIO_MAX_IRQ_PINS 8
+#endif
+
+//! number of events in the queue. must be power of 2.
+#ifndef GPIO_EVENT_QUEUE_SIZE
+# define GPIO_EVENT_QUEUE_SIZE 16
+#endif
+
+
+/***** Macros ***************************************************************/
+//! timestamp of the event. redefine to use a faster timer.
+#ifndef GPIO_EVENT_TIMESTAMP
+# define GPIO_EVENT_TIMESTAMP(ev) ((ev)->tick)
+#endif
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! a pin. accessed by the pin configuration (PC) register.
+*/
+typedef struct GPIO_PIN {
+  volatile uint8_t *pc;
+  uint8_t port;
+  uint8_t pin;
+
+} GPIO_PIN;
+
+
+//================================================================
+/*! bits of a port. accessed by the port registers.
+*/
+typedef struct GPIO_PORT {
+  volatile uint8_t *dr;		// PRTn_DR, and the other registers follow.
+  uint8_t port;
+  uint8_t mask;			// bits in use.
+
+} GPIO_PORT;
+
+
+//================================================================
+/*! a pin change event.
+*/
+typedef struct GPIO_EVENT {
+  uint32_t timestamp;
+  uint8_t port;
+  uint8_t pin;
+  uint8_t edge;			// GPIO_EDGE_RISING or FALLING.
+
+} GPIO_EVENT;
+
+
+//================================================================
+/*! a pin with the interrupt.
+*/
+typedef struct GPIO_IRQ_PIN {
+  uint8_t port;
+  uint8_t pin;
+  uint8_t edge;			// GPIO_EDGE_*
+  uint16_t debounce;		// ignore edges in this period. (timestamp unit)
+  uint32_t last;		// timestamp of the last event.
+
+} GPIO_IRQ_PIN;
+
+
+//================================================================
+/*! pin change events.
+
+  The ISR writes the queue, and the task reads it. (lock-free)
+*/
+typedef struct GPIO_EVENTS {
+  GPIO_IRQ_PIN pins[GPIO_MAX_IRQ_PINS];
+  volatile uint8_t n_pins;
+  volatile uint16_t port_mask;	// ports with the interrupt. bit n is port n.
+
+  GPIO_EVENT queue[GPIO_EVENT_QUEUE_SIZE];
+  volatile uint8_t rd;		// written by the task only.
+  volatile uint8_t wr;		// written by the ISR only.
+  volatile uint16_t overflow;	// dropped events. (queue full)
+  volatile uint32_t tick;	// counted by gpio_events_tick().
+
+  //! called in the ISR when events are queued.
+  void (*callback)(struct GPIO_EVENTS *ev);
+  void *user_data;
+
+} GPIO_EVENTS;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int gpio_pin_init(GPIO_PIN *gp, int port, int pin);
+int gpio_port_init(GPIO_PORT *pt, int port, int mask);
+void gpio_port_set_mode(GPIO_PORT *pt, int mask, int mode);
+void gpio_irq_init(GPIO_EVENTS *ev);
+int gpio_irq_enable(GPIO_EVENTS *ev, int port, int pin, int edge, int debounce);
+void gpio_irq_isr(GPIO_EVENTS *ev);
+int gpio_event_take(GPIO_EVENTS *ev, GPIO_EVENT *event);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! write the pin.
+
+  @param  gp		pointer to GPIO_PIN
+  @param  value		0 or 1.
+*/
+static inline void gpio_pin_write(GPIO_PIN *gp, int value)
+{
+  if( value ) {
+    *gp->pc |= CY_PINS_PC_DATAOUT;
+  } else {
+    *gp->pc &= ~CY_PINS_PC_DATAOUT;
+  }
+}
+
+
+//================================================================
+/*! read the pin state.
+
+  @param  gp		pointer to GPIO_PIN
+  @return int		0 or 1.
+*/
+static inline int gpio_pin_read(GPIO_PIN *gp)
+{
+  return (*gp->pc & CY_PINS_PC_PIN_STATE) != 0;
+}
+
+
+//================================================================
+/*! set the drive mode of the pin.
+
+  @param  gp		pointer to GPIO_PIN
+  @param  mode		PIN_DM_*
+*/
+static inline void gpio_pin_set_mode(GPIO_PIN *gp, int mode)
+{
+  *gp->pc = (*gp->pc & ~CY_PINS_PC_DRIVE_MODE_MASK) |
+    (mode & CY_PINS_PC_DRIVE_MODE_MASK);
+}
+
+
+//================================================================
+/*! write the bits of the port at once.
+
+  @param  pt		pointer to GPIO_PORT
+  @param  mask		bits to write. (limited to the bits in use)
+  @param  value		value.
+*/
+static inline void gpio_port_write(GPIO_PORT *pt, int mask, int value)
+{
+  mask &= pt->mask;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  *pt->dr = (*pt->dr & ~mask) | (value & mask);
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! read the pin state of the port.
+
+  @param  pt		pointer to GPIO_PORT
+  @return int		bits in use.
+*/
+static inline int gpio_port_read(GPIO_PORT *pt)
+{
+  return pt->dr[GPIO_PRT_PS] & pt->mask;
+}
+
+
+//================================================================
+/*! read the output data of the port.
+
+  @param  pt		pointer to GPIO_PORT
+  @return int		bits in use.
+*/
+static inline int gpio_port_output(GPIO_PORT *pt)
+{
+  return *pt->dr & pt->mask;
+}
+
+
+//================================================================
+/*! number of events in the queue.
+
+  @param  ev		pointer to GPIO_EVENTS
+  @return int		number of events.
+*/
+static inline int gpio_event_available(GPIO_EVENTS *ev)
+{
+  return (uint8_t)(ev->wr - ev->rd);
+}
+
+
+//================================================================
+/*! timer tick for the timestamp.
+
+  @param  ev		pointer to GPIO_EVENTS
+
+  Call this every 1ms.
+*/
+static inline void gpio_events_tick(GPIO_EVENTS *ev)
+{
+  ev->tick++;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -14,23 +14,67 @@
   * Add below to main.c.
       #include "c_i2c.h"
       mrbc_init_class_i2c(0);	// needs to be after mrbc_init()
+  * Add file 'i2c_m2.c' to PSoC Creator.
+  * Copy 'task2.h' in the common directory to the project folder.
+  * Add below to the auto-generated "cyapicallbacks.h".
+      #define I2C_1_ISR_EXIT_CALLBACK
+      void I2C_1_ISR_ExitCallback(void);
+
+  * Call below from the periodic (1ms) timer ISR. (required)
+      mrbc_i2c_poller_tick();
+    It counts the deadlines and drives I2C::Poller.
+  * For the bus recovery, name the pins SCL_1 and SDA_1.
+
+  More I2C buses?
+      Place the following I2C Master device (I2C_2, I2C_3),
+      and add the callback setting to "cyapicallbacks.h".
+      Define pre-processor macro MRBC_NUM_I2C=n. (n=1..3)
 
 
   (Note)
-  * Only I2C master mode and only 1 device.
-    Preparing to handle multiple instances, but can't use it in this version.
+  * Only I2C master mode.
+  * Each bus keeps its own transaction state, so transactions on
+    different buses can overlap.
 
   (on Ruby)
-    i2c = I2C.new()
+    i2c = I2C.new()	# first bus
+    i2c = I2C.new(2)	# second bus
 
     # write to device
     i2c.write( i2c_adrs_7, data1, data2,... )
     i2c.write( i2c_adrs_7, "string" )
 
+    # EEPROM page write in chunks. the second write continues the data.
+    i2c.write( eeprom_adrs_7, mem_adrs_h, mem_adrs_l, :NO_STOP )
+    i2c.write( eeprom_adrs_7, "data..." )
+
     # read from device
     s = i2c.read( i2c_adrs_7, read_bytes, *params )
     s.getbyte(n)
 
+    # non-blocking read. other tasks run during the transfer.
+    i2c.read_async( i2c_adrs_7, read_bytes, *params )
+    s = i2c.wait
+    i2c.status		# => 0 if success.
+
+    # non-blocking write.
+    i2c.write_async( i2c_adrs_7, data1, data2,... )
+    i2c.done?		# => true if complete.
+    i2c.wait
+
+    # deadline and retry.
+    i2c.timeout = 10	# ms
+    i2c.retry = 2
+    i2c.status		# => I2C::ERR_TIMEOUT etc.
+
+    # combined transfer. returns Array of read Strings, or nil if error.
+    a = i2c.transfer( [[i2c_adrs_7, [reg]], [i2c_adrs_7, read_bytes]] )
+
+    # background periodic read. (needs mrbc_i2c_poller_tick() in C)
+    pl = I2C::Poller.new( i2c, i2c_adrs_7, reg, read_bytes, period_ms )
+    a = pl.take( n )	# => [[timestamp_ms, String], ...]
+    pl.stop
+
     # convert byte array to uint16, int16 example.
     def to_uint16( b1, b2 )
       return (b1 << 8 | b2)
@@ -48,78 +92,444 @@
 
 #include "vm_config.h"
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include <project.h>	// auto generated by PSoC Creator.
 
 #include "mrubyc.h"
+#include "i2c_m2.h"
+#include "task2.h"
+
 
+//================================================================
+/*! I2C用設定
+*/
+#if !defined(MRBC_NUM_I2C)
+# define MRBC_NUM_I2C 1
+#endif
 
-// convert pseudo identifier to real identifier.
-#define I2CNAME_MSTR_NO_ERROR		I2C_1_MSTR_NO_ERROR
-#define I2CNAME_ACK_DATA		I2C_1_ACK_DATA
-#define I2CNAME_NAK_DATA		I2C_1_NAK_DATA
-#define I2CNAME_MasterClearStatus	I2C_1_MasterClearStatus
-#define I2CNAME_MasterReadByte		I2C_1_MasterReadByte
-#define I2CNAME_MasterSendRestart	I2C_1_MasterSendRestart
-#define I2CNAME_MasterSendStart		I2C_1_MasterSendStart
-#define I2CNAME_MasterSendStop		I2C_1_MasterSendStop
-#define I2CNAME_MasterStatus		I2C_1_MasterStatus
-#define I2CNAME_MasterWriteByte		I2C_1_MasterWriteByte
-#define I2CNAME_Start			I2C_1_Start
+//! max number of messages in a transaction.
+#if !defined(I2C_MAX_MSGS)
+# define I2C_MAX_MSGS	8
+#endif
 
 
 //================================================================
-/*! Define I2C attribute structure.
+/*! Define I2C bus attribute structure. (one for each bus)
 */
 struct I2C_attr
 {
-  uint8_t state;	//!< none=-1, read=1, write=0
-  uint8_t address;	//!< 7bit I2C address.
-  uint8_t status;
-};
-enum {
-  I2C_STATE_NONE = 0,
-  I2C_STATE_READ1 = 0x02,
-  I2C_STATE_READ2 = 0x03,
-  I2C_STATE_WRITE = 0x04,
+  I2C_HANDLE *ih;
+
+  // transaction of this class. (not the poller)
+  volatile uint8_t xfer_state;	//!< I2C_XFER_IDLE, BUSY or DONE.
+  volatile uint8_t xfer_status;	//!< I2C_ERR_*
+  I2C_MSG msgs[I2C_MAX_MSGS];
+  volatile uint8_t n_pending;	//!< messages waiting for the poller's job.
+  mrbc_tcb * volatile waiting_tcb; //!< task waiting for the completion.
+  mrbc_value tx_str;		//!< keeps the write data alive.
+  mrbc_value rx_str;		//!< receive buffer. returned by wait.
+  mrbc_value * volatile ret_reg; //!< return value of the waiting method.
+  uint8_t flag_ret_dropped;	//!< ret_reg was set to nil by the ISR.
+
+  I2C_POLLER poller;		//!< background acquisition.
 };
 
+static I2C_HANDLE i2ch[MRBC_NUM_I2C];
+static struct I2C_attr i2c_attr[MRBC_NUM_I2C];
+static mrbc_class *i2c_class;
+static volatile uint8_t i2c_flag_timer_tick;	// mrbc_i2c_poller_tick() is called.
+
+#if MRBC_NUM_I2C >= 1
+I2C_ISR( &i2ch[0], I2C_1 );
+#endif
+#if MRBC_NUM_I2C >= 2
+I2C_ISR( &i2ch[1], I2C_2 );
+#endif
+#if MRBC_NUM_I2C >= 3
+I2C_ISR( &i2ch[2], I2C_3 );
+#endif
+#if MRBC_NUM_I2C >= 4
+#error "MRBC_NUM_I2C >= 4"
+#endif
+
+
+//================================================================
+/*! transaction done callback. (called in the ISR)
+*/
+static void i2c_done_callback(I2C_HANDLE *ih)
+{
+  struct I2C_attr *attr = ih->user_data;
+
+  if( i2c_poller_done( &attr->poller ) ) {
+    // start the transaction queued behind the poller's job.
+    int n_msgs = attr->n_pending;
+    if( n_msgs == 0 ) return;
+    attr->n_pending = 0;
+    if( i2c_transfer_start( ih, attr->msgs, n_msgs ) == 0 ) return;
+  }
+
+  attr->xfer_status = i2c_status( ih );
+  attr->xfer_state = I2C_XFER_DONE;
+  i2c_clear_done( ih );
+
+  // error. the waiting method returns nil instead of the receive buffer.
+  // its reference is released in the task. (see i2c_check_idle)
+  if( attr->ret_reg ) {
+    if( attr->xfer_status != I2C_ERR_NONE ) {
+      attr->ret_reg->tt = MRBC_TT_NIL;
+      attr->flag_ret_dropped = 1;
+    }
+    attr->ret_reg = 0;
+  }
+  task_wakeup( &attr->waiting_tcb );
+
+  i2c_poller_resume( &attr->poller );
+}
+
+
+//================================================================
+/*! check the bus can start a new transaction,
+    and release the buffers of the last transaction.
+
+  @return	0 if usable.
+  @note	If usable, the poller doesn't start new jobs until the
+	transaction completes. (see i2c_set_result and the done callback)
+	A non-blocking transaction in progress keeps its own status.
+*/
+static int i2c_check_idle(struct I2C_attr *attr)
+{
+  if( attr->xfer_state == I2C_XFER_BUSY ) return -1;
+
+  if( attr->flag_ret_dropped ) {
+    mrbc_decref( &attr->rx_str );	// the reference of the return value.
+    attr->flag_ret_dropped = 0;
+  }
+  mrbc_decref( &attr->tx_str );
+  mrbc_decref( &attr->rx_str );
+  attr->tx_str = mrbc_nil_value();
+  attr->rx_str = mrbc_nil_value();
+
+  i2c_poller_pause( &attr->poller );
+  attr->xfer_state = I2C_XFER_IDLE;
+  return 0;
+}
+
+
+//================================================================
+/*! warn once if the timer tick is missing.
+
+  The deadline of the non-blocking methods and I2C::Poller are counted
+  only by mrbc_i2c_poller_tick().
+*/
+static void i2c_check_timer_tick(void)
+{
+  static uint8_t flag_warned;
+
+  if( i2c_flag_timer_tick || flag_warned ) return;
+  flag_warned = 1;
+  console_printf("I2C: mrbc_i2c_poller_tick() is not called.\n");
+}
+
+
+//================================================================
+/*! set the result without the transaction.
+*/
+static void i2c_set_result(struct I2C_attr *attr, int status)
+{
+  attr->xfer_status = status;
+  attr->xfer_state = I2C_XFER_DONE;
+  i2c_poller_resume( &attr->poller );
+}
+
+
+//================================================================
+/*! start the non-blocking transaction.
+
+  @param  n_msgs	number of messages in attr->msgs.
+  @return		0 if started.
+  @note	If the poller's job is in progress, the transaction is queued
+	and the done callback starts it.
+*/
+static int i2c_start(struct I2C_attr *attr, int n_msgs)
+{
+  I2C_HANDLE *ih = attr->ih;
+
+  i2c_check_timer_tick();
+  attr->xfer_state = I2C_XFER_BUSY;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  if( i2c_is_busy( ih ) ) {
+    attr->n_pending = n_msgs;
+    CyExitCriticalSection( interrupts );
+    return 0;
+  }
+  CyExitCriticalSection( interrupts );
+
+  if( i2c_transfer_start( ih, attr->msgs, n_msgs ) == 0 ) return 0;
+
+  // can't start.
+  int status = i2c_is_done( ih ) ? i2c_status( ih ) : I2C_ERR_BUSY;
+  i2c_clear_done( ih );
+  i2c_set_result( attr, status );
+  return -1;
+}
+
+
+//================================================================
+/*! suspend the task until the transaction completes.
+
+  @note
+    The task sleeps after the method returns,
+    and the ISR exit callback resumes it.
+*/
+static void i2c_suspend_until_done(struct VM *vm, struct I2C_attr *attr)
+{
+  I2C_HANDLE *ih = attr->ih;
+
+  i2c_poll( ih );
+  if( attr->xfer_state != I2C_XFER_BUSY ) return;
+
+  mrbc_tcb *tcb = VM2TCB(vm);
+  mrbc_suspend_task( tcb );
+
+  uint8 interrupts = CyEnterCriticalSection();
+  i2c_isr( ih );
+  if( attr->xfer_state == I2C_XFER_BUSY ) {
+    attr->waiting_tcb = tcb;
+  } else {
+    mrbc_resume_task( tcb );
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! return the receive buffer when the transaction completes.
+
+  The receive buffer (String, Array or nil) is set to the return value,
+  and the task sleeps until the transaction completes. If it fails,
+  the return value becomes nil before the task runs again.
+*/
+static void i2c_return_when_done(struct VM *vm, mrbc_value v[],
+				 struct I2C_attr *attr)
+{
+  I2C_HANDLE *ih = attr->ih;
+
+  i2c_poll( ih );
+  if( attr->xfer_state != I2C_XFER_BUSY ) goto DONE;
+
+  // the return value and attr->rx_str refer the buffer.
+  mrbc_incref( &attr->rx_str );
+  SET_RETURN( attr->rx_str );
+
+  mrbc_tcb *tcb = VM2TCB(vm);
+  mrbc_suspend_task( tcb );
+
+  uint8 interrupts = CyEnterCriticalSection();
+  i2c_isr( ih );
+  int flag_busy = (attr->xfer_state == I2C_XFER_BUSY);
+  if( flag_busy ) {
+    attr->ret_reg = &v[0];
+    attr->waiting_tcb = tcb;
+  } else {
+    mrbc_resume_task( tcb );
+  }
+  CyExitCriticalSection( interrupts );
+
+  if( !flag_busy && attr->xfer_status != I2C_ERR_NONE ) SET_NIL_RETURN();
+  return;
+
+ DONE:
+  if( attr->xfer_status == I2C_ERR_NONE ) {
+    mrbc_value ret = attr->rx_str;
+    attr->rx_str = mrbc_nil_value();
+    SET_RETURN( ret );
+  } else {
+    SET_NIL_RETURN();
+  }
+}
+
+
+//================================================================
+/*! a step of the busy wait. (10us)
+
+  @param  us	elapsed time in the current 1ms.
+*/
+static void i2c_wait_step(I2C_HANDLE *ih, int *us)
+{
+  CyDelayUs( 10 );
+  i2c_poll( ih );
+
+  // count the deadline, if the timer doesn't.
+  if( (*us += 10) >= 1000 ) {
+    *us = 0;
+    if( !i2c_flag_timer_tick ) i2c_tick( ih );
+  }
+}
+
+
+//================================================================
+/*! wait for the poller's job on the bus. (bounded by the deadline)
+
+  @note	Call this after i2c_check_idle(), so no other job starts.
+*/
+static void i2c_wait_engine(struct I2C_attr *attr)
+{
+  int us = 0;
+
+  while( i2c_is_busy( attr->ih ) ) {
+    i2c_wait_step( attr->ih, &us );
+  }
+}
+
+
+//================================================================
+/*! wait for the transaction by busy loop. (bounded by the deadline)
+*/
+static void i2c_wait_sync(struct I2C_attr *attr)
+{
+  int us = 0;
+
+  while( attr->xfer_state == I2C_XFER_BUSY ) {
+    i2c_wait_step( attr->ih, &us );
+  }
+}
+
+
+//================================================================
+/*! transfer of read and write. (blocking)
+
+  :NO_STOP and the next call use the byte API of the component,
+  to continue the data phase. (see i2c_transfer_bytes)
+*/
+static void i2c_transfer_sync(struct I2C_attr *attr, int n_msgs)
+{
+  I2C_HANDLE *ih = attr->ih;
+
+  if( (attr->msgs[n_msgs - 1].flags & I2C_MSG_NO_STOP) ||
+      ih->flag_halted == I2C_HALTED_BYTES ) {
+    i2c_wait_engine( attr );
+    i2c_set_result( attr, i2c_transfer_bytes( ih, attr->msgs, n_msgs ) );
+    return;
+  }
+
+  if( i2c_start( attr, n_msgs ) != 0 ) return;
+  i2c_wait_sync( attr );
+}
+
 
 //================================================================
 /*! I2C constructor
+
+  i2c = I2C.new		# first bus
+  i2c = I2C.new( num )	# specifies bus number. 1 origin.
 */
 static void c_i2c_new(struct VM *vm, mrb_value v[], int argc)
 {
-  *v = mrbc_instance_new(vm, v->cls, sizeof(struct I2C_attr));
-  struct I2C_attr *attr = (struct I2C_attr *)v->instance->data;
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
-  attr->status = 0;
+  int i2c_num;
+
+  if( argc == 0 ) {
+    i2c_num = 0;
+  } else if( v[1].tt == MRBC_TT_FIXNUM ) {
+    i2c_num = v[1].i - 1;
+  } else {
+    goto ERROR_RETURN;
+  }
+  if( i2c_num < 0 || i2c_num >= MRBC_NUM_I2C ) goto ERROR_RETURN;
+
+  // all objects of the same bus share the bus attribute.
+  *v = mrbc_instance_new(vm, v->cls, sizeof(struct I2C_attr *));
+  *(struct I2C_attr **)v->instance->data = &i2c_attr[i2c_num];
+  return;
+
+ ERROR_RETURN:
+  SET_NIL_RETURN();
 }
 
 
 //================================================================
 /*! I2C get status
+
+  (mruby usage)
+  i2c.status	# => status of the last transaction.
+
+  I2C::ERR_NONE       0  success.
+  I2C::ERR_BUSY       1  bus busy or not ready.
+  I2C::ERR_ADDR_NAK   2  slave address not acknowledged.
+  I2C::ERR_DATA_NAK   3  data not acknowledged.
+  I2C::ERR_ARB_LOST   4  arbitration lost.
+  I2C::ERR_XFER       5  other transfer error.
+  I2C::ERR_TIMEOUT    6  deadline exceeded. the bus was recovered.
+  I2C::ERR_BUS_STUCK  7  SDA is held low after the bus recovery.
 */
 static void c_i2c_status(struct VM *vm, mrb_value v[], int argc)
 {
-  struct I2C_attr *attr = (struct I2C_attr *)v->instance->data;
-  int status = I2CNAME_MasterStatus();
-  attr->status = status;
-  SET_INT_RETURN( status );
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+
+  SET_INT_RETURN( attr->xfer_state == I2C_XFER_DONE ? attr->xfer_status : 0 );
 }
 
 
 //================================================================
 /*! I2C clear status
+
+  Also send stop condition, if the bus is kept by :NO_STOP.
 */
 static void c_i2c_clear_status(struct VM *vm, mrb_value v[], int argc)
 {
-  struct I2C_attr *attr = (struct I2C_attr *)v->instance->data;
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+
+  if( i2c_check_idle(attr) != 0 ) return;
+  i2c_release( attr->ih );
+  i2c_poller_resume( &attr->poller );
+}
+
+
+//================================================================
+/*! I2C set deadline
+
+  (mruby usage)
+  i2c.timeout = 10	# ms. 0 is none.
+
+  If a transaction doesn't complete by the deadline (e.g. clock
+  stretching forever), it is aborted and the bus is recovered.
+*/
+static void c_i2c_set_timeout(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( GET_INT_ARG(1) < 0 || GET_INT_ARG(1) > 0xffff ) goto ERROR_PARAM;
+
+  i2c_set_policy( attr->ih, GET_INT_ARG(1), attr->ih->retries );
+  return;
+
+ ERROR_PARAM:
+  console_printf("i2c.timeout: parameter error.\n");
+}
+
+
+//================================================================
+/*! I2C set retry policy
+
+  (mruby usage)
+  i2c.retry = 2		# max number of retries.
+
+  Retry the whole transaction on error. (NAK, arbitration lost, timeout)
+*/
+static void c_i2c_set_retry(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
 
-  I2CNAME_MasterClearStatus();
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
-  attr->status = 0;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( GET_INT_ARG(1) < 0 || GET_INT_ARG(1) > 255 ) goto ERROR_PARAM;
+
+  i2c_set_policy( attr->ih, attr->ih->timeout, GET_INT_ARG(1) );
+  return;
+
+ ERROR_PARAM:
+  console_printf("i2c.retry: parameter error.\n");
 }
 
 
@@ -127,25 +537,35 @@ static void c_i2c_clear_status(struct VM *vm, mrb_value v[], int argc)
 /*! I2C read
 
   (mruby usage)
-  s = i2c.read( i2c_adrs_7, read_bytes, *params )
+  s = i2c.read( i2c_adrs_7, read_bytes, *params, [:NO_STOP] )
   s.getbyte(n)  # bytes
 
   i2c_adrs_7 = Fixnum
-  read_byres = Fixnum
+  read_byres = Fixnum (0..255)
   *params    = Fixnum (option)
+  :NO_STOP   if you don't need stop conditon, specify :NO_STOP.
+             the last byte is acknowledged. the next read of the same
+             address continues the data, without start condition and
+             address. other transactions start with repeated start.
 
   (I2C Sequence)
-  S - ADRS W A - [params A...] - Sr - ADRS R A - data_1 A... data_n A|N - [P]
+  S - ADRS W A - [params A...] - Sr - ADRS R A - data_1 A... data_n N - [P]
+  continued: data_1 A... data_n N - [P]
     S : Start condition
     P : Stop condition
     Sr: Repeated start condition
     A : Ack
     N : Nack
+
+  Returns nil if error. (see status)
+  It waits at most the deadline for each try. (see timeout=, retry=)
+  :NO_STOP and the next call use the byte API. Their deadline is
+  checked by mrbc_i2c_poller_tick() only.
 */
 static void c_i2c_read(struct VM *vm, mrb_value v[], int argc)
 {
-  struct I2C_attr *attr = (struct I2C_attr *)v->instance->data;
-  uint32_t status = 0;
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  I2C_MSG *msg = attr->msgs;
   mrb_value ret = mrb_nil_value();
 
   /*
@@ -153,9 +573,9 @@ static void c_i2c_read(struct VM *vm, mrb_value v[], int argc)
   */
   int i2c_adrs_7;
   int read_bytes;
-  uint8_t *buf = 0;
   int flag_no_stop;
-  int flag_params;
+  int n_params;
+  int i;
 
   if( argc < 2 ) goto ERROR_PARAM;
   if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
@@ -165,91 +585,69 @@ static void c_i2c_read(struct VM *vm, mrb_value v[], int argc)
   read_bytes = GET_INT_ARG(2);
 
   flag_no_stop = (v[argc].tt == MRBC_TT_SYMBOL && v[argc].i == str_to_symid("NO_STOP"));
-  flag_params = (argc - 2 - flag_no_stop) > 0;
+  n_params = argc - 2 - flag_no_stop;
+  if( read_bytes < 0 || read_bytes > 255 || n_params > 255 ) goto ERROR_PARAM;
+  if( read_bytes == 0 && n_params == 0 ) goto ERROR_PARAM;
+  for( i = 3; i < 3 + n_params; i++ ) {
+    if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  }
 
-  /* start condition check.
-     - - - -  - - 1 0
-                  | \_ bit 0: send start or restart condition flag.
-                   \__ bit 1: address check result.
-  */
-  int start_cond_case = (attr->address == i2c_adrs_7) << 1 |
-                        (attr->state == I2C_STATE_READ2);
-  attr->state = I2C_STATE_READ1;
-  attr->address = i2c_adrs_7;
+  if( i2c_check_idle(attr) != 0 ) goto ERROR_BUSY;
 
   /*
-    Start I2C communication
+    Build the messages.
   */
-  // send START condition, slave address and R/W (1:read, 0:write)
-  switch( start_cond_case ) {
-  case 0x00:
-    I2CNAME_MasterClearStatus();
-    status = I2CNAME_MasterSendStart( i2c_adrs_7, !flag_params );
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
-    break;
-
-  case 0x02:
-    status = I2CNAME_MasterSendRestart( i2c_adrs_7, !flag_params );
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
-    break;
-
-  case 0x01:
-    goto ERROR_PARAM;
-
-  case 0x03:
-  default:
-    ;
-  }
-
   // send params if specified.
-  if( flag_params ) {
-    for( int i = 3; i <= (argc - flag_no_stop); i++ ) {
-      if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
-      status = I2CNAME_MasterWriteByte( v[i].i );
-      if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
+  if( n_params > 0 ) {
+    attr->tx_str = mrbc_string_new( vm, 0, n_params );
+    if( attr->tx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+    msg->address = i2c_adrs_7;
+    msg->flags = 0;
+    msg->len = n_params;
+    msg->buf = (uint8_t *)mrbc_string_cstr( &attr->tx_str );
+    for( i = 0; i < n_params; i++ ) {
+      msg->buf[i] = GET_INT_ARG(i+3);
     }
-    if( read_bytes <= 0 ) goto DONE;
-
-    // send repeated start
-    status = I2CNAME_MasterSendRestart( i2c_adrs_7, 1 );	// 1:read
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
+    msg++;
   }
 
-  // receive data.
-  attr->state = I2C_STATE_READ2;
-  buf = mrbc_alloc(vm, read_bytes + 1);
-  if( !buf ) goto ERROR;
-  uint8_t *p_buf = buf;
-  for( int i = read_bytes - !flag_no_stop; i > 0; i-- ) {
-    *p_buf++ = I2CNAME_MasterReadByte( I2CNAME_ACK_DATA );
-  }
-  if( !flag_no_stop && read_bytes > 0 ) {
-    *p_buf++ = I2CNAME_MasterReadByte( I2CNAME_NAK_DATA );
+  // receive data with repeated start.
+  if( read_bytes > 0 ) {
+    attr->rx_str = mrbc_string_new( vm, 0, read_bytes );
+    if( attr->rx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+    msg->address = i2c_adrs_7;
+    msg->flags = I2C_MSG_READ;
+    msg->len = read_bytes;
+    msg->buf = (uint8_t *)mrbc_string_cstr( &attr->rx_str );
+    msg++;
   }
-  *p_buf = 0;
-  ret = mrbc_string_new_alloc(vm, buf, read_bytes);
+  if( flag_no_stop ) (msg-1)->flags |= I2C_MSG_NO_STOP;
 
-  if( flag_no_stop ) goto DONE;
+  /*
+    Start I2C communication
+  */
+  i2c_transfer_sync( attr, msg - attr->msgs );
 
-  // send STOP condition.
-  status = I2CNAME_MasterSendStop();
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
+  if( attr->xfer_status == I2C_ERR_NONE && read_bytes > 0 ) {
+    ret = attr->rx_str;
+    attr->rx_str = mrbc_nil_value();
+  }
   goto DONE;
 
 
  ERROR_PARAM:
   console_printf("i2c_read: parameter error.\n");
+  goto DONE;
+
+ ERROR_ALLOC:
+  i2c_set_result( attr, I2C_ERR_XFER );
+  goto DONE;
 
- ERROR:
-  I2CNAME_MasterSendStop();
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
-  if( buf ) mrbc_raw_free(buf);
+ ERROR_BUSY:
+  // the bus is busy. (i2c.status tells the reason)
+  console_printf("i2c.read: busy.\n");
 
  DONE:
-  attr->status = status;
-
   SET_RETURN( ret );
 }
 
@@ -263,26 +661,34 @@ static void c_i2c_read(struct VM *vm, mrb_value v[], int argc)
   i2c_adrs_7 = Fixnum
   write_data = String, or Fixnum...
   :NO_STOP  if you don't need stop conditon, specify :NO_STOP
+            the next write of the same address continues the data,
+            without start condition and address. (e.g. EEPROM page
+            write in chunks) other transactions start with repeated start.
 
   (I2C Sequence)
   S - ADRS W A - data1 A... - [P]
+  continued: data1 A... - [P]
 
     S : Start condition
     P : Stop condition
     A : Ack
+
+  Returns the status. (0 if success)
+  :NO_STOP and the next call use the byte API. Their deadline is
+  checked by mrbc_i2c_poller_tick() only.
 */
 static void c_i2c_write(struct VM *vm, mrb_value v[], int argc)
 {
-  struct I2C_attr *attr = (struct I2C_attr *)v->instance->data;
-  uint32_t status = 0;
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  I2C_MSG *msg = attr->msgs;
 
   /*
     Get parameter
   */
   int i2c_adrs_7;
   int write_bytes;
-  const char *write_ptr = 0;
   int flag_no_stop;
+  int i;
 
   if( argc < 1 ) goto ERROR_PARAM;
   if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
@@ -292,94 +698,647 @@ static void c_i2c_write(struct VM *vm, mrb_value v[], int argc)
 
   if( argc >= 2 && v[2].tt == MRBC_TT_STRING ) {
     write_bytes = mrbc_string_size( &GET_ARG(2) );
-    write_ptr = mrbc_string_cstr( &GET_ARG(2) );
   } else {
     write_bytes = argc - flag_no_stop - 1;
+    for( i = 2; i < 2 + write_bytes; i++ ) {
+      if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    }
   }
+  if( write_bytes > 255 ) goto ERROR_PARAM;
 
-  /* start condition check.
-     - - - -  - - 1 0
-                  | \_ bit 0: send start or restart condition flag.
-                   \__ bit 1: address check result.
-  */
-  int start_cond_case = (attr->address == i2c_adrs_7) << 1 |
-                        (attr->state == I2C_STATE_WRITE);
-  attr->state = I2C_STATE_WRITE;
-  attr->address = i2c_adrs_7;
+  if( i2c_check_idle(attr) != 0 ) goto ERROR_BUSY;
+
+  // copy the data.
+  attr->tx_str = mrbc_string_new( vm, 0, write_bytes );
+  if( attr->tx_str.tt != MRBC_TT_STRING ) {
+    i2c_set_result( attr, I2C_ERR_XFER );
+    goto DONE;
+  }
+  msg->address = i2c_adrs_7;
+  msg->flags = flag_no_stop ? I2C_MSG_NO_STOP : 0;
+  msg->len = write_bytes;
+  msg->buf = (uint8_t *)mrbc_string_cstr( &attr->tx_str );
+  if( argc >= 2 && v[2].tt == MRBC_TT_STRING ) {
+    memcpy( msg->buf, mrbc_string_cstr( &GET_ARG(2) ), write_bytes );
+  } else {
+    for( i = 0; i < write_bytes; i++ ) {
+      msg->buf[i] = GET_INT_ARG(i+2);
+    }
+  }
 
   /*
     Start I2C communication
   */
-  // send START condition, slave address and R/W (0:write)
-  switch( start_cond_case ) {
-  case 0x00:
-    I2CNAME_MasterClearStatus();
-    status = I2CNAME_MasterSendStart( i2c_adrs_7, 0 );
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
-    break;
-
-  case 0x02:
-    status = I2CNAME_MasterSendRestart( i2c_adrs_7, 0 );
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
-    break;
-
-  case 0x01:
-    goto ERROR_PARAM;
-
-  case 0x03:
-  default:
-    ;
-  }
-
-  // send data.
-  for( int i = 0; i < write_bytes; i++ ) {
-    if( write_ptr ) {
-      status = I2CNAME_MasterWriteByte( *write_ptr++ );
+  i2c_transfer_sync( attr, 1 );
+  goto DONE;
+
+
+ ERROR_PARAM:
+  console_printf("i2c.write: parameter error.\n");
+  SET_INT_RETURN( I2C_ERR_XFER );
+  return;
+
+ ERROR_BUSY:
+  // the bus is busy. (i2c.status tells the reason)
+  SET_INT_RETURN( I2C_ERR_BUSY );
+  return;
+
+ DONE:
+  SET_INT_RETURN( attr->xfer_status );
+}
+
+
+//================================================================
+/*! I2C read (non-blocking)
+
+  (mruby usage)
+  i2c.read_async( i2c_adrs_7, read_bytes, *params )	# => true/false
+  s = i2c.wait
+
+  i2c_adrs_7 = Fixnum
+  read_byres = Fixnum (1..255)
+  *params    = Fixnum (option)
+
+  (I2C Sequence)
+  S - ADRS W A - [params A...] - Sr - ADRS R A - data_1 A... data_n N - P
+*/
+static void c_i2c_read_async(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  I2C_MSG *msg = attr->msgs;
+  int i2c_adrs_7;
+  int read_bytes;
+  int n_params;
+  int i;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  i2c_adrs_7 = GET_INT_ARG(1);
+  read_bytes = GET_INT_ARG(2);
+  n_params = argc - 2;
+  if( read_bytes < 1 || read_bytes > 255 || n_params > 255 ) goto ERROR_PARAM;
+  for( i = 3; i <= argc; i++ ) {
+    if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  }
+
+  if( i2c_check_idle(attr) != 0 ) goto ERROR_BUSY;
+
+  // write params, and read with repeated start.
+  if( n_params > 0 ) {
+    attr->tx_str = mrbc_string_new( vm, 0, n_params );
+    if( attr->tx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+    msg->address = i2c_adrs_7;
+    msg->flags = 0;
+    msg->len = n_params;
+    msg->buf = (uint8_t *)mrbc_string_cstr( &attr->tx_str );
+    for( i = 0; i < n_params; i++ ) {
+      msg->buf[i] = GET_INT_ARG(i+3);
+    }
+    msg++;
+  }
+
+  // receive into the String object directly.
+  attr->rx_str = mrbc_string_new( vm, 0, read_bytes );
+  if( attr->rx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+  msg->address = i2c_adrs_7;
+  msg->flags = I2C_MSG_READ;
+  msg->len = read_bytes;
+  msg->buf = (uint8_t *)mrbc_string_cstr( &attr->rx_str );
+
+  if( i2c_start( attr, msg - attr->msgs + 1 ) != 0 ) goto ERROR_BUSY;
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_ALLOC:
+  i2c_set_result( attr, I2C_ERR_XFER );
+  goto ERROR_BUSY;
+
+ ERROR_PARAM:
+  console_printf("i2c.read_async: parameter error.\n");
+ ERROR_BUSY:
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! I2C write (non-blocking)
+
+  (mruby usage)
+  i2c.write_async( i2c_adrs_7, write_data, ... )	# => true/false
+  i2c.wait
+
+  i2c_adrs_7 = Fixnum
+  write_data = String, or Fixnum...
+
+  (I2C Sequence)
+  S - ADRS W A - data1 A... - P
+*/
+static void c_i2c_write_async(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  I2C_MSG *msg = attr->msgs;
+  int i2c_adrs_7;
+  int write_bytes;
+  int i;
+
+  if( argc < 1 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  i2c_adrs_7 = GET_INT_ARG(1);
+
+  if( argc >= 2 && v[2].tt == MRBC_TT_STRING ) {
+    write_bytes = mrbc_string_size( &GET_ARG(2) );
+  } else {
+    write_bytes = argc - 1;
+    for( i = 2; i <= argc; i++ ) {
+      if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    }
+  }
+  if( write_bytes > 255 ) goto ERROR_PARAM;
+
+  if( i2c_check_idle(attr) != 0 ) goto ERROR_BUSY;
+
+  // copy the data. Ruby can modify or release the arguments.
+  attr->tx_str = mrbc_string_new( vm, 0, write_bytes );
+  if( attr->tx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+  msg->address = i2c_adrs_7;
+  msg->flags = 0;
+  msg->len = write_bytes;
+  msg->buf = (uint8_t *)mrbc_string_cstr( &attr->tx_str );
+  if( argc >= 2 && v[2].tt == MRBC_TT_STRING ) {
+    memcpy( msg->buf, mrbc_string_cstr( &GET_ARG(2) ), write_bytes );
+  } else {
+    for( i = 0; i < write_bytes; i++ ) {
+      msg->buf[i] = GET_INT_ARG(i+2);
+    }
+  }
+
+  if( i2c_start( attr, 1 ) != 0 ) goto ERROR_BUSY;
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_ALLOC:
+  i2c_set_result( attr, I2C_ERR_XFER );
+  goto ERROR_BUSY;
+
+ ERROR_PARAM:
+  console_printf("i2c.write_async: parameter error.\n");
+ ERROR_BUSY:
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! Is the transaction complete?
+
+  (mruby usage)
+  until i2c.done?
+    # do something
+  end
+
+  relinquish if not complete.
+*/
+static void c_i2c_done(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  I2C_HANDLE *ih = attr->ih;
+
+  i2c_poll( ih );
+
+  if( attr->xfer_state == I2C_XFER_BUSY ) {
+    vm->flag_preemption = 1;
+    SET_FALSE_RETURN();
+  } else {
+    SET_TRUE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! Wait for the transaction.
+
+  (mruby usage)
+  s = i2c.wait		# => String (read_async) or nil (write_async)
+  i2c.status		# => 0 if success.
+
+  Other tasks run until the transaction completes.
+*/
+static void c_i2c_wait(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+
+  i2c_suspend_until_done( vm, attr );
+
+  // the receive String will be filled before this task runs again.
+  mrbc_value ret = attr->rx_str;
+  if( ret.tt == MRBC_TT_STRING ) {
+    attr->rx_str = mrbc_nil_value();
+    SET_RETURN( ret );
+  } else {
+    SET_NIL_RETURN();
+  }
+}
+
+
+//================================================================
+/*! I2C combined transfer
+
+  (mruby usage)
+  # write register address, and read 6 bytes with repeated start.
+  a = i2c.transfer( [[i2c_adrs_7, [0x28]], [i2c_adrs_7, 6]] )
+  s = a[0]
+  i2c.status		# => 0 if success.
+
+  message = [i2c_adrs_7, String or Array of Fixnum]  write
+            [i2c_adrs_7, Fixnum]                     read bytes (1..255)
+
+  (I2C Sequence)
+  S - message1 - Sr - message2 - Sr ... - messageN - P
+
+  Returns the Array of read Strings, or nil if error. (see status)
+  Other tasks run until the transaction completes, and the Strings are
+  filled before this task runs again.
+*/
+static void c_i2c_transfer(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_attr *attr = *(struct I2C_attr **)v->instance->data;
+  int n_msgs;
+  int tx_bytes = 0;
+  int n_read = 0;
+  int i, j;
+
+  /*
+    Check the messages.
+  */
+  if( argc != 1 || v[1].tt != MRBC_TT_ARRAY ) goto ERROR_PARAM;
+  n_msgs = mrbc_array_size( &v[1] );
+  if( n_msgs < 1 || n_msgs > I2C_MAX_MSGS ) goto ERROR_PARAM;
+
+  for( i = 0; i < n_msgs; i++ ) {
+    mrbc_value m = mrbc_array_get( &v[1], i );
+    if( m.tt != MRBC_TT_ARRAY || mrbc_array_size( &m ) != 2 ) goto ERROR_PARAM;
+    mrbc_value adrs = mrbc_array_get( &m, 0 );
+    mrbc_value data = mrbc_array_get( &m, 1 );
+    if( adrs.tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+    switch( data.tt ) {
+    case MRBC_TT_FIXNUM:
+      if( data.i < 1 || data.i > 255 ) goto ERROR_PARAM;
+      n_read++;
+      break;
+
+    case MRBC_TT_STRING:
+      if( mrbc_string_size( &data ) > 255 ) goto ERROR_PARAM;
+      tx_bytes += mrbc_string_size( &data );
+      break;
+
+    case MRBC_TT_ARRAY:
+      if( mrbc_array_size( &data ) > 255 ) goto ERROR_PARAM;
+      for( j = 0; j < mrbc_array_size( &data ); j++ ) {
+	if( mrbc_array_get( &data, j ).tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+      }
+      tx_bytes += mrbc_array_size( &data );
+      break;
+
+    default:
+      goto ERROR_PARAM;
+    }
+  }
+
+  if( i2c_check_idle(attr) != 0 ) goto ERROR_BUSY;
+
+  /*
+    Build the messages. write data is copied into one String,
+    and read data goes directly into the result Strings.
+  */
+  attr->tx_str = mrbc_string_new( vm, 0, tx_bytes );
+  attr->rx_str = mrbc_array_new( vm, n_read );
+  if( attr->tx_str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+  if( attr->rx_str.tt != MRBC_TT_ARRAY ) goto ERROR_ALLOC;
+  uint8_t *tx_buf = (uint8_t *)mrbc_string_cstr( &attr->tx_str );
+  n_read = 0;
+
+  for( i = 0; i < n_msgs; i++ ) {
+    mrbc_value m = mrbc_array_get( &v[1], i );
+    mrbc_value data = mrbc_array_get( &m, 1 );
+    I2C_MSG *msg = &attr->msgs[i];
+
+    msg->address = mrbc_array_get( &m, 0 ).i;
+
+    if( data.tt == MRBC_TT_FIXNUM ) {
+      mrbc_value str = mrbc_string_new( vm, 0, data.i );
+      if( str.tt != MRBC_TT_STRING ) goto ERROR_ALLOC;
+      mrbc_array_set( &attr->rx_str, n_read++, &str );
+      msg->flags = I2C_MSG_READ;
+      msg->len = data.i;
+      msg->buf = (uint8_t *)mrbc_string_cstr( &str );
+      continue;
+    }
+
+    msg->flags = 0;
+    msg->buf = tx_buf;
+    if( data.tt == MRBC_TT_STRING ) {
+      msg->len = mrbc_string_size( &data );
+      memcpy( tx_buf, mrbc_string_cstr( &data ), msg->len );
     } else {
-      if( v[i+2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
-      status = I2CNAME_MasterWriteByte( v[i+2].i );
+      msg->len = mrbc_array_size( &data );
+      for( j = 0; j < msg->len; j++ ) {
+	tx_buf[j] = mrbc_array_get( &data, j ).i;
+      }
     }
-    if( status != I2CNAME_MSTR_NO_ERROR ) goto ERROR;
+    tx_buf += msg->len;
   }
 
-  if( flag_no_stop ) goto DONE;
+  if( i2c_start( attr, n_msgs ) != 0 ) goto ERROR_BUSY;
+  i2c_return_when_done( vm, v, attr );
+  return;
 
-  // send STOP condition.
-  status = I2CNAME_MasterSendStop();
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
-  goto DONE;
+ ERROR_ALLOC:
+  i2c_set_result( attr, I2C_ERR_XFER );
+  goto ERROR_BUSY;
+
+ ERROR_PARAM:
+  console_printf("i2c.transfer: parameter error.\n");
+ ERROR_BUSY:
+  SET_NIL_RETURN();
+}
 
 
+//================================================================
+/*! Define I2C::Poller attribute structure.
+*/
+struct I2C_POLLER_attr
+{
+  struct I2C_attr *bus;
+  I2C_POLL_JOB *job;	//!< NULL if stopped.
+};
+
+
+//================================================================
+/*! I2C::Poller constructor
+
+  (mruby usage)
+  pl = I2C::Poller.new( i2c, i2c_adrs_7, reg, read_bytes, period, samples = 16 )
+
+  i2c        = I2C object.
+  reg        = Fixnum. register address.
+  read_bytes = Fixnum. bytes per sample (1..255)
+  period     = Fixnum. in ticks of mrbc_i2c_poller_tick() (normally ms)
+  samples    = Fixnum. size of ring buffer in samples.
+
+  (I2C Sequence, every period)
+  S - ADRS W A - reg A - Sr - ADRS R A - data_1 A... data_n N - P
+*/
+static void c_i2c_poller_new(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 5 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_OBJECT || v[1].instance->cls != i2c_class ) goto ERROR_PARAM;
+  for( int i = 2; i <= argc; i++ ) {
+    if( v[i].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  }
+  struct I2C_attr *bus = *(struct I2C_attr **)v[1].instance->data;
+  int len = GET_INT_ARG(4);
+  int period = GET_INT_ARG(5);
+  int samples = (argc >= 6) ? GET_INT_ARG(6) : 16;
+  if( len < 1 || len > 255 ) goto ERROR_PARAM;
+  if( period < 1 || period > 0xffff ) goto ERROR_PARAM;
+  if( samples < 1 || samples > 0xfffe ) goto ERROR_PARAM;
+
+  // ring buffer needs an empty slot.
+  int n_slots = samples + 1;
+  I2C_POLL_JOB *job = mrbc_raw_alloc( sizeof(I2C_POLL_JOB) +
+				      n_slots * I2C_POLL_SLOT_SIZE(len) );
+  if( !job ) goto ERROR_RETURN;
+  job->address = GET_INT_ARG(2);
+  job->reg = GET_INT_ARG(3);
+  job->len = len;
+  job->period = period;
+  job->n_slots = n_slots;
+  job->slots = (uint8_t *)(job + 1);
+
+  mrbc_value val = mrbc_instance_new(vm, v->cls, sizeof(struct I2C_POLLER_attr));
+  if( val.instance == NULL ) {
+    mrbc_raw_free( job );
+    goto ERROR_RETURN;
+  }
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)val.instance->data;
+  attr->bus = bus;
+  attr->job = job;
+  i2c_poller_add( &bus->poller, job );
+
+  SET_RETURN( val );
+  return;
+
  ERROR_PARAM:
-  console_printf("i2c.write: parameter error.\n");
+  console_printf("I2C::Poller: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
 
- ERROR:
-  I2CNAME_MasterSendStop();
-  attr->state = I2C_STATE_NONE;
-  attr->address = -1;
 
- DONE:
-  attr->status = status;
+//================================================================
+/*! take samples
+
+  (mruby usage)
+  a = pl.take( n )	# => [[timestamp, String], ...]
+  a = pl.take		# all samples.
+*/
+static void c_i2c_poller_take(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)v->instance->data;
+  I2C_POLL_JOB *job = attr->job;
+  int n;
+
+  if( !job ) goto ERROR_RETURN;
+  n = i2c_poller_available( job );
+  if( argc >= 1 ) {
+    if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_RETURN;
+    if( GET_INT_ARG(1) < n ) n = GET_INT_ARG(1);
+  }
+  if( n < 0 ) n = 0;
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  for( int i = 0; i < n; i++ ) {
+    mrbc_value sample = mrbc_array_new( vm, 2 );
+    mrbc_value str = mrbc_string_new( vm, 0, job->len );
+    uint32_t timestamp;
+
+    if( str.tt != MRBC_TT_STRING ) break;
+    i2c_poller_read( job, &timestamp, (uint8_t *)mrbc_string_cstr(&str) );
+    mrbc_value ts = mrbc_fixnum_value( timestamp );
+    mrbc_array_set( &sample, 0, &ts );
+    mrbc_array_set( &sample, 1, &str );
+    mrbc_array_set( &ret, i, &sample );
+  }
 
-  SET_INT_RETURN(status);
+  SET_RETURN( ret );
+  return;
+
+ ERROR_RETURN:
+  SET_NIL_RETURN();
 }
 
 
+//================================================================
+/*! number of samples in the ring buffer.
+*/
+static void c_i2c_poller_available(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)v->instance->data;
+
+  SET_INT_RETURN( attr->job ? i2c_poller_available( attr->job ) : 0 );
+}
+
+
+//================================================================
+/*! number of dropped samples. (ring buffer full)
+*/
+static void c_i2c_poller_overflow(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)v->instance->data;
+
+  SET_INT_RETURN( attr->job ? attr->job->overflow : 0 );
+}
+
+
+//================================================================
+/*! number of failed transactions.
+*/
+static void c_i2c_poller_errors(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)v->instance->data;
+
+  SET_INT_RETURN( attr->job ? attr->job->errors : 0 );
+}
+
+
+//================================================================
+/*! stop the job, and release the ring buffer.
+
+  (mruby usage)
+  pl.stop
+*/
+static void c_i2c_poller_stop(struct VM *vm, mrb_value v[], int argc)
+{
+  struct I2C_POLLER_attr *attr = (struct I2C_POLLER_attr *)v->instance->data;
+  I2C_POLL_JOB *job = attr->job;
+
+  if( !job ) return;
+
+  // the job in progress finishes soon.
+  while( i2c_poller_remove( &attr->bus->poller, job ) != 0 ) {
+    i2c_poll( attr->bus->ih );
+  }
+  mrbc_raw_free( job );
+  attr->job = 0;
+}
+
+
+//================================================================
+/*! timer tick of the pollers and the deadlines.
+
+  Call this every 1ms from the periodic timer ISR. (e.g. with mrbc_tick)
+  It is required. Without it, a non-blocking transaction that hangs
+  never ends, and I2C::Poller doesn't run.
+*/
+void mrbc_i2c_poller_tick(void)
+{
+  int i;
+
+  i2c_flag_timer_tick = 1;
+  for( i = 0; i < MRBC_NUM_I2C; i++ ) {
+    i2c_poller_tick( &i2c_attr[i].poller );
+  }
+}
+
 
 //================================================================
 /*! initialize
+
+  @note	Call mrbc_i2c_poller_tick() every 1ms from the timer ISR too.
 */
 void mrbc_init_class_i2c(struct VM *vm)
 {
-  I2CNAME_Start();	// start physical device
+  int i;
+
+  // start physical device
+#if MRBC_NUM_I2C >= 1
+  i2c_init( &i2ch[0], I2C_1 );
+#endif
+#if MRBC_NUM_I2C >= 2
+  i2c_init( &i2ch[1], I2C_2 );
+#endif
+#if MRBC_NUM_I2C >= 3
+  i2c_init( &i2ch[2], I2C_3 );
+#endif
+
+  // bus recovery, if the pins are named SCL_n and SDA_n.
+#if MRBC_NUM_I2C >= 1 && defined(SCL_1__DR) && defined(SDA_1__DR)
+  i2c_init_recovery( &i2ch[0], SCL_1, SDA_1 );
+#endif
+#if MRBC_NUM_I2C >= 2 && defined(SCL_2__DR) && defined(SDA_2__DR)
+  i2c_init_recovery( &i2ch[1], SCL_2, SDA_2 );
+#endif
+#if MRBC_NUM_I2C >= 3 && defined(SCL_3__DR) && defined(SDA_3__DR)
+  i2c_init_recovery( &i2ch[2], SCL_3, SDA_3 );
+#endif
+  for( i = 0; i < MRBC_NUM_I2C; i++ ) {
+    i2c_attr[i] = (struct I2C_attr){
+      .ih = &i2ch[i],
+      .tx_str = mrbc_nil_value(),
+      .rx_str = mrbc_nil_value(),
+    };
+    i2ch[i].done_callback = i2c_done_callback;
+    i2ch[i].user_data = &i2c_attr[i];
+    i2c_poller_init( &i2c_attr[i].poller, &i2ch[i] );
+  }
 
   mrb_class *i2c;
   i2c = mrbc_define_class(vm, "I2C",	mrbc_class_object);
+  i2c_class = i2c;
 
   mrbc_define_method(vm, i2c, "new",	c_i2c_new);
   mrbc_define_method(vm, i2c, "read",	c_i2c_read);
   mrbc_define_method(vm, i2c, "write",	c_i2c_write);
   mrbc_define_method(vm, i2c, "status",	c_i2c_status);
   mrbc_define_method(vm, i2c, "clear_status", c_i2c_clear_status);
+  mrbc_define_method(vm, i2c, "timeout=",	c_i2c_set_timeout);
+  mrbc_define_method(vm, i2c, "retry=",	c_i2c_set_retry);
+  mrbc_define_method(vm, i2c, "read_async",	c_i2c_read_async);
+  mrbc_define_method(vm, i2c, "write_async",	c_i2c_write_async);
+  mrbc_define_method(vm, i2c, "done?",	c_i2c_done);
+  mrbc_define_method(vm, i2c, "wait",	c_i2c_wait);
+  mrbc_define_method(vm, i2c, "transfer",	c_i2c_transfer);
+
+  // status constants.
+  static const struct {
+    const char *name;
+    int value;
+  } i2c_err_const[] = {
+    { "ERR_NONE", I2C_ERR_NONE },
+    { "ERR_BUSY", I2C_ERR_BUSY },
+    { "ERR_ADDR_NAK", I2C_ERR_ADDR_NAK },
+    { "ERR_DATA_NAK", I2C_ERR_DATA_NAK },
+    { "ERR_ARB_LOST", I2C_ERR_ARB_LOST },
+    { "ERR_XFER", I2C_ERR_XFER },
+    { "ERR_TIMEOUT", I2C_ERR_TIMEOUT },
+    { "ERR_BUS_STUCK", I2C_ERR_BUS_STUCK },
+  };
+  for( i = 0; i < sizeof(i2c_err_const) / sizeof(i2c_err_const[0]); i++ ) {
+    mrbc_value val = mrbc_fixnum_value( i2c_err_const[i].value );
+    mrbc_set_class_const( i2c, str_to_symid(i2c_err_const[i].name), &val );
+  }
+
+  // I2C::Poller
+  mrb_class *poller;
+  poller = mrbc_define_class(vm, "I2C_Poller", mrbc_class_object);
+  mrbc_value val = {.tt = MRBC_TT_CLASS, .cls = poller};
+  mrbc_set_class_const( i2c, str_to_symid("Poller"), &val );
+
+  mrbc_define_method(vm, poller, "new",		c_i2c_poller_new);
+  mrbc_define_method(vm, poller, "take",	c_i2c_poller_take);
+  mrbc_define_method(vm, poller, "available",	c_i2c_poller_available);
+  mrbc_define_method(vm, poller, "overflow",	c_i2c_poller_overflow);
+  mrbc_define_method(vm, poller, "errors",	c_i2c_poller_errors);
+  mrbc_define_method(vm, poller, "stop",	c_i2c_poller_stop);
 }
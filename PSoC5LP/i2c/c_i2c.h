@@ -20,6 +20,7 @@ extern "C" {
 
 struct VM;
 void mrbc_init_class_i2c(struct VM *vm);
+void mrbc_i2c_poller_tick(void);
 
 
 #ifdef __cplusplus
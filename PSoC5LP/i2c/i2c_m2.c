@@ -0,0 +1,759 @@
+/*! @file
+  @brief
+  I2C master convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+  @note This version supports up to 3 interfaces.
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "i2c_m2.h"
+
+/***** Constant values ******************************************************/
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+static uint8_t i2c_issue(I2C_HANDLE *ih);
+static int i2c_start_error(const I2C_HANDLE *ih, uint8_t ret);
+static void i2c_fail(I2C_HANDLE *ih, int err);
+
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+
+//================================================================
+/*! Interrupt callback. advance the transaction.
+
+  @param  ih		pointer to I2C_HANDLE
+  @note
+    Called from the ISR exit callback of the component,
+    or from i2c_poll() in a critical section.
+*/
+void i2c_isr(I2C_HANDLE *ih)
+{
+  int err;
+
+  if( ih->state != I2C_XFER_BUSY ) return;
+
+  uint8_t sts = ih->MasterStatus();
+  if( sts & ih->MSTAT_XFER_INP ) return;
+  if( sts & ih->MSTAT_ERR_XFER ) {
+    if( sts & ih->MSTAT_ERR_ADDR_NAK ) {
+      err = I2C_ERR_ADDR_NAK;
+    } else if( sts & ih->MSTAT_ERR_ARB_LOST ) {
+      err = I2C_ERR_ARB_LOST;
+    } else if( sts & ih->MSTAT_ERR_SHORT_XFER ) {
+      err = I2C_ERR_DATA_NAK;
+    } else {
+      err = I2C_ERR_XFER;
+    }
+    i2c_fail(ih, err);
+    return;
+  }
+  if( !(sts & (ih->MSTAT_RD_CMPLT | ih->MSTAT_WR_CMPLT)) ) return;
+
+  // next message with repeated start.
+  if( ++ih->idx < ih->n_msgs ) {
+    uint8_t ret = i2c_issue(ih);
+    if( ret != ih->MSTR_NO_ERROR ) i2c_fail(ih, i2c_start_error(ih, ret));
+    return;
+  }
+
+  ih->flag_halted = (ih->msgs[ih->n_msgs - 1].flags & I2C_MSG_NO_STOP) ?
+    I2C_HALTED_XFER : 0;
+  ih->status = I2C_ERR_NONE;
+  ih->state = I2C_XFER_DONE;
+  if( ih->done_callback ) ih->done_callback(ih);
+}
+
+
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! issue the current message.
+
+  @return	MSTR_NO_ERROR if success.
+*/
+static uint8_t i2c_issue(I2C_HANDLE *ih)
+{
+  const I2C_MSG *msg = &ih->msgs[ih->idx];
+  uint8_t mode = ih->MODE_COMPLETE_XFER;
+
+  if( ih->idx != 0 || ih->flag_halted ) mode |= ih->MODE_REPEAT_START;
+  if( ih->idx != ih->n_msgs - 1 || (msg->flags & I2C_MSG_NO_STOP) ) {
+    mode |= ih->MODE_NO_STOP;
+  }
+
+  ih->MasterClearStatus();
+  if( msg->flags & I2C_MSG_READ ) {
+    return ih->MasterReadBuf( msg->address, msg->buf, msg->len, mode );
+  } else {
+    return ih->MasterWriteBuf( msg->address, msg->buf, msg->len, mode );
+  }
+}
+
+
+//================================================================
+/*! convert the return code of MasterWriteBuf/ReadBuf to I2C_ERR_*.
+*/
+static int i2c_start_error(const I2C_HANDLE *ih, uint8_t ret)
+{
+  return (ret == ih->MSTR_BUS_BUSY) ? I2C_ERR_BUSY : I2C_ERR_XFER;
+}
+
+
+//================================================================
+/*! the attempt failed. retry from the first message, or finish.
+
+  @param  ih		pointer to I2C_HANDLE
+  @param  err		I2C_ERR_*
+*/
+static void i2c_fail(I2C_HANDLE *ih, int err)
+{
+  // the component sends stop condition on error.
+  ih->flag_halted = 0;
+
+  while( ih->n_retry < ih->retries ) {
+    ih->n_retry++;
+    ih->idx = 0;
+    ih->elapsed = 0;
+    uint8_t ret = i2c_issue(ih);
+    if( ret == ih->MSTR_NO_ERROR ) return;
+    err = i2c_start_error(ih, ret);
+  }
+
+  ih->status = err;
+  ih->state = I2C_XFER_DONE;
+  if( ih->done_callback ) ih->done_callback(ih);
+}
+
+
+//================================================================
+/*! bus recovery. clock SCL until the slave releases SDA, then STOP.
+
+  @param  ih		pointer to I2C_HANDLE
+  @return int		0 if SDA is released.
+*/
+static int i2c_bus_recovery(I2C_HANDLE *ih)
+{
+  int i;
+
+  if( !ih->scl_dr ) return 0;
+
+  // take the pins from the component.
+  *ih->scl_dr |= ih->scl_mask;
+  *ih->sda_dr |= ih->sda_mask;
+  *ih->scl_byp &= ~ih->scl_mask;
+  *ih->sda_byp &= ~ih->sda_mask;
+  CyDelayUs( 5 );
+
+  // max 9 clocks. (I2C-bus specification 3.1.16)
+  for( i = 0; i < 9 && !(*ih->sda_ps & ih->sda_mask); i++ ) {
+    *ih->scl_dr &= ~ih->scl_mask;
+    CyDelayUs( 5 );
+    *ih->scl_dr |= ih->scl_mask;
+    CyDelayUs( 5 );
+  }
+
+  // STOP condition.
+  *ih->scl_dr &= ~ih->scl_mask;
+  CyDelayUs( 5 );
+  *ih->sda_dr &= ~ih->sda_mask;
+  CyDelayUs( 5 );
+  *ih->scl_dr |= ih->scl_mask;
+  CyDelayUs( 5 );
+  *ih->sda_dr |= ih->sda_mask;
+  CyDelayUs( 5 );
+
+  int ret = !(*ih->sda_ps & ih->sda_mask);
+
+  // return the pins to the component.
+  *ih->scl_byp |= ih->scl_mask;
+  *ih->sda_byp |= ih->sda_mask;
+
+  return ret;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+  @internal
+  @param  ih		pointer to I2C_HANDLE
+  @note
+    Don't use this directry. Use i2c_init macro.
+*/
+void i2c_init_m(I2C_HANDLE *ih,
+		uint8_t mstr_no_error,
+		uint8_t mstr_bus_busy,
+		uint8_t ack_data,
+		uint8_t nak_data,
+		uint8_t mode_complete_xfer,
+		uint8_t mode_repeat_start,
+		uint8_t mode_no_stop,
+		uint8_t mstat_rd_cmplt,
+		uint8_t mstat_wr_cmplt,
+		uint8_t mstat_xfer_inp,
+		uint8_t mstat_err_xfer,
+		uint8_t mstat_err_addr_nak,
+		uint8_t mstat_err_arb_lost,
+		uint8_t mstat_err_short_xfer,
+		void *Start,
+		void *Stop,
+		void *Enable,
+		void *MasterStatus,
+		void *MasterClearStatus,
+		void *MasterSendStart,
+		void *MasterSendRestart,
+		void *MasterSendStop,
+		void *MasterWriteByte,
+		void *MasterReadByte,
+		void *MasterWriteBuf,
+		void *MasterReadBuf)
+{
+  ih->msgs = 0;
+  ih->n_msgs = 0;
+  ih->idx = 0;
+  ih->state = I2C_XFER_IDLE;
+  ih->status = 0;
+  ih->flag_halted = 0;
+  ih->halted_address = 0;
+  ih->halted_flags = 0;
+  ih->retries = 0;
+  ih->n_retry = 0;
+  ih->timeout = I2C_DEFAULT_TIMEOUT;
+  ih->elapsed = 0;
+  ih->flag_bytes = 0;
+  ih->bytes_status = 0;
+  ih->done_callback = 0;
+  ih->user_data = 0;
+  ih->scl_dr = 0;
+
+  ih->MSTR_NO_ERROR = mstr_no_error;
+  ih->MSTR_BUS_BUSY = mstr_bus_busy;
+  ih->ACK_DATA = ack_data;
+  ih->NAK_DATA = nak_data;
+  ih->MODE_COMPLETE_XFER = mode_complete_xfer;
+  ih->MODE_REPEAT_START = mode_repeat_start;
+  ih->MODE_NO_STOP = mode_no_stop;
+  ih->MSTAT_RD_CMPLT = mstat_rd_cmplt;
+  ih->MSTAT_WR_CMPLT = mstat_wr_cmplt;
+  ih->MSTAT_XFER_INP = mstat_xfer_inp;
+  ih->MSTAT_ERR_XFER = mstat_err_xfer;
+  ih->MSTAT_ERR_ADDR_NAK = mstat_err_addr_nak;
+  ih->MSTAT_ERR_ARB_LOST = mstat_err_arb_lost;
+  ih->MSTAT_ERR_SHORT_XFER = mstat_err_short_xfer;
+
+  ih->Start = Start;
+  ih->Stop = Stop;
+  ih->Enable = Enable;
+  ih->MasterStatus = MasterStatus;
+  ih->MasterClearStatus = MasterClearStatus;
+  ih->MasterSendStart = MasterSendStart;
+  ih->MasterSendRestart = MasterSendRestart;
+  ih->MasterSendStop = MasterSendStop;
+  ih->MasterWriteByte = MasterWriteByte;
+  ih->MasterReadByte = MasterReadByte;
+  ih->MasterWriteBuf = MasterWriteBuf;
+  ih->MasterReadBuf = MasterReadBuf;
+
+  ih->Start();
+}
+
+
+//================================================================
+/*! initialize the bus recovery.
+  @internal
+  @param  ih		pointer to I2C_HANDLE
+  @note
+    Don't use this directry. Use i2c_init_recovery macro.
+*/
+void i2c_init_recovery_m(I2C_HANDLE *ih,
+			 void *scl_dr,
+			 void *scl_byp,
+			 uint8_t scl_mask,
+			 void *sda_dr,
+			 void *sda_ps,
+			 void *sda_byp,
+			 uint8_t sda_mask)
+{
+  ih->scl_dr = scl_dr;
+  ih->scl_byp = scl_byp;
+  ih->scl_mask = scl_mask;
+  ih->sda_dr = sda_dr;
+  ih->sda_ps = sda_ps;
+  ih->sda_byp = sda_byp;
+  ih->sda_mask = sda_mask;
+}
+
+
+//================================================================
+/*! start the transaction. (non-blocking)
+
+  @param  ih		pointer to I2C_HANDLE
+  @param  msgs		pointer to messages. keep it until done.
+  @param  n_msgs	number of messages.
+  @return int		0 if started.
+  @note
+    Each message is separated by repeated start,
+    and the last message ends with stop condition.
+    (unless I2C_MSG_NO_STOP)
+    If the previous transaction kept the bus, it starts with
+    repeated start. (if i2c_transfer_bytes() kept the bus,
+    it is released by stop condition first)
+    The deadline counts from here for all messages. (and each retry)
+    If start fails, done_callback is not called.
+*/
+int i2c_transfer_start(I2C_HANDLE *ih, const I2C_MSG *msgs, int n_msgs)
+{
+  if( n_msgs < 1 ) return -1;
+
+  // the poller may start a transaction in the ISR.
+  uint8 interrupts = CyEnterCriticalSection();
+  if( ih->state == I2C_XFER_BUSY ) {
+    CyExitCriticalSection( interrupts );
+    return -1;
+  }
+
+  // the component can't restart after its byte API.
+  if( ih->flag_halted == I2C_HALTED_BYTES ) {
+    ih->MasterSendStop();
+    ih->flag_halted = 0;
+  }
+
+  ih->msgs = msgs;
+  ih->n_msgs = n_msgs;
+  ih->idx = 0;
+  ih->n_retry = 0;
+  ih->elapsed = 0;
+  ih->status = 0;
+  ih->state = I2C_XFER_BUSY;
+
+  uint8_t ret = i2c_issue(ih);
+  if( ret != ih->MSTR_NO_ERROR ) {
+    ih->flag_halted = 0;
+    ih->status = i2c_start_error(ih, ret);
+    ih->state = I2C_XFER_DONE;
+  }
+  CyExitCriticalSection( interrupts );
+
+  return ret != ih->MSTR_NO_ERROR;
+}
+
+
+//================================================================
+/*! transfer byte by byte with the component API. (blocking)
+
+  @param  ih		pointer to I2C_HANDLE
+  @param  msgs		pointer to messages.
+  @param  n_msgs	number of messages.
+  @return int		I2C_ERR_*
+  @note
+    For the data phase continued over calls. Call this in the task.
+    If the last call kept the bus by I2C_MSG_NO_STOP and the first
+    message has the same address and direction, its data follows
+    without start condition and address. (e.g. EEPROM page write
+    in chunks)
+    The last byte of a read with I2C_MSG_NO_STOP is acknowledged,
+    so the slave keeps sending.
+    The component waits for each byte. At the deadline, i2c_tick()
+    clocks SCL by the bus recovery to finish the byte in progress,
+    and the transfer ends with the component reset.
+*/
+int i2c_transfer_bytes(I2C_HANDLE *ih, const I2C_MSG *msgs, int n_msgs)
+{
+  const I2C_MSG *msg = msgs;
+  uint8_t ret;
+  int err = I2C_ERR_NONE;
+  int flag_no_stop;
+  int i, j;
+
+  if( n_msgs < 1 ) return I2C_ERR_XFER;
+  flag_no_stop = !!(msgs[n_msgs - 1].flags & I2C_MSG_NO_STOP);
+
+  // keep the poller away during the transfer.
+  uint8 interrupts = CyEnterCriticalSection();
+  if( ih->state == I2C_XFER_BUSY ) {
+    CyExitCriticalSection( interrupts );
+    return I2C_ERR_BUSY;
+  }
+  int halted = ih->flag_halted;
+  ih->flag_halted = I2C_HALTED_BYTES;
+  ih->elapsed = 0;
+  ih->bytes_status = I2C_ERR_NONE;
+  ih->flag_bytes = 1;
+  CyExitCriticalSection( interrupts );
+
+  // the component can't continue the data phase of the transaction.
+  if( halted == I2C_HALTED_XFER ) {
+    ih->MasterSendStop();
+    halted = 0;
+  }
+
+  for( i = 0; i < n_msgs; i++, msg++ ) {
+    int flag_read = msg->flags & I2C_MSG_READ;
+
+    if( i == 0 && halted == I2C_HALTED_BYTES &&
+	msg->address == ih->halted_address &&
+	flag_read == (ih->halted_flags & I2C_MSG_READ) ) {
+      // continue the data phase.
+    } else {
+      if( i == 0 && !halted ) {
+	ih->MasterClearStatus();
+	ret = ih->MasterSendStart( msg->address, !!flag_read );
+      } else {
+	ret = ih->MasterSendRestart( msg->address, !!flag_read );
+      }
+      if( ih->bytes_status ) goto ABORTED;
+      if( ret != ih->MSTR_NO_ERROR ) {
+	err = i2c_start_error(ih, ret);
+	goto ERROR;
+      }
+    }
+
+    if( flag_read ) {
+      for( j = 0; j < msg->len; j++ ) {
+	int flag_nak = (j == msg->len - 1) && !(i == n_msgs - 1 && flag_no_stop);
+	msg->buf[j] = ih->MasterReadByte( flag_nak ? ih->NAK_DATA : ih->ACK_DATA );
+	if( ih->bytes_status ) goto ABORTED;
+      }
+    } else {
+      for( j = 0; j < msg->len; j++ ) {
+	ret = ih->MasterWriteByte( msg->buf[j] );
+	if( ih->bytes_status ) goto ABORTED;
+	if( ret != ih->MSTR_NO_ERROR ) {
+	  err = I2C_ERR_DATA_NAK;
+	  goto ERROR;
+	}
+      }
+    }
+  }
+
+  // the deadline may pass after the last byte.
+  interrupts = CyEnterCriticalSection();
+  ih->flag_bytes = 0;
+  CyExitCriticalSection( interrupts );
+  if( ih->bytes_status ) goto ABORTED;
+
+  if( flag_no_stop ) {
+    ih->halted_address = msgs[n_msgs - 1].address;
+    ih->halted_flags = msgs[n_msgs - 1].flags;
+    return I2C_ERR_NONE;
+  }
+
+ ERROR:
+  ih->flag_bytes = 0;
+  ih->MasterSendStop();
+  ih->flag_halted = 0;
+  return err;
+
+ ABORTED:
+  // the bus was recovered by i2c_tick(). reset the component.
+  ih->Stop();
+  ih->Start();
+  ih->flag_halted = 0;
+  return ih->bytes_status;
+}
+
+
+//================================================================
+/*! advance the transaction from the task.
+
+  @param  ih		pointer to I2C_HANDLE
+*/
+void i2c_poll(I2C_HANDLE *ih)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+  i2c_isr(ih);
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! timer tick. check the deadline.
+
+  @param  ih		pointer to I2C_HANDLE
+  @note
+    Call this every 1ms from the timer ISR, or from the waiting loop.
+    The deadline of i2c_transfer_bytes() is checked only here.
+*/
+void i2c_tick(I2C_HANDLE *ih)
+{
+  if( ih->timeout == 0 ) return;
+
+  if( ih->flag_bytes ) {
+    if( ++ih->elapsed < ih->timeout ) return;
+
+    // the task waits in the byte API. finish the byte by the clocks.
+    ih->flag_bytes = 0;
+    ih->bytes_status = i2c_bus_recovery(ih) ? I2C_ERR_BUS_STUCK : I2C_ERR_TIMEOUT;
+    return;
+  }
+
+  if( ih->state != I2C_XFER_BUSY ) return;
+
+  if( ++ih->elapsed >= ih->timeout ) i2c_abort(ih, I2C_ERR_TIMEOUT);
+}
+
+
+//================================================================
+/*! abort the transaction. reset the component and recover the bus.
+
+  @param  ih		pointer to I2C_HANDLE
+  @param  status	I2C_ERR_*
+*/
+void i2c_abort(I2C_HANDLE *ih, int status)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  if( ih->state == I2C_XFER_BUSY ) {
+    ih->Stop();		// it disables the interrupt too.
+    if( i2c_bus_recovery(ih) != 0 ) status = I2C_ERR_BUS_STUCK;
+    ih->Start();
+    i2c_fail(ih, status);
+  }
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! release the bus kept by I2C_MSG_NO_STOP.
+
+  @param  ih		pointer to I2C_HANDLE
+*/
+void i2c_release(I2C_HANDLE *ih)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  if( ih->state != I2C_XFER_BUSY && ih->flag_halted ) {
+    ih->MasterSendStop();
+    ih->flag_halted = 0;
+  }
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! initialize the poller.
+
+  @param  pl		pointer to I2C_POLLER
+  @param  ih		pointer to I2C_HANDLE
+*/
+void i2c_poller_init(I2C_POLLER *pl, I2C_HANDLE *ih)
+{
+  pl->ih = ih;
+  pl->jobs = 0;
+  pl->active = 0;
+  pl->last = 0;
+  pl->tick = 0;
+  pl->flag_pause = 0;
+}
+
+
+//================================================================
+/*! timer tick. call this every 1ms from the periodic timer ISR.
+
+  @param  pl		pointer to I2C_POLLER
+  @note
+    It also checks the deadline of the transaction.
+*/
+void i2c_poller_tick(I2C_POLLER *pl)
+{
+  I2C_POLL_JOB *job;
+
+  i2c_tick(pl->ih);
+  pl->tick++;
+  for( job = pl->jobs; job; job = job->next ) {
+    if( --job->countdown == 0 ) {
+      job->countdown = job->period;
+      job->flag_pending = 1;
+    }
+  }
+
+  i2c_poller_kick(pl);
+}
+
+
+//================================================================
+/*! start the next pending job if the bus is free.
+
+  @param  pl		pointer to I2C_POLLER
+  @note
+    Jobs are served in round robin. Nothing starts while paused.
+*/
+void i2c_poller_kick(I2C_POLLER *pl)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  if( pl->active || !pl->jobs || pl->flag_pause ) goto DONE;
+  if( i2c_is_busy(pl->ih) || pl->ih->flag_halted ) goto DONE;
+
+  I2C_POLL_JOB *job = pl->last;
+  I2C_POLL_JOB *first = 0;
+  while( 1 ) {
+    job = (job && job->next) ? job->next : pl->jobs;
+    if( job == first ) break;	// all jobs checked.
+    if( !first ) first = job;
+    if( !job->flag_pending ) continue;
+    job->flag_pending = 0;
+
+    uint16_t wr = job->wr + 1;
+    if( wr >= job->n_slots ) wr = 0;
+    if( wr == job->rd ) {
+      job->overflow++;		// ring buffer full
+      continue;
+    }
+
+    // timestamp, and read into the slot directly.
+    uint8_t *slot = job->slots + job->wr * I2C_POLL_SLOT_SIZE(job->len);
+    uint32_t tick = pl->tick;
+    memcpy( slot, &tick, sizeof(tick) );
+
+    pl->reg = job->reg;
+    pl->msgs[0] = (I2C_MSG){ .address = job->address, .flags = 0,
+			     .len = 1, .buf = &pl->reg };
+    pl->msgs[1] = (I2C_MSG){ .address = job->address, .flags = I2C_MSG_READ,
+			     .len = job->len, .buf = slot + sizeof(tick) };
+    if( i2c_transfer_start( pl->ih, pl->msgs, 2 ) != 0 ) {
+      job->flag_pending = 1;	// retry at next chance.
+      goto DONE;
+    }
+    pl->active = job;
+    pl->last = job;
+    break;
+  }
+
+ DONE:
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! start the jobs again, after i2c_poller_pause().
+
+  @param  pl		pointer to I2C_POLLER
+*/
+void i2c_poller_resume(I2C_POLLER *pl)
+{
+  pl->flag_pause = 0;
+  i2c_poller_kick(pl);
+}
+
+
+//================================================================
+/*! transaction done. call this from the done callback.
+
+  @param  pl		pointer to I2C_POLLER
+  @return int		1 if the transaction was the poller's job.
+*/
+int i2c_poller_done(I2C_POLLER *pl)
+{
+  I2C_POLL_JOB *job = pl->active;
+  if( !job ) return 0;
+
+  if( i2c_status(pl->ih) == 0 ) {
+    uint16_t wr = job->wr + 1;
+    if( wr >= job->n_slots ) wr = 0;
+    job->wr = wr;
+  } else {
+    job->errors++;
+  }
+  pl->active = 0;
+  i2c_clear_done(pl->ih);
+
+  i2c_poller_kick(pl);
+  return 1;
+}
+
+
+//================================================================
+/*! add the job.
+
+  @param  pl		pointer to I2C_POLLER
+  @param  job		pointer to I2C_POLL_JOB. all fields must be set.
+*/
+void i2c_poller_add(I2C_POLLER *pl, I2C_POLL_JOB *job)
+{
+  job->countdown = job->period;
+  job->flag_pending = 0;
+  job->rd = 0;
+  job->wr = 0;
+  job->overflow = 0;
+  job->errors = 0;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  job->next = pl->jobs;
+  pl->jobs = job;
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! remove the job.
+
+  @param  pl		pointer to I2C_POLLER
+  @param  job		pointer to I2C_POLL_JOB
+  @return int		0 if removed. -1 if the job is in progress.
+*/
+int i2c_poller_remove(I2C_POLLER *pl, I2C_POLL_JOB *job)
+{
+  I2C_POLL_JOB **pp;
+  int ret = 0;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  if( pl->active == job ) {
+    ret = -1;
+    goto DONE;
+  }
+  for( pp = &pl->jobs; *pp; pp = &(*pp)->next ) {
+    if( *pp == job ) {
+      *pp = job->next;
+      break;
+    }
+  }
+  if( pl->last == job ) pl->last = 0;
+
+ DONE:
+  CyExitCriticalSection( interrupts );
+  return ret;
+}
+
+
+//================================================================
+/*! read a sample from the ring buffer.
+
+  @param  job		pointer to I2C_POLL_JOB
+  @param  timestamp	pointer to timestamp. (out)
+  @param  buf		pointer to buffer. (len bytes)
+  @return int		1 if read, 0 if empty.
+*/
+int i2c_poller_read(I2C_POLL_JOB *job, uint32_t *timestamp, uint8_t *buf)
+{
+  uint16_t rd = job->rd;
+  if( rd == job->wr ) return 0;
+
+  const uint8_t *slot = job->slots + rd * I2C_POLL_SLOT_SIZE(job->len);
+  memcpy( timestamp, slot, sizeof(uint32_t) );
+  memcpy( buf, slot + sizeof(uint32_t), job->len );
+
+  if( ++rd >= job->n_slots ) rd = 0;
+  job->rd = rd;
+  return 1;
+}
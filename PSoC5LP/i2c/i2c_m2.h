@@ -0,0 +1,375 @@
+/*! @file
+  @brief
+  I2C master convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+  @note This version supports up to 3 interfaces.
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+#ifndef	PSOC5_I2CMWRAP_H_
+#define	PSOC5_I2CMWRAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! flags of I2C_MSG.
+#define I2C_MSG_READ	0x01
+#define I2C_MSG_NO_STOP	0x02	// last message only. keep the bus.
+
+//! how the bus is kept. (flag_halted)
+#define I2C_HALTED_XFER		1	// by the interrupt driven transaction.
+#define I2C_HALTED_BYTES	2	// by i2c_transfer_bytes().
+
+//! status of the transaction.
+enum {
+  I2C_ERR_NONE = 0,
+  I2C_ERR_BUSY,		// bus busy or not ready.
+  I2C_ERR_ADDR_NAK,	// slave address not acknowledged.
+  I2C_ERR_DATA_NAK,	// data not acknowledged. (short transfer)
+  I2C_ERR_ARB_LOST,	// arbitration lost.
+  I2C_ERR_XFER,		// other transfer error.
+  I2C_ERR_TIMEOUT,	// deadline exceeded. (clock stretching or stuck)
+  I2C_ERR_BUS_STUCK,	// SDA held low after the bus recovery.
+};
+
+//! default deadline of a transaction in ms.
+#ifndef I2C_DEFAULT_TIMEOUT
+# define I2C_DEFAULT_TIMEOUT 10
+#endif
+
+//! state of the transaction.
+enum {
+  I2C_XFER_IDLE = 0,
+  I2C_XFER_BUSY,
+  I2C_XFER_DONE,
+};
+
+
+/***** Macros ***************************************************************/
+//! Convenience macro to define the ISR exit callback.
+#define I2C_ISR(ih, NAME)			\
+  void NAME ## _ISR_ExitCallback(void) {	\
+    i2c_isr(ih);				\
+  }
+
+//! Initializer macro for I2C Master
+#define i2c_init(ih, NAME)				\
+  i2c_init_m( ih,					\
+	      NAME ## _MSTR_NO_ERROR,			\
+	      NAME ## _MSTR_BUS_BUSY,			\
+	      NAME ## _ACK_DATA,			\
+	      NAME ## _NAK_DATA,			\
+	      NAME ## _MODE_COMPLETE_XFER,		\
+	      NAME ## _MODE_REPEAT_START,		\
+	      NAME ## _MODE_NO_STOP,			\
+	      NAME ## _MSTAT_RD_CMPLT,			\
+	      NAME ## _MSTAT_WR_CMPLT,			\
+	      NAME ## _MSTAT_XFER_INP,			\
+	      NAME ## _MSTAT_ERR_XFER,			\
+	      NAME ## _MSTAT_ERR_ADDR_NAK,		\
+	      NAME ## _MSTAT_ERR_ARB_LOST,		\
+	      NAME ## _MSTAT_ERR_SHORT_XFER,		\
+	      NAME ## _Start,				\
+	      NAME ## _Stop,				\
+	      NAME ## _Enable,				\
+	      NAME ## _MasterStatus,			\
+	      NAME ## _MasterClearStatus,		\
+	      NAME ## _MasterSendStart,			\
+	      NAME ## _MasterSendRestart,		\
+	      NAME ## _MasterSendStop,			\
+	      NAME ## _MasterWriteByte,			\
+	      NAME ## _MasterReadByte,			\
+	      NAME ## _MasterWriteBuf,			\
+	      NAME ## _MasterReadBuf)
+
+//! Initializer macro for the bus recovery. SCL and SDA are names of pins.
+#define i2c_init_recovery(ih, SCL, SDA)			\
+  i2c_init_recovery_m( ih,				\
+		       (void *)SCL ## __DR,		\
+		       (void *)SCL ## __BYP,		\
+		       SCL ## __MASK,			\
+		       (void *)SDA ## __DR,		\
+		       (void *)SDA ## __PS,		\
+		       (void *)SDA ## __BYP,		\
+		       SDA ## __MASK)
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! transfer message. (like Linux i2c_msg)
+*/
+typedef struct I2C_MSG {
+  uint8_t address;	//!< 7bit I2C address.
+  uint8_t flags;	//!< I2C_MSG_READ or 0 (write)
+  uint8_t len;		//!< length of data.
+  uint8_t *buf;		//!< pointer to data.
+} I2C_MSG;
+
+
+//================================================================
+/*! I2C handle.
+*/
+typedef struct I2C_HANDLE {
+  // transaction engine
+  const I2C_MSG *msgs;
+  uint8_t n_msgs;
+  volatile uint8_t idx;		// index of the message in progress.
+  volatile uint8_t state;	// I2C_XFER_IDLE, BUSY or DONE.
+  volatile uint8_t status;	// I2C_ERR_*
+  volatile uint8_t flag_halted;	// I2C_HALTED_* if kept by I2C_MSG_NO_STOP.
+  uint8_t halted_address;	// the data phase kept by i2c_transfer_bytes().
+  uint8_t halted_flags;
+  uint8_t retries;		// max number of retries.
+  volatile uint8_t n_retry;
+  uint16_t timeout;		// deadline of an attempt in ms. 0 is none.
+  volatile uint16_t elapsed;	// counted by i2c_tick().
+  volatile uint8_t flag_bytes;	// i2c_transfer_bytes() in progress.
+  volatile uint8_t bytes_status; // I2C_ERR_* set by i2c_tick() at the deadline.
+  void (*done_callback)(struct I2C_HANDLE *ih);	// called in the ISR.
+  void *user_data;
+
+  // bus recovery pins. (optional)
+  volatile uint8_t *scl_dr;
+  volatile uint8_t *scl_byp;
+  volatile uint8_t *sda_dr;
+  volatile uint8_t *sda_ps;
+  volatile uint8_t *sda_byp;
+  uint8_t scl_mask;
+  uint8_t sda_mask;
+
+  // constant table
+  uint8_t MSTR_NO_ERROR;
+  uint8_t MSTR_BUS_BUSY;
+  uint8_t ACK_DATA;
+  uint8_t NAK_DATA;
+  uint8_t MODE_COMPLETE_XFER;
+  uint8_t MODE_REPEAT_START;
+  uint8_t MODE_NO_STOP;
+  uint8_t MSTAT_RD_CMPLT;
+  uint8_t MSTAT_WR_CMPLT;
+  uint8_t MSTAT_XFER_INP;
+  uint8_t MSTAT_ERR_XFER;
+  uint8_t MSTAT_ERR_ADDR_NAK;
+  uint8_t MSTAT_ERR_ARB_LOST;
+  uint8_t MSTAT_ERR_SHORT_XFER;
+
+  // function table
+  void (*Start)(void);
+  void (*Stop)(void);
+  void (*Enable)(void);
+  uint8_t (*MasterStatus)(void);
+  uint8_t (*MasterClearStatus)(void);
+  uint8_t (*MasterSendStart)(uint8_t, uint8_t);
+  uint8_t (*MasterSendRestart)(uint8_t, uint8_t);
+  uint8_t (*MasterSendStop)(void);
+  uint8_t (*MasterWriteByte)(uint8_t);
+  uint8_t (*MasterReadByte)(uint8_t);
+  uint8_t (*MasterWriteBuf)(uint8_t, uint8_t *, uint8_t, uint8_t);
+  uint8_t (*MasterReadBuf)(uint8_t, uint8_t *, uint8_t, uint8_t);
+
+} I2C_HANDLE;
+
+
+//================================================================
+/*! periodic read job of the poller.
+*/
+typedef struct I2C_POLL_JOB {
+  struct I2C_POLL_JOB *next;
+  uint8_t address;		// 7bit I2C address.
+  uint8_t reg;			// register address to read.
+  uint8_t len;			// bytes per sample.
+  volatile uint8_t flag_pending; // the period has elapsed.
+  uint16_t period;		// in ticks.
+  uint16_t countdown;
+  uint16_t n_slots;		// size of ring buffer in samples.
+  volatile uint16_t rd;
+  volatile uint16_t wr;
+  volatile uint16_t overflow;	// dropped samples. (ring buffer full)
+  volatile uint16_t errors;	// failed transactions.
+  uint8_t *slots;		// n_slots * I2C_POLL_SLOT_SIZE(len)
+} I2C_POLL_JOB;
+
+//! size of a sample slot. timestamp (uint32_t) and data.
+#define I2C_POLL_SLOT_SIZE(len) (sizeof(uint32_t) + (len))
+
+
+//================================================================
+/*! background acquisition scheduler. (one for each bus)
+*/
+typedef struct I2C_POLLER {
+  I2C_HANDLE *ih;
+  I2C_POLL_JOB *jobs;		// list of jobs.
+  I2C_POLL_JOB * volatile active; // job in progress.
+  I2C_POLL_JOB *last;		// last started job. for round robin.
+  volatile uint32_t tick;	// timestamp.
+  volatile uint8_t flag_pause;	// a foreground transaction keeps the bus.
+  uint8_t reg;			// copy of the register address.
+  I2C_MSG msgs[2];
+} I2C_POLLER;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void i2c_isr(I2C_HANDLE *ih);
+void i2c_init_m(I2C_HANDLE *ih,
+		uint8_t mstr_no_error,
+		uint8_t mstr_bus_busy,
+		uint8_t ack_data,
+		uint8_t nak_data,
+		uint8_t mode_complete_xfer,
+		uint8_t mode_repeat_start,
+		uint8_t mode_no_stop,
+		uint8_t mstat_rd_cmplt,
+		uint8_t mstat_wr_cmplt,
+		uint8_t mstat_xfer_inp,
+		uint8_t mstat_err_xfer,
+		uint8_t mstat_err_addr_nak,
+		uint8_t mstat_err_arb_lost,
+		uint8_t mstat_err_short_xfer,
+		void *Start,
+		void *Stop,
+		void *Enable,
+		void *MasterStatus,
+		void *MasterClearStatus,
+		void *MasterSendStart,
+		void *MasterSendRestart,
+		void *MasterSendStop,
+		void *MasterWriteByte,
+		void *MasterReadByte,
+		void *MasterWriteBuf,
+		void *MasterReadBuf);
+void i2c_init_recovery_m(I2C_HANDLE *ih,
+			 void *scl_dr,
+			 void *scl_byp,
+			 uint8_t scl_mask,
+			 void *sda_dr,
+			 void *sda_ps,
+			 void *sda_byp,
+			 uint8_t sda_mask);
+int i2c_transfer_start(I2C_HANDLE *ih, const I2C_MSG *msgs, int n_msgs);
+int i2c_transfer_bytes(I2C_HANDLE *ih, const I2C_MSG *msgs, int n_msgs);
+void i2c_poll(I2C_HANDLE *ih);
+void i2c_tick(I2C_HANDLE *ih);
+void i2c_abort(I2C_HANDLE *ih, int status);
+void i2c_release(I2C_HANDLE *ih);
+void i2c_poller_init(I2C_POLLER *pl, I2C_HANDLE *ih);
+void i2c_poller_tick(I2C_POLLER *pl);
+void i2c_poller_kick(I2C_POLLER *pl);
+void i2c_poller_resume(I2C_POLLER *pl);
+int i2c_poller_done(I2C_POLLER *pl);
+void i2c_poller_add(I2C_POLLER *pl, I2C_POLL_JOB *job);
+int i2c_poller_remove(I2C_POLLER *pl, I2C_POLL_JOB *job);
+int i2c_poller_read(I2C_POLL_JOB *job, uint32_t *timestamp, uint8_t *buf);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! Is a transaction in progress?
+
+  @param  ih		pointer to I2C_HANDLE
+  @return int	true or false
+*/
+static inline int i2c_is_busy(const I2C_HANDLE *ih)
+{
+  return ih->state == I2C_XFER_BUSY;
+}
+
+
+//================================================================
+/*! Has the transaction completed? (until the next transaction)
+
+  @param  ih		pointer to I2C_HANDLE
+  @return int	true or false
+*/
+static inline int i2c_is_done(const I2C_HANDLE *ih)
+{
+  return ih->state == I2C_XFER_DONE;
+}
+
+
+//================================================================
+/*! Forget the completed transaction.
+
+  @param  ih		pointer to I2C_HANDLE
+*/
+static inline void i2c_clear_done(I2C_HANDLE *ih)
+{
+  if( ih->state == I2C_XFER_DONE ) ih->state = I2C_XFER_IDLE;
+}
+
+
+//================================================================
+/*! Result of the transaction.
+
+  @param  ih		pointer to I2C_HANDLE
+  @return int	I2C_ERR_*
+*/
+static inline int i2c_status(const I2C_HANDLE *ih)
+{
+  return ih->status;
+}
+
+
+//================================================================
+/*! Number of samples in the ring buffer.
+
+  @param  job		pointer to I2C_POLL_JOB
+  @return int		number of samples.
+*/
+static inline int i2c_poller_available(const I2C_POLL_JOB *job)
+{
+  uint16_t wr = job->wr;
+
+  if( job->rd <= wr ) {
+    return wr - job->rd;
+  } else {
+    return job->n_slots - job->rd + wr;
+  }
+}
+
+
+//================================================================
+/*! Don't start new jobs. The job in progress continues.
+
+  @param  pl		pointer to I2C_POLLER
+*/
+static inline void i2c_poller_pause(I2C_POLLER *pl)
+{
+  pl->flag_pause = 1;
+}
+
+
+//================================================================
+/*! Set the deadline and the retry policy.
+
+  @param  ih		pointer to I2C_HANDLE
+  @param  timeout	deadline of an attempt in ms. 0 is none.
+  @param  retries	max number of retries.
+*/
+static inline void i2c_set_policy(I2C_HANDLE *ih, int timeout, int retries)
+{
+  ih->timeout = timeout;
+  ih->retries = retries;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,359 @@
+/*! @file
+  @brief
+  I2C slave class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Kyushu Institute of Technology.
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Communication > I2C >
+        EZI2C Slave" device.
+   2. Open a configure dialog.
+   3. Make sure the name is "EZI2C_1".
+   4. Set the Data rate and Primary slave address.
+      Number of addresses is 1, Sub-address size is 8 bits.
+   5. Close this dialog.
+   6. Add following lines to the auto-generated "cyapicallbacks.h".
+	#define EZI2C_1_ISR_EXIT_CALLBACK
+	void EZI2C_1_ISR_ExitCallback(void);
+
+  More I2C slave devices?
+      Place "EZI2C_2" in the same way and define MRBC_NUM_I2CS=2.
+
+
+  C program (main.c)
+    #include "c_i2cs.h"
+    mrbc_init_class_i2cs(0);
+
+
+  mruby program
+
+    # 64 bytes register file, host can write to 0..15.
+    #  read:  S - ADRS W - sub_adrs - Sr - ADRS R - data... - P
+    #  write: S - ADRS W - sub_adrs - data... - P
+    regs = I2CSlave.new( 1, 64, 16 )
+    regs.update( 0x20, "\x12\x34" )	# update the table.
+    s = regs.fetch( 0, 16 )		# get the table.
+    regs.changed?			# host has changed?
+    a = regs.changes			# => [offset, ...] changed by host.
+    regs.wait_change			# sleep until the host changes.
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "i2c_s2.h"
+#include "task2.h"
+
+
+//================================================================
+/*! I2C slave用設定
+*/
+#if !defined(MRBC_NUM_I2CS)
+# define MRBC_NUM_I2CS 1
+#endif
+
+//! attribute of each interface.
+struct I2CS_attr {
+  I2CS_HANDLE *sh;
+  uint8_t *regs;		// register file and the shadow.
+  mrbc_tcb *volatile waiting_tcb;	// task waiting for the change.
+};
+
+static I2CS_HANDLE i2csh[MRBC_NUM_I2CS];
+static struct I2CS_attr i2cs_attr[MRBC_NUM_I2CS];
+
+#if MRBC_NUM_I2CS >= 1
+I2CS_ISR( &i2csh[0], EZI2C_1 );
+#endif
+#if MRBC_NUM_I2CS >= 2
+I2CS_ISR( &i2csh[1], EZI2C_2 );
+#endif
+#if MRBC_NUM_I2CS >= 3
+#error "MRBC_NUM_I2CS >= 3"
+#endif
+
+
+//================================================================
+/*! change callback. (called in the ISR)
+*/
+static void i2cs_change_callback(I2CS_HANDLE *sh)
+{
+  struct I2CS_attr *attr = sh->user_data;
+
+  task_wakeup( &attr->waiting_tcb );
+}
+
+
+
+//================================================================
+/*! I2CSlave constructor
+
+  $i2cs = I2CSlave.new( num, reg_size, rw_boundary )
+
+  @param  num		interface number. 1 origin.
+  @param  reg_size	size of the register file. (1..256)
+  @param  rw_boundary	host can write to 0...rw_boundary. (default 0)
+*/
+static void c_i2cs_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int i2cs_num = v[1].i - 1;
+  if( i2cs_num < 0 || i2cs_num >= MRBC_NUM_I2CS ) goto ERROR_PARAM;
+
+  int reg_size = v[2].i;
+  if( reg_size <= 0 || reg_size > I2CS_MAX_REG_SIZE ) goto ERROR_PARAM;
+
+  int rw_boundary = 0;
+  if( argc >= 3 ) {
+    if( v[3].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    rw_boundary = v[3].i;
+    if( rw_boundary < 0 || rw_boundary > reg_size ) goto ERROR_PARAM;
+  }
+
+  struct I2CS_attr *attr = &i2cs_attr[i2cs_num];
+
+  // register file and the shadow in one block.
+  uint8_t *regs = mrbc_raw_alloc( reg_size + rw_boundary );
+  if( !regs ) goto ERROR_RETURN;	// ENOMEM
+  memset( regs, 0, reg_size + rw_boundary );
+
+  mrbc_value val = mrbc_instance_new(vm, v->cls, sizeof(struct I2CS_attr *));
+  if( val.instance == NULL ) {	// ENOMEM
+    mrbc_raw_free( regs );
+    goto ERROR_RETURN;
+  }
+  *((struct I2CS_attr **)val.instance->data) = attr;
+
+  i2cs_set_buffer( attr->sh, regs, regs + reg_size, reg_size, rw_boundary );
+  if( attr->regs ) mrbc_raw_free( attr->regs );
+  attr->regs = regs;
+
+  SET_RETURN( val );
+  return;
+
+ ERROR_PARAM:
+  console_printf("I2CSlave: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! update the register file
+
+  $i2cs.update( offset, s )
+  $i2cs.update( offset, [byte, ...] )
+
+  The region is updated at once. The host never reads it half updated.
+  The data must fit in the register file from the offset.
+*/
+static void c_i2cs_update(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  I2CS_HANDLE *sh = (*(struct I2CS_attr **)v->instance->data)->sh;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[1].i < 0 || v[1].i >= sh->reg_size ) goto ERROR_PARAM;
+
+  if( v[2].tt == MRBC_TT_STRING ) {
+    int n = mrbc_string_size(&v[2]);
+    if( n > sh->reg_size - v[1].i ) goto ERROR_PARAM;
+    i2cs_update( sh, v[1].i, mrbc_string_cstr(&v[2]), n );
+
+  } else if( v[2].tt == MRBC_TT_ARRAY ) {
+    uint8_t buf[I2CS_MAX_REG_SIZE];
+    int n = mrbc_array_size(&v[2]);
+    int i;
+    if( n > sh->reg_size - v[1].i ) goto ERROR_PARAM;
+    for( i = 0; i < n; i++ ) {
+      mrbc_value val = mrbc_array_get(&v[2], i);
+      if( val.tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+      buf[i] = val.i;
+    }
+    i2cs_update( sh, v[1].i, buf, n );
+
+  } else {
+    goto ERROR_PARAM;
+  }
+
+  SET_NIL_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("I2CSlave: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! fetch the register file
+
+  s = $i2cs.fetch( offset, length )
+*/
+static void c_i2cs_fetch(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  I2CS_HANDLE *sh = (*(struct I2CS_attr **)v->instance->data)->sh;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int offset = v[1].i;
+  int len = v[2].i;
+  if( offset < 0 || offset >= sh->reg_size || len < 0 ) goto ERROR_PARAM;
+  if( len > sh->reg_size - offset ) len = sh->reg_size - offset;
+
+  mrbc_value ret = mrbc_string_new( vm, 0, len );
+  if( ret.tt != MRBC_TT_STRING ) goto ERROR_RETURN;	// ENOMEM
+  i2cs_fetch( sh, offset, mrbc_string_cstr(&ret), len );
+
+  SET_RETURN(ret);
+  return;
+
+ ERROR_PARAM:
+  console_printf("I2CSlave: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! Has the host changed the register file?
+
+  $i2cs.changed?
+*/
+static void c_i2cs_changed(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  I2CS_HANDLE *sh = (*(struct I2CS_attr **)v->instance->data)->sh;
+  SET_BOOL_RETURN( i2cs_is_changed( sh ) );
+}
+
+
+//================================================================
+/*! take the offsets changed by the host
+
+  a = $i2cs.changes	# => [offset, ...]
+
+  The dirty flags of the returned offsets are cleared.
+*/
+static void c_i2cs_changes(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  I2CS_HANDLE *sh = (*(struct I2CS_attr **)v->instance->data)->sh;
+  uint8_t offsets[I2CS_MAX_REG_SIZE];
+
+  int n = i2cs_take_changes( sh, offsets, sizeof(offsets) );
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( ret.tt != MRBC_TT_ARRAY ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    mrbc_value val = mrbc_fixnum_value( offsets[i] );
+    mrbc_array_set( &ret, i, &val );
+  }
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! sleep until the host changes the register file
+
+  $i2cs.wait_change
+  a = $i2cs.changes
+
+  Other tasks run while waiting.
+*/
+static void c_i2cs_wait_change(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  struct I2CS_attr *attr = *(struct I2CS_attr **)v->instance->data;
+  mrbc_tcb *tcb = VM2TCB(vm);
+
+  SET_NIL_RETURN();
+  if( i2cs_is_changed( attr->sh ) ) return;
+
+  // the task sleeps after the method returns.
+  mrbc_suspend_task( tcb );
+
+  uint8 interrupts = CyEnterCriticalSection();
+  if( i2cs_is_changed( attr->sh ) ) {
+    mrbc_resume_task( tcb );
+  } else {
+    attr->waiting_tcb = tcb;
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! bus activity since the last call
+
+  $i2cs.activity	# => Integer
+
+  bit 0: the host has read.
+  bit 1: the host has written.
+  bit 7: error.
+*/
+static void c_i2cs_activity(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  I2CS_HANDLE *sh = (*(struct I2CS_attr **)v->instance->data)->sh;
+  int status = i2cs_get_activity( sh );
+  int ret = 0;
+
+  if( status & sh->STATUS_READ1 ) ret |= 0x01;
+  if( status & sh->STATUS_WRITE1 ) ret |= 0x02;
+  if( status & sh->STATUS_ERR ) ret |= 0x80;
+
+  SET_INT_RETURN(ret);
+}
+
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_i2cs(struct VM *vm)
+{
+  int i;
+
+  // start physical device
+#if MRBC_NUM_I2CS >= 1
+  i2cs_init( &i2csh[0], EZI2C_1 );
+#endif
+#if MRBC_NUM_I2CS >= 2
+  i2cs_init( &i2csh[1], EZI2C_2 );
+#endif
+
+  for( i = 0; i < MRBC_NUM_I2CS; i++ ) {
+    i2cs_attr[i].sh = &i2csh[i];
+    i2csh[i].change_callback = i2cs_change_callback;
+    i2csh[i].user_data = &i2cs_attr[i];
+  }
+
+  // define class and methods.
+  mrbc_class *i2cs;
+  i2cs = mrbc_define_class(0, "I2CSlave",	mrbc_class_object);
+  mrbc_define_method(0, i2cs, "new",		c_i2cs_new);
+  mrbc_define_method(0, i2cs, "update",		c_i2cs_update);
+  mrbc_define_method(0, i2cs, "fetch",		c_i2cs_fetch);
+  mrbc_define_method(0, i2cs, "changed?",	c_i2cs_changed);
+  mrbc_define_method(0, i2cs, "changes",	c_i2cs_changes);
+  mrbc_define_method(0, i2cs, "wait_change",	c_i2cs_wait_change);
+  mrbc_define_method(0, i2cs, "activity",	c_i2cs_activity);
+}
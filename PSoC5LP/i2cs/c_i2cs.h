@@ -0,0 +1,28 @@
+/*! @file
+  @brief
+  I2C slave class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Kyushu Institute of Technology.
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_PSOC5LP_I2CS_H_
+#define MRBC_PSOC5LP_I2CS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct VM;
+void mrbc_init_class_i2cs(struct VM *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,251 @@
+/*! @file
+  @brief
+  I2C slave (EZI2C) convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+  @note This version supports up to 2 interfaces.
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "i2c_s2.h"
+
+/***** Constant values ******************************************************/
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+
+//================================================================
+/*! find the bytes changed by the host. (compare with the shadow)
+
+  @return int	number of newly changed bytes.
+*/
+static int i2cs_scan_changes(I2CS_HANDLE *sh)
+{
+  int n = 0;
+  int i;
+
+  for( i = 0; i < sh->rw_boundary; i++ ) {
+    uint8_t data = sh->regs[i];
+    if( data == sh->shadow[i] ) continue;
+
+    sh->shadow[i] = data;
+    if( sh->dirty[i >> 3] & (1 << (i & 7)) ) continue;
+    sh->dirty[i >> 3] |= (1 << (i & 7));
+    n++;
+  }
+  sh->n_changed += n;
+
+  return n;
+}
+
+
+//================================================================
+/*! Intterrupt callback on exit of the EZI2C ISR.
+
+  The host read is served by the EZI2C ISR itself from the register file,
+  so it doesn't depend on the VM.
+*/
+void i2cs_isr(I2CS_HANDLE *sh)
+{
+  uint8_t status = sh->GetActivity();
+  sh->activity |= status;
+
+  // the host write is complete. (stop or repeated start)
+  if( !(status & sh->STATUS_WRITE1) ) return;
+  if( !sh->shadow ) return;
+
+  if( i2cs_scan_changes(sh) && sh->change_callback ) {
+    sh->change_callback(sh);
+  }
+}
+
+
+/***** Local functions ******************************************************/
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+  @internal
+  @param  sh		pointer to I2CS_HANDLE
+  @note
+    Don't use this directry. Use i2cs_init macro.
+*/
+void i2cs_init_m(I2CS_HANDLE *sh,
+		 uint8_t status_read1,
+		 uint8_t status_write1,
+		 uint8_t status_busy,
+		 uint8_t status_err,
+		 void *Start,
+		 void *EnableInt,
+		 void *DisableInt,
+		 void *GetActivity,
+		 void *SetBuffer1)
+{
+  sh->regs = 0;
+  sh->shadow = 0;
+  sh->reg_size = 0;
+  sh->rw_boundary = 0;
+  sh->activity = 0;
+  sh->n_changed = 0;
+  memset( (uint8_t *)sh->dirty, 0, sizeof(sh->dirty) );
+  sh->change_callback = 0;
+  sh->user_data = 0;
+
+  sh->STATUS_READ1 = status_read1;
+  sh->STATUS_WRITE1 = status_write1;
+  sh->STATUS_BUSY = status_busy;
+  sh->STATUS_ERR = status_err;
+  sh->Start = Start;
+  sh->EnableInt = EnableInt;
+  sh->DisableInt = DisableInt;
+  sh->GetActivity = GetActivity;
+  sh->SetBuffer1 = SetBuffer1;
+
+  sh->Start();
+}
+
+
+//================================================================
+/*! set the register file.
+
+  @param  sh		pointer to I2CS_HANDLE
+  @param  regs		pointer to the register file.
+  @param  shadow	pointer to the shadow. (rw_boundary bytes, or NULL)
+  @param  reg_size	size of the register file. (max I2CS_MAX_REG_SIZE)
+  @param  rw_boundary	host can write to [0, rw_boundary).
+  @note
+    Without the shadow, the changes are not detected.
+*/
+void i2cs_set_buffer(I2CS_HANDLE *sh, uint8_t *regs, uint8_t *shadow,
+		     int reg_size, int rw_boundary)
+{
+  if( reg_size > I2CS_MAX_REG_SIZE ) reg_size = I2CS_MAX_REG_SIZE;
+  if( rw_boundary > reg_size ) rw_boundary = reg_size;
+  if( rw_boundary < 0 ) rw_boundary = 0;
+
+  sh->DisableInt();
+
+  sh->regs = regs;
+  sh->shadow = shadow;
+  sh->reg_size = reg_size;
+  sh->rw_boundary = rw_boundary;
+  sh->activity = 0;
+  sh->n_changed = 0;
+  memset( (uint8_t *)sh->dirty, 0, sizeof(sh->dirty) );
+  if( shadow ) memcpy( shadow, regs, rw_boundary );
+  sh->SetBuffer1( reg_size, rw_boundary, regs );
+
+  sh->EnableInt();
+}
+
+
+//================================================================
+/*! update the register file.
+
+  @param  sh		pointer to I2CS_HANDLE
+  @param  offset	offset in the register file.
+  @param  data		pointer to data.
+  @param  size		size of data.
+  @note
+    The host never reads a half updated region.
+*/
+void i2cs_update(I2CS_HANDLE *sh, int offset, const void *data, int size)
+{
+  if( offset < 0 || offset >= sh->reg_size ) return;
+  if( size > sh->reg_size - offset ) size = sh->reg_size - offset;
+  if( size <= 0 ) return;
+
+  // the shadow follows, so this is not a change by the host.
+  int n_shadow = sh->rw_boundary - offset;
+  if( n_shadow > size ) n_shadow = size;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  memcpy( (uint8_t *)sh->regs + offset, data, size );
+  if( sh->shadow && n_shadow > 0 ) {
+    memcpy( sh->shadow + offset, data, n_shadow );
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! fetch the register file.
+
+  @param  sh		pointer to I2CS_HANDLE
+  @param  offset	offset in the register file.
+  @param  buffer	pointer to buffer.
+  @param  size		size of buffer. (must be checked by caller)
+*/
+void i2cs_fetch(I2CS_HANDLE *sh, int offset, void *buffer, int size)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+  memcpy( buffer, (uint8_t *)sh->regs + offset, size );
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! take the offsets of the changed bytes, and clear them.
+
+  @param  sh		pointer to I2CS_HANDLE
+  @param  offsets	pointer to buffer for offsets.
+  @param  size		size of buffer.
+  @return int		number of offsets.
+*/
+int i2cs_take_changes(I2CS_HANDLE *sh, uint8_t *offsets, int size)
+{
+  int n = 0;
+  int i;
+
+  for( i = 0; i < sh->rw_boundary && n < size; i++ ) {
+    if( (i & 7) == 0 && sh->dirty[i >> 3] == 0 ) {
+      i += 7;
+      continue;
+    }
+    if( !(sh->dirty[i >> 3] & (1 << (i & 7))) ) continue;
+
+    uint8 interrupts = CyEnterCriticalSection();
+    sh->dirty[i >> 3] &= ~(1 << (i & 7));
+    sh->n_changed--;
+    CyExitCriticalSection( interrupts );
+
+    offsets[n++] = i;
+  }
+
+  return n;
+}
+
+
+//================================================================
+/*! get the activity since the last call. (STATUS_* bits)
+
+  @param  sh		pointer to I2CS_HANDLE
+  @return int		STATUS_* bits
+*/
+int i2cs_get_activity(I2CS_HANDLE *sh)
+{
+  // don't call GetActivity() here. the ISR needs the STATUS_WRITE1.
+  uint8 interrupts = CyEnterCriticalSection();
+  int ret = sh->activity;
+  sh->activity = 0;
+  CyExitCriticalSection( interrupts );
+
+  return ret;
+}
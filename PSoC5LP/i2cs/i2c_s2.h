@@ -0,0 +1,144 @@
+/*! @file
+  @brief
+  I2C slave (EZI2C) convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+  @note This version supports up to 2 interfaces.
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+#ifndef	PSOC5_I2CSWRAP_H_
+#define	PSOC5_I2CSWRAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! maximum size of the register file.
+#ifndef I2CS_MAX_REG_SIZE
+# define I2CS_MAX_REG_SIZE 256
+#endif
+
+
+/***** Macros ***************************************************************/
+//! Convenience macro to define the interrupt handler.
+#define I2CS_ISR(sh, NAME)			\
+  void NAME ## _ISR_ExitCallback(void) {	\
+    i2cs_isr(sh);				\
+  }
+
+//! Initializer macro for I2C Slave
+#define i2cs_init(sh, NAME)			\
+  i2cs_init_m( sh,				\
+	       NAME ## _STATUS_READ1,		\
+	       NAME ## _STATUS_WRITE1,		\
+	       NAME ## _STATUS_BUSY,		\
+	       NAME ## _STATUS_ERR,		\
+	       NAME ## _Start,			\
+	       NAME ## _EnableInt,		\
+	       NAME ## _DisableInt,		\
+	       NAME ## _GetActivity,		\
+	       NAME ## _SetBuffer1)
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! I2C slave handle.
+*/
+typedef struct I2CS_HANDLE {
+  // register file.
+  volatile uint8_t *regs;	// host reads from here in the ISR.
+  uint8_t *shadow;		// copy of [0, rw_boundary) to find changes.
+  uint16_t reg_size;
+  uint16_t rw_boundary;		// host can write to [0, rw_boundary).
+
+  volatile uint8_t activity;	// accumulated STATUS_* bits.
+  volatile uint16_t n_changed;	// number of dirty bytes.
+  volatile uint8_t dirty[I2CS_MAX_REG_SIZE / 8];
+
+  //! called in the ISR when the host has changed the register file.
+  void (*change_callback)(struct I2CS_HANDLE *sh);
+  void *user_data;
+
+  // constant table
+  uint8_t STATUS_READ1;
+  uint8_t STATUS_WRITE1;
+  uint8_t STATUS_BUSY;
+  uint8_t STATUS_ERR;
+
+  // function table
+  void (*Start)(void);
+  void (*EnableInt)(void);
+  void (*DisableInt)(void);
+  uint8_t (*GetActivity)(void);
+  void (*SetBuffer1)(uint16_t, uint16_t, volatile uint8_t *);
+
+} I2CS_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void i2cs_isr(I2CS_HANDLE *sh);
+void i2cs_init_m(I2CS_HANDLE *sh,
+		 uint8_t status_read1,
+		 uint8_t status_write1,
+		 uint8_t status_busy,
+		 uint8_t status_err,
+		 void *Start,
+		 void *EnableInt,
+		 void *DisableInt,
+		 void *GetActivity,
+		 void *SetBuffer1);
+void i2cs_set_buffer(I2CS_HANDLE *sh, uint8_t *regs, uint8_t *shadow,
+		     int reg_size, int rw_boundary);
+void i2cs_update(I2CS_HANDLE *sh, int offset, const void *data, int size);
+void i2cs_fetch(I2CS_HANDLE *sh, int offset, void *buffer, int size);
+int i2cs_take_changes(I2CS_HANDLE *sh, uint8_t *offsets, int size);
+int i2cs_get_activity(I2CS_HANDLE *sh);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! Has the host changed the register file?
+
+  @param  sh		pointer to I2CS_HANDLE
+  @return int	true or false
+*/
+static inline int i2cs_is_changed(const I2CS_HANDLE *sh)
+{
+  return sh->n_changed != 0;
+}
+
+
+//================================================================
+/*! Is the byte changed by the host, and not yet taken?
+
+  @param  sh		pointer to I2CS_HANDLE
+  @param  offset	offset in the register file.
+  @return int	true or false
+*/
+static inline int i2cs_is_dirty(const I2CS_HANDLE *sh, int offset)
+{
+  if( offset < 0 || offset >= sh->rw_boundary ) return 0;
+  return (sh->dirty[offset >> 3] >> (offset & 7)) & 1;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,272 @@
+/*! @file
+  @brief
+  OneWire class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+   1. Copy c_onewire.h, c_onewire.c, onewire2.h and onewire2.c files,
+      and gpio2.h and gpio2.c of the GPIO class to project folder.
+   2. Add c_onewire.c, onewire2.c and gpio2.c files to PSoC Creator.
+   3. Pull up the bus pin by 4.7k ohm.
+   4. Add below to main.c.
+      #include "c_onewire.h"
+      mrbc_init_class_onewire(0);	// needs to be after mrbc_init()
+
+
+  (on Ruby)
+    ow = OneWire.new( 2, 3 )		# P2[3]
+    ow = OneWire.new( 2, 3, true )	# use the internal pull up.
+
+    roms = ow.search()			# => ["\x28...", ...] 8 bytes each.
+
+    # DS18B20. convert, and read the scratchpad.
+    ow.select( roms[0] )		# or ow.select() for all devices.
+    ow.write_bytes( 0x44 )
+    sleep_ms( 750 )
+    ow.select( roms[0] )
+    ow.write_bytes( 0xbe )
+    s = ow.read_bytes( 9 )
+    ow.crc8( s )			# => 0 if no error.
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <project.h>	// auto generated by PSoC Creator.
+#include <stdint.h>
+
+#include "mrubyc.h"
+#include "onewire2.h"
+
+
+//! maximum number of devices to search.
+#ifndef ONEWIRE_MAX_SEARCH
+# define ONEWIRE_MAX_SEARCH 8
+#endif
+
+
+
+//================================================================
+/*! constructor
+
+  ow = OneWire.new( port, pin, pull_up = false )
+*/
+static void c_onewire_new(struct VM *vm, mrb_value v[], int argc)
+{
+  int flag_pull_up = 0;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( argc >= 3 ) {
+    flag_pull_up = (mrbc_type(v[3]) != MRBC_TT_NIL &&
+		    mrbc_type(v[3]) != MRBC_TT_FALSE);
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(ONEWIRE_HANDLE));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)ret.instance->data;
+  if( onewire_init( ow, mrbc_fixnum(v[1]), mrbc_fixnum(v[2]),
+		    flag_pull_up ) != 0 ) {
+    mrbc_decref( &ret );
+    goto ERROR_PARAM;
+  }
+
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("OneWire: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! reset
+
+  ow.reset()	# => true if any device is present.
+*/
+static void c_onewire_reset(struct VM *vm, mrb_value v[], int argc)
+{
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)v->instance->data;
+
+  if( onewire_reset( ow ) ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! reset and select a device
+
+  ow.select( rom )	# MATCH ROM. rom is 8 bytes String.
+  ow.select()		# SKIP ROM. all devices.
+
+  @return Bool	true if any device is present.
+*/
+static void c_onewire_select(struct VM *vm, mrb_value v[], int argc)
+{
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)v->instance->data;
+  const uint8_t *rom = 0;
+
+  if( argc >= 1 && mrbc_type(v[1]) != MRBC_TT_NIL ) {
+    if( mrbc_type(v[1]) != MRBC_TT_STRING ||
+	mrbc_string_size(&v[1]) != ONEWIRE_ROM_SIZE ) {
+      console_printf("OneWire: parameter error.\n");
+      SET_FALSE_RETURN();
+      return;
+    }
+    rom = (const uint8_t *)mrbc_string_cstr(&v[1]);
+  }
+
+  if( onewire_select( ow, rom ) ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! write
+
+  ow.write_bytes( str )
+  ow.write_bytes( d1, d2, ... )
+*/
+static void c_onewire_write_bytes(struct VM *vm, mrb_value v[], int argc)
+{
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)v->instance->data;
+
+  if( argc >= 1 && mrbc_type(v[1]) == MRBC_TT_STRING ) {
+    onewire_write_bytes( ow, (const uint8_t *)mrbc_string_cstr(&v[1]),
+			 mrbc_string_size(&v[1]) );
+    goto DONE;
+  }
+
+  int i;
+  for( i = 1; i <= argc; i++ ) {
+    if( mrbc_type(v[i]) != MRBC_TT_FIXNUM ) {
+      console_printf("OneWire: parameter error.\n");
+      goto DONE;
+    }
+  }
+  for( i = 1; i <= argc; i++ ) {
+    uint8_t data = mrbc_fixnum(v[i]);
+    onewire_write_bytes( ow, &data, 1 );
+  }
+
+ DONE:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! read
+
+  s = ow.read_bytes( n )	# => String
+*/
+static void c_onewire_read_bytes(struct VM *vm, mrb_value v[], int argc)
+{
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)v->instance->data;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ||
+      mrbc_fixnum(v[1]) < 0 ) {
+    console_printf("OneWire: parameter error.\n");
+    goto RETURN_NIL;
+  }
+  int n = mrbc_fixnum(v[1]);
+
+  uint8_t *buf = mrbc_alloc( vm, n+1 );
+  if( !buf ) goto RETURN_NIL;	// ENOMEM
+
+  onewire_read_bytes( ow, buf, n );
+  buf[n] = 0;
+  mrbc_value ret = mrbc_string_new_alloc( vm, buf, n );
+  SET_RETURN( ret );
+  return;
+
+ RETURN_NIL:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! search the devices
+
+  roms = ow.search( max = ONEWIRE_MAX_SEARCH )	# => [rom, ...]
+
+  rom is 8 bytes String. (family code, serial number, CRC)
+*/
+static void c_onewire_search(struct VM *vm, mrb_value v[], int argc)
+{
+  ONEWIRE_HANDLE *ow = (ONEWIRE_HANDLE *)v->instance->data;
+  int max = ONEWIRE_MAX_SEARCH;
+
+  if( argc >= 1 ) {
+    if( mrbc_type(v[1]) != MRBC_TT_FIXNUM || mrbc_fixnum(v[1]) < 0 ) {
+      console_printf("OneWire: parameter error.\n");
+      SET_NIL_RETURN();
+      return;
+    }
+    max = mrbc_fixnum(v[1]);
+  }
+
+  mrbc_value ret = mrbc_array_new( vm, 0 );
+  if( mrbc_type(ret) != MRBC_TT_ARRAY ) goto RETURN;
+
+  uint8_t rom[ONEWIRE_ROM_SIZE];
+  int i;
+  onewire_search_reset( ow );
+  for( i = 0; i < max && onewire_search( ow, rom ); i++ ) {
+    mrbc_value s = mrbc_string_new( vm, rom, ONEWIRE_ROM_SIZE );
+    mrbc_array_set( &ret, i, &s );
+  }
+
+ RETURN:
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! CRC8 (Dallas/Maxim)
+
+  ow.crc8( str )	# => Integer. 0 if str includes the correct CRC.
+*/
+static void c_onewire_crc8(struct VM *vm, mrb_value v[], int argc)
+{
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_STRING ) {
+    console_printf("OneWire: parameter error.\n");
+    SET_NIL_RETURN();
+    return;
+  }
+
+  SET_INT_RETURN( onewire_crc8( (const uint8_t *)mrbc_string_cstr(&v[1]),
+				mrbc_string_size(&v[1]) ) );
+}
+
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_onewire(struct VM *vm)
+{
+  mrbc_class *onewire;
+  onewire = mrbc_define_class(0, "OneWire",	mrbc_class_object);
+  mrbc_define_method(0, onewire, "new",		c_onewire_new);
+  mrbc_define_method(0, onewire, "reset",	c_onewire_reset);
+  mrbc_define_method(0, onewire, "select",	c_onewire_select);
+  mrbc_define_method(0, onewire, "write_bytes",	c_onewire_write_bytes);
+  mrbc_define_method(0, onewire, "read_bytes",	c_onewire_read_bytes);
+  mrbc_define_method(0, onewire, "search",	c_onewire_search);
+  mrbc_define_method(0, onewire, "crc8",	c_onewire_crc8);
+}
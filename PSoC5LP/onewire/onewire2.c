@@ -0,0 +1,323 @@
+/*! @file
+  @brief
+  1-Wire bus master library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The bus is a GPIO pin in the open drain (drives low) mode, pulled up
+  by a resistor. (4.7k ohm, or the internal pull up for a short bus)
+
+  Timing:
+  The slots are timed by the cycle counter of the Cortex-M3 (DWT CYCCNT),
+  counted from the start of the slot, so the code between the edges does
+  not add up. The interrupts are masked only from the falling edge to the
+  release (or the sampling), because a longer high time is allowed.
+  (standard speed. Maxim AN126)
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "onewire2.h"
+
+/***** Constant values ******************************************************/
+//! Cortex-M3 debug registers for the cycle counter.
+#define ONEWIRE_DEMCR		((reg32 *)0xe000edfc)
+#define ONEWIRE_DEMCR_TRCENA	0x01000000
+#define ONEWIRE_DWT_CTRL	((reg32 *)0xe0001000)
+#define ONEWIRE_DWT_CYCCNTENA	0x00000001
+#define ONEWIRE_DWT_CYCCNT	((reg32 *)0xe0001004)
+
+//! CPU clock. the cycle counter counts it.
+#ifndef ONEWIRE_CPU_HZ
+# define ONEWIRE_CPU_HZ		BCLK__BUS_CLK__HZ
+#endif
+
+//! timing in micro seconds.
+#define ONEWIRE_T_RESET_LOW	480
+#define ONEWIRE_T_PRESENCE	70	// from the release.
+#define ONEWIRE_T_RESET_HIGH	410	// from the sampling.
+#define ONEWIRE_T_SLOT		70
+#define ONEWIRE_T_WRITE1_LOW	6
+#define ONEWIRE_T_WRITE0_LOW	60
+#define ONEWIRE_T_READ_LOW	6
+#define ONEWIRE_T_READ_SAMPLE	15	// from the start of the slot.
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! wait until the time from t0.
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  t0		cycle counter at the start.
+  @param  us		micro seconds from t0.
+*/
+static void onewire_wait_until(ONEWIRE_HANDLE *ow, uint32_t t0, uint32_t us)
+{
+  uint32_t cycles = us * ow->cycles_per_us;
+
+  while( (uint32_t)(*ONEWIRE_DWT_CYCCNT - t0) < cycles )
+    ;
+}
+
+
+//================================================================
+/*! write a bit.
+*/
+static void onewire_write_bit(ONEWIRE_HANDLE *ow, int bit)
+{
+  uint32_t low = bit ? ONEWIRE_T_WRITE1_LOW : ONEWIRE_T_WRITE0_LOW;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  uint32_t t0 = *ONEWIRE_DWT_CYCCNT;
+  gpio_pin_write( &ow->pin, 0 );
+  onewire_wait_until( ow, t0, low );
+  gpio_pin_write( &ow->pin, 1 );
+  CyExitCriticalSection( interrupts );
+
+  onewire_wait_until( ow, t0, ONEWIRE_T_SLOT );
+}
+
+
+//================================================================
+/*! read a bit.
+*/
+static int onewire_read_bit(ONEWIRE_HANDLE *ow)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+  uint32_t t0 = *ONEWIRE_DWT_CYCCNT;
+  gpio_pin_write( &ow->pin, 0 );
+  onewire_wait_until( ow, t0, ONEWIRE_T_READ_LOW );
+  gpio_pin_write( &ow->pin, 1 );
+  onewire_wait_until( ow, t0, ONEWIRE_T_READ_SAMPLE );
+  int bit = gpio_pin_read( &ow->pin );
+  CyExitCriticalSection( interrupts );
+
+  onewire_wait_until( ow, t0, ONEWIRE_T_SLOT );
+  return bit;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  port		port number.
+  @param  pin		pin number. (0..7)
+  @param  flag_pull_up	use the internal pull up.
+  @return int		0 is no error.
+*/
+int onewire_init(ONEWIRE_HANDLE *ow, int port, int pin, int flag_pull_up)
+{
+  memset( ow, 0, sizeof(ONEWIRE_HANDLE) );
+  if( gpio_pin_init( &ow->pin, port, pin ) != 0 ) return -1;
+
+  gpio_pin_write( &ow->pin, 1 );
+  gpio_pin_set_mode( &ow->pin, flag_pull_up ? PIN_DM_RES_UP : PIN_DM_OD_LO );
+
+  ow->cycles_per_us = (ONEWIRE_CPU_HZ + 999999) / 1000000;
+
+  // start the cycle counter.
+  *ONEWIRE_DEMCR |= ONEWIRE_DEMCR_TRCENA;
+  *ONEWIRE_DWT_CTRL |= ONEWIRE_DWT_CYCCNTENA;
+
+  return 0;
+}
+
+
+//================================================================
+/*! reset pulse and presence detect.
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @return int		1 if any device is present.
+*/
+int onewire_reset(ONEWIRE_HANDLE *ow)
+{
+  uint32_t t0 = *ONEWIRE_DWT_CYCCNT;
+  gpio_pin_write( &ow->pin, 0 );
+  onewire_wait_until( ow, t0, ONEWIRE_T_RESET_LOW );
+
+  uint8 interrupts = CyEnterCriticalSection();
+  t0 = *ONEWIRE_DWT_CYCCNT;
+  gpio_pin_write( &ow->pin, 1 );
+  onewire_wait_until( ow, t0, ONEWIRE_T_PRESENCE );
+  int present = !gpio_pin_read( &ow->pin );
+  CyExitCriticalSection( interrupts );
+
+  onewire_wait_until( ow, t0, ONEWIRE_T_PRESENCE + ONEWIRE_T_RESET_HIGH );
+  return present;
+}
+
+
+//================================================================
+/*! write bytes. (LSB first)
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  buf		data.
+  @param  n		number of bytes.
+*/
+void onewire_write_bytes(ONEWIRE_HANDLE *ow, const uint8_t *buf, int n)
+{
+  int i, j;
+
+  for( i = 0; i < n; i++ ) {
+    for( j = 0; j < 8; j++ ) {
+      onewire_write_bit( ow, (buf[i] >> j) & 1 );
+    }
+  }
+}
+
+
+//================================================================
+/*! read bytes. (LSB first)
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  buf		buffer to store.
+  @param  n		number of bytes.
+*/
+void onewire_read_bytes(ONEWIRE_HANDLE *ow, uint8_t *buf, int n)
+{
+  int i, j;
+
+  for( i = 0; i < n; i++ ) {
+    uint8_t data = 0;
+    for( j = 0; j < 8; j++ ) {
+      data |= onewire_read_bit( ow ) << j;
+    }
+    buf[i] = data;
+  }
+}
+
+
+//================================================================
+/*! reset and select a device.
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  rom		ROM code (8 bytes), or NULL for all devices.
+  @return int		1 if any device is present.
+*/
+int onewire_select(ONEWIRE_HANDLE *ow, const uint8_t *rom)
+{
+  if( !onewire_reset( ow ) ) return 0;
+
+  if( rom ) {
+    uint8_t cmd = ONEWIRE_CMD_MATCH_ROM;
+    onewire_write_bytes( ow, &cmd, 1 );
+    onewire_write_bytes( ow, rom, ONEWIRE_ROM_SIZE );
+  } else {
+    uint8_t cmd = ONEWIRE_CMD_SKIP_ROM;
+    onewire_write_bytes( ow, &cmd, 1 );
+  }
+
+  return 1;
+}
+
+
+//================================================================
+/*! restart the search from the first device.
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+*/
+void onewire_search_reset(ONEWIRE_HANDLE *ow)
+{
+  memset( ow->rom, 0, sizeof(ow->rom) );
+  ow->last_discrepancy = 0;
+  ow->flag_last_device = 0;
+}
+
+
+//================================================================
+/*! search the next device. (Maxim AN187)
+
+  @param  ow		pointer to ONEWIRE_HANDLE
+  @param  rom		buffer to store the ROM code. (8 bytes)
+  @return int		1 if found. 0 if no more devices.
+*/
+int onewire_search(ONEWIRE_HANDLE *ow, uint8_t *rom)
+{
+  if( ow->flag_last_device ) return 0;
+  if( !onewire_reset( ow ) ) goto NOT_FOUND;
+
+  uint8_t cmd = ONEWIRE_CMD_SEARCH_ROM;
+  onewire_write_bytes( ow, &cmd, 1 );
+
+  int last_zero = 0;
+  int n;
+  for( n = 1; n <= ONEWIRE_ROM_SIZE * 8; n++ ) {
+    int id_bit = onewire_read_bit( ow );
+    int cmp_id_bit = onewire_read_bit( ow );
+    if( id_bit && cmp_id_bit ) goto NOT_FOUND;	// no devices respond.
+
+    uint8_t *p = &ow->rom[(n - 1) >> 3];
+    uint8_t mask = 1 << ((n - 1) & 7);
+    int dir;
+
+    if( id_bit != cmp_id_bit ) {
+      dir = id_bit;		// all devices have the same bit.
+    } else {
+      // discrepancy. take the same path until the last one, then 1.
+      if( n < ow->last_discrepancy ) {
+	dir = (*p & mask) != 0;
+      } else {
+	dir = (n == ow->last_discrepancy);
+      }
+      if( !dir ) last_zero = n;
+    }
+
+    if( dir ) *p |= mask; else *p &= ~mask;
+    onewire_write_bit( ow, dir );
+  }
+
+  if( onewire_crc8( ow->rom, ONEWIRE_ROM_SIZE ) != 0 ) goto NOT_FOUND;
+
+  ow->last_discrepancy = last_zero;
+  if( last_zero == 0 ) ow->flag_last_device = 1;
+  memcpy( rom, ow->rom, ONEWIRE_ROM_SIZE );
+  return 1;
+
+ NOT_FOUND:
+  onewire_search_reset( ow );
+  return 0;
+}
+
+
+//================================================================
+/*! Dallas/Maxim CRC8. (x^8 + x^5 + x^4 + 1)
+
+  @param  buf		data.
+  @param  n		number of bytes.
+  @return uint8_t	CRC. 0 if the data includes the correct CRC.
+*/
+uint8_t onewire_crc8(const uint8_t *buf, int n)
+{
+  uint8_t crc = 0;
+  int i, j;
+
+  for( i = 0; i < n; i++ ) {
+    crc ^= buf[i];
+    for( j = 0; j < 8; j++ ) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8c : (crc >> 1);
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,71 @@
+/*! @file
+  @brief
+  1-Wire bus master library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_ONEWIRE2_H_
+#define PSOC5_ONEWIRE2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+#include "gpio2.h"
+
+
+/***** Constant values ******************************************************/
+//! ROM commands.
+#define ONEWIRE_CMD_SEARCH_ROM	0xf0
+#define ONEWIRE_CMD_MATCH_ROM	0x55
+#define ONEWIRE_CMD_SKIP_ROM	0xcc
+
+//! bytes of a ROM code. (family, serial number x 6, CRC)
+#define ONEWIRE_ROM_SIZE	8
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! 1-Wire bus handle.
+*/
+typedef struct ONEWIRE_HANDLE {
+  GPIO_PIN pin;
+  uint32_t cycles_per_us;	// of the timer. (CPU clock)
+
+  // state of the search.
+  uint8_t rom[ONEWIRE_ROM_SIZE];
+  uint8_t last_discrepancy;	// bit number. 0 is none.
+  uint8_t flag_last_device;
+
+} ONEWIRE_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int onewire_init(ONEWIRE_HANDLE *ow, int port, int pin, int flag_pull_up);
+int onewire_reset(ONEWIRE_HANDLE *ow);
+void onewire_write_bytes(ONEWIRE_HANDLE *ow, const uint8_t *buf, int n);
+void onewire_read_bytes(ONEWIRE_HANDLE *ow, uint8_t *buf, int n);
+int onewire_select(ONEWIRE_HANDLE *ow, const uint8_t *rom);
+void onewire_search_reset(ONEWIRE_HANDLE *ow);
+int onewire_search(ONEWIRE_HANDLE *ow, uint8_t *rom);
+uint8_t onewire_crc8(const uint8_t *buf, int n);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
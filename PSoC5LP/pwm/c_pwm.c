@@ -0,0 +1,306 @@
+/*! @file
+  @brief
+  PWM class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Digital > Functions > PWM" device.
+   2. Make sure the name is "PWM_1".
+      PWM mode "One Output", Compare type "Less".
+   3. Place "System > Clock" device, and change the name to "Clock_PWM".
+      Source "MASTER_CLK". Connect it to clock of the PWM.
+
+  For the sequence playback.
+   4. Place "System > DMA" device, and change the name to "DMA_PWM".
+      Hardware request "Rising Edge".
+   5. Connect tc of the PWM to drq of the DMA.
+
+
+  C program (main.c)
+
+    #include "c_pwm.h"
+    mrbc_init_class_pwm(0);
+
+
+  mruby program
+
+    pwm = PWM.new()
+    pwm.frequency( 440 )	# Hz (Integer or Float)
+    pwm.period_us( 2273 )	# micro seconds (Integer or Float)
+    pwm.duty( 512 )		# 0 to 1024
+    f = pwm.frequency()		# => actual frequency (Float)
+
+    # sequence playback. (a duty each period)
+    pwm.play( [0, 256, 512, 768, 1024], :loop )
+    pwm.play( [1024, 512, 0] )	# one-shot
+    pwm.playing?()
+    pwm.stop_play()
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "pwm2.h"
+
+
+static PWM_HANDLE pwmh;
+
+
+//================================================================
+/*! get the numeric parameter.
+*/
+static int get_number(mrbc_value *v, float *ret)
+{
+  switch( mrbc_type(*v) ) {
+  case MRBC_TT_FIXNUM:	*ret = mrbc_fixnum(*v);	return 0;
+#if MRBC_USE_FLOAT
+  case MRBC_TT_FLOAT:	*ret = mrbc_float(*v);	return 0;
+#endif
+  default:		return -1;
+  }
+}
+
+
+//================================================================
+/*! stop the sequence and release the table.
+
+  Without flag_force, only if the one-shot is done.
+*/
+static void release_sequence(PWM_HANDLE *ph, int flag_force)
+{
+  void *table = ph->table;
+
+  if( !flag_force && pwm_is_playing( ph ) ) return;
+
+  pwm_stop_sequence( ph );
+  if( table ) mrbc_raw_free( table );
+}
+
+
+
+//================================================================
+/*! constructor
+
+  $pwm = PWM.new()
+*/
+static void c_pwm_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(PWM_HANDLE *));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  *((PWM_HANDLE **)ret.instance->data) = &pwmh;
+  SET_RETURN( ret );
+  return;
+
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! set or get the frequency
+
+  $pwm.frequency( hz )	# 0 stops the output.
+  f = $pwm.frequency()	# => Float
+			(rounded Integer, if MRBC_USE_FLOAT is 0)
+*/
+static void c_pwm_frequency(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+  float hz;
+
+  if( argc == 0 ) {
+#if MRBC_USE_FLOAT
+    SET_FLOAT_RETURN( pwm_get_frequency( ph ) );
+#else
+    SET_INT_RETURN( (int32_t)(pwm_get_frequency( ph ) + 0.5f) );
+#endif
+    return;
+  }
+  if( get_number( &v[1], &hz ) != 0 ) goto ERROR_PARAM;
+  release_sequence( ph, hz == 0 );
+  if( pwm_set_frequency( ph, hz ) != 0 ) goto ERROR_PARAM;
+
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("PWM: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! set the period
+
+  $pwm.period_us( us )	# 0 stops the output.
+*/
+static void c_pwm_period_us(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+  float us;
+
+  if( argc < 1 || get_number( &v[1], &us ) != 0 ) goto ERROR_PARAM;
+  release_sequence( ph, us == 0 );
+  if( pwm_set_period_us( ph, us ) != 0 ) goto ERROR_PARAM;
+
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("PWM: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! set the duty
+
+  $pwm.duty( n )	# 0 (all off) to 1024 (all on)
+
+  The output starts by frequency or period_us. Until then,
+  the duty is only stored.
+*/
+static void c_pwm_duty(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+  float duty;
+
+  if( argc < 1 || get_number( &v[1], &duty ) != 0 ) goto ERROR_PARAM;
+  if( duty < 0 || duty > PWM_DUTY_MAX ) goto ERROR_PARAM;
+
+  release_sequence( ph, 0 );
+  pwm_set_duty( ph, (int)(duty + 0.5f) );
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("PWM: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! start the sequence playback
+
+  $pwm.play( [duty, ...] )		# one-shot
+  $pwm.play( [duty, ...], :loop )
+
+  A duty of the table is applied at each period boundary.
+  The table is converted at the current frequency, so set the
+  frequency before.
+*/
+static void c_pwm_play(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+#if defined(DMA_PWM__DRQ_NUMBER)
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+  int flag_loop = 0;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_ARRAY ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+    if( strcmp( symid_to_str(v[2].i), "loop" ) != 0 ) goto ERROR_PARAM;
+    flag_loop = 1;
+  }
+
+  int n = mrbc_array_size( &v[1] );
+  if( n < 1 ) goto ERROR_PARAM;
+
+  release_sequence( ph, 1 );
+  void *table = mrbc_raw_alloc( n * pwm_sequence_entry_size( ph ) );
+  if( !table ) goto ERROR_RETURN;		// ENOMEM
+
+  int i;
+  for( i = 0; i < n; i++ ) {
+    mrbc_value val = mrbc_array_get( &v[1], i );
+    float duty;
+    if( get_number( &val, &duty ) != 0 ||
+	duty < 0 || duty > PWM_DUTY_MAX ) goto ERROR_FREE;
+    pwm_sequence_set( ph, table, i, (int)(duty + 0.5f) );
+  }
+
+  if( pwm_start_sequence( ph, DMA_PWM, table, n, flag_loop ) != 0 ) {
+    goto ERROR_FREE;
+  }
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_FREE:
+  mrbc_raw_free( table );
+ ERROR_PARAM:
+  console_printf("PWM: parameter error.\n");
+ ERROR_RETURN:
+  SET_FALSE_RETURN();
+
+#else
+  console_printf("PWM: DMA_PWM is not placed.\n");
+  SET_FALSE_RETURN();
+#endif
+}
+
+
+//================================================================
+/*! check the sequence playback
+
+  $pwm.playing?()	# => true or false
+*/
+static void c_pwm_playing(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+
+  if( pwm_is_playing( ph ) ) {
+    SET_TRUE_RETURN();
+    return;
+  }
+  release_sequence( ph, 0 );
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! stop the sequence playback
+
+  $pwm.stop_play()
+
+  The output keeps the last value, until the duty is set.
+*/
+static void c_pwm_stop_play(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  PWM_HANDLE *ph = *(PWM_HANDLE **)v->instance->data;
+
+  release_sequence( ph, 1 );
+  SET_NIL_RETURN();
+}
+
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_pwm(struct VM *vm)
+{
+  pwm_init( &pwmh, PWM_1, Clock_PWM );
+
+  // define class and methods.
+  mrbc_class *pwm;
+  pwm = mrbc_define_class(0, "PWM",		mrbc_class_object);
+  mrbc_define_method(0, pwm, "new",		c_pwm_new);
+  mrbc_define_method(0, pwm, "frequency",	c_pwm_frequency);
+  mrbc_define_method(0, pwm, "period_us",	c_pwm_period_us);
+  mrbc_define_method(0, pwm, "duty",		c_pwm_duty);
+  mrbc_define_method(0, pwm, "play",		c_pwm_play);
+  mrbc_define_method(0, pwm, "playing?",	c_pwm_playing);
+  mrbc_define_method(0, pwm, "stop_play",	c_pwm_stop_play);
+}
@@ -0,0 +1,27 @@
+/*! @file
+  @brief
+  PWM class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_PSOC5LP_PWM_H_
+#define MRBC_PSOC5LP_PWM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct VM;
+void mrbc_init_class_pwm(struct VM *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,288 @@
+/*! @file
+  @brief
+  PWM convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Frequency:
+  The clock divider and the period are chosen from the frequency,
+  so that the period has as many counts as possible. (best resolution
+  of the duty) The output is high while the counter is less than
+  the compare value.
+
+  Sequence playback:
+  The tc of the PWM requests the DMA, and the DMA moves an entry of the
+  table to the compare register at each period boundary. The table is
+  converted to the compare values in advance, and split into TDs of
+  4095 bytes at most. In the loop mode, the last TD is linked to the
+  first one. No interrupt and no task are involved.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "pwm2.h"
+
+/***** Constant values ******************************************************/
+//! maximum bytes in a TD.
+#define PWM_DMA_TD_MAX_BYTES 4095
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! free the TDs.
+*/
+static void pwm_free_td(PWM_HANDLE *ph)
+{
+  int i;
+
+  for( i = 0; i < PWM_DMA_NUM_TD; i++ ) {
+    if( ph->td[i] != CY_DMA_INVALID_TD ) CyDmaTdFree( ph->td[i] );
+    ph->td[i] = CY_DMA_INVALID_TD;
+  }
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  resolution	8 or 16 bits.
+  @param  src_hz	frequency of the clock source.
+*/
+void pwm_init_m(PWM_HANDLE *ph,
+		void *Start,
+		void *Stop,
+		void *WritePeriod,
+		void *WriteCompare,
+		void *SetDividerValue,
+		void *compare_reg,
+		int resolution,
+		uint32_t src_hz)
+{
+  int i;
+
+  ph->compare_reg = compare_reg;
+  ph->resolution = resolution;
+  ph->flag_running = 0;
+  ph->duty = 0;
+  ph->src_hz = src_hz;
+  ph->divider = 1;
+  ph->counts = 0;
+
+  ph->flag_playing = 0;
+  ph->dma_ch = 0xff;
+  for( i = 0; i < PWM_DMA_NUM_TD; i++ ) {
+    ph->td[i] = CY_DMA_INVALID_TD;
+  }
+  ph->table = 0;
+
+  ph->Start = Start;
+  ph->Stop = Stop;
+  ph->WritePeriod = WritePeriod;
+  ph->WriteCompare = WriteCompare;
+  ph->SetDividerValue = SetDividerValue;
+}
+
+
+//================================================================
+/*! set the frequency.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  hz		frequency. 0 stops the output.
+  @return int		0 is no error.
+
+  It can't be changed while the sequence is playing,
+  because the table holds the compare values.
+*/
+int pwm_set_frequency(PWM_HANDLE *ph, float hz)
+{
+  if( hz == 0 ) {
+    pwm_stop_sequence( ph );
+    if( ph->flag_running ) {
+      ph->WriteCompare( 0 );
+      ph->Stop();
+      ph->flag_running = 0;
+    }
+    return 0;
+  }
+  if( hz < 0 ) return -1;
+  if( pwm_is_playing( ph ) ) return -1;
+
+  uint32_t max_counts = (ph->resolution == 8) ? 0xff : 0xffff;
+  float total = ph->src_hz / hz;	// clocks in a period.
+  if( total > (float)max_counts * 65536 ) return -1;	// too low.
+
+  uint32_t divider = (uint32_t)(total / max_counts);
+  if( (float)divider * max_counts < total ) divider++;
+  if( divider < 1 ) divider = 1;
+
+  uint32_t counts = (uint32_t)(total / divider + 0.5f);
+  if( counts > max_counts ) counts = max_counts;
+  if( counts < 2 ) return -1;				// too high.
+
+  // the first Start() runs Init(), and it loads the period and
+  // the compare value of the customizer. so start before the writes.
+  if( !ph->flag_running ) {
+    ph->Start();
+    ph->flag_running = 1;
+  }
+
+  if( ph->divider != divider ) {
+    ph->SetDividerValue( (uint16_t)divider );		// 65536 is 0.
+    ph->divider = divider;
+  }
+  ph->counts = counts;
+  ph->WritePeriod( counts - 1 );
+  ph->WriteCompare( pwm_duty_to_compare( ph, ph->duty ) );
+
+  return 0;
+}
+
+
+//================================================================
+/*! get the actual frequency.
+
+  @param  ph		pointer to PWM_HANDLE
+  @return float		frequency. 0 if stopped.
+*/
+float pwm_get_frequency(PWM_HANDLE *ph)
+{
+  if( !ph->flag_running ) return 0;
+
+  return (float)ph->src_hz / ((float)ph->divider * ph->counts);
+}
+
+
+//================================================================
+/*! set the duty.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  duty		0 to PWM_DUTY_MAX
+
+  While the sequence is playing, or before the frequency is set,
+  the duty is only stored. pwm_set_frequency() applies it.
+*/
+void pwm_set_duty(PWM_HANDLE *ph, int duty)
+{
+  if( duty < 0 ) duty = 0;
+  if( duty > PWM_DUTY_MAX ) duty = PWM_DUTY_MAX;
+
+  ph->duty = duty;
+  if( ph->flag_running && !pwm_is_playing( ph ) ) {
+    ph->WriteCompare( pwm_duty_to_compare( ph, duty ) );
+  }
+}
+
+
+//================================================================
+/*! start the sequence playback.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  DmaInitialize	DmaInitialize function of the DMA component.
+  @param  table		compare values. (see pwm_sequence_set)
+  @param  n		number of entries.
+  @param  flag_loop	loop or one-shot.
+  @return int		0 is no error.
+
+  The table must be kept until pwm_stop_sequence() is called.
+*/
+int pwm_start_sequence_m(PWM_HANDLE *ph, void *DmaInitialize, void *table, int n, int flag_loop)
+{
+  uint8 (*dma_initialize)(uint8, uint8, uint16, uint16) = DmaInitialize;
+  int size = pwm_sequence_entry_size( ph );
+  int max_entries = PWM_DMA_TD_MAX_BYTES / size;
+  int n_td = (n + max_entries - 1) / max_entries;
+  int i;
+
+  if( ph->flag_playing || !ph->flag_running ) return -1;
+  if( n < 1 || n_td > PWM_DMA_NUM_TD ) return -1;
+
+  // a burst is an entry to the compare register, a request each.
+  if( ph->dma_ch == 0xff ) {
+    ph->dma_ch = dma_initialize( size, 1, HI16(CYDEV_SRAM_BASE),
+				 HI16((uint32)ph->compare_reg) );
+  }
+
+  for( i = 0; i < n_td; i++ ) {
+    ph->td[i] = CyDmaTdAllocate();
+    if( ph->td[i] == CY_DMA_INVALID_TD ) goto ERROR_RETURN;
+  }
+  for( i = 0; i < n_td; i++ ) {
+    int len = (i < n_td - 1) ? max_entries : n - i * max_entries;
+    uint8 next;
+    if( i < n_td - 1 ) {
+      next = ph->td[i + 1];
+    } else {
+      next = flag_loop ? ph->td[0] : CY_DMA_DISABLE_TD;
+    }
+    CyDmaTdSetConfiguration( ph->td[i], len * size, next, TD_INC_SRC_ADR );
+    CyDmaTdSetAddress( ph->td[i],
+		       LO16((uint32)table + i * max_entries * size),
+		       LO16((uint32)ph->compare_reg) );
+  }
+  ph->table = table;
+  ph->flag_playing = 1;
+
+  CyDmaChSetInitialTd( ph->dma_ch, ph->td[0] );
+  CyDmaChEnable( ph->dma_ch, 1 );
+  return 0;
+
+ ERROR_RETURN:
+  pwm_free_td( ph );
+  return -1;
+}
+
+
+//================================================================
+/*! stop the sequence playback.
+
+  @param  ph		pointer to PWM_HANDLE
+
+  The output keeps the last value of the table, until the duty is set.
+*/
+void pwm_stop_sequence(PWM_HANDLE *ph)
+{
+  if( !ph->flag_playing ) return;
+
+  CyDmaChDisable( ph->dma_ch );
+  pwm_free_td( ph );
+  ph->table = 0;
+  ph->flag_playing = 0;
+}
+
+
+//================================================================
+/*! check the sequence playback.
+
+  @param  ph		pointer to PWM_HANDLE
+  @return int		1 if playing. 0 if stopped or the one-shot is done.
+*/
+int pwm_is_playing(PWM_HANDLE *ph)
+{
+  uint8 state = 0;
+
+  if( !ph->flag_playing ) return 0;
+  CyDmaChStatus( ph->dma_ch, 0, &state );
+
+  return (state & CY_DMA_STATUS_CHAIN_ACTIVE) != 0;
+}
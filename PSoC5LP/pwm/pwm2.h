@@ -0,0 +1,167 @@
+/*! @file
+  @brief
+  PWM convenience library for PSoC5LP.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_PWMWRAP2_H_
+#define PSOC5_PWMWRAP2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! full scale of the duty.
+#define PWM_DUTY_MAX 1024
+
+//! number of DMA transfer descriptors for the sequence.
+#ifndef PWM_DMA_NUM_TD
+# define PWM_DMA_NUM_TD 4
+#endif
+
+//! clock source of the clock component. (Master clock)
+#ifndef PWM_SRC_CLOCK_HZ
+# define PWM_SRC_CLOCK_HZ BCLK__BUS_CLK__HZ
+#endif
+
+
+/***** Macros ***************************************************************/
+//! Initializer macro
+#define pwm_init(ph, NAME, CLOCK)		\
+  pwm_init_m( ph,				\
+	      NAME ## _Start,			\
+	      NAME ## _Stop,			\
+	      NAME ## _WritePeriod,		\
+	      NAME ## _WriteCompare,		\
+	      CLOCK ## _SetDividerValue,	\
+	      (void *)NAME ## _COMPARE1_LSB_PTR,	\
+	      NAME ## _Resolution,		\
+	      PWM_SRC_CLOCK_HZ )
+
+//! start the sequence playback with the DMA component.
+#define pwm_start_sequence(ph, DMA, table, n, flag_loop)	\
+  pwm_start_sequence_m( ph, DMA ## _DmaInitialize, table, n, flag_loop )
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! PWM handle.
+*/
+typedef struct PWM_HANDLE {
+  volatile void *compare_reg;	// DMA destination.
+  uint8_t resolution;		// 8 or 16 bits.
+  uint8_t flag_running;
+  uint16_t duty;		// 0 to PWM_DUTY_MAX
+  uint32_t src_hz;		// clock source.
+  uint32_t divider;		// clock divider. 1 to 65536
+  uint32_t counts;		// clocks in a period. 0 is not set.
+
+  // sequence playback.
+  uint8_t flag_playing;
+  uint8_t dma_ch;		// 0xff if not initialized.
+  uint8_t td[PWM_DMA_NUM_TD];
+  void *table;			// compare values. 8 or 16 bits each.
+
+  // function table
+  void (*Start)(void);
+  void (*Stop)(void);
+  void (*WritePeriod)(uint16_t);
+  void (*WriteCompare)(uint16_t);
+  void (*SetDividerValue)(uint16_t);
+
+} PWM_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void pwm_init_m(PWM_HANDLE *ph,
+		void *Start,
+		void *Stop,
+		void *WritePeriod,
+		void *WriteCompare,
+		void *SetDividerValue,
+		void *compare_reg,
+		int resolution,
+		uint32_t src_hz);
+int pwm_set_frequency(PWM_HANDLE *ph, float hz);
+float pwm_get_frequency(PWM_HANDLE *ph);
+void pwm_set_duty(PWM_HANDLE *ph, int duty);
+int pwm_start_sequence_m(PWM_HANDLE *ph, void *DmaInitialize, void *table, int n, int flag_loop);
+void pwm_stop_sequence(PWM_HANDLE *ph);
+int pwm_is_playing(PWM_HANDLE *ph);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! set the period in micro seconds.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  us		period. 0 stops the output.
+  @return int		0 is no error.
+*/
+static inline int pwm_set_period_us(PWM_HANDLE *ph, float us)
+{
+  return pwm_set_frequency( ph, us == 0 ? 0 : 1000000 / us );
+}
+
+
+//================================================================
+/*! convert the duty to the compare value.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  duty		0 to PWM_DUTY_MAX
+  @return int		compare value.
+*/
+static inline int pwm_duty_to_compare(PWM_HANDLE *ph, int duty)
+{
+  return (ph->counts * duty + PWM_DUTY_MAX / 2) / PWM_DUTY_MAX;
+}
+
+
+//================================================================
+/*! store a duty to the sequence table.
+
+  @param  ph		pointer to PWM_HANDLE
+  @param  table		sequence table. (bytes_per_entry * n)
+  @param  i		index.
+  @param  duty		0 to PWM_DUTY_MAX
+*/
+static inline void pwm_sequence_set(PWM_HANDLE *ph, void *table, int i, int duty)
+{
+  if( ph->resolution == 8 ) {
+    ((uint8_t *)table)[i] = pwm_duty_to_compare( ph, duty );
+  } else {
+    ((uint16_t *)table)[i] = pwm_duty_to_compare( ph, duty );
+  }
+}
+
+
+//================================================================
+/*! bytes per entry of the sequence table.
+
+  @param  ph		pointer to PWM_HANDLE
+  @return int		1 or 2.
+*/
+static inline int pwm_sequence_entry_size(PWM_HANDLE *ph)
+{
+  return ph->resolution == 8 ? 1 : 2;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,300 @@
+/*! @file
+  @brief
+  QuadDec class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Digital > Functions > Quadrature Decoder"
+      device.
+   2. Make sure the name is "QuadDec_1".
+      Counter size 16 bits, Resolution 1x, 2x or 4x, Use index input off.
+   3. Place two "Digital Input Pin" devices, and connect to A and B.
+   4. Connect a clock (e.g. 1MHz or faster than the edges) to clock of
+      the QuadDec.
+   5. Call mrbc_quaddec_tick() every 1ms.
+      (e.g. in the same timer ISR as mrbc_tick)
+
+  For the index.
+   6. Place "Digital Input Pin" device, and change the name to "Pin_Index".
+      Interrupt "Rising edge".
+   7. Place "System > Interrupt" device, and change the name to
+      "isr_QuadDec_Index". Connect it to irq of the Pin_Index.
+
+
+  C program (main.c)
+
+    #include "c_quaddec.h"
+    mrbc_init_class_quaddec(0);
+
+
+  mruby program
+
+    qd = QuadDec.new()
+    p = qd.position()		# => Integer (counts)
+    v = qd.velocity()		# => Float (counts per second)
+    p, v, t = qd.snapshot()	# => [position, velocity, timestamp(ms)]
+    qd.position = 0
+    qd.window( 20, 4 )		# velocity window 20ms, period based below 4.
+    qd.index_reset = true	# position is 0 at the index.
+    qd.index_count()
+
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "quaddec2.h"
+
+
+static QUADDEC_HANDLE qdh;
+
+#if defined(isr_QuadDec_Index__INTC_NUMBER)
+//================================================================
+/*! interrupt handler. (index pin)
+*/
+static CY_ISR(quaddec_index_isr_handler)
+{
+  Pin_Index_ClearInterrupt();
+  quaddec_index_isr( &qdh );
+}
+#endif
+
+
+
+//================================================================
+/*! constructor
+
+  $qd = QuadDec.new()
+*/
+static void c_quaddec_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(QUADDEC_HANDLE *));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  *((QUADDEC_HANDLE **)ret.instance->data) = &qdh;
+  SET_RETURN( ret );
+  return;
+
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! position
+
+  p = $qd.position()	# => Integer (counts)
+*/
+static void c_quaddec_position(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+  QUADDEC_SNAPSHOT snap;
+
+  quaddec_snapshot( qh, &snap );
+  SET_INT_RETURN( snap.position );
+}
+
+
+//================================================================
+/*! set the position
+
+  $qd.position = n
+*/
+static void c_quaddec_set_position(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) {
+    console_printf("QuadDec: parameter error.\n");
+    return;
+  }
+  quaddec_set_position( qh, mrbc_fixnum(v[1]) );
+}
+
+
+//================================================================
+/*! velocity to mrbc_value.
+
+  Rounded to Integer, if MRBC_USE_FLOAT is 0.
+*/
+static mrbc_value quaddec_velocity_value(float velocity)
+{
+#if MRBC_USE_FLOAT
+  return mrbc_float_value( velocity );
+#else
+  return mrbc_fixnum_value( (int32_t)(velocity + (velocity < 0 ? -0.5f : 0.5f)) );
+#endif
+}
+
+
+//================================================================
+/*! velocity
+
+  v = $qd.velocity()	# => Float (counts per second)
+			(rounded Integer, if MRBC_USE_FLOAT is 0)
+*/
+static void c_quaddec_velocity(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+  QUADDEC_SNAPSHOT snap;
+
+  quaddec_snapshot( qh, &snap );
+  SET_RETURN( quaddec_velocity_value( snap.velocity ) );
+}
+
+
+//================================================================
+/*! a consistent snapshot
+
+  p, v, t = $qd.snapshot()	# => [position, velocity, timestamp]
+
+  timestamp is the ticks of mrbc_quaddec_tick(). (ms)
+*/
+static void c_quaddec_snapshot(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+  QUADDEC_SNAPSHOT snap;
+
+  quaddec_snapshot( qh, &snap );
+
+  mrbc_value ret = mrbc_array_new( vm, 3 );
+  if( mrbc_type(ret) == MRBC_TT_ARRAY ) {
+    mrbc_value val;
+    val = mrbc_fixnum_value( snap.position );
+    mrbc_array_set( &ret, 0, &val );
+    val = quaddec_velocity_value( snap.velocity );
+    mrbc_array_set( &ret, 1, &val );
+    val = mrbc_fixnum_value( snap.timestamp & 0x7fffffff );
+    mrbc_array_set( &ret, 2, &val );
+  }
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! set the velocity window
+
+  $qd.window( ms, min_counts = 4 )
+
+  ms:		window of the counts. (1 to 65535)
+  min_counts:	below this in a window, the velocity is period based.
+		0 is window only.
+*/
+static void c_quaddec_window(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+  int min_counts = 4;
+
+  if( argc < 1 || mrbc_type(v[1]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  int ms = mrbc_fixnum(v[1]);
+  if( ms < 1 || ms > 0xffff ) goto ERROR_PARAM;	// before the conversion.
+  int window = (int32_t)ms * 1000 / QUADDEC_TICK_US;
+  if( argc >= 2 ) {
+    if( mrbc_type(v[2]) != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    min_counts = mrbc_fixnum(v[2]);
+  }
+  if( window < 1 || window > 0xffff ) goto ERROR_PARAM;
+  if( min_counts < 0 || min_counts > 0xffff ) goto ERROR_PARAM;
+
+  quaddec_set_window( qh, window, min_counts );
+  SET_TRUE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("QuadDec: parameter error.\n");
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! reset the position at the index
+
+  $qd.index_reset = true or false
+*/
+static void c_quaddec_set_index_reset(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+
+  if( argc < 1 ) return;
+  qh->flag_index_reset = (mrbc_type(v[1]) != MRBC_TT_NIL &&
+			  mrbc_type(v[1]) != MRBC_TT_FALSE);
+}
+
+
+//================================================================
+/*! number of the index pulses
+
+  $qd.index_count()
+*/
+static void c_quaddec_index_count(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+  SET_INT_RETURN( qh->n_index );
+}
+
+
+//================================================================
+/*! position at the last index (before the reset)
+
+  $qd.index_position()
+
+  @return Nil		No index yet.
+*/
+static void c_quaddec_index_position(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  QUADDEC_HANDLE *qh = *(QUADDEC_HANDLE **)v->instance->data;
+
+  if( qh->n_index == 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_INT_RETURN( qh->index_position );
+}
+
+
+
+//================================================================
+/*! timer tick for the extension of the counter and the velocity.
+
+  Call this every 1ms from the periodic timer ISR. (e.g. with mrbc_tick)
+*/
+void mrbc_quaddec_tick(void)
+{
+  quaddec_tick( &qdh );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_quaddec(struct VM *vm)
+{
+  quaddec_init( &qdh, QuadDec_1 );
+#if defined(isr_QuadDec_Index__INTC_NUMBER)
+  isr_QuadDec_Index_StartEx( quaddec_index_isr_handler );
+#endif
+
+  // define class and methods.
+  mrbc_class *quaddec;
+  quaddec = mrbc_define_class(0, "QuadDec",	mrbc_class_object);
+  mrbc_define_method(0, quaddec, "new",		c_quaddec_new);
+  mrbc_define_method(0, quaddec, "position",	c_quaddec_position);
+  mrbc_define_method(0, quaddec, "position=",	c_quaddec_set_position);
+  mrbc_define_method(0, quaddec, "velocity",	c_quaddec_velocity);
+  mrbc_define_method(0, quaddec, "snapshot",	c_quaddec_snapshot);
+  mrbc_define_method(0, quaddec, "window",	c_quaddec_window);
+  mrbc_define_method(0, quaddec, "index_reset=",	c_quaddec_set_index_reset);
+  mrbc_define_method(0, quaddec, "index_count",	c_quaddec_index_count);
+  mrbc_define_method(0, quaddec, "index_position", c_quaddec_index_position);
+}
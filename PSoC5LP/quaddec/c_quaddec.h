@@ -0,0 +1,28 @@
+/*! @file
+  @brief
+  QuadDec class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_PSOC5LP_QUADDEC_H_
+#define MRBC_PSOC5LP_QUADDEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct VM;
+void mrbc_init_class_quaddec(struct VM *vm);
+void mrbc_quaddec_tick(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,228 @@
+/*! @file
+  @brief
+  Quadrature decoder library for PSoC5LP. (QuadDec component)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The QuadDec component counts the edges of A and B in hardware.
+  quaddec_tick() reads the counter periodically, and extends it to
+  32 bits with the signed difference from the last read, so the counter
+  must not move more than half of its range in a tick.
+  (e.g. 16 bits: 32767 counts per 1ms)
+
+  Velocity:
+  Counts in a window of ticks. If the counts are fewer than min_counts,
+  the quantization error is large, so the velocity is computed from the
+  period between the last two count changes, and the counts of the last
+  change, instead. While no change,
+  the period is at least the time since the last change, so the
+  velocity decays to 0 when stopped.
+
+  Index:
+  The index pin raises an interrupt, and quaddec_index_isr() latches the
+  position. The hardware counter is not reset, so the position stays
+  continuous, and the reset at the index is done by the origin.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "quaddec2.h"
+
+/***** Constant values ******************************************************/
+//! no change in this period is stopped. (ticks)
+#ifndef QUADDEC_STOP_TICKS
+# define QUADDEC_STOP_TICKS 1000
+#endif
+
+#define QUADDEC_TICKS_PER_SEC (1000000.0f / QUADDEC_TICK_US)
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+
+//================================================================
+/*! read the hardware counter and extend it. (in a critical section)
+*/
+static void quaddec_update(QUADDEC_HANDLE *qh)
+{
+  uint32_t raw = (uint32_t)qh->GetCounter() & qh->mask;
+  uint32_t diff = (raw - qh->last_raw) & qh->mask;
+  int32_t delta;
+
+  qh->last_raw = raw;
+  if( diff == 0 ) return;
+
+  // sign extension of the difference.
+  if( diff > qh->mask / 2 ) {
+    delta = (int32_t)(diff | ~qh->mask);
+  } else {
+    delta = (int32_t)diff;
+  }
+  qh->count += delta;
+
+  qh->period_ticks = qh->tick - qh->change_tick;
+  qh->change_tick = qh->tick;
+  qh->period_counts = delta;
+}
+
+
+//================================================================
+/*! velocity at the end of the window. (in a critical section)
+*/
+static float quaddec_velocity(QUADDEC_HANDLE *qh)
+{
+  int32_t counts = qh->count - qh->win_start;
+  uint32_t abs_counts = (counts < 0) ? -counts : counts;
+
+  if( abs_counts >= qh->min_counts ) {
+    return counts * QUADDEC_TICKS_PER_SEC / qh->window;
+  }
+
+  // period based.
+  uint32_t since = qh->tick - qh->change_tick;
+  uint32_t period = qh->period_ticks;
+
+  if( qh->period_counts == 0 || since >= QUADDEC_STOP_TICKS ) return 0;
+  if( period < since ) period = since;
+  if( period == 0 ) period = 1;
+
+  // a tick can see several counts at the higher speed.
+  return qh->period_counts * QUADDEC_TICKS_PER_SEC / period;
+}
+
+
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+
+  @param  qh		pointer to QUADDEC_HANDLE
+  @param  counter_size	bits of the counter. (8, 16 or 32)
+*/
+void quaddec_init_m(QUADDEC_HANDLE *qh, void *Start, void *GetCounter, int counter_size)
+{
+  memset( qh, 0, sizeof(QUADDEC_HANDLE) );
+
+  qh->mask = (counter_size >= 32) ? 0xffffffff : ((uint32_t)1 << counter_size) - 1;
+  qh->window = 10;
+  qh->min_counts = 4;
+
+  qh->Start = Start;
+  qh->GetCounter = GetCounter;
+
+  qh->Start();
+  qh->last_raw = (uint32_t)qh->GetCounter() & qh->mask;
+}
+
+
+//================================================================
+/*! set the velocity window.
+
+  @param  qh		pointer to QUADDEC_HANDLE
+  @param  window	ticks in a window. (1 to 65535)
+  @param  min_counts	below this, period based. 0 is window only.
+*/
+void quaddec_set_window(QUADDEC_HANDLE *qh, int window, int min_counts)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  qh->window = window;
+  qh->min_counts = min_counts;
+  qh->win_ticks = 0;
+  qh->win_start = qh->count;
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! set the current position.
+
+  @param  qh		pointer to QUADDEC_HANDLE
+  @param  position	new position.
+*/
+void quaddec_set_position(QUADDEC_HANDLE *qh, int32_t position)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  quaddec_update( qh );
+  qh->origin = qh->count - position;
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! timer tick. (every QUADDEC_TICK_US)
+
+  @param  qh		pointer to QUADDEC_HANDLE
+*/
+void quaddec_tick(QUADDEC_HANDLE *qh)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  qh->tick++;
+  quaddec_update( qh );
+
+  if( ++qh->win_ticks >= qh->window ) {
+    qh->velocity = quaddec_velocity( qh );
+    qh->win_ticks = 0;
+    qh->win_start = qh->count;
+  }
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! interrupt handler. (index pin)
+
+  @param  qh		pointer to QUADDEC_HANDLE
+*/
+void quaddec_index_isr(QUADDEC_HANDLE *qh)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  quaddec_update( qh );
+  qh->n_index++;
+  qh->index_position = qh->count - qh->origin;
+  if( qh->flag_index_reset ) qh->origin = qh->count;
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! take a consistent snapshot.
+
+  @param  qh		pointer to QUADDEC_HANDLE
+  @param  snap		pointer to QUADDEC_SNAPSHOT to store.
+*/
+void quaddec_snapshot(QUADDEC_HANDLE *qh, QUADDEC_SNAPSHOT *snap)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  quaddec_update( qh );
+  snap->position = qh->count - qh->origin;
+  snap->velocity = qh->velocity;
+  snap->timestamp = qh->tick;
+
+  CyExitCriticalSection( interrupts );
+}
@@ -0,0 +1,102 @@
+/*! @file
+  @brief
+  Quadrature decoder library for PSoC5LP. (QuadDec component)
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_QUADDEC2_H_
+#define PSOC5_QUADDEC2_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! period of quaddec_tick() in micro seconds.
+#ifndef QUADDEC_TICK_US
+# define QUADDEC_TICK_US 1000
+#endif
+
+
+/***** Macros ***************************************************************/
+//! Initializer macro
+#define quaddec_init(qh, NAME)			\
+  quaddec_init_m( qh,				\
+		  NAME ## _Start,		\
+		  NAME ## _GetCounter,		\
+		  NAME ## _COUNTER_SIZE )
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! a consistent snapshot.
+*/
+typedef struct QUADDEC_SNAPSHOT {
+  int32_t position;		// counts.
+  float velocity;		// counts per second.
+  uint32_t timestamp;		// ticks.
+
+} QUADDEC_SNAPSHOT;
+
+
+//================================================================
+/*! quadrature decoder handle.
+
+  quaddec_tick() and quaddec_index_isr() update it in the interrupts.
+*/
+typedef struct QUADDEC_HANDLE {
+  // position. the hardware counter is extended to 32 bits.
+  uint32_t mask;		// of the hardware counter.
+  uint32_t last_raw;
+  int32_t count;		// extended. never reset.
+  int32_t origin;		// position = count - origin
+
+  // index.
+  uint8_t flag_index_reset;	// position is 0 at the index.
+  uint32_t n_index;
+  int32_t index_position;	// position at the last index.
+
+  // velocity.
+  uint32_t tick;
+  uint16_t window;		// ticks.
+  uint16_t win_ticks;
+  int32_t win_start;		// count at the start of the window.
+  uint16_t min_counts;		// below this in a window, period based.
+  uint32_t change_tick;		// the last count change.
+  uint32_t period_ticks;	// between the last two changes.
+  int32_t period_counts;	// counts of the last change. (signed)
+  float velocity;		// counts per second.
+
+  // function table
+  void (*Start)(void);
+  int32_t (*GetCounter)(void);
+
+} QUADDEC_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void quaddec_init_m(QUADDEC_HANDLE *qh, void *Start, void *GetCounter, int counter_size);
+void quaddec_set_window(QUADDEC_HANDLE *qh, int window, int min_counts);
+void quaddec_set_position(QUADDEC_HANDLE *qh, int32_t position);
+void quaddec_tick(QUADDEC_HANDLE *qh);
+void quaddec_index_isr(QUADDEC_HANDLE *qh);
+void quaddec_snapshot(QUADDEC_HANDLE *qh, QUADDEC_SNAPSHOT *snap);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
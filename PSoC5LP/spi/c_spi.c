@@ -61,6 +61,65 @@
     # only read
     #  sending 0x00 * 2 bytes, then receive 2 bytes and return.
     ret = spi.read( 2 )
+
+    # fill
+    #  send 0xff * 100 bytes.
+    spi.fill( 0xff, 100 )
+    #  send 16bit pattern 0xf800 (MSB first) * 76800 times.
+    spi.fill( 0xf800, 240*320, 2 )
+    #  send string "\x01\x02\x03" * 10 times.
+    spi.fill( "\x01\x02\x03", 10 )
+
+    # register access (e.g. LIS3DH. read flag 0x80, auto increment flag 0x40)
+    spi.reg_setup( 0x80, 0x40 )
+    spi.write_regs( 0x20, 0x57 )
+    x, y, z = spi.read_regs( 0x28, 3, :s16le )
+
+
+  Multiple devices on one bus. (SPIDevice class)
+    Each device has its own SPI mode, bit order, bit rate and CS pin.
+    The bus is reprogrammed only when the active device changes.
+
+    To change the bit rate, use the internal clock of SPIM_1.
+    To use CS pins, place a "Control Register" named "SPI_CS",
+    connect its bits to CS pins (active low),
+    and define pre-processor macro MRBC_SPI_CS_REG=SPI_CS.
+    If the SPI mode differs from the PSoC Creator setting (MRBC_SPI_MODE),
+    set a hook function by mrbc_spi_set_mode_hook( bus, func ).
+
+    # bus 1, CS 0, 20MHz, mode 0, MSB first.
+    flash = SPIDevice.new( 1, 0, 20_000_000 )
+    # bus 1, CS 1, 1MHz, mode 1, LSB first.
+    tc = SPIDevice.new( 1, 1, 1_000_000, 1, :LSB_FIRST )
+    s = tc.read( 4 )
+
+    # hold the bus (and CS) over several method calls.
+    #  While other task uses the bus, acquire returns false and
+    #  the task sleeps until its turn. Tasks get the bus in order of arrival.
+    nil until flash.acquire
+    begin
+      flash.write( 0x03, 0x00, 0x10, 0x00 )
+      s = flash.read( 256 )
+    ensure
+      flash.release
+    end
+
+    # Other methods wait in the same queue. If it is not the turn,
+    # the method returns false without the transfer, and the task
+    # sleeps until its turn. Call it again right after the wakeup.
+    s = tc.read( 4 ) until s
+    nil while tc.write( 0x01, 0x02 ) == false
+
+
+  WS2812 LEDs. (NeoPixel class)
+    Connect MOSI to DIN of the LEDs. SCLK and ss are not used.
+    The frame is sent at 3.2MHz, so use the internal clock of SPIM_1,
+    or set the Bit Rate to 3.2Mbps.
+    Add ws2812.h and ws2812.c to the project.
+
+    led = NeoPixel.new( 1, :GRB )	# bus 1. (default)
+    led.brightness = 64
+    led.show( "\xff\x00\x00" * 300 )	# 300 pixels, packed R, G, B.
   </pre>
 */
 
@@ -71,6 +130,8 @@
 
 #include "mrubyc.h"
 #include "spi_m2.h"
+#include "ws2812.h"
+#include "task2.h"
 
 
 //================================================================
@@ -80,6 +141,21 @@
 # define MRBC_NUM_SPI 1
 #endif
 
+//! SPI mode set by PSoC Creator. (CPOL << 1 | CPHA)
+#if !defined(MRBC_SPI_MODE)
+# define MRBC_SPI_MODE 0
+#endif
+
+//! Shift direction set by PSoC Creator.
+#if !defined(MRBC_SPI_BIT_ORDER)
+# define MRBC_SPI_BIT_ORDER SPI_MSB_FIRST
+#endif
+
+//! tickets in the queue of a bus. must be power of 2.
+#if !defined(MRBC_SPI_QUEUE_SIZE)
+# define MRBC_SPI_QUEUE_SIZE 8
+#endif
+
 static SPI_HANDLE spih[MRBC_NUM_SPI];
 
 #if MRBC_NUM_SPI >= 1	// use boost? the following are enough in this project.
@@ -96,6 +172,292 @@ SPI_ISR( &spih[2], SPIM_3 );
 #endif
 
 
+//================================================================
+/*! CS pins by control register. bit n is CS n, active low.
+*/
+#if defined(MRBC_SPI_CS_REG)
+#define SPI_CS_CONCAT_(a, b) a ## b
+#define SPI_CS_CONCAT(a, b) SPI_CS_CONCAT_(a, b)
+#define SPI_CS_Read  SPI_CS_CONCAT(MRBC_SPI_CS_REG, _Read)
+#define SPI_CS_Write SPI_CS_CONCAT(MRBC_SPI_CS_REG, _Write)
+#endif
+
+
+//================================================================
+/*! SPI instance attribute. (SPI and SPIDevice)
+*/
+typedef struct SPI_ATTR {
+  SPI_HANDLE *spih;
+  SPI_DEVICE dev;
+  int8_t cs;			//!< CS number. -1 means use SPIM's ss.
+  uint8_t flag_acquired;	//!< holding the bus by acquire.
+  uint8_t reg_read_mask;	//!< read flag of register address.
+  uint8_t reg_inc_mask;		//!< auto increment flag of register address.
+} SPI_ATTR;
+
+
+//================================================================
+/*! a ticket in the bus queue. (one per task)
+
+  The tickets are served in order. A task that is not its turn sleeps,
+  and is resumed when the ticket comes to the head. The resumed task
+  must call again to use its turn. If it sleeps or ends without that,
+  the turn is passed to the next.
+*/
+typedef struct SPI_TICKET {
+  mrbc_tcb *tcb;		//!< owner task. NULL if cancelled.
+  const SPI_ATTR *attr;		//!< device. (compared only)
+  int8_t cs;
+  uint8_t flag_acquired;	//!< holding the bus by acquire.
+  uint8_t flag_sleep;		//!< the owner sleeps until its turn.
+  uint8_t flag_granted;		//!< the owner is resumed for its turn.
+} SPI_TICKET;
+
+static SPI_TICKET spi_tickets[MRBC_NUM_SPI][MRBC_SPI_QUEUE_SIZE];
+
+
+//================================================================
+/*! value types of read_regs/write_regs.
+*/
+static const struct SPI_REG_TYPE {
+  const char *name;
+  uint8_t size;
+  uint8_t flag_signed;
+  uint8_t flag_big_endian;
+} spi_reg_types[] = {
+  { "u8",    1, 0, 0 },
+  { "s8",    1, 1, 0 },
+  { "u16",   2, 0, 1 },
+  { "s16",   2, 1, 1 },
+  { "u16be", 2, 0, 1 },
+  { "s16be", 2, 1, 1 },
+  { "u16le", 2, 0, 0 },
+  { "s16le", 2, 1, 0 },
+  { "u32",   4, 0, 1 },
+  { "s32",   4, 1, 1 },
+  { "u32be", 4, 0, 1 },
+  { "s32be", 4, 1, 1 },
+  { "u32le", 4, 0, 0 },
+  { "s32le", 4, 1, 0 },
+};
+#define SPI_NUM_REG_TYPES (sizeof(spi_reg_types) / sizeof(spi_reg_types[0]))
+static mrbc_sym spi_reg_type_symid[SPI_NUM_REG_TYPES];
+
+
+
+//================================================================
+/*! assert CS
+*/
+static void spi_cs_assert(int cs)
+{
+#if defined(MRBC_SPI_CS_REG)
+  if( cs < 0 ) return;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  SPI_CS_Write( SPI_CS_Read() & ~(1 << cs) );
+  CyExitCriticalSection( interrupts );
+#endif
+}
+
+
+//================================================================
+/*! negate CS
+*/
+static void spi_cs_negate(int cs)
+{
+#if defined(MRBC_SPI_CS_REG)
+  if( cs < 0 ) return;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  SPI_CS_Write( SPI_CS_Read() | (1 << cs) );
+  CyExitCriticalSection( interrupts );
+#endif
+}
+
+
+//================================================================
+/*! the ticket of number n.
+*/
+static SPI_TICKET *spi_ticket(const SPI_HANDLE *h, uint16_t n)
+{
+  return &spi_tickets[h - spih][n & (MRBC_SPI_QUEUE_SIZE - 1)];
+}
+
+
+//================================================================
+/*! the ticket of the task in the queue.
+
+  @return	pointer to the ticket, or NULL.
+*/
+static SPI_TICKET *spi_find_ticket(const SPI_HANDLE *h, const mrbc_tcb *tcb)
+{
+  uint16_t n;
+
+  for( n = h->queue_head; n != h->queue_tail; n++ ) {
+    SPI_TICKET *t = spi_ticket( h, n );
+    if( t->tcb == tcb ) return t;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! take a ticket.
+
+  @return	pointer to the ticket, or NULL if the queue is full.
+*/
+static SPI_TICKET *spi_take_ticket(SPI_HANDLE *h, mrbc_tcb *tcb,
+				   const SPI_ATTR *attr)
+{
+  if( (uint16_t)(h->queue_tail - h->queue_head) >= MRBC_SPI_QUEUE_SIZE ) {
+    return 0;
+  }
+
+  SPI_TICKET *t = spi_ticket( h, spi_bus_enqueue( h ) );
+  *t = (SPI_TICKET){ .tcb = tcb, .attr = attr, .cs = attr->cs };
+  return t;
+}
+
+
+//================================================================
+/*! update the head of the queue.
+
+  Drop the cancelled tickets, the tickets of the ended tasks
+  (e.g. by an exception) and the turns not used, and resume the owner
+  of the head.
+  A turn is not used if the owner was resumed for it, and then sleeps
+  or waits for other things without calling again.
+*/
+static void spi_queue_update(SPI_HANDLE *h)
+{
+  while( !spi_bus_is_free( h ) ) {
+    SPI_TICKET *t = spi_ticket( h, h->queue_head );
+
+    if( t->tcb ) {
+      if( !task_is_dormant( t->tcb ) &&
+	  !(t->flag_granted && !task_is_runnable( t->tcb )) ) {
+	if( t->flag_sleep ) {
+	  t->flag_sleep = 0;
+	  t->flag_granted = 1;
+	  mrbc_resume_task( t->tcb );
+	}
+	return;
+      }
+      if( t->flag_acquired ) {
+	spi_wait_done( h );
+	spi_cs_negate( t->cs );
+      }
+    }
+
+    t->tcb = 0;
+    spi_bus_dequeue( h );
+  }
+}
+
+
+//================================================================
+/*! give back the ticket, and pass the bus to the next.
+*/
+static void spi_release_ticket(SPI_HANDLE *h, SPI_TICKET *t)
+{
+  t->tcb = 0;
+  t->flag_acquired = 0;
+  t->flag_sleep = 0;
+  t->flag_granted = 0;
+  spi_queue_update( h );
+}
+
+
+//================================================================
+/*! is the device holding the bus by acquire?
+*/
+static int spi_is_holding(const SPI_HANDLE *h, const SPI_ATTR *attr)
+{
+  if( spi_bus_is_free( h ) ) return 0;
+
+  const SPI_TICKET *t = spi_ticket( h, h->queue_head );
+  return t->tcb && t->attr == attr && t->flag_acquired;
+}
+
+
+//================================================================
+/*! wait for the turn of the ticket.
+
+  @return	0 if it is the turn. 1 if the task sleeps.
+*/
+static int spi_wait_turn(mrbc_vm *vm, SPI_HANDLE *h, SPI_TICKET *t)
+{
+  if( t == spi_ticket( h, h->queue_head ) ) {
+    t->flag_granted = 0;
+    return 0;
+  }
+
+  // the task sleeps after the method returns.
+  t->flag_sleep = 1;
+  mrbc_suspend_task( VM2TCB(vm) );
+  return 1;
+}
+
+
+//================================================================
+/*! begin the transfer. select the device and assert CS.
+
+  If other task uses the bus, the task takes a ticket and sleeps until
+  its turn, and the method returns false without the transfer.
+  The next call of the task does the transfer in the turn.
+
+  @return int	0 if success. 1 if the task waits for its turn.
+		-1 if error.
+*/
+static int spi_begin(mrbc_vm *vm, SPI_ATTR *attr)
+{
+  SPI_HANDLE *h = attr->spih;
+
+  spi_queue_update( h );
+  attr->flag_acquired = spi_is_holding( h, attr );
+  if( attr->flag_acquired ) return 0;
+
+  mrbc_tcb *tcb = VM2TCB(vm);
+  SPI_TICKET *t = spi_find_ticket( h, tcb );
+  if( !t ) {
+    t = spi_take_ticket( h, tcb, attr );
+    if( !t ) {
+      vm->flag_preemption = 1;	// queue full.
+      return 1;
+    }
+  } else if( t->flag_acquired ) {
+    return -1;			// the task holds the bus by other device.
+  }
+
+  if( spi_wait_turn( vm, h, t ) != 0 ) return 1;
+
+  if( spi_select_device( h, &attr->dev ) != 0 ) {
+    console_printf("SPI: Can't change the bus setting.\n");
+    spi_release_ticket( h, t );
+    return -1;
+  }
+
+  t->attr = attr;
+  t->cs = attr->cs;
+  spi_cs_assert( attr->cs );
+  return 0;
+}
+
+
+//================================================================
+/*! end the transfer. wait for done, negate CS and pass the bus.
+*/
+static void spi_end(SPI_ATTR *attr)
+{
+  SPI_HANDLE *h = attr->spih;
+
+  spi_wait_done( h );
+  if( attr->flag_acquired ) return;
+
+  spi_cs_negate( attr->cs );
+  spi_release_ticket( h, spi_ticket( h, h->queue_head ) );
+}
+
 
 //================================================================
 /*! SPI constructor
@@ -116,8 +478,15 @@ static void c_spi_new(mrbc_vm *vm, mrbc_value v[], int argc)
   }
   if( spi_num < 0 || spi_num >= MRBC_NUM_SPI ) goto ERROR_RETURN;
 
-  *v = mrbc_instance_new(vm, v->cls, sizeof(SPI_HANDLE *));
-  *((SPI_HANDLE **)v->instance->data) = &spih[spi_num];
+  *v = mrbc_instance_new(vm, v->cls, sizeof(SPI_ATTR));
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  *attr = (SPI_ATTR){
+    .spih = &spih[spi_num],
+    .dev = { .divider = 0, .mode = MRBC_SPI_MODE,
+	     .bit_order = MRBC_SPI_BIT_ORDER },
+    .cs = -1,
+    .reg_read_mask = 0x80,
+  };
   return;
 
  ERROR_RETURN:
@@ -125,6 +494,160 @@ static void c_spi_new(mrbc_vm *vm, mrbc_value v[], int argc)
 }
 
 
+//================================================================
+/*! SPIDevice constructor
+
+  $dev = SPIDevice.new( bus, cs, frequency, mode, bit_order )
+
+  @param  bus		interface number. 1 origin.
+  @param  cs		CS number (0 origin) or nil.
+  @param  frequency	bit rate (Hz). 0 or nil means bus default.
+  @param  mode		SPI mode 0..3 (option)
+  @param  bit_order	:MSB_FIRST or :LSB_FIRST (option)
+*/
+static void c_spidevice_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  int spi_num = v[1].i - 1;
+  if( spi_num < 0 || spi_num >= MRBC_NUM_SPI ) goto ERROR_PARAM;
+
+  int cs = -1;
+  if( argc >= 2 && v[2].tt == MRBC_TT_FIXNUM ) {
+#if defined(MRBC_SPI_CS_REG)
+    cs = v[2].i;
+    if( cs < 0 || cs > 7 ) goto ERROR_PARAM;
+#else
+    goto ERROR_PARAM;
+#endif
+  }
+
+  uint16_t divider = 0;
+  if( argc >= 3 && v[3].tt == MRBC_TT_FIXNUM && v[3].i > 0 ) {
+    // bit rate = clock / 2
+    uint32_t freq2 = (uint32_t)v[3].i * 2;
+    uint32_t div = (BCLK__BUS_CLK__HZ + freq2 - 1) / freq2;
+    if( div > 0xffff ) div = 0xffff;
+    divider = div;
+  }
+
+  int mode = MRBC_SPI_MODE;
+  if( argc >= 4 && v[4].tt == MRBC_TT_FIXNUM ) {
+    mode = v[4].i;
+    if( mode < 0 || mode > 3 ) goto ERROR_PARAM;
+  }
+
+  int bit_order = MRBC_SPI_BIT_ORDER;
+  if( argc >= 5 ) {
+    if( v[5].tt != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+    if( v[5].i == str_to_symid("LSB_FIRST") ) {
+      bit_order = SPI_LSB_FIRST;
+    } else if( v[5].i == str_to_symid("MSB_FIRST") ) {
+      bit_order = SPI_MSB_FIRST;
+    } else {
+      goto ERROR_PARAM;
+    }
+  }
+
+  *v = mrbc_instance_new(vm, v->cls, sizeof(SPI_ATTR));
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  *attr = (SPI_ATTR){
+    .spih = &spih[spi_num],
+    .dev = { .divider = divider, .mode = mode, .bit_order = bit_order },
+    .cs = cs,
+    .reg_read_mask = 0x80,
+  };
+  spi_cs_negate( cs );
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPIDevice: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! acquire the bus
+
+  nil until $dev.acquire
+
+  If other task uses the bus, the task sleeps until its turn,
+  and the method returns false. Tasks get the bus in order of arrival.
+
+  @return Bool	true if acquired.
+*/
+static void c_spi_acquire(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *h = attr->spih;
+
+  spi_queue_update( h );
+  attr->flag_acquired = spi_is_holding( h, attr );
+  if( attr->flag_acquired ) goto RETURN_TRUE;
+
+  mrbc_tcb *tcb = VM2TCB(vm);
+  SPI_TICKET *t = spi_find_ticket( h, tcb );
+  if( !t ) {
+    t = spi_take_ticket( h, tcb, attr );
+    if( !t ) {
+      vm->flag_preemption = 1;	// queue full.
+      goto RETURN_FALSE;
+    }
+  } else if( t->flag_acquired ) {
+    console_printf("SPI: The bus is held by other device.\n");
+    goto RETURN_FALSE;
+  }
+
+  if( spi_wait_turn( vm, h, t ) != 0 ) goto RETURN_FALSE;
+
+  if( spi_select_device( h, &attr->dev ) != 0 ) {
+    console_printf("SPI: Can't change the bus setting.\n");
+    spi_release_ticket( h, t );
+    goto RETURN_FALSE;
+  }
+
+  t->attr = attr;
+  t->cs = attr->cs;
+  t->flag_acquired = 1;
+  attr->flag_acquired = 1;
+  spi_cs_assert( attr->cs );
+
+ RETURN_TRUE:
+  SET_TRUE_RETURN();
+  return;
+
+ RETURN_FALSE:
+  SET_FALSE_RETURN();
+}
+
+
+//================================================================
+/*! release the bus
+
+  $dev.release
+
+  Also cancels the waiting ticket of the task.
+  Call this in the rescue clause, so the bus is not left held.
+*/
+static void c_spi_release(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *h = attr->spih;
+
+  spi_queue_update( h );
+  if( spi_is_holding( h, attr ) ) {
+    spi_wait_done( h );
+    spi_cs_negate( attr->cs );
+    spi_release_ticket( h, spi_ticket( h, h->queue_head ) );
+  } else {
+    SPI_TICKET *t = spi_find_ticket( h, VM2TCB(vm) );
+    if( t && !t->flag_acquired ) spi_release_ticket( h, t );
+  }
+  attr->flag_acquired = 0;
+
+  SET_TRUE_RETURN();
+}
+
+
 //================================================================
 /*! read
 
@@ -132,20 +655,28 @@ static void c_spi_new(mrbc_vm *vm, mrbc_value v[], int argc)
 
   @param  n		Number of bytes receive.
   @return String	Received data.
+			false if the task waits for its turn.
 */
 static void c_spi_read(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   mrbc_value ret;
-  SPI_HANDLE *handle = *(SPI_HANDLE **)v->instance->data;
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
   int recv_len = GET_INT_ARG(1);
   uint8_t *buf = mrbc_alloc( vm, recv_len+1 );
   if( !buf ) {			// ENOMEM
     ret = mrbc_nil_value();
     goto DONE;
   }
+  int r = spi_begin( vm, attr );
+  if( r != 0 ) {
+    mrbc_raw_free( buf );
+    ret = (r > 0) ? mrbc_false_value() : mrbc_nil_value();
+    goto DONE;
+  }
 
   spi_transfer(handle, 0, 0, buf, recv_len, 0);
-  spi_wait_done( handle );
+  spi_end( attr );
   buf[recv_len] = 0;
   ret = mrbc_string_new_alloc( vm, buf, recv_len );
 
@@ -159,15 +690,22 @@ static void c_spi_read(mrbc_vm *vm, mrbc_value v[], int argc)
 
   $spi.write( str )
   $spi.write( d1, d2, ...)
+
+  @return	nil, or false if the task waits for its turn.
 */
 static void c_spi_write(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  SPI_HANDLE *handle = *(SPI_HANDLE **)v->instance->data;
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
+  int r;
 
   if( v[1].tt == MRBC_TT_STRING ) {
+    r = spi_begin( vm, attr );
+    if( r > 0 ) goto RETURN_FALSE;
+    if( r < 0 ) goto DONE;
     spi_transfer( handle, mrbc_string_cstr(&v[1]), mrbc_string_size(&v[1]),
 		  0, 0, 0 );
-    spi_wait_done( handle );
+    spi_end( attr );
     goto DONE;
   }
 
@@ -179,9 +717,13 @@ static void c_spi_write(mrbc_vm *vm, mrbc_value v[], int argc)
     for( i = 0; i < argc; i++ ) {
       buf[i] = GET_INT_ARG(i+1);
     }
-    spi_transfer( handle, buf, argc, 0, 0, 0 );
-    spi_wait_done( handle );
+    r = spi_begin( vm, attr );
+    if( r == 0 ) {
+      spi_transfer( handle, buf, argc, 0, 0, 0 );
+      spi_end( attr );
+    }
     mrbc_raw_free( buf );
+    if( r > 0 ) goto RETURN_FALSE;
     goto DONE;
   }
 
@@ -190,6 +732,10 @@ static void c_spi_write(mrbc_vm *vm, mrbc_value v[], int argc)
 
  DONE:
   SET_NIL_RETURN();
+  return;
+
+ RETURN_FALSE:
+  SET_FALSE_RETURN();
 }
 
 
@@ -200,19 +746,28 @@ static void c_spi_write(mrbc_vm *vm, mrbc_value v[], int argc)
   $spi.transfer( [d1, d2,...], recv_size )
 
   @return String	Received data.
+			false if the task waits for its turn.
 */
 static void c_spi_transfer(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   mrbc_value ret;
-  SPI_HANDLE *handle = *(SPI_HANDLE **)v->instance->data;
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
+  int r;
 
   if( v[1].tt == MRBC_TT_STRING && v[2].tt == MRBC_TT_FIXNUM ) {
     int recv_len = GET_INT_ARG(2);
     uint8_t *buf = mrbc_alloc( vm, recv_len+1 );
     if( !buf ) goto ERROR_RETURN;		// ENOMEM
+    r = spi_begin( vm, attr );
+    if( r != 0 ) {
+      mrbc_raw_free( buf );
+      if( r > 0 ) goto RETURN_FALSE;
+      goto ERROR_RETURN;
+    }
     spi_transfer( handle, mrbc_string_cstr(&v[1]), mrbc_string_size(&v[1]),
 		  buf, recv_len, 0 );
-    spi_wait_done( handle );
+    spi_end( attr );
     buf[recv_len] = 0;
     ret = mrbc_string_new_alloc( vm, buf, recv_len );
     goto DONE;
@@ -235,8 +790,14 @@ static void c_spi_transfer(mrbc_vm *vm, mrbc_value v[], int argc)
       buf[i] = v1.i;
     }
 
+    r = spi_begin( vm, attr );
+    if( r != 0 ) {
+      mrbc_raw_free( buf );
+      if( r > 0 ) goto RETURN_FALSE;
+      goto ERROR_RETURN;
+    }
     spi_transfer( handle, buf, send_len, buf, recv_len, 0 );
-    spi_wait_done( handle );
+    spi_end( attr );
     buf[recv_len] = 0;
     ret = mrbc_string_new_alloc( vm, buf, recv_len );
     goto DONE;
@@ -247,6 +808,10 @@ static void c_spi_transfer(mrbc_vm *vm, mrbc_value v[], int argc)
 
  ERROR_RETURN:
   ret = mrbc_nil_value();
+  goto DONE;
+
+ RETURN_FALSE:
+  ret = mrbc_false_value();
 
  DONE:
   SET_RETURN(ret);
@@ -254,21 +819,482 @@ static void c_spi_transfer(mrbc_vm *vm, mrbc_value v[], int argc)
 
 
 
+//================================================================
+/*! fill
+
+  $spi.fill( pattern, count )		# 1 byte pattern
+  $spi.fill( pattern, count, 2 )	# 16bit pattern (MSB first)
+  $spi.fill( "string", count )		# repeat string
+
+  @return	nil, or false if the task waits for its turn.
+*/
+static void c_spi_fill(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
+  uint8_t pattern[2];
+  const void *p_pattern = pattern;
+  int pattern_size = 1;
+
+  if( argc < 2 || v[2].tt != MRBC_TT_FIXNUM ) goto DONE;	// raise?
+  int count = GET_INT_ARG(2);
+
+  switch( v[1].tt ) {
+  case MRBC_TT_FIXNUM:
+    if( argc >= 3 && v[3].tt == MRBC_TT_FIXNUM && v[3].i == 2 ) {
+      pattern[0] = v[1].i >> 8;
+      pattern[1] = v[1].i;
+      pattern_size = 2;
+    } else {
+      pattern[0] = v[1].i;
+    }
+    break;
+
+  case MRBC_TT_STRING:
+    p_pattern = mrbc_string_cstr(&v[1]);
+    pattern_size = mrbc_string_size(&v[1]);
+    break;
+
+  default:
+    goto DONE;	// TypeError. raise?
+  }
+  if( pattern_size <= 0 || count <= 0 ) goto DONE;
+
+  int r = spi_begin( vm, attr );
+  if( r > 0 ) goto RETURN_FALSE;
+  if( r < 0 ) goto DONE;
+  if( spi_fill( handle, p_pattern, pattern_size, count ) != 0 ) {
+    console_printf("SPI: parameter error.\n");	// too long.
+  }
+  spi_end( attr );
+
+ DONE:
+  SET_NIL_RETURN();
+  return;
+
+ RETURN_FALSE:
+  SET_FALSE_RETURN();
+}
+
+
+
+//================================================================
+/*! get the value type of read_regs/write_regs.
+
+  @param  v	type symbol, nil or NULL.
+  @return	pointer to the type or NULL.
+*/
+static const struct SPI_REG_TYPE *spi_get_reg_type(const mrbc_value *v)
+{
+  if( !v || v->tt == MRBC_TT_NIL ) {
+    return &spi_reg_types[0];
+  }
+  if( v->tt != MRBC_TT_SYMBOL ) return 0;
+
+  int i;
+  for( i = 0; i < (int)SPI_NUM_REG_TYPES; i++ ) {
+    if( v->i == spi_reg_type_symid[i] ) return &spi_reg_types[i];
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! register access settings
+
+  $spi.reg_setup( read_mask, inc_mask )
+
+  @param  read_mask	read flag of register address. (default 0x80)
+  @param  inc_mask	auto increment flag of register address. (default 0)
+*/
+static void c_spi_reg_setup(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+
+  if( argc >= 1 && v[1].tt == MRBC_TT_FIXNUM ) {
+    attr->reg_read_mask = v[1].i;
+  }
+  if( argc >= 2 && v[2].tt == MRBC_TT_FIXNUM ) {
+    attr->reg_inc_mask = v[2].i;
+  }
+
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! read registers
+
+  a = $spi.read_regs( reg, count, type = :u8, auto_inc = true )
+
+  @param  reg		register address.
+  @param  count		number of values.
+  @param  type		:u8, :s8, :u16, :s16, :u32, :s32 and
+			suffix le or be. (e.g. :s16le) no suffix is big endian.
+  @param  auto_inc	if true, add inc_mask to the address.
+  @return Array		Integer values.
+			:u32 values above 0x7fffffff are returned as Float.
+			(as negative Integer, if MRBC_USE_FLOAT is 0)
+			false if the task waits for its turn.
+*/
+static void c_spi_read_regs(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
+  uint8_t sbuf[32];
+  uint8_t *buf = sbuf;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  const struct SPI_REG_TYPE *type = spi_get_reg_type( argc >= 3 ? &v[3] : 0 );
+  if( !type ) goto ERROR_PARAM;
+
+  int count = v[2].i;
+  if( count <= 0 ) goto ERROR_PARAM;
+
+  uint8_t cmd = v[1].i | attr->reg_read_mask;
+  if( argc < 4 || v[4].tt != MRBC_TT_FALSE ) cmd |= attr->reg_inc_mask;
+
+  int len = count * type->size;
+  if( len > (int)sizeof(sbuf) ) {
+    buf = mrbc_raw_alloc( len );
+    if( !buf ) goto ERROR_RETURN;	// ENOMEM
+  }
+
+  int r = spi_begin( vm, attr );
+  if( r > 0 ) goto RETURN_FALSE;
+  if( r < 0 ) goto ERROR_RETURN;
+  spi_transfer( handle, &cmd, 1, buf, len, 0 );
+  spi_end( attr );
+
+  // decode
+  mrbc_value ret = mrbc_array_new( vm, count );
+  const uint8_t *p = buf;
+  int i;
+  for( i = 0; i < count; i++ ) {
+    uint32_t val = 0;
+    int j;
+    if( type->flag_big_endian ) {
+      for( j = 0; j < type->size; j++ ) val = (val << 8) | p[j];
+    } else {
+      for( j = type->size - 1; j >= 0; j-- ) val = (val << 8) | p[j];
+    }
+    p += type->size;
+
+    if( type->flag_signed ) {
+      int shift = 32 - type->size * 8;
+      val = (uint32_t)((int32_t)(val << shift) >> shift);
+    }
+    mrbc_value v1;
+#if MRBC_USE_FLOAT
+    if( !type->flag_signed && val > INT32_MAX ) {
+      v1 = mrbc_float_value( val );		// out of Fixnum range.
+    } else {
+      v1 = mrbc_fixnum_value( (int32_t)val );
+    }
+#else
+    v1 = mrbc_fixnum_value( (int32_t)val );	// same bits as :s32.
+#endif
+    mrbc_array_set( &ret, i, &v1 );
+  }
+
+  if( buf != sbuf ) mrbc_raw_free( buf );
+  SET_RETURN( ret );
+  return;
+
+ RETURN_FALSE:
+  if( buf != sbuf ) mrbc_raw_free( buf );
+  SET_FALSE_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPI: parameter error.\n");
+ ERROR_RETURN:
+  if( buf != sbuf ) mrbc_raw_free( buf );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! write registers
+
+  $spi.write_regs( reg, data, type = :u8, auto_inc = true )
+
+  @param  reg		register address.
+  @param  data		Integer or Array of Integer.
+			(Float is accepted for :u32 values above 0x7fffffff)
+  @param  type		same as read_regs.
+  @param  auto_inc	if true, add inc_mask to the address.
+  @return		nil, or false if the task waits for its turn.
+*/
+static void c_spi_write_regs(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPI_ATTR *attr = (SPI_ATTR *)v->instance->data;
+  SPI_HANDLE *handle = attr->spih;
+  uint8_t sbuf[32];
+  uint8_t *buf = sbuf;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  const struct SPI_REG_TYPE *type = spi_get_reg_type( argc >= 3 ? &v[3] : 0 );
+  if( !type ) goto ERROR_PARAM;
+
+  int count;
+  switch( v[2].tt ) {
+  case MRBC_TT_FIXNUM:	count = 1;			break;
+  case MRBC_TT_ARRAY:	count = mrbc_array_size(&v[2]);	break;
+  default:		goto ERROR_PARAM;
+  }
+
+  int len = 1 + count * type->size;
+  if( len > (int)sizeof(sbuf) ) {
+    buf = mrbc_raw_alloc( len );
+    if( !buf ) goto ERROR_RETURN;	// ENOMEM
+  }
+
+  buf[0] = v[1].i & ~attr->reg_read_mask;
+  if( argc < 4 || v[4].tt != MRBC_TT_FALSE ) buf[0] |= attr->reg_inc_mask;
+
+  // encode
+  uint8_t *p = buf + 1;
+  int i;
+  for( i = 0; i < count; i++ ) {
+    mrbc_value v1 = (v[2].tt == MRBC_TT_ARRAY) ? mrbc_array_get( &v[2], i ) : v[2];
+    uint32_t val;
+    switch( v1.tt ) {
+    case MRBC_TT_FIXNUM:
+      val = v1.i;
+      break;
+#if MRBC_USE_FLOAT
+    case MRBC_TT_FLOAT:
+      if( type->size != 4 || v1.d < 0 || v1.d > UINT32_MAX ) goto ERROR_PARAM;
+      val = (uint32_t)v1.d;
+      break;
+#endif
+    default:
+      goto ERROR_PARAM;
+    }
+    int j;
+    if( type->flag_big_endian ) {
+      for( j = type->size - 1; j >= 0; j-- ) { p[j] = val; val >>= 8; }
+    } else {
+      for( j = 0; j < type->size; j++ ) { p[j] = val; val >>= 8; }
+    }
+    p += type->size;
+  }
+
+  int r = spi_begin( vm, attr );
+  if( r < 0 ) goto ERROR_RETURN;
+  if( r == 0 ) {
+    spi_transfer( handle, buf, len, 0, 0, 0 );
+    spi_end( attr );
+  }
+
+  if( buf != sbuf ) mrbc_raw_free( buf );
+  if( r > 0 ) {
+    SET_FALSE_RETURN();
+  } else {
+    SET_NIL_RETURN();
+  }
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPI: parameter error.\n");
+ ERROR_RETURN:
+  if( buf != sbuf ) mrbc_raw_free( buf );
+  SET_NIL_RETURN();
+}
+
+
+
+//================================================================
+/*! NeoPixel instance attribute.
+*/
+typedef struct NEOPIXEL_ATTR {
+  SPI_ATTR spi;			//!< MOSI is the data line.
+  WS2812_ORDER order;
+  uint16_t scale;		//!< brightness. 1 to 256.
+} NEOPIXEL_ATTR;
+
+
+//================================================================
+/*! NeoPixel constructor
+
+  $led = NeoPixel.new( bus = 1, order = :GRB )
+
+  @param  bus		SPI interface number. 1 origin.
+  @param  order		byte order on the wire. :GRB, :RGB, :GRBW, ...
+*/
+static void c_neopixel_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  int spi_num = 0;
+  const char *order = "GRB";
+
+  if( argc >= 1 ) {
+    if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    spi_num = v[1].i - 1;
+  }
+  if( spi_num < 0 || spi_num >= MRBC_NUM_SPI ) goto ERROR_PARAM;
+  if( argc >= 2 ) {
+    if( v[2].tt != MRBC_TT_SYMBOL ) goto ERROR_PARAM;
+    order = symid_to_str( v[2].i );
+  }
+
+  WS2812_ORDER wo;
+  if( ws2812_parse_order( &wo, order ) != 0 ) goto ERROR_PARAM;
+
+  // nearest divider of WS2812_SPI_HZ. (bit rate = clock / 2)
+  // 0 is the bus default, if the clock can't change.
+  uint16_t divider = 0;
+  if( spih[spi_num].default_divider ) {
+    uint32_t freq2 = WS2812_SPI_HZ * 2;
+    uint32_t div = (BCLK__BUS_CLK__HZ + freq2 / 2) / freq2;
+    divider = div ? div : 1;
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(NEOPIXEL_ATTR));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+  NEOPIXEL_ATTR *attr = (NEOPIXEL_ATTR *)ret.instance->data;
+  *attr = (NEOPIXEL_ATTR){
+    .spi = {
+      .spih = &spih[spi_num],
+      .dev = { .divider = divider, .mode = MRBC_SPI_MODE,
+	       .bit_order = SPI_MSB_FIRST },
+      .cs = -1,
+    },
+    .order = wo,
+    .scale = 256,
+  };
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("NeoPixel: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! set the brightness
+
+  $led.brightness = n	# 0 to 255. (255 is as is)
+*/
+static void c_neopixel_set_brightness(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  NEOPIXEL_ATTR *attr = (NEOPIXEL_ATTR *)v->instance->data;
+
+  if( argc < 1 || v[1].tt != MRBC_TT_FIXNUM ||
+      v[1].i < 0 || v[1].i > 255 ) {
+    console_printf("NeoPixel: parameter error.\n");
+    return;
+  }
+  attr->scale = v[1].i + 1;
+}
+
+
+//================================================================
+/*! show the pixels
+
+  $led.show( str )	# packed "RGBRGB..." (or "RGBWRGBW..." for 4 bytes)
+
+  The whole frame is encoded and sent by one SPI transfer.
+
+  @return	nil, or false if the task waits for its turn.
+*/
+static void c_neopixel_show(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  NEOPIXEL_ATTR *attr = (NEOPIXEL_ATTR *)v->instance->data;
+
+  if( argc < 1 || v[1].tt != MRBC_TT_STRING ) goto ERROR_PARAM;
+  int size = mrbc_string_size(&v[1]);
+  if( size % attr->order.bpp != 0 ) goto ERROR_PARAM;
+  int n_pixels = size / attr->order.bpp;
+
+  int len = ws2812_encoded_size( n_pixels, &attr->order );
+  uint8_t *buf = mrbc_raw_alloc( len );
+  if( !buf ) goto DONE;		// ENOMEM
+  ws2812_encode( buf, (const uint8_t *)mrbc_string_cstr(&v[1]), n_pixels,
+		 &attr->order, attr->scale );
+
+  int r = spi_begin( vm, &attr->spi );
+  if( r == 0 ) {
+    spi_transfer( attr->spi.spih, buf, len, 0, 0, 0 );
+    spi_end( &attr->spi );
+  }
+  mrbc_raw_free( buf );
+  if( r > 0 ) {
+    SET_FALSE_RETURN();
+    return;
+  }
+  goto DONE;
+
+ ERROR_PARAM:
+  console_printf("NeoPixel: parameter error.\n");
+ DONE:
+  SET_NIL_RETURN();
+}
+
+
+
+//================================================================
+/*! set the hook to change the SPI mode of the bus.
+
+  The hook is called when a device of other SPI mode is selected.
+  (e.g. switch the SCLK polarity by an XOR gate and a control register.)
+
+  @param  bus		interface number. 1 origin.
+  @param  hook		hook function. returns 0 if success.
+  @return int		0 if success.
+*/
+int mrbc_spi_set_mode_hook(int bus, int (*hook)(uint8_t mode))
+{
+  if( bus < 1 || bus > MRBC_NUM_SPI ) return -1;
+
+  spi_set_mode_hook( &spih[bus - 1], hook );
+  return 0;
+}
+
+
 //================================================================
 /*! initialize
 */
 void mrbc_init_class_spi(struct VM *vm)
 {
+  int i;
+
   // start physical device
 #if MRBC_NUM_SPI >= 1
   spi_init( &spih[0], SPIM_1 );
+#if defined(SPIM_1_IntClock__CFG0)
+  spi_init_clock( &spih[0], SPIM_1 );
+#endif
 #endif
 #if MRBC_NUM_SPI >= 2
   spi_init( &spih[1], SPIM_2 );
+#if defined(SPIM_2_IntClock__CFG0)
+  spi_init_clock( &spih[1], SPIM_2 );
+#endif
 #endif
 #if MRBC_NUM_SPI >= 3
   spi_init( &spih[2], SPIM_3 );
+#if defined(SPIM_3_IntClock__CFG0)
+  spi_init_clock( &spih[2], SPIM_3 );
+#endif
 #endif
+  for( i = 0; i < MRBC_NUM_SPI; i++ ) {
+    spi_set_hw_config( &spih[i], MRBC_SPI_MODE, MRBC_SPI_BIT_ORDER );
+  }
+#if defined(MRBC_SPI_CS_REG)
+  SPI_CS_Write( 0xff );
+#endif
+
+  for( i = 0; i < (int)SPI_NUM_REG_TYPES; i++ ) {
+    spi_reg_type_symid[i] = str_to_symid( spi_reg_types[i].name );
+  }
 
   // define class and methods.
   mrbc_class *spi;
@@ -277,4 +1303,20 @@ void mrbc_init_class_spi(struct VM *vm)
   mrbc_define_method(0, spi, "read",	c_spi_read);
   mrbc_define_method(0, spi, "write",	c_spi_write);
   mrbc_define_method(0, spi, "transfer",c_spi_transfer);
+  mrbc_define_method(0, spi, "fill",	c_spi_fill);
+  mrbc_define_method(0, spi, "reg_setup",	c_spi_reg_setup);
+  mrbc_define_method(0, spi, "read_regs",	c_spi_read_regs);
+  mrbc_define_method(0, spi, "write_regs",	c_spi_write_regs);
+  mrbc_define_method(0, spi, "acquire",	c_spi_acquire);
+  mrbc_define_method(0, spi, "release",	c_spi_release);
+
+  mrbc_class *spidevice;
+  spidevice = mrbc_define_class(0, "SPIDevice",	spi);
+  mrbc_define_method(0, spidevice, "new",	c_spidevice_new);
+
+  mrbc_class *neopixel;
+  neopixel = mrbc_define_class(0, "NeoPixel",	mrbc_class_object);
+  mrbc_define_method(0, neopixel, "new",	c_neopixel_new);
+  mrbc_define_method(0, neopixel, "show",	c_neopixel_show);
+  mrbc_define_method(0, neopixel, "brightness=",	c_neopixel_set_brightness);
 }
@@ -18,8 +18,11 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 struct VM;
 void mrbc_init_class_spi(struct VM *vm);
+int mrbc_spi_set_mode_hook(int bus, int (*hook)(uint8_t mode));
 
 
 #ifdef __cplusplus
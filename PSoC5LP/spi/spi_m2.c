@@ -18,6 +18,7 @@
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
 #include <stdint.h>
+#include <limits.h>
 
 /***** Local headers ********************************************************/
 #include "spi_m2.h"
@@ -27,23 +28,60 @@
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
+static const uint8_t spi_zero_pattern[1] = { 0 };
+
 /***** Global variables *****************************************************/
 /***** Signal catching functions ********************************************/
 
+//================================================================
+/*! reverse bit order of a byte.
+*/
+static inline uint8_t spi_reverse_bits(uint8_t data)
+{
+  return ((data * 0x0802UL & 0x22110UL) |
+	  (data * 0x8020UL & 0x88440UL)) * 0x10101UL >> 16;
+}
+
+
+//================================================================
+/*! get the next byte to send.
+
+  send_data first, and then fill pattern repeatedly.
+*/
+static inline uint8_t spi_next_send_data(SPI_HANDLE *spih)
+{
+  uint8_t data;
+
+  if( spih->send_n++ < spih->send_size ) {
+    data = *spih->send_data++;
+  } else {
+    data = spih->fill_data[spih->fill_n];
+    if( ++spih->fill_n >= spih->fill_size ) spih->fill_n = 0;
+  }
+
+  return spih->flag_reverse ? spi_reverse_bits(data) : data;
+}
+
+
 //================================================================
 /*! Intterrupt callback on byte transfer complete.
 */
 void spi_tx_isr(SPI_HANDLE *spih)
 {
-  if( spih->send_n < spih->send_size ) {
-    spih->WriteTxData( *spih->send_data++ );
-    ++spih->send_n;
-    return;
+  if( spih->send_n < spih->send_total ) {
+    spih->WriteTxData( spi_next_send_data(spih) );
   }
+}
 
-  if( spih->send_n < spih->send_total ) {
-    spih->WriteTxData( 0 );
-    ++spih->send_n;
+
+//================================================================
+/*! store a received byte.
+*/
+static inline void spi_store_recv_data(SPI_HANDLE *spih, uint8_t data)
+{
+  if( spih->recv_n < spih->recv_size &&
+      spih->recv_n++ >= 0 ) {
+    *spih->recv_data++ = spih->flag_reverse ? spi_reverse_bits(data) : data;
   }
 }
 
@@ -54,17 +92,48 @@ void spi_tx_isr(SPI_HANDLE *spih)
 void spi_rx_isr(SPI_HANDLE *spih)
 {
   do {
-    int data = spih->ReadRxData();
-
-    if( spih->recv_n < spih->recv_size &&
-	spih->recv_n++ >= 0 ) {
-      *spih->recv_data++ = data;
-    }
+    spi_store_recv_data( spih, spih->ReadRxData() );
   } while( spih->GetRxBufferSize() != 0 );
 }
 
 
 /***** Local functions ******************************************************/
+
+//================================================================
+/*! start the transfer that was set up in the handle.
+
+  @param  spih		pointer to SPI_HANDLE
+*/
+static void spi_start(SPI_HANDLE *spih)
+{
+  /* Small transfer that fits in the FIFO.
+     The interrupt overhead is larger than the transfer itself,
+     so do it by polling and leave the interrupts masked.
+  */
+  if( spih->send_total <= spih->FIFO_SIZE ) {
+    int n = spih->send_total;
+    while( spih->send_n < n ) {
+      spih->WriteTxData( spi_next_send_data(spih) );
+    }
+    while( n > 0 ) {
+      if( spih->GetRxBufferSize() == 0 ) continue;
+      spi_store_recv_data( spih, spih->ReadRxData() );
+      n--;
+    }
+    return;
+  }
+
+  // send SPI_n_FIFO_SIZE (maybe 4) byte continuously.
+  while( spih->send_n < spih->send_total ) {
+    spih->WriteTxData( spi_next_send_data(spih) );
+    if( spih->send_n >= spih->FIFO_SIZE ) break;
+  }
+
+  spih->EnableTxInt();
+  spih->EnableRxInt();
+}
+
+
 /***** Global functions *****************************************************/
 
 //================================================================
@@ -107,10 +176,89 @@ void spi_init_m(SPI_HANDLE *spih,
 //spih->GetTxBufferSize = GetTxBufferSize;
   spih->ClearFIFO = ClearFIFO;
 
+  spih->active = (SPI_DEVICE){ .divider = 0, .mode = 0,
+			       .bit_order = SPI_MSB_FIRST };
+  spih->default_divider = 0;
+  spih->bit_order = SPI_MSB_FIRST;
+  spih->flag_reverse = 0;
+  spih->queue_head = 0;
+  spih->queue_tail = 0;
+  spih->SetDividerValue = 0;
+  spih->SetMode = 0;
+
   spih->Start();
 }
 
 
+//================================================================
+/*! initialize the clock setting.
+  @internal
+  @param  spih		pointer to SPI_HANDLE
+  @note
+    Don't use this directry. Use spi_init_clock macro.
+*/
+void spi_init_clock_m(SPI_HANDLE *spih, void *SetDividerValue,
+		      uint16_t default_divider)
+{
+  spih->SetDividerValue = SetDividerValue;
+  spih->default_divider = default_divider;
+  spih->active.divider = default_divider;
+}
+
+
+//================================================================
+/*! set the hardware configuration of the component.
+
+  @param  spih		pointer to SPI_HANDLE
+  @param  mode		SPI mode set by PSoC Creator.
+  @param  bit_order	Shift direction set by PSoC Creator.
+*/
+void spi_set_hw_config(SPI_HANDLE *spih, uint8_t mode, uint8_t bit_order)
+{
+  spih->active.mode = mode;
+  spih->active.bit_order = bit_order;
+  spih->bit_order = bit_order;
+  spih->flag_reverse = 0;
+}
+
+
+//================================================================
+/*! select a device. reprogram the bus only when settings are changed.
+
+  @param  spih		pointer to SPI_HANDLE
+  @param  dev		pointer to SPI_DEVICE
+  @return int		0 if success.
+*/
+int spi_select_device(SPI_HANDLE *spih, const SPI_DEVICE *dev)
+{
+  uint16_t divider = dev->divider ? dev->divider : spih->default_divider;
+
+  if( divider == spih->active.divider &&
+      dev->mode == spih->active.mode &&
+      dev->bit_order == spih->active.bit_order ) return 0;
+
+  if( divider != spih->active.divider && !spih->SetDividerValue ) return -1;
+  if( dev->mode != spih->active.mode && !spih->SetMode ) return -1;
+
+  spi_wait_done(spih);
+
+  if( dev->mode != spih->active.mode ) {
+    if( spih->SetMode( dev->mode ) != 0 ) return -1;
+    spih->active.mode = dev->mode;
+  }
+
+  if( divider != spih->active.divider ) {
+    spih->SetDividerValue( divider );
+    spih->active.divider = divider;
+  }
+
+  spih->active.bit_order = dev->bit_order;
+  spih->flag_reverse = (dev->bit_order != spih->bit_order);
+
+  return 0;
+}
+
+
 
 //================================================================
 /*! Perform SPI data transfer. (send and receive)
@@ -139,22 +287,54 @@ void spi_transfer(SPI_HANDLE *spih, void *send_buf, int send_size,
     spih->send_total = send_size + recv_size;
   }
   spih->send_n = 0;
+  spih->fill_data = spi_zero_pattern;
+  spih->fill_size = sizeof(spi_zero_pattern);
+  spih->fill_n = 0;
 
   spih->recv_data = recv_buf;
   spih->recv_size = recv_buf ? recv_size : 0;
   spih->recv_n = flag_include ? 0 : -send_size;
 
-  // send SPI_n_FIFO_SIZE (maybe 4) byte continuously.
-  while( spih->send_n < spih->send_size ) {
-    spih->WriteTxData( *spih->send_data++ );
-    if( ++spih->send_n >= spih->FIFO_SIZE ) goto DONE;
-  }
-  while( spih->send_n < spih->send_total ) {
-    spih->WriteTxData( 0 );
-    if( ++spih->send_n >= spih->FIFO_SIZE ) goto DONE;
-  }
+  spi_start(spih);
+}
 
- DONE:
-  spih->EnableTxInt();
-  spih->EnableRxInt();
+
+//================================================================
+/*! Send a pattern repeatedly. (fill transfer)
+
+  @param  spih		pointer to SPI_HANDLE
+  @param  pattern	pointer to pattern data.
+  @param  pattern_size	pattern size (bytes).
+  @param  count		number of repetitions.
+  @return int		0 if success. -1 if the total size overflows.
+  @note
+    The pattern must remain valid until the transfer is done.
+    Received data are discarded.
+*/
+int spi_fill(SPI_HANDLE *spih, const void *pattern, int pattern_size,
+	     int count)
+{
+  if( pattern_size <= 0 || count < 0 ) return -1;
+  if( count > INT_MAX / pattern_size ) return -1;
+
+  spi_wait_done(spih);
+
+  spih->DisableTxInt();
+  spih->DisableRxInt();
+  spih->ClearFIFO();
+
+  spih->send_data = 0;
+  spih->send_size = 0;
+  spih->send_total = pattern_size * count;
+  spih->send_n = 0;
+  spih->fill_data = pattern;
+  spih->fill_size = pattern_size;
+  spih->fill_n = 0;
+
+  spih->recv_data = 0;
+  spih->recv_size = 0;
+  spih->recv_n = 0;
+
+  spi_start(spih);
+  return 0;
 }
@@ -29,6 +29,11 @@ extern "C" {
 
 /***** Local headers ********************************************************/
 /***** Constant values ******************************************************/
+//! bit order
+#define SPI_MSB_FIRST	0
+#define SPI_LSB_FIRST	1
+
+
 /***** Macros ***************************************************************/
 //! Convenience macro to define the interrupt handler.
 #define SPI_ISR(spih, NAME)			\
@@ -55,8 +60,24 @@ extern "C" {
 	      NAME ## _GetRxBufferSize,		\
 	      NAME ## _ClearFIFO)
 
+//! Initializer macro for the internal clock. Needs for the per-device bit rate.
+#define spi_init_clock(spih, NAME)				\
+  spi_init_clock_m( spih,					\
+		    NAME ## _IntClock_SetDividerValue,		\
+		    NAME ## _IntClock_GetDividerRegister() + 1 )
+
 
 /***** Typedefs *************************************************************/
+//================================================================
+/*! SPI device settings.
+*/
+typedef struct SPI_DEVICE {
+  uint16_t divider;	//!< clock divider. 0 means bus default.
+  uint8_t mode;		//!< SPI mode. (CPOL << 1 | CPHA)
+  uint8_t bit_order;	//!< SPI_MSB_FIRST or SPI_LSB_FIRST
+} SPI_DEVICE;
+
+
 //================================================================
 /*! SPI handle.
 */
@@ -70,6 +91,18 @@ typedef struct SPI_HANDLE {
   int recv_size;
   int recv_n;
 
+  const uint8_t *fill_data;	// padding pattern after send_data.
+  int fill_size;
+  int fill_n;
+
+  // bus sharing
+  SPI_DEVICE active;		// settings of the active device.
+  uint16_t default_divider;	// 0 if clock can't change.
+  uint8_t bit_order;		// shift direction of the component.
+  uint8_t flag_reverse;		// reverse bit order by software.
+  uint16_t queue_head;		// fair bus queue (ticket).
+  uint16_t queue_tail;
+
   // constant table
   uint8_t STS_SPI_IDLE;
   uint8_t FIFO_SIZE;
@@ -88,6 +121,8 @@ typedef struct SPI_HANDLE {
   uint8_t (*GetRxBufferSize)(void);
 //uint8_t (*GetTxBufferSize)(void);
   void (*ClearFIFO)(void);
+  void (*SetDividerValue)(uint16_t);
+  int (*SetMode)(uint8_t mode);		// optional hook. returns 0 if success.
 
 } SPI_HANDLE;
 
@@ -109,12 +144,21 @@ void spi_init_m(SPI_HANDLE *spih,
 		void *ReadRxData,
 		void *GetRxBufferSize,
 		void *ClearFIFO);
+void spi_init_clock_m(SPI_HANDLE *spih,
+		      void *SetDividerValue,
+		      uint16_t default_divider);
+void spi_set_hw_config(SPI_HANDLE *spih, uint8_t mode, uint8_t bit_order);
+int spi_select_device(SPI_HANDLE *spih, const SPI_DEVICE *dev);
 void spi_transfer(SPI_HANDLE *spih,
 		  void *send_buf,
 		  int send_size,
 		  void *recv_buf,
 		  int recv_size,
 		  int flag_include);
+int spi_fill(SPI_HANDLE *spih,
+	     const void *pattern,
+	     int pattern_size,
+	     int count);
 
 /***** Inline functions *****************************************************/
 //================================================================
@@ -141,6 +185,66 @@ static inline int spi_is_transfer(const SPI_HANDLE *spih)
 }
 
 
+//================================================================
+/*! Set the hook to change the SPI mode. spi_select_device() calls it.
+
+  @param  spih		pointer to SPI_HANDLE
+  @param  hook		hook function. returns 0 if success.
+*/
+static inline void spi_set_mode_hook(SPI_HANDLE *spih, int (*hook)(uint8_t mode))
+{
+  spih->SetMode = hook;
+}
+
+
+//================================================================
+/*! Take a ticket to use the bus. (fair bus queue)
+
+  @param  spih		pointer to SPI_HANDLE
+  @return uint16_t	ticket
+*/
+static inline uint16_t spi_bus_enqueue(SPI_HANDLE *spih)
+{
+  return spih->queue_tail++;
+}
+
+
+//================================================================
+/*! Is it the turn of the ticket?
+
+  @param  spih		pointer to SPI_HANDLE
+  @param  ticket	ticket
+  @return int	true or false
+*/
+static inline int spi_bus_is_turn(const SPI_HANDLE *spih, uint16_t ticket)
+{
+  return spih->queue_head == ticket;
+}
+
+
+//================================================================
+/*! Release the bus and pass it to the next ticket.
+
+  @param  spih		pointer to SPI_HANDLE
+*/
+static inline void spi_bus_dequeue(SPI_HANDLE *spih)
+{
+  spih->queue_head++;
+}
+
+
+//================================================================
+/*! Is nobody using or waiting the bus?
+
+  @param  spih		pointer to SPI_HANDLE
+  @return int	true or false
+*/
+static inline int spi_bus_is_free(const SPI_HANDLE *spih)
+{
+  return spih->queue_head == spih->queue_tail;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
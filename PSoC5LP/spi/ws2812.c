@@ -0,0 +1,112 @@
+/*! @file
+  @brief
+  WS2812 (NeoPixel) frame encoder for the SPI master.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+
+  A WS2812 bit is 4 SPI bits at 3.2MHz, so the MOSI pin makes the
+  waveform without the CPU timing.
+     1: 1110  (high 938ns, low 312ns)
+     0: 1000  (high 312ns, low 938ns)
+  A color byte becomes 4 SPI bytes, MSB first. An SPI byte holds just
+  2 WS2812 bits, so every byte boundary is at the low end of a bit.
+  A gap between the SPI bytes only stretches that low time. It must be
+  shorter than the reset time, or the LEDs latch in the middle.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+/***** Local headers ********************************************************/
+#include "ws2812.h"
+
+/***** Constant values ******************************************************/
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+//! 2 SPI bytes of a nibble.
+static const uint16_t ws2812_nibble[16] = {
+  0x8888, 0x888e, 0x88e8, 0x88ee, 0x8e88, 0x8e8e, 0x8ee8, 0x8eee,
+  0xe888, 0xe88e, 0xe8e8, 0xe8ee, 0xee88, 0xee8e, 0xeee8, 0xeeee,
+};
+
+
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+/***** Local functions ******************************************************/
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! parse the byte order.
+
+  @param  order		pointer to WS2812_ORDER to store.
+  @param  s		order string. e.g. "GRB", "RGB", "GRBW"
+  @return int		0 is no error.
+*/
+int ws2812_parse_order(WS2812_ORDER *order, const char *s)
+{
+  static const char COLORS[] = "RGBW";
+  int used = 0;
+  int i;
+
+  for( i = 0; s[i]; i++ ) {
+    int idx;
+    for( idx = 0; COLORS[idx] && COLORS[idx] != s[i]; idx++ )
+      ;
+    if( i >= 4 || !COLORS[idx] || (used & (1 << idx)) ) return -1;
+    used |= (1 << idx);
+    order->src[i] = idx;
+  }
+
+  // W needs 4 bytes, and 4 bytes need W.
+  if( (i == 3 && used == 0x07) || (i == 4 && used == 0x0f) ) {
+    order->bpp = i;
+    return 0;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*! encode the pixels.
+
+  @param  dst		destination. ws2812_encoded_size() bytes.
+  @param  src		pixels, packed R, G, B (, W) bytes.
+  @param  n_pixels	number of pixels.
+  @param  order		pointer to WS2812_ORDER
+  @param  scale		brightness. 1 to 256. (256 is as is)
+*/
+void ws2812_encode(uint8_t *dst, const uint8_t *src, int n_pixels,
+		   const WS2812_ORDER *order, int scale)
+{
+  int bpp = order->bpp;
+  int i, j;
+
+  for( i = 0; i < n_pixels; i++ ) {
+    for( j = 0; j < bpp; j++ ) {
+      unsigned int c = src[order->src[j]];
+      if( scale < 256 ) c = (c * scale) >> 8;
+
+      uint16_t hi = ws2812_nibble[c >> 4];
+      uint16_t lo = ws2812_nibble[c & 0x0f];
+      *dst++ = hi >> 8;
+      *dst++ = hi;
+      *dst++ = lo >> 8;
+      *dst++ = lo;
+    }
+    src += bpp;
+  }
+
+  for( i = 0; i < WS2812_RESET_BYTES; i++ ) {
+    *dst++ = 0;
+  }
+}
@@ -0,0 +1,78 @@
+/*! @file
+  @brief
+  WS2812 (NeoPixel) frame encoder for the SPI master.
+
+  @version 1.0
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef PSOC5_WS2812_H_
+#define PSOC5_WS2812_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! SPI bit rate. 4 SPI bits are a WS2812 bit. (1.25us)
+#define WS2812_SPI_HZ		3200000
+
+//! SPI bytes of a color byte.
+#define WS2812_BYTES_PER_BYTE	4
+
+//! zero bytes after the frame for the reset (latch). 320us at 3.2MHz.
+#ifndef WS2812_RESET_BYTES
+# define WS2812_RESET_BYTES	128
+#endif
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*! byte order on the wire.
+
+  src[n] is the index of the byte in a source pixel (R, G, B, W)
+  sent in the n-th.
+*/
+typedef struct WS2812_ORDER {
+  uint8_t bpp;			// bytes per pixel. 3 or 4.
+  uint8_t src[4];
+
+} WS2812_ORDER;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+int ws2812_parse_order(WS2812_ORDER *order, const char *s);
+void ws2812_encode(uint8_t *dst, const uint8_t *src, int n_pixels,
+		   const WS2812_ORDER *order, int scale);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! size of the encoded frame.
+
+  @param  n_pixels	number of pixels.
+  @param  order		pointer to WS2812_ORDER
+  @return int		bytes, including the reset.
+*/
+static inline int ws2812_encoded_size(int n_pixels, const WS2812_ORDER *order)
+{
+  return n_pixels * order->bpp * WS2812_BYTES_PER_BYTE + WS2812_RESET_BYTES;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,386 @@
+/*! @file
+  @brief
+  SPI slave class for Cypress PSoC5LP
+
+  <pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (Usage)
+  Hardware configration.
+
+   1. Use PSoC Creator, place "Communication > SPI >
+        SPI Slave Full Duplex mode Macro" device.
+   2. Open a configure dialog.
+   3. Make sure the name is "SPIS_1".
+   4. Set the Mode and Shift Direction.
+   5. Change to the "Advanced" tab and check as follows.
+	Enable Tx Internal Interrupt
+	Interrupt On Tx FIFO Not Full
+	Enable Rx Internal Interrupt
+	Interrupt On Rx FIFO Not Empty
+
+   6. Close this dialog.
+   7. Add following lines to the auto-generated "cyapicallbacks.h".
+	#define SPIS_1_TX_ISR_ENTRY_CALLBACK
+	void SPIS_1_TX_ISR_EntryCallback(void);
+	#define SPIS_1_RX_ISR_ENTRY_CALLBACK
+	void SPIS_1_RX_ISR_EntryCallback(void);
+
+  Register mode needs the end of frame.
+   8. Place "Ports and Pins > Digital Input Pin" named "SPIS_1_SS",
+      connect it to SPIS_1's ss, and set "Interrupt" to "Rising edge".
+   9. Place "System > Interrupt" named "isr_SPIS_1_SS",
+      and connect to irq of SPIS_1_SS.
+  10. Define pre-processor macro MRBC_SPIS_USE_SS.
+
+  More SPI slave devices?
+      Place "SPIS_2" in the same way and define MRBC_NUM_SPIS=2.
+
+
+  C program (main.c)
+    #include "c_spis.h"
+    mrbc_init_class_spis(0);
+
+
+  mruby program
+
+    # stream mode.
+    spis = SPISlave.new()
+    spis.write( "DATA" )	# queue data for the host read.
+    s = spis.read( 4 )		# read 4 bytes or nil.
+    s = spis.read_nonblock( 16 )
+
+    # register mode. 64 bytes register file, host can write to 0..15.
+    #  read:  CS low - (0x80 | addr) - dummy - data... - CS high
+    #  write: CS low - addr - data... - CS high
+    regs = SPISlave.new( 1, 64, 16 )
+    regs.update( 0x20, "\x12\x34" )	# update the table.
+    s = regs.fetch( 0, 16 )		# get the table.
+    regs.written?			# host has written?
+  </pre>
+*/
+
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+#include <project.h>	// auto generated by PSoC Creator.
+
+#include "mrubyc.h"
+#include "spi_s2.h"
+
+
+//================================================================
+/*! SPI slave用設定
+*/
+#if !defined(MRBC_NUM_SPIS)
+# define MRBC_NUM_SPIS 1
+#endif
+
+//! number of dummy bytes after the command byte in register mode.
+#if !defined(MRBC_SPIS_TURNAROUND)
+# define MRBC_SPIS_TURNAROUND 1
+#endif
+
+static SPIS_HANDLE spish[MRBC_NUM_SPIS];
+static uint8_t *spis_regs[MRBC_NUM_SPIS];
+
+#if MRBC_NUM_SPIS >= 1
+SPIS_ISR( &spish[0], SPIS_1 );
+#if defined(MRBC_SPIS_USE_SS)
+SPIS_SS_ISR( &spish[0], SPIS_1 );
+#endif
+#endif
+#if MRBC_NUM_SPIS >= 2
+SPIS_ISR( &spish[1], SPIS_2 );
+#if defined(MRBC_SPIS_USE_SS)
+SPIS_SS_ISR( &spish[1], SPIS_2 );
+#endif
+#endif
+#if MRBC_NUM_SPIS >= 3
+#error "MRBC_NUM_SPIS >= 3"
+#endif
+
+
+
+//================================================================
+/*! SPISlave constructor
+
+  $spis = SPISlave.new			# first interface, stream mode.
+  $spis = SPISlave.new( num )		# specifies interface number. 1 origin.
+  $spis = SPISlave.new( num, reg_size, rw_boundary )	# register mode.
+*/
+static void c_spis_new(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  int spis_num = 0;
+
+  if( argc >= 1 ) {
+    if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    spis_num = v[1].i - 1;
+  }
+  if( spis_num < 0 || spis_num >= MRBC_NUM_SPIS ) goto ERROR_PARAM;
+
+  SPIS_HANDLE *handle = &spish[spis_num];
+
+  if( argc >= 2 ) {
+#if defined(MRBC_SPIS_USE_SS)
+    if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+    int reg_size = v[2].i;
+    if( reg_size <= 0 || reg_size > 128 ) goto ERROR_PARAM;
+
+    int rw_boundary = 0;
+    if( argc >= 3 ) {
+      if( v[3].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+      rw_boundary = v[3].i;
+    }
+
+    uint8_t *regs = mrbc_raw_alloc( reg_size );
+    if( !regs ) goto ERROR_RETURN;	// ENOMEM
+    memset( regs, 0, reg_size );
+
+    spis_set_register_mode( handle, regs, reg_size, rw_boundary,
+			    MRBC_SPIS_TURNAROUND );
+    if( spis_regs[spis_num] ) mrbc_raw_free( spis_regs[spis_num] );
+    spis_regs[spis_num] = regs;
+#else
+    console_printf("SPISlave: register mode needs MRBC_SPIS_USE_SS.\n");
+    goto ERROR_RETURN;
+#endif
+
+  } else {
+    // the ISR doesn't use the register file after this.
+    spis_set_stream_mode( handle );
+    if( spis_regs[spis_num] ) mrbc_raw_free( spis_regs[spis_num] );
+    spis_regs[spis_num] = 0;
+  }
+
+  mrbc_value ret = mrbc_instance_new(vm, v->cls, sizeof(SPIS_HANDLE *));
+  if( ret.instance == NULL ) goto ERROR_RETURN;	// ENOMEM
+
+  *((SPIS_HANDLE **)ret.instance->data) = handle;
+  SET_RETURN( ret );
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPISlave: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! read
+
+  s = $spis.read(n)
+
+  @param  n		Number of bytes receive.
+  @return String	Received data.
+  @return Nil		Not enough receive length.
+*/
+static void c_spis_read(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value ret;
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+  int need_length = GET_INT_ARG(1);
+
+  if( spis_is_rx_overflow( handle ) ) {
+    console_print("SPISlave Rx buffer overflow.\n");
+    spis_clear_rx_overflow( handle );
+  }
+
+  if( spis_bytes_available(handle) < need_length ) goto RETURN_NIL;
+
+  uint8_t *buf = mrbc_alloc( vm, need_length + 1 );
+  if( !buf ) goto RETURN_NIL;
+
+  int len = spis_read( handle, buf, need_length );
+  buf[len] = 0;
+  ret = mrbc_string_new_alloc( vm, buf, len );
+  goto DONE;
+
+ RETURN_NIL:
+  ret = mrbc_nil_value();
+
+ DONE:
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! read_nonblock
+
+  s = $spis.read_nonblock(maxlen)
+
+  @param  maxlen	Maximum receive length.
+  @return String	Received data.
+  @return Nil		No received data
+*/
+static void c_spis_read_nonblock(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value ret;
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+  int max_length = GET_INT_ARG(1);
+
+  int len = spis_bytes_available(handle);
+  if( len == 0 ) goto RETURN_NIL;
+  if( len > max_length ) len = max_length;
+
+  uint8_t *buf = mrbc_alloc( vm, len + 1 );
+  if( !buf ) goto RETURN_NIL;
+
+  len = spis_read( handle, buf, len );
+  buf[len] = 0;
+  ret = mrbc_string_new_alloc( vm, buf, len );
+  goto DONE;
+
+ RETURN_NIL:
+  ret = mrbc_nil_value();
+
+ DONE:
+  SET_RETURN(ret);
+}
+
+
+//================================================================
+/*! write
+
+  $spis.write(s)
+
+  @param  s		Data for the host read.
+  @return Integer	Queued bytes.
+*/
+static void c_spis_write(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+
+  if( argc < 1 || v[1].tt != MRBC_TT_STRING ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  int n = spis_write( handle, mrbc_string_cstr(&v[1]), mrbc_string_size(&v[1]) );
+  SET_INT_RETURN(n);
+}
+
+
+//================================================================
+/*! update the register file
+
+  $spis.update( offset, s )
+*/
+static void c_spis_update(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_STRING ) goto ERROR_PARAM;
+
+  spis_update_regs( handle, v[1].i,
+		    mrbc_string_cstr(&v[2]), mrbc_string_size(&v[2]) );
+  SET_NIL_RETURN();
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPISlave: parameter error.\n");
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! fetch the register file
+
+  s = $spis.fetch( offset, length )
+*/
+static void c_spis_fetch(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+
+  if( argc < 2 ) goto ERROR_PARAM;
+  if( v[1].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+  if( v[2].tt != MRBC_TT_FIXNUM ) goto ERROR_PARAM;
+
+  int offset = v[1].i;
+  int len = v[2].i;
+  if( offset < 0 || offset >= handle->reg_size || len < 0 ) goto ERROR_PARAM;
+  if( len > handle->reg_size - offset ) len = handle->reg_size - offset;
+
+  uint8_t *buf = mrbc_alloc( vm, len + 1 );
+  if( !buf ) goto ERROR_RETURN;		// ENOMEM
+
+  uint8 interrupts = CyEnterCriticalSection();
+  for( int i = 0; i < len; i++ ) {
+    buf[i] = handle->regs[offset + i];
+  }
+  CyExitCriticalSection( interrupts );
+  buf[len] = 0;
+
+  mrbc_value ret = mrbc_string_new_alloc( vm, buf, len );
+  SET_RETURN(ret);
+  return;
+
+ ERROR_PARAM:
+  console_printf("SPISlave: parameter error.\n");
+ ERROR_RETURN:
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! Has the host written to the register file?
+
+  $spis.written?
+*/
+static void c_spis_written(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+  SET_BOOL_RETURN( spis_is_regs_written( handle ) );
+}
+
+
+//================================================================
+/*! number of TX underruns
+
+  $spis.underrun
+*/
+static void c_spis_underrun(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SPIS_HANDLE *handle = *(SPIS_HANDLE **)v->instance->data;
+  SET_INT_RETURN( handle->underrun );
+}
+
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_spis(struct VM *vm)
+{
+  // start physical device
+#if MRBC_NUM_SPIS >= 1
+  spis_init( &spish[0], SPIS_1 );
+#if defined(MRBC_SPIS_USE_SS)
+  spis_init_ss( &spish[0], SPIS_1 );
+#endif
+#endif
+#if MRBC_NUM_SPIS >= 2
+  spis_init( &spish[1], SPIS_2 );
+#if defined(MRBC_SPIS_USE_SS)
+  spis_init_ss( &spish[1], SPIS_2 );
+#endif
+#endif
+
+  // define class and methods.
+  mrbc_class *spis;
+  spis = mrbc_define_class(0, "SPISlave",	mrbc_class_object);
+  mrbc_define_method(0, spis, "new",		c_spis_new);
+  mrbc_define_method(0, spis, "read",		c_spis_read);
+  mrbc_define_method(0, spis, "read_nonblock",	c_spis_read_nonblock);
+  mrbc_define_method(0, spis, "write",		c_spis_write);
+  mrbc_define_method(0, spis, "update",		c_spis_update);
+  mrbc_define_method(0, spis, "fetch",		c_spis_fetch);
+  mrbc_define_method(0, spis, "written?",	c_spis_written);
+  mrbc_define_method(0, spis, "underrun",	c_spis_underrun);
+}
@@ -0,0 +1,390 @@
+/*! @file
+  @brief
+  SPI slave convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <project.h>
+
+/***** Local headers ********************************************************/
+#include "spi_s2.h"
+
+/***** Constant values ******************************************************/
+//! state of register mode.
+enum {
+  SPIS_REG_STATE_CMD = 0,	// waiting for the command byte.
+  SPIS_REG_STATE_READ,		// host reads the register file.
+  SPIS_REG_STATE_WRITE,		// host writes the register file.
+};
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+
+//================================================================
+/*! fill the TX FIFO from the ring buffer or the register file.
+*/
+static void spis_fill_tx_fifo(SPIS_HANDLE *sh)
+{
+  while( sh->ReadTxStatus() & sh->STS_TX_FIFO_NOT_FULL ) {
+    uint8_t data;
+
+    if( sh->mode == SPIS_MODE_REGISTER ) {
+      if( sh->reg_state != SPIS_REG_STATE_READ ) goto EMPTY;
+      data = sh->regs[sh->reg_addr];
+      if( ++sh->reg_addr >= sh->reg_size ) sh->reg_addr = 0;
+
+    } else {
+      uint16_t tx_rd = sh->tx_rd;
+      if( tx_rd == sh->tx_wr ) goto EMPTY;
+      data = sh->txbuf[tx_rd++];
+      if( tx_rd >= sizeof(sh->txbuf) ) tx_rd = 0;
+      sh->tx_rd = tx_rd;
+    }
+
+    sh->WriteTxData( data );
+    sh->tx_in_fifo++;
+  }
+  return;
+
+  // nothing to send. stop the TX FIFO not full interrupt.
+ EMPTY:
+  sh->DisableTxInt();
+}
+
+
+//================================================================
+/*! receive a byte in register mode.
+*/
+static void spis_reg_recv(SPIS_HANDLE *sh, uint8_t data)
+{
+  switch( sh->reg_state ) {
+  case SPIS_REG_STATE_CMD:
+    sh->reg_addr = data & ~SPIS_REG_READ;
+    if( sh->reg_addr >= sh->reg_size ) sh->reg_addr = 0;
+
+    if( data & SPIS_REG_READ ) {
+      // respond as soon as possible. the host is clocking turnaround bytes.
+      sh->reg_state = SPIS_REG_STATE_READ;
+      spis_fill_tx_fifo(sh);
+      sh->EnableTxInt();
+    } else {
+      sh->reg_state = SPIS_REG_STATE_WRITE;
+    }
+    break;
+
+  case SPIS_REG_STATE_WRITE:
+    if( sh->reg_addr < sh->rw_boundary ) {
+      sh->regs[sh->reg_addr++] = data;
+      sh->flag_reg_written = 1;
+    }
+    break;
+
+  default:	// SPIS_REG_STATE_READ. ignore host data.
+    break;
+  }
+}
+
+
+//================================================================
+/*! start a frame of register mode. preload dummy bytes.
+*/
+static void spis_reg_frame_start(SPIS_HANDLE *sh)
+{
+  sh->reg_state = SPIS_REG_STATE_CMD;
+
+  // command byte and turnaround bytes.
+  int i;
+  for( i = 0; i <= sh->turnaround; i++ ) {
+    sh->WriteTxData( SPIS_DUMMY_DATA );
+  }
+  sh->tx_in_fifo = i;
+}
+
+
+//================================================================
+/*! Intterrupt callback on TX FIFO not full.
+*/
+void spis_tx_isr(SPIS_HANDLE *sh)
+{
+  spis_fill_tx_fifo(sh);
+}
+
+
+//================================================================
+/*! Intterrupt callback on RX FIFO not empty.
+*/
+void spis_rx_isr(SPIS_HANDLE *sh)
+{
+  while( sh->ReadRxStatus() & sh->STS_RX_FIFO_NOT_EMPTY ) {
+    uint8_t data = sh->ReadRxData();
+
+    // a byte was clocked out at the same time.
+    if( sh->tx_in_fifo > 0 ) {
+      sh->tx_in_fifo--;
+    } else {
+      sh->underrun++;
+    }
+
+    if( sh->mode == SPIS_MODE_REGISTER ) {
+      spis_reg_recv(sh, data);
+      continue;
+    }
+
+    uint16_t rx_wr = sh->rx_wr + 1;
+    if( rx_wr >= sizeof(sh->rxbuf) ) rx_wr = 0;
+    if( rx_wr == sh->rx_rd ) {
+      sh->rx_overflow = 1;	// buffer full
+      continue;
+    }
+    sh->rxbuf[sh->rx_wr] = data;
+    sh->rx_wr = rx_wr;
+  }
+}
+
+
+//================================================================
+/*! Intterrupt callback on ss pin rising edge. (end of frame)
+*/
+void spis_ss_isr(SPIS_HANDLE *sh)
+{
+  spis_rx_isr(sh);
+  if( sh->mode != SPIS_MODE_REGISTER ) return;
+
+  // discard unread bytes, and prepare for the next frame.
+  sh->DisableTxInt();
+  sh->ClearFIFO();
+  spis_reg_frame_start(sh);
+}
+
+
+/***** Local functions ******************************************************/
+/***** Global functions *****************************************************/
+
+//================================================================
+/*! initialize
+  @internal
+  @param  sh		pointer to SPIS_HANDLE
+  @note
+    Don't use this directry. Use spis_init macro.
+*/
+void spis_init_m(SPIS_HANDLE *sh,
+		 uint8_t fifo_size,
+		 uint8_t sts_tx_fifo_not_full,
+		 uint8_t sts_rx_fifo_not_empty,
+		 void *Start,
+		 void *EnableTxInt,
+		 void *EnableRxInt,
+		 void *DisableTxInt,
+		 void *DisableRxInt,
+		 void *ReadTxStatus,
+		 void *ReadRxStatus,
+		 void *WriteTxData,
+		 void *ReadRxData,
+		 void *ClearFIFO)
+{
+  sh->mode = SPIS_MODE_STREAM;
+  sh->tx_in_fifo = 0;
+  sh->underrun = 0;
+  sh->rx_rd = 0;
+  sh->rx_wr = 0;
+  sh->rx_overflow = 0;
+  sh->tx_rd = 0;
+  sh->tx_wr = 0;
+  sh->regs = 0;
+  sh->reg_size = 0;
+  sh->rw_boundary = 0;
+  sh->turnaround = 0;
+  sh->reg_state = SPIS_REG_STATE_CMD;
+  sh->reg_addr = 0;
+  sh->flag_reg_written = 0;
+
+  sh->FIFO_SIZE = fifo_size;
+  sh->STS_TX_FIFO_NOT_FULL = sts_tx_fifo_not_full;
+  sh->STS_RX_FIFO_NOT_EMPTY = sts_rx_fifo_not_empty;
+  sh->Start = Start;
+  sh->EnableTxInt = EnableTxInt;
+  sh->EnableRxInt = EnableRxInt;
+  sh->DisableTxInt = DisableTxInt;
+  sh->DisableRxInt = DisableRxInt;
+  sh->ReadTxStatus = ReadTxStatus;
+  sh->ReadRxStatus = ReadRxStatus;
+  sh->WriteTxData = WriteTxData;
+  sh->ReadRxData = ReadRxData;
+  sh->ClearFIFO = ClearFIFO;
+
+  sh->Start();
+  sh->DisableTxInt();
+  sh->ClearFIFO();
+  sh->EnableRxInt();
+}
+
+
+//================================================================
+/*! set stream mode. (ring buffers)
+
+  @param  sh		pointer to SPIS_HANDLE
+*/
+void spis_set_stream_mode(SPIS_HANDLE *sh)
+{
+  uint8 interrupts = CyEnterCriticalSection();
+
+  sh->DisableTxInt();
+  sh->ClearFIFO();
+  sh->mode = SPIS_MODE_STREAM;
+  sh->regs = 0;
+  sh->reg_size = 0;
+  sh->tx_in_fifo = 0;
+  sh->rx_rd = 0;
+  sh->rx_wr = 0;
+  sh->rx_overflow = 0;
+  sh->tx_rd = 0;
+  sh->tx_wr = 0;
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! set register mode. (register file emulation)
+
+  @param  sh		pointer to SPIS_HANDLE
+  @param  regs		pointer to the register file.
+  @param  reg_size	size of the register file. (max 128)
+  @param  rw_boundary	host can write to [0, rw_boundary).
+  @param  turnaround	number of dummy bytes after the command byte.
+  @note
+    Frame format.
+      read:  CS low - (0x80 | addr) - dummy * turnaround - data... - CS high
+      write: CS low - addr - data... - CS high
+*/
+void spis_set_register_mode(SPIS_HANDLE *sh, uint8_t *regs, int reg_size,
+			    int rw_boundary, int turnaround)
+{
+  if( reg_size > 128 ) reg_size = 128;
+  if( rw_boundary > reg_size ) rw_boundary = reg_size;
+  if( turnaround > sh->FIFO_SIZE - 1 ) turnaround = sh->FIFO_SIZE - 1;
+
+  uint8 interrupts = CyEnterCriticalSection();
+
+  sh->DisableTxInt();
+  sh->ClearFIFO();
+  sh->mode = SPIS_MODE_REGISTER;
+  sh->regs = regs;
+  sh->reg_size = reg_size;
+  sh->rw_boundary = rw_boundary;
+  sh->turnaround = turnaround;
+  sh->flag_reg_written = 0;
+  spis_reg_frame_start(sh);
+
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! update the register file.
+
+  @param  sh		pointer to SPIS_HANDLE
+  @param  offset	offset in the register file.
+  @param  data		pointer to data.
+  @param  size		size of data.
+*/
+void spis_update_regs(SPIS_HANDLE *sh, int offset, const void *data, int size)
+{
+  const uint8_t *p = data;
+
+  if( offset < 0 || offset >= sh->reg_size ) return;
+  if( size > sh->reg_size - offset ) size = sh->reg_size - offset;
+
+  uint8 interrupts = CyEnterCriticalSection();
+  while( --size >= 0 ) {
+    sh->regs[offset++] = *p++;
+  }
+  CyExitCriticalSection( interrupts );
+}
+
+
+//================================================================
+/*! queue data to the TX ring buffer. (stream mode)
+
+  @param  sh		pointer to SPIS_HANDLE
+  @param  buffer	pointer to data.
+  @param  size		size of data.
+  @return int		number of queued bytes.
+*/
+int spis_write(SPIS_HANDLE *sh, const void *buffer, int size)
+{
+  const uint8_t *p = buffer;
+  int n;
+
+  if( sh->mode != SPIS_MODE_STREAM ) return 0;
+
+  for( n = 0; n < size; n++ ) {
+    uint16_t tx_wr = sh->tx_wr + 1;
+    if( tx_wr >= sizeof(sh->txbuf) ) tx_wr = 0;
+    if( tx_wr == sh->tx_rd ) break;	// buffer full
+    sh->txbuf[sh->tx_wr] = *p++;
+    sh->tx_wr = tx_wr;
+  }
+
+  sh->EnableTxInt();
+  return n;
+}
+
+
+//================================================================
+/*! read data from the RX ring buffer. (stream mode)
+
+  @param  sh		pointer to SPIS_HANDLE
+  @param  buffer	pointer to buffer.
+  @param  size		size of buffer.
+  @return int		number of read bytes.
+*/
+int spis_read(SPIS_HANDLE *sh, void *buffer, int size)
+{
+  uint8_t *p = buffer;
+  uint16_t rx_rd = sh->rx_rd;
+  int n;
+
+  for( n = 0; n < size && rx_rd != sh->rx_wr; n++ ) {
+    *p++ = sh->rxbuf[rx_rd++];
+    if( rx_rd >= sizeof(sh->rxbuf) ) rx_rd = 0;
+  }
+  sh->rx_rd = rx_rd;
+
+  return n;
+}
+
+
+//================================================================
+/*! check data length can be read.
+
+  @param  sh		pointer to SPIS_HANDLE
+  @return int		result (bytes)
+*/
+int spis_bytes_available(const SPIS_HANDLE *sh)
+{
+  uint16_t rx_wr = sh->rx_wr;
+
+  if( sh->rx_rd <= rx_wr ) {
+    return rx_wr - sh->rx_rd;
+  } else {
+    return sizeof(sh->rxbuf) - sh->rx_rd + rx_wr;
+  }
+}
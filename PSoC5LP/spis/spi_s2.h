@@ -0,0 +1,209 @@
+/*! @file
+  @brief
+  SPI slave convenience library for PSoC5LP. Multi component version.
+
+  @version 1.0
+
+<pre>
+  Copyright (C) 2020 Shimane IT Open-Innovation Center.
+  All Rights Reserved.
+
+  This file is distributed under BSD 3-Clause License.
+</pre>
+*/
+
+
+/***** Feature test switches ************************************************/
+#ifndef	PSOC5_SPISWRAP_H_
+#define	PSOC5_SPISWRAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** System headers *******************************************************/
+#include <stdint.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+//! size of ring buffer for receive.
+#ifndef SPIS_SIZE_RXBUF
+# define SPIS_SIZE_RXBUF 128
+#endif
+
+//! size of ring buffer for transmit.
+#ifndef SPIS_SIZE_TXBUF
+# define SPIS_SIZE_TXBUF 128
+#endif
+
+//! dummy byte sent while receiving the address and turnaround bytes.
+#ifndef SPIS_DUMMY_DATA
+# define SPIS_DUMMY_DATA 0xff
+#endif
+
+//! work mode.
+#define SPIS_MODE_STREAM	0
+#define SPIS_MODE_REGISTER	1
+
+//! read flag in the command byte of register mode.
+#define SPIS_REG_READ		0x80
+
+
+/***** Macros ***************************************************************/
+//! Convenience macro to define the interrupt handler.
+#define SPIS_ISR(sh, NAME)			\
+  void NAME ## _TX_ISR_EntryCallback(void) {	\
+    spis_tx_isr(sh);				\
+  }						\
+  void NAME ## _RX_ISR_EntryCallback(void) {	\
+    spis_rx_isr(sh);				\
+  }
+
+//! Convenience macro to define the interrupt handler of ss pin (rising edge).
+#define SPIS_SS_ISR(sh, NAME)			\
+  CY_ISR(isr_ ## NAME ## _SS) {			\
+    NAME ## _SS_ClearInterrupt();		\
+    spis_ss_isr(sh);				\
+  }
+
+//! Initializer macro for SPI Slave
+#define spis_init(sh, NAME)			\
+  spis_init_m( sh,				\
+	       NAME ## _FIFO_SIZE,		\
+	       NAME ## _STS_TX_FIFO_NOT_FULL,	\
+	       NAME ## _STS_RX_FIFO_NOT_EMPTY,	\
+	       NAME ## _Start,			\
+	       NAME ## _EnableTxInt,		\
+	       NAME ## _EnableRxInt,		\
+	       NAME ## _DisableTxInt,		\
+	       NAME ## _DisableRxInt,		\
+	       NAME ## _ReadTxStatus,		\
+	       NAME ## _ReadRxStatus,		\
+	       NAME ## _WriteTxData,		\
+	       NAME ## _ReadRxData,		\
+	       NAME ## _ClearFIFO)
+
+//! Initializer macro for the ss pin interrupt. Needs for register mode.
+#define spis_init_ss(sh, NAME)				\
+  isr_ ## NAME ## _SS_StartEx( isr_ ## NAME ## _SS )
+
+
+/***** Typedefs *************************************************************/
+//================================================================
+/*! SPI slave handle.
+*/
+typedef struct SPIS_HANDLE {
+  uint8_t mode;			// SPIS_MODE_STREAM or SPIS_MODE_REGISTER
+  volatile int8_t tx_in_fifo;	// bytes in TX FIFO, not yet clocked out.
+  volatile uint16_t underrun;	// host clocked a byte with empty TX FIFO.
+
+  // stream mode.
+  volatile uint16_t rx_rd;
+  volatile uint16_t rx_wr;
+  volatile uint8_t rx_overflow;
+  volatile uint8_t rxbuf[SPIS_SIZE_RXBUF];
+
+  volatile uint16_t tx_rd;
+  volatile uint16_t tx_wr;
+  volatile uint8_t txbuf[SPIS_SIZE_TXBUF];
+
+  // register mode.
+  volatile uint8_t *regs;	// register file.
+  uint16_t reg_size;
+  uint16_t rw_boundary;		// host can write to [0, rw_boundary).
+  uint8_t turnaround;		// number of dummy bytes after the command.
+  volatile uint8_t reg_state;
+  volatile uint16_t reg_addr;	// address of next read/write.
+  volatile uint8_t flag_reg_written;
+
+  // constant table
+  uint8_t FIFO_SIZE;
+  uint8_t STS_TX_FIFO_NOT_FULL;
+  uint8_t STS_RX_FIFO_NOT_EMPTY;
+
+  // function table
+  void (*Start)(void);
+  void (*EnableTxInt)(void);
+  void (*EnableRxInt)(void);
+  void (*DisableTxInt)(void);
+  void (*DisableRxInt)(void);
+  uint8_t (*ReadTxStatus)(void);
+  uint8_t (*ReadRxStatus)(void);
+  void (*WriteTxData)(uint8_t);
+  uint8_t (*ReadRxData)(void);
+  void (*ClearFIFO)(void);
+
+} SPIS_HANDLE;
+
+
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+void spis_tx_isr(SPIS_HANDLE *sh);
+void spis_rx_isr(SPIS_HANDLE *sh);
+void spis_ss_isr(SPIS_HANDLE *sh);
+void spis_init_m(SPIS_HANDLE *sh,
+		 uint8_t fifo_size,
+		 uint8_t sts_tx_fifo_not_full,
+		 uint8_t sts_rx_fifo_not_empty,
+		 void *Start,
+		 void *EnableTxInt,
+		 void *EnableRxInt,
+		 void *DisableTxInt,
+		 void *DisableRxInt,
+		 void *ReadTxStatus,
+		 void *ReadRxStatus,
+		 void *WriteTxData,
+		 void *ReadRxData,
+		 void *ClearFIFO);
+void spis_set_stream_mode(SPIS_HANDLE *sh);
+void spis_set_register_mode(SPIS_HANDLE *sh, uint8_t *regs, int reg_size,
+			    int rw_boundary, int turnaround);
+void spis_update_regs(SPIS_HANDLE *sh, int offset, const void *data, int size);
+int spis_write(SPIS_HANDLE *sh, const void *buffer, int size);
+int spis_read(SPIS_HANDLE *sh, void *buffer, int size);
+int spis_bytes_available(const SPIS_HANDLE *sh);
+
+
+/***** Inline functions *****************************************************/
+//================================================================
+/*! check Rx buffer overflow?
+
+  @param  sh		pointer to SPIS_HANDLE
+  @return int	true or false
+*/
+static inline int spis_is_rx_overflow(const SPIS_HANDLE *sh)
+{
+  return sh->rx_overflow;
+}
+
+
+//================================================================
+/*! clear Rx buffer overflow flag.
+
+  @param  sh		pointer to SPIS_HANDLE
+*/
+static inline void spis_clear_rx_overflow(SPIS_HANDLE *sh)
+{
+  sh->rx_overflow = 0;
+}
+
+
+//================================================================
+/*! Has the host written to the register file? (and clear the flag)
+
+  @param  sh		pointer to SPIS_HANDLE
+  @return int	true or false
+*/
+static inline int spis_is_regs_written(SPIS_HANDLE *sh)
+{
+  int ret = sh->flag_reg_written;
+  sh->flag_reg_written = 0;
+  return ret;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif